@@ -40,6 +40,7 @@ public class MediaPlayer implements MediaSourceListener {
   private String _name = null;
   private long _timestamp = 0;
   private boolean _is_playing = false;
+  private long _nativeSound = 0;
 
   public MediaPlayerListener getListener ( ) {
     return this._listener;
@@ -134,6 +135,17 @@ public class MediaPlayer implements MediaSourceListener {
     }
   }
 
+  /* Set by the native media manager while the sound is registered */
+  public synchronized void setNativeSound ( long nativeSound ) {
+    this._nativeSound = nativeSound;
+  }
+
+  public synchronized void onStartedPlaying ( MediaSource source ) {
+    if ( this._nativeSound != 0 ) {
+      nativeSoundStarted(this._nativeSound);
+    }
+  }
+
   public void onFinishedPlaying ( MediaSource source ) {
 
 	  //Log.d("avs", "MediaPlayer:onFinishedPlaying");
@@ -150,4 +162,6 @@ public class MediaPlayer implements MediaSourceListener {
   public boolean getIsPlaying() {
     return _is_playing;
   }
+
+  private native void nativeSoundStarted(long nativeSound);
 }
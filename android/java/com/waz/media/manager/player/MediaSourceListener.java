@@ -22,5 +22,6 @@ import com.waz.media.manager.player.MediaSource;
 
 
 public interface MediaSourceListener {
+  public void onStartedPlaying(MediaSource source);
   public void onFinishedPlaying(MediaSource source);
 }
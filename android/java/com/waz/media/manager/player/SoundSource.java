@@ -248,6 +248,8 @@ public class SoundSource implements MediaSource, OnPreparedListener, OnSeekCompl
       this._player.seekTo(0);
 
       this._currentState = MPState.PLAY;
+
+      this.onStarted();
     }
 
     if ( this._requestStop ) {
@@ -271,6 +273,8 @@ public class SoundSource implements MediaSource, OnPreparedListener, OnSeekCompl
       this._player.seekTo(0);
 
       this._currentState = MPState.PLAY;
+
+      this.onStarted();
     }
 
     if ( this._requestStop ) {
@@ -295,6 +299,8 @@ public class SoundSource implements MediaSource, OnPreparedListener, OnSeekCompl
       this._player.start();
 
       this._currentState = MPState.PLAY;
+
+      this.onStarted();
     }
 
     if ( this._requestStop ) {
@@ -319,6 +325,8 @@ public class SoundSource implements MediaSource, OnPreparedListener, OnSeekCompl
       this._player.start();
 
       this._currentState = MPState.PLAY;
+
+      this.onStarted();
     }
 
     if ( this._requestStop ) {
@@ -437,6 +445,12 @@ public class SoundSource implements MediaSource, OnPreparedListener, OnSeekCompl
     this.update();
   }
 
+  private void onStarted ( ) {
+    if ( this._listener != null ) {
+      this._listener.onStartedPlaying(this);
+    }
+  }
+
   @Override
   public void onSeekComplete ( MediaPlayer player ) {
     DoLog("Sound Source Seek Completed: " + this._uri);
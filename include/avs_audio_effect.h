@@ -19,6 +19,8 @@
 #ifndef AVS_AUDIO_EFFECT_H
 #define AVS_AUDIO_EFFECT_H
 
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -28,6 +30,8 @@ typedef void (reset_effect_h)(void *st, int fs_hz);
 typedef void (free_effect_h)(void *st);
 typedef void (effect_process_h)(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
 typedef void (effect_length_h)(void *st, int *length_mod_Q10);
+struct pitch_estimator;
+typedef void (effect_pitch_h)(void *st, const struct pitch_estimator *pest);
     
 enum audio_effect{
     AUDIO_EFFECT_CHORUS = 0,
@@ -77,43 +81,75 @@ struct aueffect {
     free_effect_h *e_free_h;
     effect_process_h *e_proc_h;
     effect_length_h *e_length_h;
+    effect_pitch_h *e_pitch_h;
+    int fs_hz;
+    int strength;
 };
     
 int aueffect_alloc(struct aueffect **auep, enum audio_effect effect_type, int fs_hz);
 int aueffect_reset(struct aueffect *aue, int fs_hz);
 int aueffect_process(struct aueffect *aue, const int16_t *sampin, int16_t *sampout, size_t n_sampin, size_t *n_sampout);
 int aueffect_length_modification(struct aueffect *aue, int *length_modification_q10);
+/* Vectorized kernels are on by default, disable to run the scalar reference */
+void aueffect_set_simd(bool enable);
+
+/*
+ * Effects applied in sequence on 10 ms frames. Pitch lags and voicing
+ * are estimated once per frame on the chain input and shared by all
+ * pitch based stages. A length modifying effect (pace) must be last.
+ */
+#define AUEFFECT_CHAIN_MAX 8
+
+struct aueffect_chain;
+
+int aueffect_chain_alloc(struct aueffect_chain **chainp, const enum audio_effect *effectv, size_t effectc, int fs_hz);
+int aueffect_chain_process(struct aueffect_chain *chain, const int16_t *sampin, int16_t *sampout, size_t n_sampin, size_t *n_sampout);
+int aueffect_chain_length_modification(struct aueffect_chain *chain, int *length_modification_q10);
     
 void* create_chorus(int fs_hz, int strength);
+void reset_chorus(void *st, int fs_hz);
 void free_chorus(void *st);
 void chorus_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void chorus_share_pitch(void *st, const struct pitch_estimator *pest);
     
 void* create_reverb(int fs_hz, int strength);
+void reset_reverb(void *st, int fs_hz);
 void free_reverb(void *st);
 void reverb_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
     
 void* create_pitch_up_shift(int fs_hz, int strength);
 void* create_pitch_down_shift(int fs_hz, int strength);
+void reset_pitch_shift(void *st, int fs_hz);
 void free_pitch_shift(void *st);
 void pitch_shift_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void pitch_shift_share_pitch(void *st, const struct pitch_estimator *pest);
+const struct pitch_estimator *pitch_shift_estimator(void *st);
     
 void* create_pace_up_shift(int fs_hz, int strength);
 void* create_pace_down_shift(int fs_hz, int strength);
+void reset_pace_shift(void *st, int fs_hz);
 void free_pace_shift(void *st);
 void pace_shift_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
 void pace_shift_length_factor(void *st, int *length_mod_Q10);
+void pace_shift_share_pitch(void *st, const struct pitch_estimator *pest);
     
 void* create_vocoder(int fs_hz, int strength);
+void reset_vocoder(void *st, int fs_hz);
 void free_vocoder(void *st);
 void vocoder_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void vocoder_share_pitch(void *st, const struct pitch_estimator *pest);
 
 void* create_auto_tune(int fs_hz, int strength);
+void reset_auto_tune(void *st, int fs_hz);
 void free_auto_tune(void *st);
 void auto_tune_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void auto_tune_share_pitch(void *st, const struct pitch_estimator *pest);
 
 void* create_harmonizer(int fs_hz, int strength);
+void reset_harmonizer(void *st, int fs_hz);
 void free_harmonizer(void *st);
 void harmonizer_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void harmonizer_share_pitch(void *st, const struct pitch_estimator *pest);
 
 void* create_normalizer(int fs_hz, int strength);
 void reset_normalizer(void *st, int fs_hz);
@@ -121,16 +157,67 @@ void free_normalizer(void *st);
 void normalizer_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
     
 void* create_pitch_cycler(int fs_hz, int strength);
+void reset_pitch_cycler(void *st, int fs_hz);
 void free_pitch_cycler(void *st);
 void pitch_cycler_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void pitch_cycler_share_pitch(void *st, const struct pitch_estimator *pest);
     
 void* create_pass_through(int fs_hz, int strength);
+void reset_pass_through(void *st, int fs_hz);
 void free_pass_through(void *st);
 void pass_through_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
     
+struct wav_format {
+    uint16_t audio_format;
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    int32_t num_samples_in;
+    int32_t num_samples_out;
+    int32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+};
+
+/* Leaves in_file positioned at the first sample of the data chunk */
+int wav_read_header(FILE *in_file, struct wav_format *format);
+/* Writes a canonical 44 byte header for num_samples_out samples */
+int wav_write_header(FILE *out_file, const struct wav_format *format);
+
 typedef void (effect_progress_h)(int progress, void *arg);
 int apply_effect_to_wav(const char* wavIn, const char* wavOut, enum audio_effect effect_type, bool reduce_noise, effect_progress_h* progress_h, void *arg);
 int apply_effect_to_pcm(const char* pcmIn, const char* pcmOut, int fs_hz, enum audio_effect effect_type, bool reduce_noise, effect_progress_h* progress_h, void *arg);
+/* Output is allocated with mem_alloc and has the same length semantics as apply_effect_to_wav */
+int apply_effect_to_buffer(const int16_t *sampin, size_t n_sampin, int fs_hz, int16_t **sampoutp, size_t *n_sampoutp, enum audio_effect effect_type, bool reduce_noise, effect_progress_h* progress_h, void *arg);
+
+struct aueffect_job {
+    const char *in;
+    const char *out;
+    int fs_hz;                      /* raw PCM sample rate, 0 for WAV */
+    enum audio_effect effect_type;
+    bool reduce_noise;
+    effect_progress_h *progress_h;  /* per job, called on a worker    */
+    void *arg;
+
+    /* Set by apply_effect_batch */
+    int err;
+    double audio_sec;
+    double proc_sec;
+};
+
+struct aueffect_batch_stats {
+    size_t n_jobs;
+    size_t n_failed;
+    int n_workers;
+    double audio_sec;
+    double wall_sec;
+    double rtf;                     /* wall_sec / audio_sec */
+};
+
+/* Runs jobv on n_workers threads (0 for one per CPU) and blocks until
+ * all jobs are done. progress_h reports the share of completed jobs,
+ * it is called on the workers and may see the values out of order.
+ */
+int apply_effect_batch(struct aueffect_job *jobv, size_t jobc, int n_workers, effect_progress_h* progress_h, void *arg, struct aueffect_batch_stats *stats);
     
 #ifdef __cplusplus
 }
@@ -25,6 +25,7 @@ enum audio_io_mode{
     AUDIO_IO_MODE_NORMAL = 0,
     AUDIO_IO_MODE_MOCK,
     AUDIO_IO_MODE_MOCK_REALTIME,
+    AUDIO_IO_MODE_FILE,
 };
 
 struct audio_io{
@@ -32,6 +33,31 @@ struct audio_io{
     void *aioc;
 };
 
+/* File backed audio device, see audio_io_set_file() */
+struct audio_io_file_cfg {
+    const char *capture;  /* WAV, or raw 16-bit mono PCM at fs_hz   */
+    const char *playout;  /* written as WAV when ending in ".wav"   */
+    const char *timing;   /* optional per-frame callback timing log */
+    int fs_hz;            /* sample rate of raw PCM files           */
+    bool loop;            /* restart capture at end of file         */
+    bool realtime;        /* pace callbacks at 10ms intervals       */
+};
+
+struct audio_io_latency {
+    uint32_t nframes;
+    uint32_t late;        /* callbacks exceeding the frame duration */
+    uint32_t avg_us;
+    uint32_t max_us;
+};
+
+struct audio_io_file_stats {
+    struct audio_io_latency rec;   /* RecordedDataIsAvailable */
+    struct audio_io_latency play;  /* NeedMorePlayData        */
+    uint64_t samples_captured;
+    uint64_t samples_played;
+    bool capture_eof;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -47,6 +73,13 @@ int  audio_io_terminate(struct audio_io *aio);
 int  audio_io_enable_sine(void);
 
 int  audio_io_reset(struct audio_io *aio);
+
+/* Use the file backed device for subsequently created ADMs,
+ * pass NULL to revert to the default device. A new configuration is
+ * refused with EBUSY while the file device is in use, clear it first.
+ */
+int  audio_io_set_file(const struct audio_io_file_cfg *cfg);
+int  audio_io_get_file_stats(struct audio_io_file_stats *stats);
 	
 #ifdef __cplusplus
     }
@@ -29,6 +29,7 @@ typedef void (dce_close_chan_h)(int sid,
 				const char *label, const char *protocol,
 				void *arg);
 typedef void (dce_data_h)(int id, const uint8_t *data, size_t len, void *arg);
+typedef void (dce_buffered_low_h)(int id, size_t buffered, void *arg);
 
 int  dce_init(void);
 void dce_close(void);
@@ -43,6 +44,7 @@ int  dce_connect(struct dce *dce, bool dtls_role_active);
 int  dce_status(struct re_printf *pf, struct dce *dce);
 void dce_recv_pkt(struct dce *dce, const uint8_t *pkt, size_t len);
 bool dce_snd_dry(struct dce *dce);
+int  dce_set_max_streams(struct dce *dce, uint16_t n);
 
 int  dce_channel_alloc(struct dce_channel **chp,
 		       struct dce *dce,
@@ -57,3 +59,11 @@ bool dce_is_chan_open(const struct dce_channel *ch);
 int  dce_open_chan(struct dce_channel *ch);
 int  dce_close_chan(struct dce_channel *ch);
 int  dce_send(struct dce_channel *ch, const void *data, size_t len);
+
+/*
+ * Bytes accepted by dce_send that are still waiting for room in the
+ * SCTP send buffer. lowh is called once the amount drops to lowmark.
+ */
+size_t dce_buffered_amount(struct dce *dce, const struct dce_channel *ch);
+int  dce_set_buffered_low(struct dce *dce, struct dce_channel *ch,
+			  size_t lowmark, dce_buffered_low_h *lowh);
@@ -79,6 +79,29 @@ const char *ecall_props_get_remote(struct ecall *ecall, const char *key);
 void ecall_trace(struct ecall *ecall, const struct econn_message *msg,
 		 bool tx, enum econn_transport tp,
 		 const char *fmt, ...);
+/* Trace of the most recent messages as a JSON timeline */
+int ecall_trace_json(char **strp, const struct ecall *ecall);
+
+/*
+ * Send to response latency of our requests, aggregated per message
+ * type over all calls in the process.
+ */
+#define ECALL_LATENCY_BUCKETS 10
+
+struct ecall_latency {
+	enum econn_msg msg_type;
+	uint32_t count;
+	uint32_t avg_ms;
+	uint32_t max_ms;
+	uint32_t bucketv[ECALL_LATENCY_BUCKETS];
+};
+
+/* Upper bound in ms of a histogram bucket, UINT32_MAX for the last */
+uint32_t ecall_latency_bound(size_t bucket);
+/* latc is the capacity of latv on input, the number filled on output */
+int ecall_latency_get(struct ecall_latency *latv, size_t *latc);
+void ecall_latency_reset(void);
+int ecall_latency_debug(struct re_printf *pf, void *arg);
 int  ecall_restart(struct ecall *ecall, enum icall_call_type call_type);
 
 struct conf_part *ecall_get_conf_part(struct ecall *ecall);
@@ -122,6 +145,13 @@ int ecall_dce_send(struct ecall *ecall, struct mbuf *mb);
 int ecall_set_quality_interval(struct ecall *ecall,
 			       uint64_t interval);
 
+int ecall_get_audio_levels(struct ecall *ecall,
+			   struct speaker_level *levelv,
+			   size_t *levelc);
+int ecall_set_active_speakers(struct ecall *ecall,
+			      const struct speaker_rank *rankv,
+			      size_t rankc);
+
 
 /* Device pairing */
 void ecall_set_devpair(struct ecall *ecall, bool devpair);
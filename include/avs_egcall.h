@@ -84,6 +84,12 @@ struct wcall_members;
 int egcall_get_members(struct icall *icall, struct wcall_members **mmp);
 
 int egcall_set_quality_interval(struct icall *icall, uint64_t interval);
+int egcall_get_audio_levels(struct icall *icall,
+			    struct speaker_level *levelv,
+			    size_t *levelc);
+int egcall_set_active_speakers(struct icall *icall,
+			       const struct speaker_rank *rankv,
+			       size_t rankc);
 
 int egcall_debug(struct re_printf *pf, const struct icall *arg);
 int egcall_stats(struct re_printf *pf, const struct icall *arg);
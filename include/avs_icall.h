@@ -31,6 +31,7 @@
 struct icall;
 struct econn_message;
 struct wcall_members;
+struct wcall_quality_sample;
 struct econn_message;
 
 
@@ -82,6 +83,12 @@ typedef int  (icall_sft_msg_recv)(struct icall* icall,
 			          struct econn_message *msg);
 typedef int  (icall_set_quality_interval)(struct icall *icall,
 					  uint64_t interval);
+typedef int  (icall_get_audio_levels)(struct icall *icall,
+				      struct speaker_level *levelv,
+				      size_t *levelc);
+typedef int  (icall_set_active_speakers)(struct icall *icall,
+					 const struct speaker_rank *rankv,
+					 size_t rankc);
 typedef int  (icall_dce_send)(struct icall *icall, struct mbuf *mb);
 typedef void (icall_set_clients)(const struct icall* icall, struct list *clientl);
 typedef int  (icall_debug)(struct re_printf *pf, const struct icall* icall);
@@ -150,6 +157,10 @@ typedef void (icall_quality_h)(struct icall *icall,
 			       const char *userid,
 			       int rtt, int uploss, int downloss,
 			       void *arg);
+typedef void (icall_quality_sample_h)(struct icall *icall,
+				      const char *userid,
+				      const struct wcall_quality_sample *sample,
+				      void *arg);
 
 typedef void (icall_req_clients_h)(struct icall *icall, void *arg);
 
@@ -167,6 +178,8 @@ struct icall {
 	icall_sft_msg_recv		*sft_msg_recv;
 	icall_get_members		*get_members;
 	icall_set_quality_interval	*set_quality_interval;
+	icall_get_audio_levels		*get_audio_levels;
+	icall_set_active_speakers	*set_active_speakers;
 	icall_dce_send                  *dce_send;
 	icall_set_clients		*set_clients;
 	icall_debug			*debug;
@@ -187,6 +200,7 @@ struct icall {
 	icall_vstate_changed_h		*vstate_changedh;
 	icall_acbr_changed_h		*acbr_changedh;
 	icall_quality_h			*qualityh;
+	icall_quality_sample_h		*quality_sampleh;
 	icall_req_clients_h		*req_clientsh;
 
 	void				*arg;
@@ -212,6 +226,8 @@ void icall_set_functions(struct icall *icall,
 			 icall_sft_msg_recv		*sft_msg_recv,
 			 icall_get_members		*get_members,
 			 icall_set_quality_interval	*set_quality_interval,
+			 icall_get_audio_levels		*get_audio_levels,
+			 icall_set_active_speakers	*set_active_speakers,
 			 icall_dce_send                 *dce_send,
 			 icall_set_clients		*set_clients,
 			 icall_debug			*debug,
@@ -233,6 +249,7 @@ void icall_set_callbacks(struct icall *icall,
 			 icall_vstate_changed_h	*vstate_changedh,
 			 icall_acbr_changed_h	*acbr_changedh,
 			 icall_quality_h	*qualityh,
+			 icall_quality_sample_h	*quality_sampleh,
 			 icall_req_clients_h	*req_clientsh,
 			 void			*arg);
 
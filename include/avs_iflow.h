@@ -23,9 +23,37 @@
 struct iflow;
 struct avs_vidframe;
 
+#define IFLOW_STATS_ID_LEN    64
+#define IFLOW_STATS_MAX_VIDEO 16
+
+/* Video budget share of one remote video stream */
+struct iflow_video_alloc {
+	char userid[IFLOW_STATS_ID_LEN];
+	char clientid[IFLOW_STATS_ID_LEN];
+	bool visible;
+	bool speaking;
+	bool paused;        /* not decoded where the flow can stop it */
+
+	uint32_t pixels;    /* decoded frame size            */
+	float fps;          /* received frame rate           */
+	int max_fps;        /* rendered frame rate cap, 0 for none */
+	uint64_t alloc_pps; /* rendered pixels/s granted     */
+};
+
 struct iflow_stats {
 	float dloss;
 	float rtt;
+	float jitter;       /* ms, worst inbound stream      */
+	float send_kbps;
+	float recv_kbps;
+	float audio_level;  /* 0..1, inbound audio           */
+	float video_fps;    /* best inbound video stream     */
+
+	/* Remote video budget, shared by all flows */
+	uint64_t video_budget;  /* rendered pixels/s, 0 is unlimited */
+	uint64_t video_used;    /* pixels/s granted over all flows   */
+	size_t video_allocc;    /* streams of this flow              */
+	struct iflow_video_alloc video_allocv[IFLOW_STATS_MAX_VIDEO];
 };
 
 /* Calls into iflow */
@@ -66,6 +94,13 @@ typedef int  (iflow_remove_decoders_for_user)(struct iflow *flow,
 					      uint32_t ssrca,
 					      uint32_t ssrcv);
 
+typedef int  (iflow_get_audio_levels)(struct iflow *flow,
+				      struct speaker_level *levelv,
+				      size_t *levelc);
+typedef int  (iflow_set_active_speakers)(struct iflow *flow,
+					 const struct speaker_rank *rankv,
+					 size_t rankc);
+
 typedef int  (iflow_set_e2ee_key)(struct iflow *flow,
 				  uint32_t idx,
 				  uint8_t e2ee_key[E2EE_SESSIONKEY_SIZE]);
@@ -94,6 +129,11 @@ typedef void (iflow_destroyf)(void);
 typedef void (iflow_set_mutef)(bool muted);
 typedef bool (iflow_get_mutef)(void);
 
+typedef void (iflow_set_video_budgetf)(uint64_t max_pps);
+typedef void (iflow_set_video_visiblef)(const char *userid,
+					const char *clientid,
+					bool visible);
+
 /* Callbacks from iflow */
 typedef void (iflow_estab_h)(const char *crypto,
 			   const char *codec,
@@ -142,6 +182,8 @@ struct iflow {
 	iflow_gather_all_turn		*gather_all_turn;
 	iflow_add_decoders_for_user	*add_decoders_for_user;
 	iflow_remove_decoders_for_user	*remove_decoders_for_user;
+	iflow_get_audio_levels		*get_audio_levels;
+	iflow_set_active_speakers	*set_active_speakers;
 	iflow_set_e2ee_key		*set_e2ee_key;
 	iflow_dce_send			*dce_send;
 	iflow_stop_media		*stop_media;
@@ -186,6 +228,8 @@ void iflow_set_functions(struct iflow *iflow,
 			 iflow_gather_all_turn		*gather_all_turn,
 			 iflow_add_decoders_for_user	*add_decoders_for_user,
 			 iflow_remove_decoders_for_user	*remove_decoders_for_user,
+			 iflow_get_audio_levels		*get_audio_levels,
+			 iflow_set_active_speakers	*set_active_speakers,
 			 iflow_set_e2ee_key		*set_e2ee_key,
 			 iflow_dce_send			*dce_send,
 			 iflow_stop_media		*stop_media,
@@ -209,7 +253,9 @@ void iflow_set_alloc(iflow_allocf *allocf);
 
 void iflow_register_statics(iflow_destroyf *destroy,
 			    iflow_set_mutef *set_mute,
-			    iflow_get_mutef *get_mute);
+			    iflow_get_mutef *get_mute,
+			    iflow_set_video_budgetf *set_video_budget,
+			    iflow_set_video_visiblef *set_video_visible);
 
 int iflow_alloc(struct iflow		**flowp,
 		const char		*convid,
@@ -222,6 +268,11 @@ void iflow_destroy(void);
 void iflow_set_mute(bool mute);
 bool iflow_get_mute(void);
 
+void iflow_set_video_budget(uint64_t max_pps);
+void iflow_set_video_visible(const char *userid,
+			     const char *clientid,
+			     bool visible);
+
 void iflow_set_video_handlers(iflow_render_frame_h *render_frame_h,
 			      iflow_video_size_h *size_h,
 			      void *arg);
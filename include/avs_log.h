@@ -31,6 +31,9 @@ enum log_level {
 	LOG_LEVEL_ERROR = 3,
 };
 
+/* Called without locks held. A line logged from within a handler is
+ * not passed to the handlers again, it only goes to stderr.
+ */
 typedef void (log_h)(uint32_t level, const char *msg, void *arg);
 
 struct log {
@@ -44,6 +47,22 @@ void log_unregister_handler(struct log *log);
 void log_set_min_level(enum log_level level);
 enum log_level log_get_min_level(void);
 void log_enable_stderr(bool enable);
+
+/*
+ * Async mode: messages are formatted into per thread lock free queues
+ * and masked, written and passed to the handlers on a background
+ * thread. Messages are dropped when a queue is full.
+ */
+struct log_async_stats {
+	uint64_t queued;
+	uint64_t written;
+	uint64_t dropped;
+	uint64_t truncated;
+};
+
+int  log_enable_async(bool enable);
+void log_async_flush(void);
+void log_async_stats(struct log_async_stats *stats);
 void vlog(enum log_level level, const char *fmt, va_list ap);
 void loglv(enum log_level level, const char *fmt, ...);
 void vloglv(enum log_level level, const char *fmt, va_list ap);
@@ -87,6 +87,17 @@ void mediamgr_register_media(struct mediamgr *mm,
 
 void mediamgr_unregister_media(struct mediamgr *mm, const char *media_name);
 
+/* Latency from a play request to the platform starting the sound */
+struct mediamgr_play_stats {
+	uint32_t nplays;   /* sounds started */
+	uint32_t last_ms;  /* play request to playback start */
+	uint32_t avg_ms;
+	uint32_t max_ms;
+};
+
+int  mediamgr_get_play_stats(struct mediamgr *mm,
+			     struct mediamgr_play_stats *stats);
+
 void mediamgr_register_route_change_h(struct mediamgr *mm,
 				      mediamgr_route_changed_h *handler,
 				      void *arg);
@@ -22,6 +22,23 @@ struct netprobe_result {
 
 	size_t n_pkt_sent;
 	size_t n_pkt_recv;
+
+	/* Delay above the minimum seen, micro-seconds */
+	uint32_t jitter_p50;
+	uint32_t jitter_p90;
+	uint32_t jitter_p99;
+	uint32_t jitter_max;
+
+	size_t n_loss_bursts;
+	size_t loss_burst_max;
+	float loss_burst_avg;
+
+	/* Probing mode only, 0 if no estimate could be made */
+	uint32_t bw_kbps;
+
+	/* Suggested starting point for the call */
+	uint32_t bitrate_kbps;
+	bool audio_cbr;
 };
 
 typedef void (netprobe_h)(int err, const struct netprobe_result *result,
@@ -35,3 +52,37 @@ int netprobe_alloc(struct netprobe **npb, const struct sa *turn_srv,
 		   const char *turn_username, const char *turn_password,
 		   size_t pkt_count, uint32_t pkt_interval_ms,
 		   netprobe_h *h, void *arg);
+
+
+/*
+ * Probing mode
+ *
+ * Packets are sent in train_count groups of train_len packets, with
+ * train_interval_ms between groups. A train is sent back-to-back and
+ * the bandwidth is estimated from its dispersion at the receiver. A
+ * chirp spaces its packets so that the send rate rises linearly from
+ * chirp_min_kbps to chirp_max_kbps, and the bandwidth is the rate at
+ * which the delay starts to build up. Fields left at 0 get defaults.
+ */
+enum netprobe_pattern {
+	NETPROBE_PATTERN_TRAIN = 0,
+	NETPROBE_PATTERN_CHIRP,
+};
+
+struct netprobe_config {
+	enum netprobe_pattern pattern;
+
+	size_t train_count;
+	size_t train_len;
+	uint32_t train_interval_ms;
+	uint32_t pkt_size;         /* payload bytes */
+
+	uint32_t chirp_min_kbps;
+	uint32_t chirp_max_kbps;
+};
+
+int netprobe_alloc_probe(struct netprobe **npb, const struct sa *turn_srv,
+			 int proto, bool secure,
+			 const char *turn_username, const char *turn_password,
+			 const struct netprobe_config *cfg,
+			 netprobe_h *h, void *arg);
@@ -37,17 +37,35 @@
 #include <stdio.h>
 
 namespace wire_avs {
+
+struct RtpDumpStats {
+    uint64_t packets;    // packets queued for writing
+    uint64_t bytes;      // bytes queued, including record headers
+    uint64_t dropped;    // packets lost because the disk fell behind
+    uint32_t files;      // files written, more than one when rotating
+};
+
+// Packets are copied into one of two large buffers on the calling
+// thread, a writer thread writes a full buffer in a single fwrite
+// while the other one is being filled. When both are full, packets
+// are dropped and counted instead of blocking the media thread.
 class RtpDump
 {
 public:
     RtpDump();
     ~RtpDump();
 
+    // Takes effect on the next Start(). With headersOnly RTP payloads
+    // are not recorded. With maxFileBytes > 0 the dump continues in
+    // <file>.1, <file>.2 ... when a file reaches that size.
+    void SetOptions(bool headersOnly, size_t maxFileBytes);
+
     int32_t Start(const char* fileNameUTF8);
     int32_t Stop();
     bool IsActive() const;
     int32_t DumpPacket(const uint8_t* packet,
                                size_t packetLength);
+    void GetStats(RtpDumpStats* stats);
 private:
     // Return the system time in ms.
     inline uint32_t GetTimeInMS() const;
@@ -61,10 +79,40 @@ private:
     //       to determine if the packet is an RTCP packet.
     bool RTCP(const uint8_t* packet) const;
 
+    // Length of the RTP header including CSRCs and extension.
+    size_t RtpHeaderLength(const uint8_t* packet, size_t packetLength) const;
+
+    FILE* OpenFile(const char* fileName);
+    uint32_t WriteBuffer(int ix);
+    static void* WriterThread(void* arg);
+    void WriterLoop();
+
 private:
     pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+    pthread_t _thread;
+    bool _running;
     FILE* _file;
     uint32_t _startTime;
+
+    // As set by SetOptions(), copied by Start()
+    bool _optHeadersOnly;
+    size_t _optMaxFileBytes;
+
+    bool _headersOnly;
+    // Owned by the writer thread while running, set up before it starts
+    size_t _maxFileBytes;
+    char* _fileName;
+    uint32_t _fileIndex;
+    size_t _fileBytes;
+
+    uint8_t* _buf[2];
+    size_t _len[2];
+    uint32_t _count[2];
+    int _active;         // buffer being filled
+    bool _pending;       // the other buffer is waiting for the writer
+
+    RtpDumpStats _stats;
 };
 }  // namespace wwire_avs
 #endif // RTP_DUMP_H
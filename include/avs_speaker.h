@@ -0,0 +1,66 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/* libavs
+ *
+ * Active speaker detection
+ */
+
+#ifndef AVS_SPEAKER_H
+#define AVS_SPEAKER_H    1
+
+
+/* RFC 6464 audio level of one received audio stream */
+struct speaker_level {
+	const char *userid;
+	const char *clientid;
+	uint32_t ssrc;
+	uint8_t dbov;      /* -dBov, 0 (loudest) .. 127 (silence) */
+};
+
+/* One entry of a ranking, loudest first */
+struct speaker_rank {
+	char *userid;
+	char *clientid;
+	uint32_t ssrc;
+	float level;       /* smoothed, 0..1 */
+	bool speaking;
+};
+
+struct speaker_engine;
+
+typedef void (speaker_rank_h)(const struct speaker_rank *rankv, size_t rankc,
+			      void *arg);
+
+/*
+ * Levels are fed per SSRC as they are polled, speaker_engine_tick ranks
+ * them and calls rankh when the ranking has changed, at most once every
+ * interval ms.
+ */
+int  speaker_engine_alloc(struct speaker_engine **sep, uint64_t interval,
+			  speaker_rank_h *rankh, void *arg);
+int  speaker_engine_level(struct speaker_engine *se,
+			  const struct speaker_level *lvl, uint64_t now);
+void speaker_engine_tick(struct speaker_engine *se, uint64_t now);
+const struct speaker_rank *speaker_engine_ranking(
+	const struct speaker_engine *se, size_t *rankc);
+int  speaker_engine_debug(struct re_printf *pf,
+			  const struct speaker_engine *se);
+
+float speaker_dbov2level(uint8_t dbov);
+
+#endif // #ifndef AVS_SPEAKER_H
@@ -46,6 +46,41 @@ struct wcall_members {
 	size_t membc;
 };
 
+/* One participant of an active speaker update */
+struct wcall_active_speaker {
+	const char *userid;
+	const char *clientid;
+	int audio_level;   /* smoothed, 0..100 */
+	int speaking;
+};
+
+/* Changes of a participant since the previous participant callback */
+#define WCALL_PARTICIPANT_ADDED    0x01
+#define WCALL_PARTICIPANT_REMOVED  0x02
+#define WCALL_PARTICIPANT_AUDIO    0x04  /* audio_estab changed */
+#define WCALL_PARTICIPANT_VIDEO    0x08  /* video_recv changed  */
+
+struct wcall_participant {
+	const char *userid;
+	const char *clientid;
+	int audio_estab;
+	int video_recv;
+	uint32_t changes;  /* WCALL_PARTICIPANT_ mask, 0 if unchanged */
+};
+
+/* Media quality averaged over one history period (a minute) */
+struct wcall_quality_sample {
+	uint64_t ts;        /* period start, seconds since the epoch */
+	uint32_t nsamples;  /* stats samples in the average          */
+	float rtt;          /* ms                                    */
+	float dloss;        /* downstream packet loss %              */
+	float jitter;       /* ms                                    */
+	float send_kbps;
+	float recv_kbps;
+	float audio_level;  /* 0..1                                  */
+	float video_fps;
+};
+
 
 /* Returns a constant string of the current AVS library version in the
  * format <major>.<minor>.<build> e.g. 5.1.25 for a 5.1 build,
@@ -125,6 +160,37 @@ typedef void (wcall_group_changed_h)(const char *convid, void *arg);
 
 typedef void (wcall_participant_changed_h)(const char *convid,
 					   const char *mjson, void *arg);
+
+/**
+ * Same as wcall_participant_changed_h, but with the participants as a
+ * flat array instead of a JSON document. Removed participants come last,
+ * with their last known state. Only called when something has changed.
+ * The array and its strings are valid for the duration of the call only.
+ *
+ * @param convid   Conversation id on which participant list has changed
+ * @param partv    Current and removed participants
+ * @param partc    Number of entries in partv
+ * @param arg      User context passed to wcall_set_participants_handler
+ */
+typedef void (wcall_participants_h)(const char *convid,
+				    const struct wcall_participant *partv,
+				    size_t partc, void *arg);
+
+/**
+ * Callback with the participants that send audio, ranked by speech
+ * activity: current speakers first, loudest first, then the others by
+ * how recently they spoke. Called when the ranking or a level changes,
+ * at most twice a second. The array is valid for the duration of the
+ * call only.
+ *
+ * @param convid    Conversation id of the call
+ * @param speakerv  Ranked participants
+ * @param speakerc  Number of entries in speakerv
+ * @param arg       User context passed to wcall_set_active_speaker_handler
+ */
+typedef void (wcall_active_speaker_h)(const char *convid,
+			const struct wcall_active_speaker *speakerv,
+			size_t speakerc, void *arg);
 	
 /* Media has been established */
 typedef void (wcall_media_estab_h)(const char *convid,
@@ -233,6 +299,17 @@ typedef int (wcall_config_req_h)(WUSER_HANDLE wuser, void *arg);
 int wcall_init(int env);
 void wcall_close(void);
 
+/* Opt-in for hosts running many instances: instances created after
+ * this call are spread over n event loop threads (shards), each with
+ * its own mqueue and timers. Call after wcall_init; instances created
+ * before keep running on the main loop. Returns EALREADY if shards
+ * are already running.
+ */
+int wcall_set_shards(int n);
+
+/* Returns the shard an instance runs on, or -1 if not sharded */
+int wcall_get_shard(WUSER_HANDLE wuser);
+
 WUSER_HANDLE wcall_create(const char *userid,
 			  const char *clientid,
 			  wcall_ready_h *readyh,
@@ -362,6 +439,21 @@ void wcall_set_video_handlers(wcall_render_frame_h *render_frame_h,
 			      wcall_video_size_h *size_h,
 			      void *arg);
 
+/* Caps the remote video rendered over all calls at max_pps pixels per
+ * second, 0 removes the cap. Speakers and then the best ranked
+ * participants keep their full frame rate, the others are slowed down
+ * or paused. In conference calls a paused participant is not decoded
+ * either; slowed down ones still are. Takes effect within a second.
+ */
+void wcall_set_video_budget(uint64_t max_pps);
+
+/* Tells whether the video of a participant is on screen. Hidden
+ * participants are paused whatever the budget.
+ */
+void wcall_set_video_visible(const char *userid,
+			     const char *clientid,
+			     int visible);
+
 void wcall_network_changed(WUSER_HANDLE wuser);
 
 void wcall_set_group_changed_handler(WUSER_HANDLE wuser,
@@ -371,6 +463,14 @@ void wcall_set_group_changed_handler(WUSER_HANDLE wuser,
 void wcall_set_participant_changed_handler(WUSER_HANDLE wuser,
 					   wcall_participant_changed_h *chgh,
 					   void *arg);
+
+void wcall_set_participants_handler(WUSER_HANDLE wuser,
+				    wcall_participants_h *partsh,
+				    void *arg);
+
+void wcall_set_active_speaker_handler(WUSER_HANDLE wuser,
+				      wcall_active_speaker_h *speakerh,
+				      void *arg);
 	
 
 int wcall_set_network_quality_handler(WUSER_HANDLE wuser,
@@ -378,6 +478,17 @@ int wcall_set_network_quality_handler(WUSER_HANDLE wuser,
 				      int interval, /* in s */
 				      void *arg);
 
+/* Copies up to *samplec history samples, oldest first, and sets
+ * *samplec to the number copied. userid selects the peer in a group
+ * call and may be NULL for a one to one call. The history is kept
+ * until the call is deleted and may be read from any thread.
+ */
+int wcall_get_quality_history(WUSER_HANDLE wuser,
+			      const char *convid,
+			      const char *userid,
+			      struct wcall_quality_sample *samplev,
+			      size_t *samplec);
+
 void wcall_set_log_handler(wcall_log_h *logh, void *arg);
 
 struct sa;
@@ -62,6 +62,7 @@ AVS_MODULES += queue
 AVS_MODULES += rest
 AVS_MODULES += sem
 AVS_MODULES += serial
+AVS_MODULES += speaker
 AVS_MODULES += string
 AVS_MODULES += trace
 AVS_MODULES += uuid
@@ -81,7 +82,9 @@ AVS_MODULES += zapi
 AVS_MODULES += ztime
 
 ifeq ($(BUILD_NETWORK_MODULES),1)
+AVS_MODULES += netprobe
 AVS_MODULES += network
+AVS_MODULES += turn
 endif
 
 ifeq ($(BUILD_OPTIONAL_MODULES),1)
@@ -33,7 +33,7 @@ static void aueffect_destructor(void *arg)
     
     debug("aueffect_destructor: %p free_h: %p\n",aue, aue->e_free_h);
 
-    if (aue->e_free_h)
+    if (aue->e_free_h && aue->effect)
 	    aue->e_free_h(aue->effect);
 }
 
@@ -64,9 +64,10 @@ int aueffect_alloc(struct aueffect **auep,
         case AUDIO_EFFECT_CHORUS:
         case AUDIO_EFFECT_REVERSE:
             aue->e_create_h = create_chorus;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_chorus;
             aue->e_free_h = free_chorus;
             aue->e_proc_h = chorus_process;
+            aue->e_pitch_h = chorus_share_pitch;
             break;
         case AUDIO_EFFECT_REVERB_MAX:
             strength++;
@@ -75,7 +76,7 @@ int aueffect_alloc(struct aueffect **auep,
         case AUDIO_EFFECT_REVERB_MIN:
         case AUDIO_EFFECT_REVERB:
             aue->e_create_h = create_reverb;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_reverb;
             aue->e_free_h = free_reverb;
             aue->e_proc_h = reverb_process;
             break;
@@ -88,9 +89,10 @@ int aueffect_alloc(struct aueffect **auep,
         case AUDIO_EFFECT_PITCH_UP_SHIFT_MIN:
         case AUDIO_EFFECT_PITCH_UP_SHIFT:
             aue->e_create_h = create_pitch_up_shift;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_pitch_shift;
             aue->e_free_h = free_pitch_shift;
             aue->e_proc_h = pitch_shift_process;
+            aue->e_pitch_h = pitch_shift_share_pitch;
             break;
         case AUDIO_EFFECT_PITCH_DOWN_SHIFT_INSANE:
             strength++;
@@ -101,9 +103,10 @@ int aueffect_alloc(struct aueffect **auep,
         case AUDIO_EFFECT_PITCH_DOWN_SHIFT_MIN:
         case AUDIO_EFFECT_PITCH_DOWN_SHIFT:
             aue->e_create_h = create_pitch_down_shift;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_pitch_shift;
             aue->e_free_h = free_pitch_shift;
             aue->e_proc_h = pitch_shift_process;
+            aue->e_pitch_h = pitch_shift_share_pitch;
             break;
         case AUDIO_EFFECT_PACE_DOWN_SHIFT_MAX:
             strength++;
@@ -111,9 +114,10 @@ int aueffect_alloc(struct aueffect **auep,
             strength++;
         case AUDIO_EFFECT_PACE_DOWN_SHIFT_MIN:
             aue->e_create_h = create_pace_down_shift;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_pace_shift;
             aue->e_free_h = free_pace_shift;
             aue->e_proc_h = pace_shift_process;
+            aue->e_pitch_h = pace_shift_share_pitch;
             aue->e_length_h = pace_shift_length_factor;
             break;
         case AUDIO_EFFECT_PACE_UP_SHIFT_MAX:
@@ -122,18 +126,20 @@ int aueffect_alloc(struct aueffect **auep,
             strength++;
         case AUDIO_EFFECT_PACE_UP_SHIFT_MIN:
             aue->e_create_h = create_pace_up_shift;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_pace_shift;
             aue->e_free_h = free_pace_shift;
             aue->e_proc_h = pace_shift_process;
+            aue->e_pitch_h = pace_shift_share_pitch;
             aue->e_length_h = pace_shift_length_factor;
             break;
         case AUDIO_EFFECT_VOCODER_MED:
             strength++;            
         case AUDIO_EFFECT_VOCODER_MIN:
             aue->e_create_h = create_vocoder;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_vocoder;
             aue->e_free_h = free_vocoder;
             aue->e_proc_h = vocoder_process;
+            aue->e_pitch_h = vocoder_share_pitch;
             break;
         case AUDIO_EFFECT_AUTO_TUNE_MAX:
             strength++;
@@ -141,9 +147,10 @@ int aueffect_alloc(struct aueffect **auep,
             strength++;            
         case AUDIO_EFFECT_AUTO_TUNE_MIN:
             aue->e_create_h = create_auto_tune;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_auto_tune;
             aue->e_free_h = free_auto_tune;
             aue->e_proc_h = auto_tune_process;
+            aue->e_pitch_h = auto_tune_share_pitch;
             break;
         case AUDIO_EFFECT_HARMONIZER_MAX:
             strength++;
@@ -151,9 +158,10 @@ int aueffect_alloc(struct aueffect **auep,
             strength++;
         case AUDIO_EFFECT_HARMONIZER_MIN:
             aue->e_create_h = create_harmonizer;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_harmonizer;
             aue->e_free_h = free_harmonizer;
             aue->e_proc_h = harmonizer_process;
+            aue->e_pitch_h = harmonizer_share_pitch;
             break;
         case AUDIO_EFFECT_NORMALIZER:
             aue->e_create_h = create_normalizer;
@@ -167,13 +175,14 @@ int aueffect_alloc(struct aueffect **auep,
             strength++;
         case AUDIO_EFFECT_PITCH_UP_DOWN_MIN:
             aue->e_create_h = create_pitch_cycler;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_pitch_cycler;
             aue->e_free_h = free_pitch_cycler;
             aue->e_proc_h = pitch_cycler_process;
+            aue->e_pitch_h = pitch_cycler_share_pitch;
             break;
         case AUDIO_EFFECT_NONE:
             aue->e_create_h = create_pass_through;
-            aue->e_reset_h = NULL;
+            aue->e_reset_h = reset_pass_through;
             aue->e_free_h = free_pass_through;
             aue->e_proc_h = pass_through_process;
             break;
@@ -182,6 +191,8 @@ int aueffect_alloc(struct aueffect **auep,
             err = -1;
             goto out;
     }
+    aue->fs_hz = fs_hz;
+    aue->strength = strength;
     aue->effect = aue->e_create_h(fs_hz, strength);
     if(!aue->effect){
         err = -1;
@@ -205,7 +216,21 @@ int aueffect_reset(struct aueffect *aue, int fs_hz)
         return -1;
     }
     
-    aue->e_reset_h(aue->effect, fs_hz);
+    /* The reset handlers clear the signal state only, delay lines and
+     * filters are sized for the rate the effect was created at.
+     */
+    if (aue->e_reset_h && fs_hz == aue->fs_hz) {
+        aue->e_reset_h(aue->effect, fs_hz);
+    }
+    else {
+        aue->e_free_h(aue->effect);
+        aue->effect = aue->e_create_h(fs_hz, aue->strength);
+        if(!aue->effect){
+            error("Effect not allocated ! \n");
+            return ENOMEM;
+        }
+    }
+    aue->fs_hz = fs_hz;
     
     return 0;
 }
@@ -0,0 +1,181 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include "find_pitch_lags.h"
+#include "avs_audio_effect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "avs_log.h"
+#ifdef __cplusplus
+}
+#endif
+
+struct aueffect_chain {
+    struct aueffect *stagev[AUEFFECT_CHAIN_MAX];
+    size_t stagec;
+    int fs_hz;
+
+    /* Set when two or more stages use pitch lags */
+    bool share_pitch;
+    struct pitch_estimator pest;
+
+    /* Stages before the last one keep the frame length */
+    int16_t buf[2][Z_MAX_FS_KHZ*10];
+};
+
+static void chain_destructor(void *arg)
+{
+    struct aueffect_chain *chain = (struct aueffect_chain *)arg;
+
+    for (size_t i = 0; i < chain->stagec; i++) {
+        mem_deref(chain->stagev[i]);
+    }
+    if (chain->share_pitch)
+        free_find_pitch_lags(&chain->pest);
+}
+
+int aueffect_chain_alloc(struct aueffect_chain **chainp,
+                         const enum audio_effect *effectv,
+                         size_t effectc,
+                         int fs_hz)
+{
+    struct aueffect_chain *chain;
+    size_t n_pitch = 0;
+    int err = 0;
+
+    if (!chainp || !effectv || !effectc || effectc > AUEFFECT_CHAIN_MAX)
+        return EINVAL;
+
+    if (fs_hz % 1000 || fs_hz / 1000 > Z_MAX_FS_KHZ) {
+        error("aueffect_chain: unsupported sample rate %d\n", fs_hz);
+        return EINVAL;
+    }
+
+    chain = (struct aueffect_chain *)mem_zalloc(sizeof(*chain),
+                                                chain_destructor);
+    if (!chain)
+        return ENOMEM;
+
+    chain->fs_hz = fs_hz;
+
+    for (size_t i = 0; i < effectc; i++) {
+        struct aueffect *aue;
+
+        err = aueffect_alloc(&aue, effectv[i], fs_hz);
+        if (err)
+            goto out;
+
+        chain->stagev[chain->stagec++] = aue;
+
+        if (aue->e_length_h && i + 1 < effectc) {
+            error("aueffect_chain: length modifying effect %d "
+                  "must be the last stage\n", effectv[i]);
+            err = EINVAL;
+            goto out;
+        }
+        if (aue->e_pitch_h)
+            ++n_pitch;
+    }
+
+    if (n_pitch > 1) {
+        init_find_pitch_lags(&chain->pest, fs_hz, 2);
+        chain->share_pitch = true;
+
+        for (size_t i = 0; i < chain->stagec; i++) {
+            struct aueffect *aue = chain->stagev[i];
+
+            if (aue->e_pitch_h)
+                aue->e_pitch_h(aue->effect, &chain->pest);
+        }
+    }
+
+    debug("aueffect_chain: %zu stages, %zu share pitch analysis\n",
+          chain->stagec, chain->share_pitch ? n_pitch : 0);
+
+ out:
+    if (err)
+        mem_deref(chain);
+    else
+        *chainp = chain;
+
+    return err;
+}
+
+int aueffect_chain_process(struct aueffect_chain *chain,
+                           const int16_t *sampin,
+                           int16_t *sampout,
+                           size_t n_sampin,
+                           size_t *n_sampout)
+{
+    size_t L10, n_out = 0;
+
+    if (!chain || !sampin || !sampout || !n_sampout)
+        return EINVAL;
+
+    L10 = chain->fs_hz / 100;
+    if (n_sampin % L10) {
+        error("aueffect_chain: needs 10 ms chunks\n");
+        return EINVAL;
+    }
+
+    for (size_t pos = 0; pos < n_sampin; pos += L10) {
+        const int16_t *src = &sampin[pos];
+        size_t n = L10;
+
+        /* The stages copy these results in their own find_pitch_lags */
+        if (chain->share_pitch)
+            find_pitch_lags(&chain->pest, (int16_t *)src, (int)L10);
+
+        for (size_t i = 0; i < chain->stagec; i++) {
+            bool last = i + 1 == chain->stagec;
+            int16_t *dst = last ? &sampout[n_out] : chain->buf[i & 1];
+            size_t n_st = 0;
+
+            aueffect_process(chain->stagev[i], src, dst, n, &n_st);
+            src = dst;
+            n = n_st;
+        }
+        n_out += n;
+    }
+
+    *n_sampout = n_out;
+
+    return 0;
+}
+
+int aueffect_chain_length_modification(struct aueffect_chain *chain,
+                                       int *length_modification_q10)
+{
+    int mod = 1024;
+
+    if (!chain || !length_modification_q10)
+        return EINVAL;
+
+    for (size_t i = 0; i < chain->stagec; i++) {
+        int m;
+
+        aueffect_length_modification(chain->stagev[i], &m);
+        mod = (mod * m) >> 10;
+    }
+    *length_modification_q10 = mod;
+
+    return 0;
+}
@@ -145,6 +145,31 @@ void free_auto_tune(void *st)
     free(ate);
 }
 
+void reset_auto_tune(void *st, int fs_hz)
+{
+    struct auto_tune_effect *ate = (struct auto_tune_effect*)st;
+    
+    reset_resampler(&ate->resampler, fs_hz, fs_hz * ATE_UP_FAC);
+    reset_find_pitch_lags(&ate->pest);
+    time_scale_reset(&ate->tscale);
+    
+    memset(ate->lp_filt, 0, sizeof(ate->lp_filt));
+    memset(ate->buf, 0, sizeof(ate->buf));
+    memset(ate->pL_buf, 0, sizeof(ate->pL_buf));
+    ate->pL_smth = 0.0f;
+    
+    ate->read_idx = ate->fs_khz * ATE_EXTRA_BUF_MS * ATE_UP_FAC;
+    ate->comp_smth = 1.0f;
+    ate->prev_idx = -1;
+}
+
+void auto_tune_share_pitch(void *st, const struct pitch_estimator *pest)
+{
+    struct auto_tune_effect *ate = (struct auto_tune_effect*)st;
+
+    share_pitch_lags(&ate->pest, pest);
+}
+
 static void find_min_max_pitch(struct auto_tune_effect *ate, int *min_pL, int *max_pL)
 {
     int pitchL;
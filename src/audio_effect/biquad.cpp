@@ -18,6 +18,7 @@
 
 #include <re.h>
 #include "biquad.h"
+#include "effect_simd.h"
 #include "avs_audio_effect.h"
 #include <math.h>
 
@@ -33,6 +34,11 @@ void biquad(struct biquad *bq, float a[2], float b[3], int16_t x[], int16_t y[],
 {
     float w0;
     float out;
+
+    if (effect_simd_enabled()) {
+        simd_biquad(&bq->w1, &bq->w2, a, b, x, y, L);
+        return;
+    }
     
     for(int i = 0; i < L; i++){
         w0 = -a[0]*bq->w1;
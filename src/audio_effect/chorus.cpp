@@ -18,6 +18,8 @@
 
 #include <re.h>
 #include "chorus.h"
+#include "find_pitch_lags.h"
+#include "effect_simd.h"
 #include "avs_audio_effect.h"
 #include <math.h>
 
@@ -94,6 +96,34 @@ static void free_chorus_org(void *st)
     free(cho);
 }
 
+static void reset_chorus_org(void *st, int fs_hz)
+{
+    struct chorus_org_effect *cho = (struct chorus_org_effect*)st;
+    
+    reset_resampler(&cho->resampler, fs_hz, fs_hz*UP_FAC);
+    memset(cho->buf, 0, sizeof(cho->buf));
+    
+#if NUM_RAND_ELEM
+    int offset = cho->r_elem[0].period_smpls / NUM_RAND_ELEM;
+    
+    for(int j = 0; j < NUM_RAND_ELEM; j++){
+        cho->r_elem[j].d = 0;
+        cho->r_elem[j].a = 0;
+        cho->r_elem[j].d_next = 0;
+        cho->r_elem[j].a_next = 0;
+        cho->r_elem[j].cnt = j*offset;
+    }
+#endif
+    
+#if NUM_SINE_ELEM
+    for(int j = 0; j < NUM_SINE_ELEM; j++){
+        cho->s_elem[j].d = 0;
+        cho->s_elem[j].a = 0;
+        cho->s_elem[j].omega = (PI/2)*j;
+    }
+#endif
+}
+
 static int16_t update_rand_chorus_elem(struct rand_chorus_elem *r_elem, int16_t buf[], int up_fac)
 {
     r_elem->cnt++;
@@ -133,6 +163,52 @@ static float compress(float x)
     return y;
 }
 
+#if NUM_SINE_ELEM && !NUM_RAND_ELEM
+/*
+ * Block version of the sine chorus: the modulation of all elements is
+ * computed for a block of samples at a time, leaving only the delay
+ * line taps per sample.
+ */
+static void chorus_process_org_block(struct chorus_org_effect *cho, int16_t ptr[], int16_t out[], size_t L)
+{
+    float s[NUM_SINE_ELEM][SIMD_BLOCK_SZ];
+    float acc[SIMD_BLOCK_SZ];
+    float sc1 = 1.0f/(32768.0f*2.0f), sc2 = (32768.0f*2.0f);
+
+    for(size_t pos = 0; pos < L; pos += SIMD_BLOCK_SZ){
+        size_t n = L - pos < SIMD_BLOCK_SZ ? L - pos : SIMD_BLOCK_SZ;
+
+        for(int j = 0; j < NUM_SINE_ELEM; j++){
+            struct sine_chorus_elem *s_elem = &cho->s_elem[j];
+
+            /* same phase accumulation as update_sine_chorus_elem() */
+            for(size_t i = 0; i < n; i++){
+                s_elem->omega += s_elem->d_omega;
+                s_elem->omega = fmod(s_elem->omega, 2*3.1415926536);
+                s[j][i] = s_elem->omega;
+            }
+            simd_sine_half(s[j], s[j], n);
+        }
+
+        for(size_t i = 0; i < n; i++){
+            int16_t *p = &ptr[(pos + i) * UP_FAC];
+            int32_t tmp = p[0];
+
+            for(int j = 0; j < NUM_SINE_ELEM; j++){
+                struct sine_chorus_elem *s_elem = &cho->s_elem[j];
+                float d = s_elem->min_d + s[j][i]*(s_elem->max_d-s_elem->min_d);
+                float a = s_elem->min_a + (1-s[j][i])*(s_elem->max_a-s_elem->min_a);
+
+                tmp += (int16_t)((float)p[-(int)(d * (float)UP_FAC)] * a);
+            }
+            acc[i] = (float)tmp * sc1;
+        }
+
+        simd_soft_clip(acc, &out[pos], sc2, n);
+    }
+}
+#endif
+
 static void chorus_process_org(void *st, int16_t in[], int16_t out[], size_t L)
 {
     struct chorus_org_effect *cho = (struct chorus_org_effect*)st;
@@ -153,6 +229,15 @@ static void chorus_process_org(void *st, int16_t in[], int16_t out[], size_t L)
     }
             
     ptr = &cho->buf[hist_size];
+
+#if NUM_SINE_ELEM && !NUM_RAND_ELEM
+    if (effect_simd_enabled()) {
+        chorus_process_org_block(cho, ptr, out, L);
+        memmove(cho->buf, &cho->buf[L * UP_FAC], hist_size*sizeof(int16_t));
+        return;
+    }
+#endif
+
     for(size_t i = 0; i < L; i++){
         tmp = ptr[i * UP_FAC];
 
@@ -184,6 +269,10 @@ static void* create_chorus_alt(int fs_hz, int strength)
     
     cho->pse1 = create_pitch_up_shift(fs_hz, 0);
     cho->pse2 = create_pitch_down_shift(fs_hz, 0);
+    cho->fs_khz = fs_hz/1000;
+
+    /* Both shifters see the same input, analyse the pitch once */
+    pitch_shift_share_pitch(cho->pse2, pitch_shift_estimator(cho->pse1));
     
     return (void*)cho;
 }
@@ -197,26 +286,99 @@ static void free_chorus_alt(void *st)
     free(cho);
 }
 
-static void chorus_process_alt(void *st, int16_t in[], int16_t out[], size_t L)
+static void reset_chorus_alt(void *st, int fs_hz)
 {
     struct chorus_alt_effect *cho = (struct chorus_alt_effect*)st;
-    int16_t out1[L], out2[L];
-    int32_t tmp;
-    float y, sc1 = 1.0f/(32768.0f*2.0f), sc2 = (32768.0f*2.0f);
     
-    size_t L_out;
-    pitch_shift_process(cho->pse1, in, out1, L, &L_out);
-    pitch_shift_process(cho->pse2, in, out2, L, &L_out);
-    
-    for(int i = 0; i < L; i++){
-        tmp = in[i] + out1[i] + out2[i];
-        y = (float)tmp * sc1;
+    reset_pitch_shift(cho->pse1, fs_hz);
+    reset_pitch_shift(cho->pse2, fs_hz);
+    cho->fs_khz = fs_hz/1000;
+    cho->in_len = 0;
+    cho->out_len = 0;
+}
+
+static void chorus_alt_mix(const int32_t sum[], int16_t out[], size_t L)
+{
+    float y, sc1 = 1.0f/(32768.0f*2.0f), sc2 = (32768.0f*2.0f);
+
+    if (effect_simd_enabled()) {
+        float acc[L];
+
+        for(size_t i = 0; i < L; i++){
+            acc[i] = (float)sum[i] * sc1;
+        }
+        simd_soft_clip(acc, out, sc2, L);
+        return;
+    }
+
+    for(size_t i = 0; i < L; i++){
+        y = (float)sum[i] * sc1;
         y = compress(y);
         y = y * sc2;
         out[i] = (int16_t)y;
     }
 }
 
+static void chorus_alt_block(struct chorus_alt_effect *cho, int16_t in[], int32_t sum[])
+{
+    size_t L10 = cho->fs_khz * 10;
+    int16_t out1[L10], out2[L10];
+    size_t L_out;
+
+    pitch_shift_process(cho->pse1, in, out1, L10, &L_out);
+    pitch_shift_process(cho->pse2, in, out2, L10, &L_out);
+    for(size_t i = 0; i < L10; i++){
+        sum[i] = in[i] + out1[i] + out2[i];
+    }
+}
+
+static void chorus_process_alt(void *st, int16_t in[], int16_t out[], size_t L)
+{
+    struct chorus_alt_effect *cho = (struct chorus_alt_effect*)st;
+    size_t L10 = cho->fs_khz * 10;
+    int32_t sum[L];
+    size_t i, n, pad;
+
+    if(L > (size_t)(MAX_L_MS * cho->fs_khz)){
+        error("chorus_process max %d ms \n", MAX_L_MS);
+        return;
+    }
+
+    /* Interleave per 10 ms so pse2 picks up the lags of the same frame */
+    if(cho->in_len == 0 && cho->out_len == 0 && L % L10 == 0){
+        for(i = 0; i < L; i += L10){
+            chorus_alt_block(cho, &in[i], &sum[i]);
+        }
+        chorus_alt_mix(sum, out, L);
+        return;
+    }
+
+    /* Odd sized calls: queue the input into 10 ms blocks. When fewer
+     * than L processed samples are ready, the output is delayed by the
+     * shortfall; the delay stays below 10 ms.
+     */
+    for(i = 0; i < L; i += n){
+        n = L10 - cho->in_len;
+        if(n > L - i)
+            n = L - i;
+        memcpy(&cho->in_fifo[cho->in_len], &in[i], n * sizeof(int16_t));
+        cho->in_len += n;
+        if(cho->in_len == L10){
+            chorus_alt_block(cho, cho->in_fifo, &cho->out_fifo[cho->out_len]);
+            cho->out_len += L10;
+            cho->in_len = 0;
+        }
+    }
+
+    pad = cho->out_len < L ? L - cho->out_len : 0;
+    memset(sum, 0, pad * sizeof(int32_t));
+    memcpy(&sum[pad], cho->out_fifo, (L - pad) * sizeof(int32_t));
+    cho->out_len -= L - pad;
+    memmove(cho->out_fifo, &cho->out_fifo[L - pad], cho->out_len * sizeof(int32_t));
+
+    chorus_alt_mix(sum, out, L);
+}
+
 void* create_chorus(int fs_hz, int strength)
 {
     struct chorus_effect* cho = (struct chorus_effect*)calloc(sizeof(struct chorus_effect),1);
@@ -230,6 +392,24 @@ void* create_chorus(int fs_hz, int strength)
     return (void*)cho;
 }
 
+void chorus_share_pitch(void *st, const struct pitch_estimator *pest)
+{
+    struct chorus_effect *cho = (struct chorus_effect*)st;
+    struct chorus_alt_effect *alt;
+
+    if(cho->strength > 0){
+        return;
+    }
+    alt = (struct chorus_alt_effect*)cho->st;
+    if(pest){
+        pitch_shift_share_pitch(alt->pse1, pest);
+        pitch_shift_share_pitch(alt->pse2, pest);
+    } else {
+        pitch_shift_share_pitch(alt->pse1, NULL);
+        pitch_shift_share_pitch(alt->pse2, pitch_shift_estimator(alt->pse1));
+    }
+}
+
 void free_chorus(void *st)
 {
     struct chorus_effect *cho = (struct chorus_effect*)st;
@@ -242,6 +422,17 @@ void free_chorus(void *st)
     free(cho);
 }
 
+void reset_chorus(void *st, int fs_hz)
+{
+    struct chorus_effect *cho = (struct chorus_effect*)st;
+
+    if(cho->strength > 0){
+        reset_chorus_org(cho->st, fs_hz);
+    } else {
+        reset_chorus_alt(cho->st, fs_hz);
+    }
+}
+
 
 void chorus_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out)
 {
@@ -81,6 +81,12 @@ struct chorus_org_effect {
 struct chorus_alt_effect {
     void* pse1;
     void* pse2;
+    int fs_khz;
+    /* Carry-over for calls that are not a multiple of 10 ms */
+    int16_t in_fifo[10*Z_MAX_FS_KHZ];
+    size_t in_len;
+    int32_t out_fifo[(10+MAX_L_MS)*Z_MAX_FS_KHZ];
+    size_t out_len;
 };
 
 struct chorus_effect {
@@ -0,0 +1,198 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <algorithm>
+
+#include "effect_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "avs_log.h"
+#ifdef __cplusplus
+}
+#endif
+
+#define BATCH_MAX_WORKERS 64
+
+struct effect_batch {
+    struct aueffect_job *jobv;
+    size_t jobc;
+    size_t next;
+    size_t done;
+
+    effect_progress_h *progress_h;
+    void *arg;
+
+    pthread_mutex_t lock;
+};
+
+static double time_sec(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (double)now.tv_sec + (double)now.tv_usec / 1000000.0;
+}
+
+static int run_job(struct effect_stream *es, struct aueffect_job *job)
+{
+    if (!job->in || !job->out)
+        return EINVAL;
+
+    if (job->fs_hz > 0) {
+        return effect_stream_pcm(es, job->in, job->out, job->fs_hz,
+                                 job->effect_type, job->reduce_noise,
+                                 job->progress_h, job->arg);
+    }
+    else {
+        return effect_stream_wav(es, job->in, job->out,
+                                 job->effect_type, job->reduce_noise,
+                                 job->progress_h, job->arg);
+    }
+}
+
+/* Each worker keeps one stream, so the effect instance, resamplers
+ * and APM are reused across all the jobs it picks up.
+ */
+static void *batch_worker(void *arg)
+{
+    struct effect_batch *batch = (struct effect_batch *)arg;
+    struct effect_stream *es;
+    struct aueffect_job *job;
+    double t0;
+    int progress;
+
+    es = effect_stream_alloc();
+
+    for(;;) {
+        pthread_mutex_lock(&batch->lock);
+        job = batch->next < batch->jobc ? &batch->jobv[batch->next++] : NULL;
+        pthread_mutex_unlock(&batch->lock);
+
+        if (!job)
+            break;
+
+        t0 = time_sec();
+        job->err = run_job(es, job);
+        job->proc_sec = time_sec() - t0;
+        job->audio_sec = 0.0;
+        if (!job->err && es->fs_hz > 0) {
+            job->audio_sec = (double)es->n_processed / es->fs_hz;
+        }
+
+        if (job->err) {
+            warning("audio_effect: batch: %s failed (%d)\n",
+                    job->in, job->err);
+        }
+
+        pthread_mutex_lock(&batch->lock);
+        ++batch->done;
+        progress = (int)((batch->done * 100) / batch->jobc);
+        pthread_mutex_unlock(&batch->lock);
+
+        /* Not under the lock, the handler may call back into us */
+        if (batch->progress_h)
+            batch->progress_h(progress, batch->arg);
+    }
+
+    effect_stream_free(es);
+
+    return NULL;
+}
+
+int apply_effect_batch(struct aueffect_job *jobv,
+                       size_t jobc,
+                       int n_workers,
+                       effect_progress_h* progress_h,
+                       void *arg,
+                       struct aueffect_batch_stats *stats)
+{
+    struct effect_batch batch;
+    pthread_t tidv[BATCH_MAX_WORKERS];
+    int n_started = 0;
+    double t0;
+
+    if (!jobv || !jobc)
+        return EINVAL;
+
+    if (n_workers <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = ncpu > 0 ? (int)ncpu : 1;
+    }
+    n_workers = (int)std::min((size_t)n_workers, jobc);
+    n_workers = std::min(n_workers, BATCH_MAX_WORKERS);
+
+    memset(&batch, 0, sizeof(batch));
+    batch.jobv = jobv;
+    batch.jobc = jobc;
+    batch.progress_h = progress_h;
+    batch.arg = arg;
+    pthread_mutex_init(&batch.lock, NULL);
+
+    info("audio_effect: batch: %zu jobs on %d workers\n",
+         jobc, n_workers);
+
+    t0 = time_sec();
+
+    for (int i = 0; i < n_workers; i++) {
+        if (pthread_create(&tidv[i], NULL, batch_worker, &batch) != 0) {
+            warning("audio_effect: batch: could not start worker %d\n",
+                    i);
+            break;
+        }
+        ++n_started;
+    }
+
+    if (n_started == 0) {
+        /* Run on the calling thread */
+        batch_worker(&batch);
+    }
+
+    for (int i = 0; i < n_started; i++) {
+        pthread_join(tidv[i], NULL);
+    }
+
+    pthread_mutex_destroy(&batch.lock);
+
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+        stats->n_jobs = jobc;
+        stats->n_workers = n_started ? n_started : 1;
+        stats->wall_sec = time_sec() - t0;
+        for (size_t i = 0; i < jobc; i++) {
+            if (jobv[i].err)
+                ++stats->n_failed;
+            stats->audio_sec += jobv[i].audio_sec;
+        }
+        if (stats->audio_sec > 0.0)
+            stats->rtf = stats->wall_sec / stats->audio_sec;
+
+        info("audio_effect: batch: %zu jobs (%zu failed) %.1fs audio "
+             "in %.1fs rtf=%.3f\n",
+             stats->n_jobs, stats->n_failed, stats->audio_sec,
+             stats->wall_sec, stats->rtf);
+    }
+
+    return 0;
+}
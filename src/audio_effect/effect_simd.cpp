@@ -0,0 +1,352 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <math.h>
+#include "effect_simd.h"
+#include "avs_audio_effect.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#define SIMD_SSE2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SIMD_NEON 1
+#endif
+
+#define PI_F     3.14159265f
+#define TWO_PI_F 6.28318531f
+
+/* tanh(t) is 1.0f beyond this for the rational approximation below */
+#define TANH_CLAMP 4.97f
+
+static bool g_simd = true;
+
+void aueffect_set_simd(bool enable)
+{
+    g_simd = enable;
+}
+
+bool effect_simd_enabled(void)
+{
+    return g_simd;
+}
+
+
+/*
+ * Vector abstraction: vf is VF_N floats wide.
+ */
+#if SIMD_AVX2
+typedef __m256 vf;
+#define VF_N 8
+#define vf_load(p)      _mm256_loadu_ps(p)
+#define vf_store(p, v)  _mm256_storeu_ps(p, v)
+#define vf_set1(x)      _mm256_set1_ps(x)
+#define vf_add(a, b)    _mm256_add_ps(a, b)
+#define vf_sub(a, b)    _mm256_sub_ps(a, b)
+#define vf_mul(a, b)    _mm256_mul_ps(a, b)
+#define vf_div(a, b)    _mm256_div_ps(a, b)
+#define vf_min(a, b)    _mm256_min_ps(a, b)
+#define vf_max(a, b)    _mm256_max_ps(a, b)
+#define vf_round(a)     _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | \
+					   _MM_FROUND_NO_EXC)
+
+#elif SIMD_SSE2
+typedef __m128 vf;
+#define VF_N 4
+#define vf_load(p)      _mm_loadu_ps(p)
+#define vf_store(p, v)  _mm_storeu_ps(p, v)
+#define vf_set1(x)      _mm_set1_ps(x)
+#define vf_add(a, b)    _mm_add_ps(a, b)
+#define vf_sub(a, b)    _mm_sub_ps(a, b)
+#define vf_mul(a, b)    _mm_mul_ps(a, b)
+#define vf_div(a, b)    _mm_div_ps(a, b)
+#define vf_min(a, b)    _mm_min_ps(a, b)
+#define vf_max(a, b)    _mm_max_ps(a, b)
+#define vf_round(a)     _mm_cvtepi32_ps(_mm_cvtps_epi32(a))
+
+#elif SIMD_NEON
+typedef float32x4_t vf;
+#define VF_N 4
+#define vf_load(p)      vld1q_f32(p)
+#define vf_store(p, v)  vst1q_f32(p, v)
+#define vf_set1(x)      vdupq_n_f32(x)
+#define vf_add(a, b)    vaddq_f32(a, b)
+#define vf_sub(a, b)    vsubq_f32(a, b)
+#define vf_mul(a, b)    vmulq_f32(a, b)
+#define vf_min(a, b)    vminq_f32(a, b)
+#define vf_max(a, b)    vmaxq_f32(a, b)
+static inline vf vf_div(vf a, vf b)
+{
+    /* armv7 has no vector divide, refine the reciprocal estimate */
+    vf r = vrecpeq_f32(b);
+
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+
+    return vmulq_f32(a, r);
+}
+static inline vf vf_round(vf a)
+{
+    vf half = vbslq_f32(vcgeq_f32(a, vdupq_n_f32(0.0f)),
+                        vdupq_n_f32(0.5f), vdupq_n_f32(-0.5f));
+
+    return vcvtq_f32_s32(vcvtq_s32_f32(vaddq_f32(a, half)));
+}
+#endif
+
+
+static inline int16_t sat16(float y)
+{
+    if (y > 32767.0f)
+        return 32767;
+    if (y < -32768.0f)
+        return -32768;
+
+    return (int16_t)y;
+}
+
+/* 0.5 * tanh(1.5 * x) == 1/(exp(-3x)+1) - 0.5 */
+float soft_clip_fast(float x)
+{
+    float t, t2, num, den;
+
+    t = 1.5f * x;
+    t = fminf(fmaxf(t, -TANH_CLAMP), TANH_CLAMP);
+    t2 = t * t;
+    num = t * (135135.0f + t2 * (17325.0f + t2 * (378.0f + t2)));
+    den = 135135.0f + t2 * (62370.0f + t2 * (3150.0f + t2 * 28.0f));
+
+    return 0.5f * num / den;
+}
+
+static inline float sin_fast(float t)
+{
+    float t2;
+
+    /* reduce to [-pi, pi], then fold to [-pi/2, pi/2] */
+    t = t - TWO_PI_F * roundf(t * (1.0f / TWO_PI_F));
+    t = fmaxf(fminf(t, PI_F - t), -PI_F - t);
+    t2 = t * t;
+
+    return t * (1.0f + t2 * (-1.0f/6 + t2 * (1.0f/120 +
+                t2 * (-1.0f/5040 + t2 * (1.0f/362880)))));
+}
+
+
+void simd_allpass_span(float *y, const float *rd, float *wr,
+                       float c, size_t n)
+{
+    size_t i = 0;
+
+#if VF_N
+    vf vc = vf_set1(c);
+
+    for (; i + VF_N <= n; i += VF_N) {
+        vf wd = vf_load(&rd[i]);
+        vf w0 = vf_add(vf_load(&y[i]), vf_mul(wd, vc));
+
+        vf_store(&wr[i], w0);
+        vf_store(&y[i], vf_sub(wd, vf_mul(vc, w0)));
+    }
+#endif
+    for (; i < n; i++) {
+        float wd = rd[i];
+        float w0 = y[i] + wd * c;
+
+        wr[i] = w0;
+        y[i] = -c * w0 + wd;
+    }
+}
+
+void simd_soft_clip(const float *x, int16_t *out, float post_sc, size_t n)
+{
+    float y[SIMD_BLOCK_SZ];
+    size_t i, j;
+
+    while (n > 0) {
+        size_t blk = n < SIMD_BLOCK_SZ ? n : SIMD_BLOCK_SZ;
+
+        i = 0;
+#if VF_N
+        vf lim = vf_set1(TANH_CLAMP);
+        vf nlim = vf_set1(-TANH_CLAMP);
+        vf k15 = vf_set1(1.5f);
+        vf sc = vf_set1(0.5f * post_sc);
+
+        for (; i + VF_N <= blk; i += VF_N) {
+            vf t = vf_mul(vf_load(&x[i]), k15);
+            vf t2, num, den;
+
+            t = vf_min(vf_max(t, nlim), lim);
+            t2 = vf_mul(t, t);
+            num = vf_add(vf_set1(378.0f), t2);
+            num = vf_add(vf_set1(17325.0f), vf_mul(t2, num));
+            num = vf_add(vf_set1(135135.0f), vf_mul(t2, num));
+            num = vf_mul(t, num);
+            den = vf_add(vf_set1(3150.0f), vf_mul(t2, vf_set1(28.0f)));
+            den = vf_add(vf_set1(62370.0f), vf_mul(t2, den));
+            den = vf_add(vf_set1(135135.0f), vf_mul(t2, den));
+
+            vf_store(&y[i], vf_mul(vf_div(num, den), sc));
+        }
+#endif
+        for (; i < blk; i++) {
+            y[i] = soft_clip_fast(x[i]) * post_sc;
+        }
+        for (j = 0; j < blk; j++) {
+            out[j] = sat16(y[j]);
+        }
+
+        x += blk;
+        out += blk;
+        n -= blk;
+    }
+}
+
+void simd_sine_half(const float *omega, float *s, size_t n)
+{
+    size_t i = 0;
+
+#if VF_N
+    vf inv = vf_set1(1.0f / TWO_PI_F);
+    vf two_pi = vf_set1(TWO_PI_F);
+    vf pi = vf_set1(PI_F);
+    vf npi = vf_set1(-PI_F);
+    vf half = vf_set1(0.5f);
+
+    for (; i + VF_N <= n; i += VF_N) {
+        vf t = vf_load(&omega[i]);
+        vf t2, p;
+
+        t = vf_sub(t, vf_mul(two_pi, vf_round(vf_mul(t, inv))));
+        t = vf_max(vf_min(t, vf_sub(pi, t)), vf_sub(npi, t));
+        t2 = vf_mul(t, t);
+        p = vf_set1(1.0f/362880);
+        p = vf_add(vf_set1(-1.0f/5040), vf_mul(t2, p));
+        p = vf_add(vf_set1(1.0f/120), vf_mul(t2, p));
+        p = vf_add(vf_set1(-1.0f/6), vf_mul(t2, p));
+        p = vf_add(vf_set1(1.0f), vf_mul(t2, p));
+        p = vf_mul(t, p);
+
+        vf_store(&s[i], vf_mul(vf_add(p, vf_set1(1.0f)), half));
+    }
+#endif
+    for (; i < n; i++) {
+        s[i] = (sin_fast(omega[i]) + 1.0f) * 0.5f;
+    }
+}
+
+/*
+ * Block formulation of the biquad: every w[n+k], k < 4, and every
+ * y[n+k] is a linear combination of x[n..n+3], w1 and w2. The
+ * combination coefficients are derived once per call.
+ */
+void simd_biquad(float *w1, float *w2, const float a[2], const float b[3],
+                 const int16_t *x, int16_t *y, int L)
+{
+    int i = 0;
+
+#if SIMD_SSE2 || SIMD_NEON
+    /* sources: x0 x1 x2 x3 w1 w2 */
+    float wc[6][6];
+    float cw[6][4], cy[6][4];
+    int k, s;
+
+    memset(wc, 0, sizeof(wc));
+    /* row r holds w[n+r-2] */
+    wc[0][5] = 1.0f;
+    wc[1][4] = 1.0f;
+    for (k = 0; k < 4; k++) {
+        for (s = 0; s < 6; s++) {
+            wc[k+2][s] = (s == k ? 1.0f : 0.0f)
+                - a[0] * wc[k+1][s] - a[1] * wc[k][s];
+        }
+    }
+    for (s = 0; s < 6; s++) {
+        for (k = 0; k < 4; k++) {
+            cw[s][k] = wc[k+2][s];
+            cy[s][k] = b[0] * wc[k+2][s] + b[1] * wc[k+1][s]
+                + b[2] * wc[k][s];
+        }
+    }
+
+#if SIMD_SSE2
+    __m128 vcw[6], vcy[6];
+    for (s = 0; s < 6; s++) {
+        vcw[s] = _mm_loadu_ps(cw[s]);
+        vcy[s] = _mm_loadu_ps(cy[s]);
+    }
+#else
+    float32x4_t vcw[6], vcy[6];
+    for (s = 0; s < 6; s++) {
+        vcw[s] = vld1q_f32(cw[s]);
+        vcy[s] = vld1q_f32(cy[s]);
+    }
+#endif
+
+    for (; i + 4 <= L; i += 4) {
+        float src[6] = {(float)x[i], (float)x[i+1], (float)x[i+2],
+                        (float)x[i+3], *w1, *w2};
+        float wo[4], yo[4];
+
+#if SIMD_SSE2
+        __m128 vw = _mm_setzero_ps();
+        __m128 vy = _mm_setzero_ps();
+        for (s = 0; s < 6; s++) {
+            __m128 v = _mm_set1_ps(src[s]);
+            vw = _mm_add_ps(vw, _mm_mul_ps(v, vcw[s]));
+            vy = _mm_add_ps(vy, _mm_mul_ps(v, vcy[s]));
+        }
+        _mm_storeu_ps(wo, vw);
+        _mm_storeu_ps(yo, vy);
+#else
+        float32x4_t vw = vdupq_n_f32(0.0f);
+        float32x4_t vy = vdupq_n_f32(0.0f);
+        for (s = 0; s < 6; s++) {
+            vw = vmlaq_n_f32(vw, vcw[s], src[s]);
+            vy = vmlaq_n_f32(vy, vcy[s], src[s]);
+        }
+        vst1q_f32(wo, vw);
+        vst1q_f32(yo, vy);
+#endif
+        for (k = 0; k < 4; k++) {
+            y[i+k] = (int16_t)yo[k];
+        }
+        *w2 = wo[2];
+        *w1 = wo[3];
+    }
+#endif
+
+    for (; i < L; i++) {
+        float w0, out;
+
+        w0 = -a[0] * *w1;
+        w0 = w0 - a[1] * *w2;
+        w0 = w0 + (float)x[i];
+        out = b[0] * w0;
+        out = out + b[1] * *w1;
+        y[i] = (int16_t)(out + b[2] * *w2);
+        *w2 = *w1;
+        *w1 = w0;
+    }
+}
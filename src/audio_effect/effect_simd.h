@@ -0,0 +1,51 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVS_SRC_AUDIO_EFFECT_EFFECT_SIMD_H
+#define AVS_SRC_AUDIO_EFFECT_EFFECT_SIMD_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Block kernels shared by the float effects. The instruction set is
+ * picked at compile time (AVX2, SSE2 or NEON) with a scalar fallback.
+ * When disabled with aueffect_set_simd() the effects run their
+ * original per-sample code, which serves as the reference.
+ */
+
+#define SIMD_BLOCK_SZ 256
+
+bool effect_simd_enabled(void);
+
+/* w0 = y + c * rd is stored in wr, and y becomes rd - c * w0 */
+void simd_allpass_span(float *y, const float *rd, float *wr,
+                       float c, size_t n);
+
+/* out = sat16(post_sc * (1/(1+exp(-3x)) - 0.5)), rational tanh approx */
+void simd_soft_clip(const float *x, int16_t *out, float post_sc, size_t n);
+float soft_clip_fast(float x);
+
+/* s[k] = (sin(omega[k]) + 1)/2 */
+void simd_sine_half(const float *omega, float *s, size_t n);
+
+/* Direct form II biquad, four output samples per step */
+void simd_biquad(float *w1, float *w2, const float a[2], const float b[3],
+                 const int16_t *x, int16_t *y, int L);
+
+#endif
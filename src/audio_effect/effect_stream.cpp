@@ -0,0 +1,463 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "effect_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "avs_log.h"
+#ifdef __cplusplus
+}
+#endif
+
+int effect_map_file(struct effect_map *map, const char *path)
+{
+    struct stat st;
+    void *p;
+    int fd;
+    int err = 0;
+
+    if (!map || !path)
+        return EINVAL;
+
+    memset(map, 0, sizeof(*map));
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        error("audio_effect: Could not open %s for reading \n", path);
+        return errno;
+    }
+
+    if (fstat(fd, &st) != 0) {
+        err = errno;
+        goto out;
+    }
+
+    map->len = (size_t)st.st_size;
+    if (map->len == 0)
+        goto out;
+
+    p = mmap(NULL, map->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+        madvise(p, map->len, MADV_SEQUENTIAL);
+#endif
+        map->p = (const uint8_t *)p;
+        map->mapped = true;
+    }
+    else {
+        /* Fall back to one large read */
+        uint8_t *buf = (uint8_t *)malloc(map->len);
+        size_t n = 0;
+
+        if (!buf) {
+            err = ENOMEM;
+            goto out;
+        }
+        while (n < map->len) {
+            ssize_t r = read(fd, buf + n, map->len - n);
+            if (r <= 0)
+                break;
+            n += r;
+        }
+        map->p = buf;
+        map->len = n;
+    }
+
+ out:
+    close(fd);
+
+    return err;
+}
+
+void effect_unmap(struct effect_map *map)
+{
+    if (!map || !map->p)
+        return;
+
+    if (map->mapped)
+        munmap((void *)map->p, map->len);
+    else
+        free((void *)map->p);
+
+    memset(map, 0, sizeof(*map));
+}
+
+int effect_file_write_h(const int16_t *samp, size_t n, void *arg)
+{
+    FILE *out_file = (FILE *)arg;
+
+    if (fwrite(samp, sizeof(int16_t), n, out_file) != n) {
+        error("audio_effect: Cannot write file \n");
+        return EIO;
+    }
+
+    return 0;
+}
+
+struct effect_stream *effect_stream_alloc(void)
+{
+    struct effect_stream *es = new effect_stream();
+
+    es->aue = NULL;
+    es->effect_type = AUDIO_EFFECT_NONE;
+    es->reduce_noise = false;
+    es->fs_hz = 0;
+    es->apm.reset(webrtc::AudioProcessingBuilder().Create());
+
+    return es;
+}
+
+void effect_stream_free(struct effect_stream *es)
+{
+    if (!es)
+        return;
+
+    mem_deref(es->aue);
+    delete es;
+}
+
+int effect_stream_init(struct effect_stream *es,
+                       enum audio_effect effect_type,
+                       int fs_hz,
+                       bool reduce_noise)
+{
+    int L_proc = FS_PROC/100;
+    int err;
+
+    if (!es || fs_hz <= 0)
+        return EINVAL;
+
+    /* Reuse the effect instance when running the same effect again */
+    if (es->aue && es->effect_type == effect_type) {
+        err = aueffect_reset(es->aue, FS_PROC);
+        if (err)
+            return err;
+    }
+    else {
+        es->aue = (struct aueffect *)mem_deref(es->aue);
+        err = aueffect_alloc(&es->aue, effect_type, FS_PROC);
+        if (err) {
+            error("aueffect_alloc failed \n");
+            return err;
+        }
+    }
+
+    es->effect_type = effect_type;
+    es->reduce_noise = reduce_noise;
+    es->fs_hz = fs_hz;
+
+    es->input_resampler.reset(new webrtc::PushResampler<int16_t>);
+    es->input_resampler->InitializeIfNeeded(fs_hz, FS_PROC, 1);
+    es->output_resampler.reset(new webrtc::PushResampler<int16_t>);
+    es->output_resampler->InitializeIfNeeded(FS_PROC, fs_hz, 1);
+
+    // Setup Audio Buffer used by apm
+    es->near_frame.samples_per_channel_ = L_proc;
+    es->near_frame.num_channels_ = 1;
+    es->near_frame.sample_rate_hz_ = FS_PROC;
+
+    // Setup APM
+    webrtc::AudioProcessing::ChannelLayout inLayout = webrtc::AudioProcessing::kMono;
+    webrtc::AudioProcessing::ChannelLayout outLayout = webrtc::AudioProcessing::kMono;
+    webrtc::AudioProcessing::ChannelLayout reverseLayout = webrtc::AudioProcessing::kMono;
+    es->apm->Initialize( FS_PROC, FS_PROC, FS_PROC, inLayout, outLayout, reverseLayout );
+
+    // Enable High Pass Filter
+    webrtc::AudioProcessing::Config apmConfig;
+
+    apmConfig.high_pass_filter.enabled = true;
+    es->apm->ApplyConfig(apmConfig);
+
+    // Enable Noise Supression
+    es->apm->noise_suppression()->Enable(reduce_noise);
+    if(reduce_noise){
+        if(effect_type == AUDIO_EFFECT_VOCODER_MED){
+            es->apm->noise_suppression()->set_level(webrtc::NoiseSuppression::kModerate);
+        } else {
+            es->apm->noise_suppression()->set_level(webrtc::NoiseSuppression::kLow);
+        }
+    }
+
+    return 0;
+}
+
+int effect_stream_length_modification(struct effect_stream *es)
+{
+    int length_modification_q10 = 1024;
+
+    if (!es || !es->aue)
+        return length_modification_q10;
+
+    if(es->effect_type == AUDIO_EFFECT_REVERSE){
+        return 1024 * 2; // We append the original
+    }
+
+    aueffect_length_modification(es->aue, &length_modification_q10);
+
+    return length_modification_q10;
+}
+
+static int stream_flush(struct effect_stream *es)
+{
+    int err = 0;
+
+    if (es->block_n > 0) {
+        err = es->writeh(es->block, es->block_n, es->arg);
+        es->block_n = 0;
+    }
+
+    return err;
+}
+
+static int stream_write(struct effect_stream *es, const int16_t *samp, size_t n)
+{
+    int err = 0;
+
+    if (es->n_target) {
+        n = std::min(n, es->n_target - es->n_written);
+    }
+
+    es->n_written += n;
+
+    while (n > 0) {
+        size_t cnt = std::min(n, (size_t)EFFECT_BLOCK_SZ - es->block_n);
+
+        memcpy(&es->block[es->block_n], samp, cnt * sizeof(int16_t));
+        es->block_n += cnt;
+        samp += cnt;
+        n -= cnt;
+
+        if (es->block_n == EFFECT_BLOCK_SZ) {
+            err = stream_flush(es);
+            if (err)
+                break;
+        }
+    }
+
+    return err;
+}
+
+static int stream_write_zeros(struct effect_stream *es, size_t n)
+{
+    int16_t zeros[256];
+    int err = 0;
+
+    memset(zeros, 0, sizeof(zeros));
+
+    while (n > 0 && !err) {
+        size_t cnt = std::min(n, sizeof(zeros)/sizeof(zeros[0]));
+
+        err = stream_write(es, zeros, cnt);
+        n -= cnt;
+    }
+
+    return err;
+}
+
+static int reverse_stream(struct effect_stream *es,
+                          const int16_t *in,
+                          size_t n_in,
+                          bool pad)
+{
+    size_t L = es->fs_hz/100;
+    size_t N = n_in/L;
+    size_t rem = n_in - N*L;
+    int16_t bufOut[L];
+    int err = 0;
+
+    for(size_t i = N; i > 0 && !err; i--){
+        const int16_t *frame = &in[(i - 1)*L];
+
+        for(size_t j = 0; j < L; j++){
+            bufOut[j] = frame[L - j - 1];
+        }
+        err = stream_write(es, bufOut, L);
+    }
+    if (pad && !err)
+        err = stream_write_zeros(es, rem);
+
+    if (!err)
+        err = stream_write(es, in, N*L);
+    if (pad && !err)
+        err = stream_write_zeros(es, rem);
+
+    return err;
+}
+
+int effect_stream_process(struct effect_stream *es,
+                          const int16_t *in,
+                          size_t n_in,
+                          size_t n_out,
+                          effect_write_h *writeh,
+                          void *arg,
+                          effect_progress_h *progress_h,
+                          void *progress_arg)
+{
+    if (!es || !es->aue || !writeh || (n_in && !in))
+        return EINVAL;
+
+    size_t L = es->fs_hz/100;
+    size_t L_proc = FS_PROC/100;
+    size_t N = n_in/L;
+    int16_t bufOut[L];
+    int16_t procOut[L_proc * EFFECT_MAX_LENGTH_MOD];
+    int err = 0;
+    int ret;
+
+    es->writeh = writeh;
+    es->arg = arg;
+    es->n_written = 0;
+    es->n_target = n_out;
+    es->n_processed = n_in;
+    es->block_n = 0;
+    es->write_idx = 0;
+    es->read_idx = 0;
+
+    if(es->effect_type == AUDIO_EFFECT_REVERSE){
+        /* Special handling for reverse effect */
+        err = reverse_stream(es, in, n_in, n_out != 0);
+        goto out;
+    }
+
+    for(size_t i = 0; i < N; i++){
+        if((i % 100) == 0){
+            int progress = (int)((i*100)/N);
+            if(progress_h){
+                progress_h(progress, progress_arg);
+            }
+        }
+
+        es->input_resampler->Resample(&in[i*L], L, es->near_frame.mutable_data(), L_proc);
+
+        ret = es->apm->ProcessStream(&es->near_frame);
+        if( ret < 0 ){
+            error("apm->ProcessStream returned %d \n", ret);
+        }
+
+        size_t L_proc_out;
+        aueffect_process(es->aue, es->near_frame.data(), procOut, L_proc, &L_proc_out);
+
+        for(size_t j = 0; j < L_proc_out; j++){
+            es->circ_buf[es->write_idx] = procOut[j];
+            es->write_idx = (es->write_idx + 1) & CIRC_BUF_MASK;
+        }
+        // resampler needs 10 ms chunks
+        int buf_smpls = (es->write_idx - es->read_idx) & CIRC_BUF_MASK;
+        while(buf_smpls >= (int)L_proc){
+            for(size_t j = 0; j < L_proc; j++){
+                procOut[j] = es->circ_buf[es->read_idx];
+                es->read_idx = (es->read_idx + 1) & CIRC_BUF_MASK;
+            }
+            es->output_resampler->Resample( procOut, L_proc, bufOut, L);
+
+            err = stream_write(es, bufOut, L);
+            if (err)
+                goto out;
+
+            buf_smpls = (es->write_idx - es->read_idx) & CIRC_BUF_MASK;
+        }
+        if(n_out && n_out - es->n_written < L*2){
+            break;
+        }
+    }
+
+    if (n_out && es->n_written < n_out)
+        err = stream_write_zeros(es, n_out - es->n_written);
+
+ out:
+    if (!err)
+        err = stream_flush(es);
+
+    if(progress_h){
+        progress_h(100, progress_arg);
+    }
+
+    return err;
+}
+
+struct buffer_sink {
+    int16_t *samp;
+    size_t n;
+};
+
+static int buffer_write_h(const int16_t *samp, size_t n, void *arg)
+{
+    struct buffer_sink *sink = (struct buffer_sink *)arg;
+
+    memcpy(&sink->samp[sink->n], samp, n * sizeof(int16_t));
+    sink->n += n;
+
+    return 0;
+}
+
+int apply_effect_to_buffer(const int16_t *sampin,
+                           size_t n_sampin,
+                           int fs_hz,
+                           int16_t **sampoutp,
+                           size_t *n_sampoutp,
+                           enum audio_effect effect_type,
+                           bool reduce_noise,
+                           effect_progress_h *progress_h,
+                           void *arg)
+{
+    struct effect_stream *es;
+    struct buffer_sink sink = {NULL, 0};
+    size_t n_out;
+    int err;
+
+    if (!sampin || !sampoutp || !n_sampoutp)
+        return EINVAL;
+
+    es = effect_stream_alloc();
+    err = effect_stream_init(es, effect_type, fs_hz, reduce_noise);
+    if (err)
+        goto out;
+
+    /* The stream writes exactly n_out samples */
+    n_out = ((int64_t)n_sampin * effect_stream_length_modification(es)) >> 10;
+
+    sink.samp = (int16_t *)mem_alloc(std::max(n_out, (size_t)1) * sizeof(int16_t), NULL);
+    if (!sink.samp) {
+        err = ENOMEM;
+        goto out;
+    }
+
+    err = effect_stream_process(es, sampin, n_sampin, n_out,
+                                buffer_write_h, &sink, progress_h, arg);
+    if (err)
+        goto out;
+
+    *sampoutp = sink.samp;
+    *n_sampoutp = sink.n;
+    sink.samp = NULL;
+
+ out:
+    mem_deref(sink.samp);
+    effect_stream_free(es);
+
+    return err;
+}
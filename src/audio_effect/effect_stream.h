@@ -0,0 +1,133 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVS_SRC_AUDIO_EFFECT_EFFECT_STREAM_H
+#define AVS_SRC_AUDIO_EFFECT_EFFECT_STREAM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <memory>
+
+#include "avs_audio_effect.h"
+
+#include "common_audio/resampler/include/push_resampler.h"
+#include "modules/audio_processing/include/audio_processing.h"
+#include "modules/include/module_common_types.h"
+#include "api/audio/audio_frame.h"
+
+#define FS_PROC 32000
+
+#define LOG2_CIRC_BUF_SZ 14
+#define CIRC_BUF_SZ (1 << LOG2_CIRC_BUF_SZ)
+#define CIRC_BUF_MASK (CIRC_BUF_SZ - 1)
+
+/* Largest output/input ratio of any effect (pace down max is 1.8) */
+#define EFFECT_MAX_LENGTH_MOD 2
+
+/* Output is handed to the writer in blocks of this many samples */
+#define EFFECT_BLOCK_SZ 32768
+
+typedef int (effect_write_h)(const int16_t *samp, size_t n, void *arg);
+
+/*
+ * Frame based effect pipeline: 10ms frames are resampled to FS_PROC,
+ * run through APM and the effect, resampled back and written in
+ * EFFECT_BLOCK_SZ blocks.
+ */
+struct effect_stream {
+    struct aueffect *aue;
+    enum audio_effect effect_type;
+    bool reduce_noise;
+    int fs_hz;
+
+    /* Recreated per run, PushResampler keeps its filter history */
+    std::unique_ptr<webrtc::PushResampler<int16_t>> input_resampler;
+    std::unique_ptr<webrtc::PushResampler<int16_t>> output_resampler;
+    std::unique_ptr<webrtc::AudioProcessing> apm;
+    webrtc::AudioFrame near_frame;
+
+    int16_t circ_buf[CIRC_BUF_SZ];
+    int write_idx;
+    int read_idx;
+
+    int16_t block[EFFECT_BLOCK_SZ];
+    size_t block_n;
+
+    effect_write_h *writeh;
+    void *arg;
+    size_t n_written;
+    size_t n_target;
+    size_t n_processed;  /* input samples of the last run */
+};
+
+/* Read-only view of an input file, memory mapped when possible */
+struct effect_map {
+    const uint8_t *p;
+    size_t len;
+    bool mapped;
+};
+
+int effect_map_file(struct effect_map *map, const char *path);
+void effect_unmap(struct effect_map *map);
+
+/* Output sink writing whole blocks to a stdio file */
+int effect_file_write_h(const int16_t *samp, size_t n, void *arg);
+
+struct effect_stream *effect_stream_alloc(void);
+void effect_stream_free(struct effect_stream *es);
+
+int effect_stream_init(struct effect_stream *es,
+                       enum audio_effect effect_type,
+                       int fs_hz,
+                       bool reduce_noise);
+
+int effect_stream_length_modification(struct effect_stream *es);
+
+/*
+ * Process n_in samples. If n_out is non-zero the output is truncated
+ * or zero padded to exactly n_out samples, otherwise only the frames
+ * produced are written.
+ */
+int effect_stream_process(struct effect_stream *es,
+                          const int16_t *in,
+                          size_t n_in,
+                          size_t n_out,
+                          effect_write_h *writeh,
+                          void *arg,
+                          effect_progress_h *progress_h,
+                          void *progress_arg);
+
+/* File front ends, processing with a caller owned stream */
+int effect_stream_wav(struct effect_stream *es,
+                      const char* wavIn,
+                      const char* wavOut,
+                      enum audio_effect effect_type,
+                      bool reduce_noise,
+                      effect_progress_h* progress_h,
+                      void *arg);
+
+int effect_stream_pcm(struct effect_stream *es,
+                      const char* pcmIn,
+                      const char* pcmOut,
+                      int fs_hz,
+                      enum audio_effect effect_type,
+                      bool reduce_noise,
+                      effect_progress_h* progress_h,
+                      void *arg);
+
+#endif
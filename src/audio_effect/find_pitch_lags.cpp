@@ -46,13 +46,42 @@ void init_find_pitch_lags(struct pitch_estimator *pest, int fs_hz, int complexit
     }
 }
 
+void reset_find_pitch_lags(struct pitch_estimator *pest)
+{
+    memset(pest->buf, 0, sizeof(pest->buf));
+    memset(pest->pitchL, 0, sizeof(pest->pitchL));
+    pest->LTPCorr_Q15 = 0;
+    pest->voiced = false;
+
+    reset_resampler(&pest->resampler, pest->fs_khz*1000, 16000);
+}
+
+void reset_resampler(webrtc::PushResampler<int16_t> **rsp, int src_hz, int dst_hz)
+{
+    delete *rsp;
+    *rsp = new webrtc::PushResampler<int16_t>;
+    (*rsp)->InitializeIfNeeded(src_hz, dst_hz, 1);
+}
+
 void free_find_pitch_lags(struct pitch_estimator *pest)
 {
     delete pest->resampler;
 }
 
+void share_pitch_lags(struct pitch_estimator *pest, const struct pitch_estimator *shared)
+{
+    pest->shared = shared != pest ? shared : NULL;
+}
+
 void find_pitch_lags(struct pitch_estimator *pest, int16_t x[], int L)
 {
+    if(pest->shared){
+        memcpy(pest->pitchL, pest->shared->pitchL, sizeof(pest->pitchL));
+        pest->LTPCorr_Q15 = pest->shared->LTPCorr_Q15;
+        pest->voiced = pest->shared->voiced;
+        return;
+    }
+
 #if !defined(WEBRTC_ARCH_ARM)
     silk_float thrhld, res_nrg;
     silk_float auto_corr[ Z_LPC_ORDER + 1 ];
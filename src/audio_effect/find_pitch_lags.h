@@ -46,11 +46,22 @@ struct pitch_estimator {
     int fs_khz;
     int complexity;
     bool voiced;
+    /* When set, results are copied from this estimator instead of
+     * being computed. It must have analysed the same frame first.
+     */
+    const struct pitch_estimator *shared;
 };
 
 void init_find_pitch_lags(struct pitch_estimator *pest, int fs_hz, int complexity);
+void reset_find_pitch_lags(struct pitch_estimator *pest);
 void free_find_pitch_lags(struct pitch_estimator *pest);
 
+/* PushResampler cannot clear its filter history, so this swaps in a
+ * fresh one at the given rates.
+ */
+void reset_resampler(webrtc::PushResampler<int16_t> **rsp, int src_hz, int dst_hz);
+
 void find_pitch_lags(struct pitch_estimator *pest, int16_t x[], int L);
+void share_pitch_lags(struct pitch_estimator *pest, const struct pitch_estimator *shared);
 
 #endif
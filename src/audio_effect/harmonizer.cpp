@@ -134,6 +134,35 @@ void free_harmonizer(void *st)
     free(he);
 }
 
+void reset_harmonizer(void *st, int fs_hz)
+{
+    struct harmonizer_effect *he = (struct harmonizer_effect*)st;
+    
+    reset_resampler(&he->resampler, fs_hz, fs_hz * HMZ_UP_FAC);
+    reset_find_pitch_lags(&he->pest);
+    
+    for(int i = 0; i < HMZ_NUM_CHANNELS; i++){
+        time_scale_reset(&he->hm_ch[i].tscale);
+        he->hm_ch[i].read_idx = he->fs_khz * HMZ_EXTRA_BUF_MS * HMZ_UP_FAC;
+        he->hm_ch[i].comp_smth = 1.0f;
+    }
+    
+    memset(he->lp_filt, 0, sizeof(he->lp_filt));
+    memset(he->buf, 0, sizeof(he->buf));
+    memset(he->pL_buf, 0, sizeof(he->pL_buf));
+    he->pL_smth = 0.0f;
+    he->read_idx_ch1 = 0.0f;
+    he->comp_smth = 0.0f;
+    he->prev_idx = -1;
+}
+
+void harmonizer_share_pitch(void *st, const struct pitch_estimator *pest)
+{
+    struct harmonizer_effect *he = (struct harmonizer_effect*)st;
+
+    share_pitch_lags(&he->pest, pest);
+}
+
 static void find_min_max_pitch(struct harmonizer_effect *he, int *min_pL, int *max_pL, int ch)
 {
     int pitchL;
@@ -4,6 +4,7 @@
 
 AVS_SRCS += \
 	audio_effect/aueffect.c \
+	audio_effect/aueffect_chain.cpp \
 	audio_effect/chorus.cpp \
 	audio_effect/reverb.cpp \
 	audio_effect/pitch_shift.cpp \
@@ -17,5 +18,8 @@ AVS_SRCS += \
 	audio_effect/find_pitch_lags.cpp \
 	audio_effect/time_scale.cpp \
 	audio_effect/biquad.cpp \
+	audio_effect/effect_simd.cpp \
+	audio_effect/effect_stream.cpp \
+	audio_effect/effect_batch.cpp \
 	audio_effect/wav_interface.cpp \
 	audio_effect/pcm_interface.cpp
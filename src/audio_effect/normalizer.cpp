@@ -18,6 +18,7 @@
 
 #include <re.h>
 #include "normalizer.h"
+#include "find_pitch_lags.h"
 #include "avs_audio_effect.h"
 #include <math.h>
 #include <cstdlib>
@@ -61,7 +62,7 @@ void reset_normalizer(void *st, int fs_hz)
     
     ne->fs_khz = fs_hz/1000;
     
-    ne->resampler->InitializeIfNeeded(fs_hz, NE_VAD_FS_KHZ*1000, 1);
+    reset_resampler(&ne->resampler, fs_hz, NE_VAD_FS_KHZ*1000);
     
     silk_VAD_Init(&ne->silk_enc.sVAD);
     
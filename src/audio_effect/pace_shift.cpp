@@ -86,6 +86,22 @@ void free_pace_shift(void *st)
     free(pse);
 }
 
+void reset_pace_shift(void *st, int fs_hz)
+{
+    struct pace_shift_effect *pse = (struct pace_shift_effect*)st;
+    
+    reset_find_pitch_lags(&pse->pest);
+    time_scale_reset(&pse->tscale);
+    pse->cnt = 0;
+}
+
+void pace_shift_share_pitch(void *st, const struct pitch_estimator *pest)
+{
+    struct pace_shift_effect *pse = (struct pace_shift_effect*)st;
+
+    share_pitch_lags(&pse->pest, pest);
+}
+
 void pace_shift_length_factor(void *st, int *length_mod_Q10){
     struct pace_shift_effect *pse = (struct pace_shift_effect*)st;
     
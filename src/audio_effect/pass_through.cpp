@@ -41,6 +41,11 @@ void free_pass_through(void *st)
     return;
 }
 
+void reset_pass_through(void *st, int fs_hz)
+{
+    return;
+}
+
 void pass_through_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out)
 {
     for(int i = 0; i < L_in; i++){
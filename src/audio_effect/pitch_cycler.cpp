@@ -76,6 +76,28 @@ void free_pitch_cycler(void *st)
     free(pce);
 }
 
+void reset_pitch_cycler(void *st, int fs_hz)
+{
+    struct pitch_cycler_effect *pce = (struct pitch_cycler_effect*)st;
+    
+    reset_resampler(&pce->resampler, fs_hz, fs_hz * PCE_UP_FAC * PCE_EXTRA_UP);
+    reset_resampler(&pce->resampler_out, fs_hz * PCE_EXTRA_UP, fs_hz);
+    reset_find_pitch_lags(&pce->pest);
+    time_scale_reset(&pce->tscale);
+    
+    memset(pce->buf, 0, sizeof(pce->buf));
+    pce->read_idx = pce->fs_khz * PCE_EXTRA_BUF_MS * PCE_UP_FAC * PCE_EXTRA_UP;
+    pce->comp = 1.5;
+    pce->used_comp_delta = pce->comp_delta;
+}
+
+void pitch_cycler_share_pitch(void *st, const struct pitch_estimator *pest)
+{
+    struct pitch_cycler_effect *pce = (struct pitch_cycler_effect*)st;
+
+    share_pitch_lags(&pce->pest, pest);
+}
+
 static void find_min_max_pitch(struct pitch_cycler_effect *pce, int *min_pL, int *max_pL)
 {
     int pitchL;
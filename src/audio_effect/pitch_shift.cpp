@@ -110,6 +110,30 @@ void free_pitch_shift(void *st)
     free(pse);
 }
 
+void reset_pitch_shift(void *st, int fs_hz)
+{
+    struct pitch_shift_effect *pse = (struct pitch_shift_effect*)st;
+    
+    reset_resampler(&pse->resampler, fs_hz, (fs_hz*pse->up)/pse->down);
+    reset_find_pitch_lags(&pse->pest);
+    time_scale_reset(&pse->tscale);
+    pse->cnt = 0;
+}
+
+void pitch_shift_share_pitch(void *st, const struct pitch_estimator *pest)
+{
+    struct pitch_shift_effect *pse = (struct pitch_shift_effect*)st;
+
+    share_pitch_lags(&pse->pest, pest);
+}
+
+const struct pitch_estimator *pitch_shift_estimator(void *st)
+{
+    struct pitch_shift_effect *pse = (struct pitch_shift_effect*)st;
+
+    return &pse->pest;
+}
+
 static void find_min_max_pitch(struct pitch_shift_effect *pse, int *min_pL, int *max_pL)
 {
     int pitchL;
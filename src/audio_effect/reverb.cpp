@@ -18,8 +18,10 @@
 
 #include <re.h>
 #include "reverb.h"
+#include "effect_simd.h"
 #include "avs_audio_effect.h"
 #include <math.h>
+#include <algorithm>
 
 #ifdef __cplusplus
 extern "C" {
@@ -172,6 +174,21 @@ void free_reverb(void *st)
     free(rvb);
 }
 
+void reset_reverb(void *st, int fs_hz)
+{
+    struct reverb_effect *rvb = (struct reverb_effect*)st;
+    
+    for(int i = 0; i < MAX_NUM_AR; i++){
+        memset(rvb->ar[i].state, 0, sizeof(rvb->ar[i].state));
+        rvb->ar[i].vd = 0.0f;
+        rvb->ar[i].idx = 0;
+    }
+    for(int i = 0; i < MAX_NUM_AP; i++){
+        memset(rvb->ap[i].state, 0, sizeof(rvb->ap[i].state));
+        rvb->ap[i].idx = 0;
+    }
+}
+
 static float compress(float x)
 {
     float y = 1/(exp(-3*x)+1.0f);
@@ -180,10 +197,67 @@ static float compress(float x)
     return y;
 }
 
+/*
+ * Each allpass stage only reads its delay line d samples back, so a
+ * block of up to d samples can run through one stage at a time.
+ */
+static void allpass_d_block(struct ap_d *ap, float y[], size_t n)
+{
+    size_t k = 0;
+
+    while (k < n) {
+        int rd = (ap->idx - ap->d) & MASK;
+        size_t cnt = n - k;
+
+        cnt = std::min(cnt, (size_t)(MAX_D - rd));
+        cnt = std::min(cnt, (size_t)(MAX_D - ap->idx));
+
+        simd_allpass_span(&y[k], &ap->state[rd], &ap->state[ap->idx],
+                          ap->c, cnt);
+
+        ap->idx = (ap->idx + (int)cnt) & MASK;
+        k += cnt;
+    }
+}
+
+static void reverb_process_block(struct reverb_effect *rvb, int16_t in[], int16_t out[], size_t L_in)
+{
+    float x[SIMD_BLOCK_SZ], y[SIMD_BLOCK_SZ];
+    size_t blk = SIMD_BLOCK_SZ;
+
+    for(int i = 0; i < NUM_AP; i++){
+        blk = std::min(blk, (size_t)rvb->ap[i].d);
+    }
+
+    for(size_t pos = 0; pos < L_in; pos += blk){
+        size_t n = std::min(blk, L_in - pos);
+
+        for(size_t j = 0; j < n; j++){
+            x[j] = (float)in[pos + j] * rvb->pre_sc;
+            y[j] = x[j];
+        }
+        for(int i = 0; i < NUM_AP; i++){
+            allpass_d_block(&rvb->ap[i], y, n);
+        }
+        for(size_t j = 0; j < n; j++){
+            y[j] = 0.7f*y[j] + x[j];
+        }
+        simd_soft_clip(y, &out[pos], rvb->post_sc, n);
+    }
+}
+
 void reverb_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out)
 {
     float x, y, tmp, sc = 1.0f / 32767.0f;
     struct reverb_effect *rvb = (struct reverb_effect*)st;
+
+#if NUM_AR == 0
+    if (effect_simd_enabled()) {
+        reverb_process_block(rvb, in, out, L_in);
+        *L_out = L_in;
+        return;
+    }
+#endif
     
     for( size_t i = 0; i < L_in; i++){
         x = (float)in[i];
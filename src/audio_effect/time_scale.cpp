@@ -123,6 +123,16 @@ void time_scale_init(struct time_scale* ts, int fs_in_hz, int fs_out_hz)
     ts->nc_bufsz_fac = 0.015f / (float)ts->fs_out_khz;
 }
 
+void time_scale_reset(struct time_scale* ts)
+{
+    memset(ts->buf, 0, sizeof(ts->buf));
+    ts->read_idx = 0;
+    ts->write_idx = 0;
+    ts->maxL = 0;
+    ts->minL = 0;
+    ts->voiced = false;
+}
+
 void time_scale_insert(struct time_scale* ts,
                        int16_t in[],
                        int N,
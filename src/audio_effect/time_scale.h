@@ -45,6 +45,7 @@ struct time_scale {
 };
 
 void time_scale_init(struct time_scale* ts, int fs_in_hz, int fs_out_hz);
+void time_scale_reset(struct time_scale* ts);
 
 void time_scale_insert(struct time_scale* ts,
                        int16_t in[],
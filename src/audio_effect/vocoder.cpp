@@ -81,6 +81,34 @@ void free_vocoder(void *st)
     free(ve);
 }
 
+void reset_vocoder(void *st, int fs_hz)
+{
+    struct vocoder_effect *ve = (struct vocoder_effect*)st;
+    
+    reset_resampler(&ve->resampler_in, fs_hz, PROC_FS_KHZ*1000);
+    reset_resampler(&ve->resampler_out, PROC_FS_KHZ*1000, fs_hz);
+    reset_find_pitch_lags(&ve->pest);
+    
+    memset(ve->lpc_synth_state, 0, sizeof(ve->lpc_synth_state));
+    memset(ve->rest.buf, 0, sizeof(ve->rest.buf));
+    memset(ve->buf, 0, sizeof(ve->buf));
+    memset(ve->pL_buf, 0, sizeof(ve->pL_buf));
+    ve->cnt = 0;
+    ve->samples_since_pulse = 0;
+    ve->mix_smth = 0.0f;
+    
+    ve->e_min_track = E_MIN;
+    ve->e_max_track = E_MIN + 10;
+    ve->pitch_period = 84;
+}
+
+void vocoder_share_pitch(void *st, const struct pitch_estimator *pest)
+{
+    struct vocoder_effect *ve = (struct vocoder_effect*)st;
+
+    share_pitch_lags(&ve->pest, pest);
+}
+
 static float compress(float x)
 {
     float xf = x * 3.0518e-05;
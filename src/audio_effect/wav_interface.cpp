@@ -17,12 +17,9 @@
 */
 
 #include <re.h>
+#include <algorithm>
 #include "avs_audio_effect.h"
-
-#include "common_audio/resampler/include/push_resampler.h"
-#include "modules/audio_processing/include/audio_processing.h"
-#include "modules/include/module_common_types.h"
-#include "api/audio/audio_frame.h"
+#include "effect_stream.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -32,19 +29,9 @@ extern "C" {
 }
 #endif
 
-#define LOG2_CIRC_BUF_SZ 14
-#define CIRC_BUF_MASK ((1 << LOG2_CIRC_BUF_SZ) -1)
-
-struct wav_format {
-    uint16_t audio_format;
-    uint16_t num_channels;
-    uint32_t sample_rate;
-    int32_t num_samples_in;
-    int32_t num_samples_out;
-    int32_t byte_rate;
-    uint16_t block_align;
-    uint16_t bits_per_sample;
-};
+#define WAV_RIFF_HDR_SZ  12
+#define WAV_CHUNK_HDR_SZ 8
+#define WAV_FMT_SZ       16
 
 static int wav_format_debug(struct re_printf *pf, void *arg)
 {
@@ -67,412 +54,270 @@ static int wav_format_debug(struct re_printf *pf, void *arg)
 }
 
 
-static int wav_converter_init(FILE *in_file, FILE *out_file, struct wav_format *format, int length_modification_q10)
+static uint32_t wav_u32(const uint8_t *p)
 {
-    char chunkID[5] = "";
-    if(fread(chunkID, sizeof(chunkID)-1, 1, in_file) != 1){
-        error("audio_effect: Cannot read file \n");
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint16_t wav_u16(const uint8_t *p)
+{
+    uint16_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static int wav_check_riff(const uint8_t *p)
+{
+    if (memcmp(p, "RIFF", 4) != 0) {
+        error("audio_effect: chunkID = %b expected RIFF \n", p, (size_t)4);
         return -1;
     }
-    chunkID[4] = '\0';
-    if(strcmp(chunkID,"RIFF")!=0){
-        error("audio_effect: chumkID = %s expected RIFF \n", chunkID);
+    if (memcmp(p + 8, "WAVE", 4) != 0) {
+        error("audio_effect: Format = %b expected WAVE \n", p + 8, (size_t)4);
         return -1;
     }
 
-    if(fwrite(chunkID, sizeof(chunkID)-1, 1, out_file) != 1){
-        error("audio_effect: Cannot write file \n");
-        return -1;
-    }
-    uint32_t ChunkSize;
-    if(fread(&ChunkSize, sizeof(uint32_t), 1, in_file) != 1){
-        error("audio_effect: Cannot read file \n");
-        return -1;
-    };
+    return 0;
+}
 
-    if(fwrite(&ChunkSize, sizeof(uint32_t), 1, out_file) != 1){
-        error("audio_effect: Cannot write file \n");
-        return -1;
-    };
-    char Format[5] = "";
-    if(fread(Format, sizeof(Format)-1, 1, in_file) != 1){
+static void wav_parse_fmt(const uint8_t *p, struct wav_format *format)
+{
+    format->audio_format = wav_u16(p);
+    format->num_channels = wav_u16(p + 2);
+    format->sample_rate = wav_u32(p + 4);
+    format->byte_rate = wav_u32(p + 8);
+    format->block_align = wav_u16(p + 12);
+    format->bits_per_sample = wav_u16(p + 14);
+}
+
+/*
+ * Walk the chunks of an in-memory WAV file, chunks other than
+ * fmt and data are skipped without being touched.
+ */
+static int wav_parse(const uint8_t *buf, size_t len,
+                     struct wav_format *format, size_t *data_offp)
+{
+    size_t pos = WAV_RIFF_HDR_SZ;
+    bool have_fmt = false;
+
+    if (len < WAV_RIFF_HDR_SZ) {
         error("audio_effect: Cannot read file \n");
         return -1;
     }
-    Format[4] = '\0';
-    if(strcmp(Format,"WAVE")!=0){
-        error("audio_effect: Format = %s expected WAVE \n", Format);
+    if (wav_check_riff(buf))
         return -1;
-    }
 
-    if(fwrite(Format, sizeof(Format)-1, 1, out_file) != 1){
-        error("audio_effect: Cannot write file \n");
-        return -1;
-    }
+    memset(format, 0, sizeof(*format));
 
+    while (pos + WAV_CHUNK_HDR_SZ <= len) {
+        const uint8_t *chunk = buf + pos;
+        uint32_t sz = wav_u32(chunk + 4);
 
-    /* Search for fmt chunk */
-    for(;;) {
-	    char Subchunk1ID[5] = "";
-	    if(fread(Subchunk1ID, sizeof(Subchunk1ID)-1, 1, in_file) != 1){
-		    error("audio_effect: Cannot read file \n");
-		    return -1;
-	    };
-	    Subchunk1ID[4] = '\0';
-    
-	    if(fwrite(Subchunk1ID, sizeof(Subchunk1ID)-1, 1, out_file) != 1){
-		    error("audio_effect: Cannot write file \n");
-		    return -1;
-	    }
-	    uint32_t Subchunk1Size;
-	    if(fread(&Subchunk1Size, sizeof(uint32_t), 1, in_file) != 1){
-		    error("audio_effect: Cannot read file \n");
-		    return -1;
-	    }
-
-	    if(fwrite(&Subchunk1Size, sizeof(uint32_t), 1, out_file) != 1){    
-		    error("audio_effect: Cannot write file \n");
-		    return -1;
-	    }
-
-	    if (strcmp(Subchunk1ID, "fmt ") == 0) {
-		    break;
-	    }
-	    for(uint32_t i = 0; i < Subchunk1Size; ++i) {
-		    char tmp;
-		    fread(&tmp, sizeof(char), 1, in_file);
-		    fwrite(&tmp, sizeof(char), 1, out_file);
-	    }
-    }
+        pos += WAV_CHUNK_HDR_SZ;
 
-    
-    if(fread(&format->audio_format, sizeof(uint16_t), 1, in_file) != 1){
-        error("audio_effect: Cannot read file \n");
-        return -1;
-    }
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (sz < WAV_FMT_SZ || pos + WAV_FMT_SZ > len)
+                break;
+            wav_parse_fmt(buf + pos, format);
+            have_fmt = true;
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_fmt || format->block_align == 0)
+                break;
 
-    if(fwrite(&format->audio_format, sizeof(uint16_t), 1, out_file) != 1){
-        error("audio_effect: Cannot write file \n");
-        return -1;
-    }
-    if(fread(&format->num_channels, sizeof(uint16_t), 1, in_file) != 1){
-        error("audio_effect: Cannot read file \n");
-        return -1;
-    }
-    if(fwrite(&format->num_channels, sizeof(uint16_t), 1, out_file) != 1){
-        error("audio_effect: Cannot write file \n");
-        return -1;
-    }
-    if(fread(&format->sample_rate, sizeof(uint32_t), 1, in_file) != 1){
-        error("audio_effect: Cannot read file \n");
-        return -1;
-    }
-    if(fwrite(&format->sample_rate, sizeof(uint32_t), 1, out_file) != 1){
-        error("audio_effect: Cannot write file \n");
-        return -1;
-    }
-    if(fread(&format->byte_rate, sizeof(uint32_t), 1, in_file) != 1){
-        error("audio_effect: Cannot read file \n");
-        return -1;
-    }
-    if(fwrite(&format->byte_rate, sizeof(uint32_t), 1, out_file) != 1){
-        error("audio_effect: Cannot write file \n");
-        return -1;
-    }
-    if(fread(&format->block_align, sizeof(uint16_t), 1, in_file) != 1){
-        error("audio_effect: Cannot read file \n");
-        return -1;
-    }
-    if(fwrite(&format->block_align, sizeof(uint16_t), 1, out_file) != 1){
-        error("audio_effect: Cannot write file \n");
-        return -1;
+            sz = (uint32_t)std::min((size_t)sz, len - pos);
+            format->num_samples_in = sz/format->block_align;
+            *data_offp = pos;
+            return 0;
+        }
+
+        pos += sz + (sz & 1);
     }
-    if(fread(&format->bits_per_sample, sizeof(uint16_t), 1, in_file) != 1){
+
+    error("audio_effect: no fmt/data chunk found \n");
+    return -1;
+}
+
+int wav_read_header(FILE *in_file, struct wav_format *format)
+{
+    uint8_t hdr[WAV_RIFF_HDR_SZ];
+    uint8_t fmt[WAV_FMT_SZ];
+    bool have_fmt = false;
+
+    if (!in_file || !format)
+        return EINVAL;
+
+    if (fread(hdr, sizeof(hdr), 1, in_file) != 1) {
         error("audio_effect: Cannot read file \n");
         return -1;
     }
-    if(fwrite(&format->bits_per_sample, sizeof(uint16_t), 1, out_file) != 1){
-        error("audio_effect: Cannot write file \n");
+    if (wav_check_riff(hdr))
         return -1;
-    }
-    
-    char Subchunk2ID[5] = "";
-    uint32_t Subchunk2Size;
-    format->num_samples_in = 0;
-    format->num_samples_out = 0;
-    while(1){
-        if(fread(Subchunk2ID, sizeof(Subchunk2ID)-1, 1, in_file) != 1){
-            error("audio_effect: Cannot read file \n");
-            return -1;
-        }
-        if(fwrite(Subchunk2ID, sizeof(Subchunk2ID)-1, 1, out_file) != 1){
-            error("audio_effect: Cannot write file \n");
-            return -1;
-        }
-        
-        if(fread(&Subchunk2Size, sizeof(uint32_t), 1, in_file) != 1){
+
+    memset(format, 0, sizeof(*format));
+
+    for(;;) {
+        uint8_t chunk[WAV_CHUNK_HDR_SZ];
+        uint32_t sz;
+
+        if (fread(chunk, sizeof(chunk), 1, in_file) != 1) {
             error("audio_effect: Cannot read file \n");
             return -1;
         }
+        sz = wav_u32(chunk + 4);
 
-	Subchunk2ID[4] = '\0';
-        if(strcmp(Subchunk2ID,"data")==0){
-            format->num_samples_in = Subchunk2Size/format->block_align;
-            int64_t tmp = (int64_t)format->num_samples_in * (int64_t)length_modification_q10;
-            tmp = tmp >> 10;
-            format->num_samples_out = tmp;
-            uint32_t new_Subchunk2Size = format->num_samples_out * format->block_align;
-            if(fwrite(&new_Subchunk2Size, sizeof(uint32_t), 1, out_file) != 1){
-                error("audio_effect: Cannot write file \n");
+        if (memcmp(chunk, "fmt ", 4) == 0 && sz >= WAV_FMT_SZ) {
+            if (fread(fmt, sizeof(fmt), 1, in_file) != 1) {
+                error("audio_effect: Cannot read file \n");
                 return -1;
             }
-            break;
-        } else {
-            char tmp;
-            if(fwrite(&Subchunk2Size, sizeof(uint32_t), 1, out_file) != 1){
-                error("audio_effect: Cannot write file \n");
+            wav_parse_fmt(fmt, format);
+            have_fmt = true;
+            sz -= WAV_FMT_SZ;
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_fmt || format->block_align == 0)
                 return -1;
-            }
-            for(int i = 0; i < Subchunk2Size; i++){
-                fread(&tmp, sizeof(char), 1, in_file);
-                fwrite(&tmp, sizeof(char), 1, out_file);
-            }
+
+            format->num_samples_in = sz/format->block_align;
+            format->num_samples_out = format->num_samples_in;
+            return 0;
         }
+
+        if (fseek(in_file, sz + (sz & 1), SEEK_CUR) != 0)
+            return -1;
     }
-    return 0;
 }
 
-#define FS_PROC 32000
-
-static void reverse_stream(FILE *in_file,
-                      FILE *out_file,
-                      struct wav_format *format)
+int wav_write_header(FILE *out_file, const struct wav_format *format)
 {
-    
-    int L = format->sample_rate/100;
-    int L_proc = FS_PROC/100;
-    int N = format->num_samples_in/L;
-    int progress = 0;
-    int rem = format->num_samples_in - N*L;
-    int16_t bufIn[L], bufOut[L];
-    FILE *tmp_file = in_file;
-    
-    size_t count;
-    fseek(in_file, format->num_samples_in*sizeof(int16_t), SEEK_CUR);
-    for( int i = 0; i < N; i++){
-        fseek(in_file, -L*sizeof(int16_t), SEEK_CUR);
-        
-        count = fread(bufIn, sizeof(int16_t), L, in_file);
-
-        for( int j = 0; j < L; j++){
-            bufOut[j] = bufIn[L - j - 1];
-        }
-        
-        count = fwrite(bufOut, sizeof(int16_t), L, out_file);
-        
-        fseek(in_file, -L*sizeof(int16_t), SEEK_CUR);
-    }
-    
-    memset(bufIn, 0, rem*sizeof(int16_t));
-
-    count = fwrite(bufIn, sizeof(int16_t), rem, out_file);
-    
-    for( int i = 0; i < N; i++){
-        count = fread(bufIn, sizeof(int16_t), L, tmp_file);        
-        count = fwrite(bufIn, sizeof(int16_t), L, out_file);        
+    uint32_t data_size;
+    uint32_t chunk_size;
+    uint32_t fmt_size = 16;
+    uint32_t byte_rate;
+
+    if (!out_file || !format)
+        return EINVAL;
+
+    data_size = format->num_samples_out * format->block_align;
+    chunk_size = 36 + data_size;
+    byte_rate = format->sample_rate * format->block_align;
+
+    if (fwrite("RIFF", 4, 1, out_file) != 1 ||
+        fwrite(&chunk_size, sizeof(uint32_t), 1, out_file) != 1 ||
+        fwrite("WAVEfmt ", 8, 1, out_file) != 1 ||
+        fwrite(&fmt_size, sizeof(uint32_t), 1, out_file) != 1 ||
+        fwrite(&format->audio_format, sizeof(uint16_t), 1, out_file) != 1 ||
+        fwrite(&format->num_channels, sizeof(uint16_t), 1, out_file) != 1 ||
+        fwrite(&format->sample_rate, sizeof(uint32_t), 1, out_file) != 1 ||
+        fwrite(&byte_rate, sizeof(uint32_t), 1, out_file) != 1 ||
+        fwrite(&format->block_align, sizeof(uint16_t), 1, out_file) != 1 ||
+        fwrite(&format->bits_per_sample, sizeof(uint16_t), 1, out_file) != 1 ||
+        fwrite("data", 4, 1, out_file) != 1 ||
+        fwrite(&data_size, sizeof(uint32_t), 1, out_file) != 1) {
+        error("audio_effect: Cannot write file \n");
+        return EIO;
     }
-    
-    memset(bufIn, 0, rem*sizeof(int16_t));
-    
-    count = fwrite(bufIn, sizeof(int16_t), rem, out_file);
+
+    return 0;
 }
 
-int apply_effect_to_wav(const char* wavIn,
-                        const char* wavOut,
-                        enum audio_effect effect_type,
-                        bool reduce_noise,
-                        effect_progress_h* progress_h,
-                        void *arg)
+int effect_stream_wav(struct effect_stream *es,
+                      const char* wavIn,
+                      const char* wavOut,
+                      enum audio_effect effect_type,
+                      bool reduce_noise,
+                      effect_progress_h* progress_h,
+                      void *arg)
 {
-    FILE *in_file, *out_file;
-    in_file = fopen(wavIn,"rb");
-    if( in_file == NULL ){
-	    error("Could not open file for reading \n");
+    struct effect_map map;
+    struct wav_format format;
+    FILE *out_file = NULL;
+    size_t data_off = 0;
+    uint8_t *hdr = NULL;
+    uint32_t sz;
+    int ret;
+
+    ret = effect_map_file(&map, wavIn);
+    if (ret != 0) {
         return -1;
     }
+
+    ret = wav_parse(map.p, map.len, &format, &data_off);
+    if (ret != 0) {
+        goto out;
+    }
+
+    ret = effect_stream_init(es, effect_type, format.sample_rate, reduce_noise);
+    if (ret != 0) {
+        goto out;
+    }
+
+    format.num_samples_out = ((int64_t)format.num_samples_in *
+                              effect_stream_length_modification(es)) >> 10;
+
+    info("wav: %s -> %H\n", wavIn, wav_format_debug, &format);
+
     out_file = fopen(wavOut,"wb");
     if( out_file == NULL ){
         error("Could not open file for writing \n");
-        fclose(in_file);
-        return -1;
+        ret = -1;
+        goto out;
     }
-    
-    webrtc::PushResampler<int16_t> input_resampler;
-    webrtc::PushResampler<int16_t> output_resampler;
-    std::unique_ptr<webrtc::AudioProcessing> apm(webrtc::AudioProcessingBuilder().Create());
-    
-    struct aueffect *aue;
-    int ret = aueffect_alloc(&aue, effect_type, FS_PROC);
-    if(ret != 0){
-        error("aueffect_alloc failed \n");
-        fclose(in_file);
-        fclose(out_file);
-        return ret;
-    }
-    
-    int length_modification_q10 = 1024;
-    aueffect_length_modification(aue, &length_modification_q10);
-    
-    if(effect_type == AUDIO_EFFECT_REVERSE){
-        length_modification_q10 = 1024 * 2; // We append the original
+
+    /* Copy all chunks up to the data, patching the sizes */
+    hdr = (uint8_t *)mem_alloc(data_off, NULL);
+    if (!hdr) {
+        ret = ENOMEM;
+        goto out;
     }
-    
-    struct wav_format format;
-    ret = wav_converter_init(in_file, out_file, &format, length_modification_q10);
-    if(ret != 0){
-        fclose(in_file);
-        fclose(out_file);
-        return ret;
+    memcpy(hdr, map.p, data_off);
+
+    sz = format.num_samples_out * format.block_align;
+    memcpy(hdr + data_off - 4, &sz, sizeof(sz));
+    sz = data_off - WAV_CHUNK_HDR_SZ + sz;
+    memcpy(hdr + 4, &sz, sizeof(sz));
+
+    if (fwrite(hdr, data_off, 1, out_file) != 1) {
+        error("audio_effect: Cannot write file \n");
+        ret = -1;
+        goto out;
     }
 
-    info("wav: %s -> %H\n", wavIn, wav_format_debug, &format);
-    
-    if(effect_type == AUDIO_EFFECT_REVERSE){
-        /* Special handling for reverse effect */
-        reverse_stream(in_file, out_file, &format);
+    ret = effect_stream_process(es,
+                                (const int16_t *)(map.p + data_off),
+                                format.num_samples_in,
+                                format.num_samples_out,
+                                effect_file_write_h, out_file,
+                                progress_h, arg);
 
-        if(progress_h){
-            progress_h(100, arg);
-        }
-        
-        mem_deref(aue);
-        
-        fclose(in_file);
+ out:
+    mem_deref(hdr);
+    effect_unmap(&map);
+    if (out_file)
         fclose(out_file);
-        
-        return 0;
-    }
-    
-    int L = format.sample_rate/100;
-    int L_proc = FS_PROC/100;
-    int N = format.num_samples_in/L;
-    int progress = 0;
-    int rem = 0;
-    int n_samp_out = 0;
-    
-    input_resampler.InitializeIfNeeded(format.sample_rate, FS_PROC, 1);
-    output_resampler.InitializeIfNeeded(FS_PROC, format.sample_rate, 1);
-    
-    // Setup Audio Buffer used by apm
-    webrtc::AudioFrame near_frame;
-    near_frame.samples_per_channel_ = L_proc;
-    near_frame.num_channels_ = 1;
-    near_frame.sample_rate_hz_ = FS_PROC;
-    
-    // Setup APM
-    webrtc::AudioProcessing::ChannelLayout inLayout = webrtc::AudioProcessing::kMono;
-    webrtc::AudioProcessing::ChannelLayout outLayout = webrtc::AudioProcessing::kMono;;
-    webrtc::AudioProcessing::ChannelLayout reverseLayout = webrtc::AudioProcessing::kMono;;
-    apm->Initialize( FS_PROC, FS_PROC, FS_PROC, inLayout, outLayout, reverseLayout );
-
-    webrtc::AudioProcessing::Config apmConfig;
-    // Enable High Pass Filter
-
-    //apm->high_pass_filter()->Enable(true);
-    apmConfig.high_pass_filter.enabled = true;
-
-    apm->ApplyConfig(apmConfig);
-    
-    // Enable Noise Supression
-    if(reduce_noise){
-	    if(effect_type == AUDIO_EFFECT_VOCODER_MED){
-		    apm->noise_suppression()->set_level(webrtc::NoiseSuppression::kModerate);
-	    } else {
-		    apm->noise_suppression()->set_level(webrtc::NoiseSuppression::kLow);
-	    }
-    }
-        
-    int16_t circ_buf[(1 << LOG2_CIRC_BUF_SZ)];
-    int write_idx = 0;
-    int read_idx = 0;
-    
-    int16_t bufIn[L];
-    int16_t procIn[L_proc], procOut[L_proc];
-    size_t count;
-    for(int i = 0; i < N; i++){
-        count = fread(bufIn,
-                      sizeof(int16_t),
-                      L,
-                      in_file);
-        
-        if(count < L){
-            break;
-        }
-        
-        if((i % 100) == 0){
-            int progress = (i*100)/N;
-            if(progress_h){
-                progress_h(progress, arg);
-            }
-        }
-        
-        input_resampler.Resample( bufIn, L, near_frame.mutable_data(), L_proc);
-        
-        ret = apm->ProcessStream(&near_frame);
-        if( ret < 0 ){
-            error("apm->ProcessStream returned %d \n", ret);
-        }
-        
-        size_t L_proc_out;
-        aueffect_process(aue, near_frame.data(), procOut, L_proc, &L_proc_out);
-        
-        for(int j = 0; j < L_proc_out; j++){
-            circ_buf[write_idx] = procOut[j];
-            write_idx = (write_idx + 1) & CIRC_BUF_MASK;
-        }
-        // resampler needs 10 ms chunks
-        int buf_smpls = (write_idx - read_idx) & CIRC_BUF_MASK;
-        while(buf_smpls >= L_proc){
-            for(int j = 0; j < L_proc; j++){
-                procOut[j] = circ_buf[read_idx];
-                read_idx = (read_idx + 1) & CIRC_BUF_MASK;
-            }
-            output_resampler.Resample( procOut, L_proc, bufIn, L);
-            
-            count = fwrite(bufIn,
-                           sizeof(int16_t),
-                           L,
-                           out_file);
-            n_samp_out+=L;
-            
-            buf_smpls = (write_idx - read_idx) & CIRC_BUF_MASK;
-        }
-        rem = format.num_samples_out - n_samp_out;
-        if(rem < L*2){
-            break;
-        }
-    }
-    
-    rem = format.num_samples_out - n_samp_out;
-        
-    if(rem > 0){
-        int16_t fillbuf[rem];
-        memset(fillbuf, 0, sizeof(fillbuf));
-        count = fwrite(fillbuf,
-                       sizeof(int16_t),
-                       rem,
-                       out_file);
-    }
-    
-    if(progress_h){
-        progress_h(100, arg);
-    }
-    
-    mem_deref(aue);
-    
-    fclose(in_file);
-    fclose(out_file);
-    
-    return 0;
+
+    return ret;
 }
 
+int apply_effect_to_wav(const char* wavIn,
+                        const char* wavOut,
+                        enum audio_effect effect_type,
+                        bool reduce_noise,
+                        effect_progress_h* progress_h,
+                        void *arg)
+{
+    struct effect_stream *es;
+    int ret;
+
+    es = effect_stream_alloc();
+    ret = effect_stream_wav(es, wavIn, wavOut, effect_type, reduce_noise,
+                            progress_h, arg);
+    effect_stream_free(es);
+
+    return ret;
+}
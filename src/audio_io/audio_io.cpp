@@ -24,6 +24,7 @@
 
 #include "avs_audio_io.h"
 #include "src/audio_io/mock/fake_audiodevice.h"
+#include "src/audio_io/mock/file_audiodevice.h"
 #if TARGET_OS_IPHONE
 #include "src/audio_io/ios/audio_io_ios.h"
 #endif
@@ -40,6 +41,28 @@ extern "C" {
 static webrtc::audio_io_class *g_aioc = nullptr;
 static bool g_enable_sine = false;
 
+static struct {
+	bool enabled;
+	struct audio_io_file_cfg cfg;
+	std::string capture;
+	std::string playout;
+	std::string timing;
+	webrtc::file_audiodevice *dev;
+} g_file;
+
+static webrtc::file_audiodevice *file_device_create(void)
+{
+	struct audio_io_file_cfg cfg = g_file.cfg;
+
+	cfg.capture = g_file.capture.c_str();
+	cfg.playout = g_file.playout.c_str();
+	cfg.timing = g_file.timing.c_str();
+
+	g_file.dev = new webrtc::file_audiodevice(&cfg);
+
+	return g_file.dev;
+}
+
 static void audio_io_destructor(void *arg)
 {
     struct audio_io *aio = (struct audio_io *)arg;
@@ -47,7 +70,8 @@ static void audio_io_destructor(void *arg)
     webrtc::audio_io_class *aioc = (webrtc::audio_io_class *)aio->aioc;
     if(aioc){
         aioc->TerminateInternal();
-	if (aioc != g_aioc)
+	/* A file device is kept for its stats, see audio_io_set_file */
+	if (aioc != g_aioc && aioc != g_file.dev)
 		delete aioc;
     }
 }
@@ -65,7 +89,11 @@ void *audio_io_create_adm(void)
 	if (g_aioc)
 		return (void *)g_aioc;
 	
-	if (flags & AVS_FLAG_AUDIO_TEST) {
+	if (g_file.enabled) {
+		info("audio_io: create_adm: creating file audio device\n");
+		g_aioc = file_device_create();
+	}
+	else if (flags & AVS_FLAG_AUDIO_TEST) {
 		info("audio_io: create_adm: creating fake audio device\n");
 		g_aioc = new webrtc::fake_audiodevice(true);		
 	}
@@ -98,7 +126,10 @@ int  audio_io_alloc(struct audio_io **aiop,
 	if (!aio)
 		return ENOMEM;
     
-	if (avs_get_flags() & AVS_FLAG_AUDIO_TEST) {
+	if (g_file.enabled) {
+		mode = AUDIO_IO_MODE_FILE;
+	}
+	else if (avs_get_flags() & AVS_FLAG_AUDIO_TEST) {
 		mode = AUDIO_IO_MODE_MOCK_REALTIME;
 	}
 	switch (mode){
@@ -116,6 +147,13 @@ int  audio_io_alloc(struct audio_io **aiop,
 	case AUDIO_IO_MODE_MOCK_REALTIME:
 		aioc = new webrtc::fake_audiodevice(realtime);
 		break;
+
+	case AUDIO_IO_MODE_FILE:
+		if (!g_aioc)
+			g_aioc = file_device_create();
+
+		aioc = g_aioc;
+		break;
 	    
 	default:
 		warning("audio_io: audio_io_alloc unknown mode \n");
@@ -191,3 +229,46 @@ int audio_io_reset(struct audio_io *aio)
 
 	return res;
 }
+
+int audio_io_set_file(const struct audio_io_file_cfg *cfg)
+{
+	if (!cfg) {
+		/* The engine may still hold the device, so it is only
+		 * detached, new ADMs get the default device.
+		 */
+		if (g_aioc && g_aioc == g_file.dev)
+			g_aioc = nullptr;
+		g_file.enabled = false;
+		return 0;
+	}
+
+	if (g_aioc && g_aioc == g_file.dev) {
+		warning("audio_io: set_file: file device already in use\n");
+		return EBUSY;
+	}
+
+	if (!str_isset(cfg->capture) && !str_isset(cfg->playout))
+		return EINVAL;
+
+	g_file.cfg = *cfg;
+	g_file.capture = str_isset(cfg->capture) ? cfg->capture : "";
+	g_file.playout = str_isset(cfg->playout) ? cfg->playout : "";
+	g_file.timing = str_isset(cfg->timing) ? cfg->timing : "";
+	g_file.enabled = true;
+
+	info("audio_io: set_file: capture=%s playout=%s fs=%d\n",
+	     g_file.capture.c_str(), g_file.playout.c_str(), cfg->fs_hz);
+
+	return 0;
+}
+
+int audio_io_get_file_stats(struct audio_io_file_stats *stats)
+{
+	if (!stats)
+		return EINVAL;
+
+	if (!g_file.dev)
+		return ENOENT;
+
+	return g_file.dev->GetStats(stats);
+}
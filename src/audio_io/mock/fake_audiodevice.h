@@ -16,6 +16,9 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef AVS_FAKE_AUDIODEVICE_H_
+#define AVS_FAKE_AUDIODEVICE_H_
+
 #include "../audio_io_class.h"
 #include <pthread.h>
 #include <string.h>
@@ -189,9 +192,9 @@ namespace webrtc {
 		    return -1;
 	    }
         
-	    void* record_thread();
-	    void* playout_thread();
-    private:
+	    virtual void* record_thread();
+	    virtual void* playout_thread();
+    protected:
 	    AudioTransport* audioCallback_;
 	    pthread_t rec_tid_ = 0;
 	    pthread_t play_tid_ = 0;
@@ -204,3 +207,5 @@ namespace webrtc {
 	    float omega_;
     };
 }
+
+#endif
@@ -0,0 +1,442 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <string.h>
+#include "file_audiodevice.h"
+#include "avs_audio_effect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "avs_log.h"
+#ifdef __cplusplus
+}
+#endif
+
+
+namespace webrtc {
+
+static uint32_t elapsed_us(const struct timeval *t0,
+			   const struct timeval *t1)
+{
+	struct timeval d;
+
+	timersub(t1, t0, &d);
+
+	return (uint32_t)(d.tv_sec * 1000000 + d.tv_usec);
+}
+
+static bool has_suffix(const std::string &s, const char *sfx)
+{
+	size_t n = strlen(sfx);
+
+	return s.size() >= n && 0 == strcasecmp(s.c_str() + s.size() - n, sfx);
+}
+
+/* Peeks at the RIFF header, so raw PCM never reaches the WAV parser */
+static bool is_wav(FILE *fp)
+{
+	uint8_t hdr[12];
+	bool wav;
+
+	wav = fread(hdr, sizeof(hdr), 1, fp) == 1
+		&& 0 == memcmp(hdr, "RIFF", 4)
+		&& 0 == memcmp(hdr + 8, "WAVE", 4);
+	rewind(fp);
+
+	return wav;
+}
+
+file_audiodevice::file_audiodevice(const struct audio_io_file_cfg *cfg)
+	: fake_audiodevice(cfg->realtime)
+{
+	capture_path_ = str_isset(cfg->capture) ? cfg->capture : "";
+	playout_path_ = str_isset(cfg->playout) ? cfg->playout : "";
+	timing_path_ = str_isset(cfg->timing) ? cfg->timing : "";
+	capture_ = NULL;
+	playout_ = NULL;
+	timing_ = NULL;
+	capture_start_ = 0;
+	playout_wav_ = has_suffix(playout_path_, ".wav");
+	loop_ = cfg->loop;
+	capture_eof_ = false;
+	fs_hz_ = cfg->fs_hz > 0 ? cfg->fs_hz : FS_KHZ * 1000;
+	frame_len_ = fs_hz_ / 100;
+	lat_sum_rec_us_ = 0;
+	lat_sum_play_us_ = 0;
+	memset(&start_time_, 0, sizeof(start_time_));
+	memset(&stats_, 0, sizeof(stats_));
+	pthread_mutex_init(&lock_, NULL);
+}
+
+file_audiodevice::~file_audiodevice()
+{
+	Terminate();
+	TerminateInternal();
+	pthread_mutex_destroy(&lock_);
+}
+
+int file_audiodevice::OpenCapture()
+{
+	struct wav_format fmt;
+
+	if (capture_path_.empty())
+		return 0;
+
+	capture_ = fopen(capture_path_.c_str(), "rb");
+	if (!capture_) {
+		warning("audio_io_file: cannot open capture file %s\n",
+			capture_path_.c_str());
+		return errno ? errno : ENOENT;
+	}
+
+	if (is_wav(capture_)) {
+		if (wav_read_header(capture_, &fmt)) {
+			warning("audio_io_file: %s: bad WAV header\n",
+				capture_path_.c_str());
+			return EBADMSG;
+		}
+		if (fmt.num_channels != 1 || fmt.bits_per_sample != 16) {
+			warning("audio_io_file: %s: only 16-bit mono "
+				"WAV is supported (ch=%d bits=%d)\n",
+				capture_path_.c_str(),
+				(int)fmt.num_channels,
+				(int)fmt.bits_per_sample);
+			return ENOTSUP;
+		}
+		fs_hz_ = fmt.sample_rate;
+	}
+
+	if (fs_hz_ / 100 > FILE_MAX_FRAME_LEN) {
+		warning("audio_io_file: unsupported sample rate %d\n",
+			fs_hz_);
+		return ENOTSUP;
+	}
+
+	frame_len_ = fs_hz_ / 100;
+	capture_start_ = ftell(capture_);
+
+	info("audio_io_file: capture %s at %dHz\n",
+	     capture_path_.c_str(), fs_hz_);
+
+	return 0;
+}
+
+int file_audiodevice::OpenPlayout()
+{
+	struct wav_format fmt;
+
+	if (playout_path_.empty())
+		return 0;
+
+	playout_ = fopen(playout_path_.c_str(), "wb");
+	if (!playout_) {
+		warning("audio_io_file: cannot open playout file %s\n",
+			playout_path_.c_str());
+		return errno ? errno : EACCES;
+	}
+
+	if (playout_wav_) {
+		/* Sizes are patched once playout stops */
+		memset(&fmt, 0, sizeof(fmt));
+		fmt.audio_format = 1;
+		fmt.num_channels = 1;
+		fmt.sample_rate = fs_hz_;
+		fmt.block_align = sizeof(int16_t);
+		fmt.bits_per_sample = 16;
+		return wav_write_header(playout_, &fmt);
+	}
+
+	return 0;
+}
+
+void file_audiodevice::ClosePlayout()
+{
+	struct wav_format fmt;
+
+	if (!playout_)
+		return;
+
+	if (playout_wav_) {
+		memset(&fmt, 0, sizeof(fmt));
+		fmt.audio_format = 1;
+		fmt.num_channels = 1;
+		fmt.sample_rate = fs_hz_;
+		fmt.block_align = sizeof(int16_t);
+		fmt.bits_per_sample = 16;
+		fmt.num_samples_out = (int32_t)stats_.samples_played;
+
+		rewind(playout_);
+		wav_write_header(playout_, &fmt);
+	}
+
+	fclose(playout_);
+	playout_ = NULL;
+}
+
+int32_t file_audiodevice::InitInternal()
+{
+	int err;
+
+	if (capture_ || playout_)
+		return 0;
+
+	/* The playout file is truncated, the stats start over with it */
+	pthread_mutex_lock(&lock_);
+	memset(&stats_, 0, sizeof(stats_));
+	lat_sum_rec_us_ = 0;
+	lat_sum_play_us_ = 0;
+	capture_eof_ = false;
+	pthread_mutex_unlock(&lock_);
+
+	err = OpenCapture();
+	if (err)
+		goto out;
+
+	err = OpenPlayout();
+	if (err)
+		goto out;
+
+	if (!timing_path_.empty()) {
+		timing_ = fopen(timing_path_.c_str(), "w");
+		if (!timing_) {
+			warning("audio_io_file: cannot open timing file %s\n",
+				timing_path_.c_str());
+		}
+		else {
+			fprintf(timing_, "# dir frame t_us cb_us\n");
+		}
+	}
+
+	gettimeofday(&start_time_, NULL);
+
+ out:
+	if (err) {
+		TerminateInternal();
+		return -1;
+	}
+
+	return 0;
+}
+
+int32_t file_audiodevice::TerminateInternal()
+{
+	Terminate();
+
+	if (capture_) {
+		fclose(capture_);
+		capture_ = NULL;
+	}
+
+	ClosePlayout();
+
+	if (timing_) {
+		fclose(timing_);
+		timing_ = NULL;
+	}
+
+	info("audio_io_file: rec: %u frames avg=%uus max=%uus late=%u "
+	     "play: %u frames avg=%uus max=%uus late=%u\n",
+	     stats_.rec.nframes, stats_.rec.avg_us, stats_.rec.max_us,
+	     stats_.rec.late,
+	     stats_.play.nframes, stats_.play.avg_us, stats_.play.max_us,
+	     stats_.play.late);
+
+	return 0;
+}
+
+int32_t file_audiodevice::RecordingSampleRate(uint32_t* samplesPerSec) const
+{
+	*samplesPerSec = fs_hz_;
+	return 0;
+}
+
+int32_t file_audiodevice::PlayoutSampleRate(uint32_t* samplesPerSec) const
+{
+	*samplesPerSec = fs_hz_;
+	return 0;
+}
+
+int file_audiodevice::GetStats(struct audio_io_file_stats *stats)
+{
+	if (!stats)
+		return EINVAL;
+
+	pthread_mutex_lock(&lock_);
+	*stats = stats_;
+	pthread_mutex_unlock(&lock_);
+
+	return 0;
+}
+
+size_t file_audiodevice::ReadCapture(int16_t *buf, size_t n)
+{
+	size_t count;
+
+	memset(buf, 0, n * sizeof(int16_t));
+
+	if (!capture_ || capture_eof_)
+		return 0;
+
+	count = fread(buf, sizeof(int16_t), n, capture_);
+	if (count < n) {
+		if (loop_) {
+			fseek(capture_, capture_start_, SEEK_SET);
+			count += fread(buf + count, sizeof(int16_t),
+				       n - count, capture_);
+		}
+		else {
+			info("audio_io_file: capture reached end of file\n");
+			capture_eof_ = true;
+		}
+	}
+
+	return count;
+}
+
+void file_audiodevice::UpdateLatency(struct audio_io_latency *lat,
+				     uint32_t cb_us)
+{
+	uint64_t *sum = (lat == &stats_.rec) ? &lat_sum_rec_us_
+					     : &lat_sum_play_us_;
+
+	++lat->nframes;
+	*sum += cb_us;
+	lat->avg_us = (uint32_t)(*sum / lat->nframes);
+	if (cb_us > lat->max_us)
+		lat->max_us = cb_us;
+	if (cb_us > FRAME_LEN_MS * 1000)
+		++lat->late;
+}
+
+void *file_audiodevice::record_thread()
+{
+	int16_t audio_buf[FILE_MAX_FRAME_LEN];
+	uint32_t currentMicLevel = 10;
+	uint32_t newMicLevel = 0;
+	struct timeval now, next_io_time, delta, sleep_time, t0;
+	size_t count;
+
+	info("audio_io_file: record_thread: started\n");
+
+	delta.tv_sec = 0;
+	delta.tv_usec = FRAME_LEN_MS * 1000;
+
+	gettimeofday(&next_io_time, NULL);
+
+	while(is_recording_) {
+		timeradd(&next_io_time, &delta, &next_io_time);
+
+		count = ReadCapture(audio_buf, frame_len_);
+
+		gettimeofday(&t0, NULL);
+		if (audioCallback_) {
+			audioCallback_->RecordedDataIsAvailable(
+					(void*)audio_buf,
+					frame_len_, 2, 1, fs_hz_, 0, 0,
+					currentMicLevel, false, newMicLevel);
+		}
+		gettimeofday(&now, NULL);
+
+		pthread_mutex_lock(&lock_);
+		UpdateLatency(&stats_.rec, elapsed_us(&t0, &now));
+		stats_.samples_captured += count;
+		stats_.capture_eof = capture_eof_;
+		if (timing_) {
+			fprintf(timing_, "rec %u %u %u\n",
+				stats_.rec.nframes,
+				elapsed_us(&start_time_, &t0),
+				elapsed_us(&t0, &now));
+		}
+		pthread_mutex_unlock(&lock_);
+
+		timersub(&next_io_time, &now, &sleep_time);
+		if (sleep_time.tv_sec < 0) {
+			sleep_time.tv_usec = 0;
+		}
+		timespec t;
+		t.tv_sec = 0;
+		t.tv_nsec = sleep_time.tv_usec*1000;
+		if (realtime_) {
+			nanosleep(&t, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+void *file_audiodevice::playout_thread()
+{
+	int16_t audio_buf[FILE_MAX_FRAME_LEN] = {0};
+	size_t nSamplesOut = 0;
+	int64_t elapsed_time_ms, ntp_time_ms;
+	struct timeval now, next_io_time, delta, sleep_time, t0;
+
+	info("audio_io_file: playout_thread: started\n");
+
+	delta.tv_sec = 0;
+	delta.tv_usec = FRAME_LEN_MS * 1000;
+
+	gettimeofday(&next_io_time, NULL);
+
+	while(is_playing_) {
+		timeradd(&next_io_time, &delta, &next_io_time);
+
+		gettimeofday(&t0, NULL);
+		if (audioCallback_) {
+			audioCallback_->NeedMorePlayData(
+					frame_len_, 2, 1, fs_hz_,
+					(void*)audio_buf, nSamplesOut,
+					&elapsed_time_ms, &ntp_time_ms);
+		}
+		gettimeofday(&now, NULL);
+
+		if (playout_) {
+			fwrite(audio_buf, sizeof(int16_t), frame_len_,
+			       playout_);
+		}
+
+		pthread_mutex_lock(&lock_);
+		UpdateLatency(&stats_.play, elapsed_us(&t0, &now));
+		stats_.samples_played += frame_len_;
+		if (timing_) {
+			fprintf(timing_, "play %u %u %u\n",
+				stats_.play.nframes,
+				elapsed_us(&start_time_, &t0),
+				elapsed_us(&t0, &now));
+		}
+		pthread_mutex_unlock(&lock_);
+
+		timersub(&next_io_time, &now, &sleep_time);
+		if (sleep_time.tv_sec < 0) {
+			sleep_time.tv_usec = 0;
+		}
+		timespec t;
+		t.tv_sec = 0;
+		t.tv_nsec = sleep_time.tv_usec*1000;
+		if (realtime_) {
+			nanosleep(&t, NULL);
+		}
+	}
+
+	return NULL;
+}
+}
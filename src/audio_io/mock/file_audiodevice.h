@@ -0,0 +1,79 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVS_FILE_AUDIODEVICE_H_
+#define AVS_FILE_AUDIODEVICE_H_
+
+#include "fake_audiodevice.h"
+#include <stdio.h>
+#include <sys/time.h>
+#include <string>
+
+#define FILE_MAX_FRAME_LEN (FRAME_LEN_MS * 48)
+
+namespace webrtc {
+    /*
+     * Audio device that captures from a WAV/PCM file and writes
+     * the received playout to a file, while timing every
+     * RecordedDataIsAvailable/NeedMorePlayData callback.
+     */
+    class file_audiodevice : public fake_audiodevice {
+    public:
+	    file_audiodevice(const struct audio_io_file_cfg *cfg);
+	    ~file_audiodevice();
+
+	    int32_t InitInternal();
+	    int32_t TerminateInternal();
+
+	    int32_t RecordingSampleRate(uint32_t* samplesPerSec) const;
+	    int32_t PlayoutSampleRate(uint32_t* samplesPerSec) const;
+
+	    int GetStats(struct audio_io_file_stats *stats);
+
+	    void* record_thread();
+	    void* playout_thread();
+
+    private:
+	    int OpenCapture();
+	    int OpenPlayout();
+	    void ClosePlayout();
+	    size_t ReadCapture(int16_t *buf, size_t n);
+	    void UpdateLatency(struct audio_io_latency *lat,
+			       uint32_t cb_us);
+
+	    std::string capture_path_;
+	    std::string playout_path_;
+	    std::string timing_path_;
+	    FILE *capture_;
+	    FILE *playout_;
+	    FILE *timing_;
+	    long capture_start_;
+	    bool playout_wav_;
+	    bool loop_;
+	    bool capture_eof_;
+	    int fs_hz_;
+	    size_t frame_len_;
+	    uint64_t lat_sum_rec_us_;
+	    uint64_t lat_sum_play_us_;
+	    struct timeval start_time_;
+	    struct audio_io_file_stats stats_;
+	    pthread_mutex_t lock_;
+    };
+}
+
+#endif
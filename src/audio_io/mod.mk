@@ -4,7 +4,8 @@
 
 AVS_SRCS += \
     audio_io/audio_io.cpp \
-	audio_io/mock/fake_audiodevice.cpp
+	audio_io/mock/fake_audiodevice.cpp \
+	audio_io/mock/file_audiodevice.cpp
 
 ifeq ($(AVS_OS),ios)
 
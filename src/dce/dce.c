@@ -72,13 +72,23 @@
 
 #include <re.h>
 #include "avs.h"
+#include "sendq.h"
+#include "slot.h"
 
 #define DATA_CHANNEL_PORT 5000
 
 #define LINE_LENGTH (1024)
-#define BUFFER_SIZE (1<<16)
-#define NUMBER_OF_CHANNELS (10)
-#define NUMBER_OF_STREAMS (10)
+
+/*
+ * The channel table and the stream maps start small and grow when
+ * more channels are opened, up to max_streams of the peer connection.
+ */
+#define DCE_INIT_CHANNELS (8)
+#define DCE_INIT_STREAMS  (16)
+#define DCE_MAX_STREAMS   (1024)
+
+/* Upper bound of the bytes queued per channel by dce_send */
+#define DCE_MAX_BUFFERED  (16 * 1024 * 1024)
 
 #define DATA_CHANNEL_PPID_CONTROL   50
 #define DATA_CHANNEL_PPID_DOMSTRING 51
@@ -98,19 +108,22 @@
 
 #define PAYLOAD_MAGIC 0x60504030
 
+#define MQ_BATCH 0
 
 enum mq_type {
 	ESTAB,
 	CH_ESTAB,
 	CH_OPEN,
 	CH_CLOSE,
-	CH_DATA
+	CH_DATA,
+	CH_BUFLOW
 };
 
 struct payload {
 	struct le le;
 	enum mq_type type;
 	struct dce *dce;           /* pointer */
+	uintptr_t token;
 	struct dce_channel *ch;    /* pointer */
 	uint32_t magic;
 
@@ -120,17 +133,28 @@ struct payload {
 		} chopen;
 
 		struct {
+			struct rcvbuf *rb;  /* owns buf */
 			uint8_t *buf;
 			size_t len;
 		} chdata;
+
+		struct {
+			size_t amount;
+		} buflow;
 	} v;
 };
 
 
+/* A message received from usrsctp, owning the buffer it allocated */
+struct rcvbuf {
+	void *data;
+};
+
 static struct {
-	struct lock *lock;
-	struct list dcel;
-	struct list pendingl;
+	struct dce_slots *slots;   /* usrsctp addresses, see slot.h */
+	struct lock *qlock;
+	struct list pendingl;      /* payloads to deliver, protected by qlock */
+	bool posted;               /* a batch wakeup is in the mqueue */
 	struct mqueue *mqueue;
 } g_dce = {
 	.lock = NULL
@@ -151,10 +175,19 @@ struct channel {
 };
 
 struct peer_connection {
-	struct channel channels[NUMBER_OF_CHANNELS];
-	struct channel *i_stream_channel[NUMBER_OF_STREAMS];
-	struct channel *o_stream_channel[NUMBER_OF_STREAMS];
-	uint16_t o_stream_buffer[NUMBER_OF_STREAMS];
+	struct channel **channelv;
+	uint32_t channelc;
+	uint32_t *freev;                      /* closed channel indices */
+	uint32_t freec;
+
+	/* Indexed by stream id, streamc entries each */
+	struct channel **i_stream_channel;
+	struct dce_channel **i_stream_dce_ch; /* cache */
+	struct channel **o_stream_channel;
+	uint16_t *o_stream_buffer;
+	uint32_t streamc;
+	uint32_t max_streams;
+
 	uint32_t o_stream_buffer_counter;
 	struct lock *lock;
 	struct socket *sock;
@@ -171,6 +204,10 @@ struct dce_channel {
 	dce_data_h *datah;
 	int id;
 	void *arg;
+
+	struct dce_sendq sendq;
+	size_t lowmark;
+	dce_buffered_low_h *lowh;
 };
 
 struct dce {
@@ -183,7 +220,7 @@ struct dce {
 	bool snd_dry_event;
 	void *arg;
 
-	struct le le; /* member of global active list */
+	uintptr_t token; /* usrsctp address of the association */
 
 	uint32_t magic;
 };
@@ -257,7 +294,7 @@ static void payload_destructor(void *arg)
 	switch (pld->type) {
 
 	case CH_DATA:
-		mem_deref(pld->v.chdata.buf);
+		mem_deref(pld->v.chdata.rb);
 		break;
 
 	default:
@@ -278,28 +315,46 @@ static struct payload *payload_new(struct dce *dce, struct dce_channel *ch,
 	pld->magic = PAYLOAD_MAGIC;
 	pld->type = type;
 	pld->dce = dce;
+	pld->token = dce ? dce->token : 0;
 	pld->ch = ch;
 
+	return pld;
+}
+
+
+/*
+ * Queues a payload for the main thread. Payloads are delivered in
+ * batches, only the first payload of a batch wakes up the mqueue.
+ */
+static void payload_post(struct payload *pld)
+{
+	bool wakeup;
+
+	lock_write_get(g_dce.qlock);
 	list_append(&g_dce.pendingl, &pld->le, pld);
+	wakeup = !g_dce.posted;
+	g_dce.posted = true;
+	lock_rel(g_dce.qlock);
 
-	return pld;
+	if (wakeup)
+		mqueue_push(g_dce.mqueue, MQ_BATCH, NULL);
 }
 
 
-static bool exist_dce(struct list *dcel, struct dce *dce)
+static void rcvbuf_destructor(void *arg)
 {
-	bool found = false;
-	struct le *le;
+	struct rcvbuf *rb = arg;
 
-	le = dcel->head;
-	while (le && !found) {
-		found = le->data == (void *)dce;
-		le = le->next;
-	}
+	free(rb->data);
+}
 
-	return found;
+
+static void *dce_addr(const struct dce *dce)
+{
+	return (void *)dce->token;
 }
 
+
 static int sctp_header_decode(struct sctp_header *hdr, struct mbuf *mb)
 {
 	if (mbuf_get_left(mb) < 12)
@@ -314,32 +369,135 @@ static int sctp_header_decode(struct sctp_header *hdr, struct mbuf *mb)
 }
 
 
+/* Resizes a table from oldn to n elements, zeroing new elements */
+static void *table_resize(void *tbl, size_t oldn, size_t n, size_t sz)
+{
+	uint8_t *p;
+
+	if (tbl)
+		p = mem_realloc(tbl, n * sz);
+	else
+		p = mem_zalloc(n * sz, NULL);
+	if (!p)
+		return NULL;
+
+	if (n > oldn)
+		memset(p + oldn * sz, 0, (n - oldn) * sz);
+
+	return p;
+}
+
+
 static int
-init_peer_connection(struct peer_connection *pc)
+grow_channels(struct peer_connection *pc, uint32_t n)
 {
-	uint32_t i;
-	struct channel *channel;
-	int err;
+	struct channel **channelv;
+	uint32_t *freev;
+	uint32_t i, old = pc->channelc;
+	int err = 0;
+
+	if (n > pc->max_streams)
+		n = pc->max_streams;
+	if (n <= old)
+		return ENOSPC;
+
+	channelv = table_resize(pc->channelv, old, n, sizeof(*channelv));
+	if (!channelv)
+		return ENOMEM;
+	pc->channelv = channelv;
+
+	freev = table_resize(pc->freev, old, n, sizeof(*freev));
+	if (!freev)
+		return ENOMEM;
+	pc->freev = freev;
+
+	for (i = old; i < n; i++) {
+		struct channel *channel;
+
+		channel = mem_zalloc(sizeof(*channel), NULL);
+		if (!channel) {
+			err = ENOMEM;
+			break;
+		}
 
-	for (i = 0; i < NUMBER_OF_CHANNELS; i++) {
-		channel = &(pc->channels[i]);
 		channel->id = i;
 		channel->state = DATA_CHANNEL_CLOSED;
 		channel->pr_policy = SCTP_PR_SCTP_NONE;
-		channel->pr_value = 0;
-		channel->i_stream = 0;
-		channel->o_stream = 0;
-		channel->unordered = 0;
-		channel->flags = 0;
-	}
-	for (i = 0; i < NUMBER_OF_STREAMS; i++) {
-		pc->i_stream_channel[i] = NULL;
-		pc->o_stream_channel[i] = NULL;
-		pc->o_stream_buffer[i] = 0;
+		pc->channelv[i] = channel;
+		pc->channelc = i + 1;
 	}
+
+	/* Lowest index on top of the free stack */
+	for (i = pc->channelc; i > old; i--)
+		pc->freev[pc->freec++] = i - 1;
+
+	return pc->channelc > old ? 0 : err;
+}
+
+
+static int
+grow_streams(struct peer_connection *pc, uint32_t n)
+{
+	struct channel **i_stream_channel;
+	struct dce_channel **i_stream_dce_ch;
+	struct channel **o_stream_channel;
+	uint16_t *o_stream_buffer;
+	uint32_t old = pc->streamc;
+
+	if (n > pc->max_streams)
+		n = pc->max_streams;
+	if (n <= old)
+		return ENOSPC;
+
+	i_stream_channel = table_resize(pc->i_stream_channel, old, n,
+					sizeof(*i_stream_channel));
+	if (!i_stream_channel)
+		return ENOMEM;
+	pc->i_stream_channel = i_stream_channel;
+
+	i_stream_dce_ch = table_resize(pc->i_stream_dce_ch, old, n,
+				       sizeof(*i_stream_dce_ch));
+	if (!i_stream_dce_ch)
+		return ENOMEM;
+	pc->i_stream_dce_ch = i_stream_dce_ch;
+
+	o_stream_channel = table_resize(pc->o_stream_channel, old, n,
+					sizeof(*o_stream_channel));
+	if (!o_stream_channel)
+		return ENOMEM;
+	pc->o_stream_channel = o_stream_channel;
+
+	o_stream_buffer = table_resize(pc->o_stream_buffer, old, n,
+				       sizeof(*o_stream_buffer));
+	if (!o_stream_buffer)
+		return ENOMEM;
+	pc->o_stream_buffer = o_stream_buffer;
+
+	pc->streamc = n;
+
+	debug("dce: stream maps grown to %u streams\n", n);
+
+	return 0;
+}
+
+
+static int
+init_peer_connection(struct peer_connection *pc)
+{
+	int err;
+
+	pc->max_streams = DCE_MAX_STREAMS;
 	pc->o_stream_buffer_counter = 0;
 	pc->sock = NULL;
 
+	err = grow_channels(pc, DCE_INIT_CHANNELS);
+	if (err)
+		return err;
+
+	err = grow_streams(pc, DCE_INIT_STREAMS);
+	if (err)
+		return err;
+
 	err = lock_alloc(&pc->lock);
 	if (err)
 		return err;
@@ -350,9 +508,25 @@ init_peer_connection(struct peer_connection *pc)
 
 static void close_peer_connection(struct peer_connection *pc)
 {
+	uint32_t i;
+
 	if (!pc)
 		return;
 
+	for (i = 0; i < pc->channelc; i++)
+		mem_deref(pc->channelv[i]);
+
+	pc->channelv = mem_deref(pc->channelv);
+	pc->freev = mem_deref(pc->freev);
+	pc->channelc = 0;
+	pc->freec = 0;
+
+	pc->i_stream_channel = mem_deref(pc->i_stream_channel);
+	pc->i_stream_dce_ch = mem_deref(pc->i_stream_dce_ch);
+	pc->o_stream_channel = mem_deref(pc->o_stream_channel);
+	pc->o_stream_buffer = mem_deref(pc->o_stream_buffer);
+	pc->streamc = 0;
+
 	pc->lock = mem_deref(pc->lock);
 }
 
@@ -374,7 +548,7 @@ unlock_peer_connection(struct peer_connection *pc)
 static struct channel *
 find_channel_by_i_stream(struct peer_connection *pc, uint16_t i_stream)
 {
-	if (i_stream < NUMBER_OF_STREAMS) {
+	if (i_stream < pc->streamc) {
 		return pc->i_stream_channel[i_stream];
 	} else {
 		return NULL;
@@ -385,7 +559,7 @@ find_channel_by_i_stream(struct peer_connection *pc, uint16_t i_stream)
 static struct channel *
 find_channel_by_o_stream(struct peer_connection *pc, uint16_t o_stream)
 {
-	if (o_stream < NUMBER_OF_STREAMS) {
+	if (o_stream < pc->streamc) {
 		return pc->o_stream_channel[o_stream];
 	} else {
 		return NULL;
@@ -396,18 +570,37 @@ find_channel_by_o_stream(struct peer_connection *pc, uint16_t o_stream)
 static struct channel *
 find_free_channel(struct peer_connection *pc)
 {
-	uint32_t i;
+	struct channel *channel;
 
-	for (i = 0; i < NUMBER_OF_CHANNELS; i++) {
-		if (pc->channels[i].state == DATA_CHANNEL_CLOSED) {
-			break;
-		}
-	}
-	if (i == NUMBER_OF_CHANNELS) {
-		return NULL;
-	} else {
-		return &(pc->channels[i]);
+	if (pc->freec == 0) {
+		if (grow_channels(pc, 2 * pc->channelc))
+			return NULL;
 	}
+
+	channel = pc->channelv[pc->freev[--pc->freec]];
+	memset(channel->label, 0, sizeof(channel->label));
+	memset(channel->protocol, 0, sizeof(channel->protocol));
+
+	return channel;
+}
+
+
+/* Returns a channel to the CLOSED state and to the free stack */
+static void
+release_channel(struct peer_connection *pc, struct channel *channel)
+{
+	bool was_closed = channel->state == DATA_CHANNEL_CLOSED;
+
+	channel->state = DATA_CHANNEL_CLOSED;
+	channel->unordered = 0;
+	channel->pr_policy = SCTP_PR_SCTP_NONE;
+	channel->pr_value = 0;
+	channel->i_stream = 0;
+	channel->o_stream = 0;
+	channel->flags = 0;
+
+	if (!was_closed)
+		pc->freev[pc->freec++] = channel->id;
 }
 
 
@@ -424,10 +617,10 @@ valid_o_stream(struct peer_connection *pc, uint16_t o_stream)
 		warning("dce: getsockopt \n");
 		return false;
 	}
-	if (status.sstat_outstrms < NUMBER_OF_STREAMS) {
+	if (status.sstat_outstrms < pc->streamc) {
 		limit = status.sstat_outstrms;
 	} else {
-		limit = NUMBER_OF_STREAMS;
+		limit = pc->streamc;
 	}
 	if(o_stream > limit){
 		return false;
@@ -449,10 +642,10 @@ find_free_o_stream(struct peer_connection *pc)
 		warning("dce: getsockopt \n");
 		return 0;
 	}
-	if (status.sstat_outstrms < NUMBER_OF_STREAMS) {
+	if (status.sstat_outstrms < pc->streamc) {
 		limit = status.sstat_outstrms;
 	} else {
-		limit = NUMBER_OF_STREAMS;
+		limit = pc->streamc;
 	}
 	/* stream id 0 is reserved */    
 	for (i = 1; i < limit; i++) {
@@ -462,6 +655,11 @@ find_free_o_stream(struct peer_connection *pc)
 		}
 	}
 	if (i == limit) {
+		/* All negotiated streams are taken, make room for
+		 * request_more_o_streams to add some.
+		 */
+		if (limit == pc->streamc)
+			grow_streams(pc, 2 * pc->streamc);
 		return 0;
 	} else {
 		return (uint16_t)i;
@@ -478,9 +676,9 @@ request_more_o_streams(struct peer_connection *pc)
 	socklen_t len;
 
 	o_streams_needed = 0;
-	for (i = 0; i < NUMBER_OF_CHANNELS; i++) {
-		if ((pc->channels[i].state == DATA_CHANNEL_CONNECTING) &&
-		    (pc->channels[i].o_stream == 0)) {
+	for (i = 0; i < pc->channelc; i++) {
+		if ((pc->channelv[i]->state == DATA_CHANNEL_CONNECTING) &&
+		    (pc->channelv[i]->o_stream == 0)) {
 			o_streams_needed++;
 		}
 	}
@@ -489,8 +687,9 @@ request_more_o_streams(struct peer_connection *pc)
 		warning("dce: getsockopt \n");
 		return;
 	}
-	if (status.sstat_outstrms + o_streams_needed > NUMBER_OF_STREAMS) {
-		o_streams_needed = NUMBER_OF_STREAMS - status.sstat_outstrms;
+	if (status.sstat_outstrms + o_streams_needed > pc->streamc) {
+		o_streams_needed = pc->streamc > status.sstat_outstrms
+			? pc->streamc - status.sstat_outstrms : 0;
 	}
 	if (o_streams_needed == 0) {
 		return;
@@ -604,8 +803,8 @@ send_deferred_messages(struct peer_connection *pc)
 	uint32_t i;
 	struct channel *channel;
 
-	for (i = 0; i < NUMBER_OF_CHANNELS; i++) {
-		channel = &(pc->channels[i]);
+	for (i = 0; i < pc->channelc; i++) {
+		channel = pc->channelv[i];
 		if (channel->flags & DATA_CHANNEL_FLAGS_SEND_REQ) {
 			if (send_open_request_message(pc->sock, channel->o_stream, channel->unordered, channel->pr_policy, channel->pr_value, channel->label, channel->protocol)) {
 				channel->flags &= ~DATA_CHANNEL_FLAGS_SEND_REQ;
@@ -669,6 +868,7 @@ open_channel(struct peer_connection *pc, uint8_t unordered, uint16_t pr_policy,
 	memcpy(channel->label, label, strlen(label));
 	memcpy(channel->protocol, protocol, strlen(protocol));
 	pc->i_stream_channel[o_stream] = channel;
+	pc->i_stream_dce_ch[o_stream] = NULL;
 	channel->flags = 0;
 	if (o_stream == 0) {
 		request_more_o_streams(pc);
@@ -680,12 +880,9 @@ open_channel(struct peer_connection *pc, uint8_t unordered, uint16_t pr_policy,
 				pc->o_stream_channel[o_stream] = channel;
 				channel->flags |= DATA_CHANNEL_FLAGS_SEND_REQ;
 			} else {
-				channel->state = DATA_CHANNEL_CLOSED;
-				channel->unordered = 0;
-				channel->pr_policy = 0;
-				channel->pr_value = 0;
-				channel->o_stream = 0;
-				channel->flags = 0;
+				pc->i_stream_channel[o_stream] = NULL;
+				pc->i_stream_dce_ch[o_stream] = NULL;
+				release_channel(pc, channel);
 				channel = NULL;
 			}
 		}
@@ -732,13 +929,95 @@ send_user_message(struct peer_connection *pc, struct channel *channel, const voi
 	                  NULL, 0,
 	                  &spa, (socklen_t)sizeof(struct sctp_sendv_spa),
 	                  SCTP_SENDV_SPA, 0) < 0) {
-		warning("dce: user: sctp_sendv (%zu bytes) failed (%m)\n", length, errno);
+		int err = errno;
+
+		/* A full send buffer is handled by the caller */
+		if (err != EAGAIN && err != EWOULDBLOCK) {
+			warning("dce: user: sctp_sendv (%zu bytes) failed"
+				" (%m)\n", length, err);
+		}
+		errno = err;
 		return -1;
 	} else {
 		return 0;
 	}
 }
 
+
+struct sendq_ctx {
+	struct peer_connection *pc;
+	struct channel *channel;
+};
+
+
+static int sendq_send_handler(const uint8_t *data, size_t len, void *arg)
+{
+	struct sendq_ctx *ctx = arg;
+
+	if (send_user_message(ctx->pc, ctx->channel, data, len))
+		return errno ? errno : EIO;
+
+	return 0;
+}
+
+
+/*
+ * Hands queued messages of a channel to SCTP until its send buffer
+ * is full again. Called with the peer connection locked.
+ */
+static void sendq_flush(struct dce *dce, struct dce_channel *ch)
+{
+	struct peer_connection *pc = &dce->pc;
+	struct sendq_ctx ctx;
+	bool above = ch->sendq.buffered > ch->lowmark;
+	uint64_t dropped = ch->sendq.dropped;
+
+	if (ch->id < 0 || (uint32_t)ch->id >= pc->channelc)
+		return;
+
+	ctx.pc = pc;
+	ctx.channel = pc->channelv[ch->id];
+
+	/* A message that SCTP has no room for stays queued and is retried
+	 * on the next flush, one it rejects for good is dropped.
+	 */
+	(void)dce_sendq_send(&ch->sendq, sendq_send_handler, &ctx);
+	if (ch->sendq.dropped != dropped) {
+		warning("dce: send: channel %d: dropped %llu messages (%m)\n",
+			ch->id,
+			(unsigned long long)(ch->sendq.dropped - dropped),
+			ch->sendq.dropped_err);
+	}
+
+	if (above && ch->sendq.buffered <= ch->lowmark && ch->lowh) {
+		struct payload *pld;
+
+		pld = payload_new(dce, ch, CH_BUFLOW);
+		if (!pld)
+			return;
+
+		pld->v.buflow.amount = ch->sendq.buffered;
+
+		payload_post(pld);
+	}
+}
+
+
+static bool sendq_isempty(const struct dce *dce)
+{
+	struct le *le;
+
+	LIST_FOREACH(&dce->channell, le) {
+		const struct dce_channel *ch = le->data;
+
+		if (!dce_sendq_isempty(&ch->sendq))
+			return false;
+	}
+
+	return true;
+}
+
+
 static void
 reset_outgoing_stream(struct peer_connection *pc, uint16_t o_stream)
 {
@@ -845,6 +1124,18 @@ handle_open_request_message(struct dce *dce,
 	if(is_odd && !pc->open_even_sid){
 		error("dce: We expect the remote side to open even stream id's \n");
 	}
+
+	if (i_stream >= pc->streamc) {
+		uint32_t n = pc->streamc;
+
+		while (n <= i_stream)
+			n *= 2;
+		if (i_stream >= pc->max_streams || grow_streams(pc, n)) {
+			warning("handle_open_request_message:"
+				" no room for stream %u\n", i_stream);
+			return;
+		}
+	}
     
 	if ((channel = find_channel_by_i_stream(pc, i_stream))) {
 		warning("handle_open_request_message:"
@@ -933,6 +1224,7 @@ handle_open_request_message(struct dce *dce,
 		}
 	}
 	pc->i_stream_channel[i_stream] = channel;
+	pc->i_stream_dce_ch[i_stream] = NULL;
 	if (o_stream == 0) {
 		request_more_o_streams(pc);
 	} else {
@@ -945,13 +1237,8 @@ handle_open_request_message(struct dce *dce,
 			} else {
 				/* XXX: Signal error to the other end. */
 				pc->i_stream_channel[i_stream] = NULL;
-				channel->state = DATA_CHANNEL_CLOSED;
-				channel->unordered = 0;
-				channel->pr_policy = 0;
-				channel->pr_value = 0;
-				channel->i_stream = 0;
-				channel->o_stream = 0;
-				channel->flags = 0;
+				pc->i_stream_dce_ch[i_stream] = NULL;
+				release_channel(pc, channel);
 			}
 		}
 	}
@@ -970,7 +1257,7 @@ handle_open_request_message(struct dce *dce,
 
 			pld->v.chopen.sid = channel->o_stream;
 
-			mqueue_push(g_dce.mqueue, pld->type, pld);
+			payload_post(pld);
 		}
 	}
 }
@@ -1010,7 +1297,7 @@ handle_open_ack_message(struct dce *dce,
 
 		pld->v.chopen.sid = channel->i_stream;
 
-		mqueue_push(g_dce.mqueue, pld->type, pld);
+		payload_post(pld);
 	}
 	return;
 }
@@ -1023,11 +1310,12 @@ handle_unknown_message(char *msg, size_t length, uint16_t i_stream)
 }
 
 static void
-handle_data_message(struct dce *dce,
+handle_data_message(struct dce *dce, struct rcvbuf *rb,
                     char *buffer, size_t length, uint16_t i_stream)
 {
 	struct peer_connection *pc = &dce->pc;
 	struct channel *channel;
+	struct dce_channel *ch;
 
 	channel = find_channel_by_i_stream(pc, i_stream);
 	if (channel == NULL) {
@@ -1046,10 +1334,11 @@ handle_data_message(struct dce *dce,
 		debug("dce: message received of length %zu on chan: %d\n",
 		      length, channel->id);
 
-		unlock_peer_connection(&dce->pc);		
-
-		struct dce_channel *ch = NULL;
-		ch = get_dce_channel(dce, channel->label);
+		ch = pc->i_stream_dce_ch[i_stream];
+		if (!ch) {
+			ch = get_dce_channel(dce, channel->label);
+			pc->i_stream_dce_ch[i_stream] = ch;
+		}
 
 		if (ch) {
 			struct payload *pld;
@@ -1058,15 +1347,16 @@ handle_data_message(struct dce *dce,
 			if (!pld)
 				return;
 
-			pld->v.chdata.buf = mem_alloc(length, NULL);
-			memcpy(pld->v.chdata.buf, buffer, length);
+			/* Keep a reference to the usrsctp buffer
+			 * instead of copying the message.
+			 */
+			pld->v.chdata.rb = mem_ref(rb);
+			pld->v.chdata.buf = (uint8_t *)buffer;
 			pld->v.chdata.len = length;
 
-			mqueue_push(g_dce.mqueue, pld->type, pld);
+			payload_post(pld);
 		}
 
-		lock_peer_connection(&dce->pc);		
-
 		/* Assuming DATA_CHANNEL_PPID_DOMSTRING */
 		/* XXX: Protect for non 0 terminated buffer */
 	}
@@ -1074,7 +1364,7 @@ handle_data_message(struct dce *dce,
 }
 
 static void
-handle_message(struct dce *dce,
+handle_message(struct dce *dce, struct rcvbuf *rb,
 	       char *buffer, size_t length, uint32_t ppid, uint16_t i_stream)
 {
 	struct rtcweb_datachannel_open_request *req;
@@ -1113,7 +1403,7 @@ handle_message(struct dce *dce,
 
 	case DATA_CHANNEL_PPID_DOMSTRING:
 	case DATA_CHANNEL_PPID_BINARY:
-		handle_data_message(dce, buffer, length, i_stream);
+		handle_data_message(dce, rb, buffer, length, i_stream);
 		break;
 
 	default:
@@ -1143,7 +1433,7 @@ handle_association_change_event(struct dce *dce,
 			if (!pld)
 				return;
 
-			mqueue_push(g_dce.mqueue, pld->type, pld);
+			payload_post(pld);
 
 			LIST_FOREACH(&dce->channell, le) {
 				struct dce_channel *ch = le->data;
@@ -1152,7 +1442,7 @@ handle_association_change_event(struct dce *dce,
 				if (!pld)
 					return;
 
-				mqueue_push(g_dce.mqueue, pld->type, pld);
+				payload_post(pld);
 			}
 		}
 		lock_peer_connection(&dce->pc);		
@@ -1327,13 +1617,10 @@ handle_stream_reset_event(struct dce *dce, struct sctp_stream_reset_event *strrs
 				channel = find_channel_by_i_stream(pc, strrst->strreset_stream_list[i]);
 				if (channel != NULL) {
 					pc->i_stream_channel[channel->i_stream] = NULL;
+					pc->i_stream_dce_ch[channel->i_stream] = NULL;
 					channel->i_stream = 0;
 					if (channel->o_stream == 0) {
-						channel->pr_policy = SCTP_PR_SCTP_NONE;
-						channel->pr_value = 0;
-						channel->unordered = 0;
-						channel->flags = 0;
-						channel->state = DATA_CHANNEL_CLOSED;
+						release_channel(pc, channel);
 					} else {
 						if (channel->state == DATA_CHANNEL_OPEN) {
 							reset_outgoing_stream(pc, channel->o_stream);
@@ -1350,11 +1637,7 @@ handle_stream_reset_event(struct dce *dce, struct sctp_stream_reset_event *strrs
 					pc->o_stream_channel[channel->o_stream] = NULL;
 					channel->o_stream = 0;
 					if (channel->i_stream == 0) {
-						channel->pr_policy = SCTP_PR_SCTP_NONE;
-						channel->pr_value = 0;
-						channel->unordered = 0;
-						channel->flags = 0;
-						channel->state = DATA_CHANNEL_CLOSED;
+						release_channel(pc, channel);
 					}
 				}
 			}
@@ -1371,7 +1654,7 @@ handle_stream_reset_event(struct dce *dce, struct sctp_stream_reset_event *strrs
 				if (!pld)
 					return;
 
-				mqueue_push(g_dce.mqueue, pld->type, pld);
+				payload_post(pld);
 			}
 		}
 	}
@@ -1387,8 +1670,8 @@ handle_stream_change_event(struct peer_connection *pc, struct sctp_stream_change
 
 	debug("Stream change event: streams (in/out) = (%u/%u), flags = %x.\n",
 	       strchg->strchange_instrms, strchg->strchange_outstrms, strchg->strchange_flags);
-	for (i = 0; i < NUMBER_OF_CHANNELS; i++) {
-		channel = &(pc->channels[i]);
+	for (i = 0; i < pc->channelc; i++) {
+		channel = pc->channelv[i];
 		if ((channel->state == DATA_CHANNEL_CONNECTING) &&
 		    (channel->o_stream == 0)) {
 			if ((strchg->strchange_flags & SCTP_STREAM_CHANGE_DENIED) ||
@@ -1396,14 +1679,9 @@ handle_stream_change_event(struct peer_connection *pc, struct sctp_stream_change
 				/* XXX: Signal to the other end. */
 				if (channel->i_stream != 0) {
 					pc->i_stream_channel[channel->i_stream] = NULL;
+					pc->i_stream_dce_ch[channel->i_stream] = NULL;
 				}
-				channel->unordered = 0;
-				channel->pr_policy = SCTP_PR_SCTP_NONE;
-				channel->pr_value = 0;
-				channel->i_stream = 0;
-				channel->o_stream = 0;
-				channel->flags = 0;
-				channel->state = DATA_CHANNEL_CLOSED;
+				release_channel(pc, channel);
 			} else {
 				o_stream = find_free_o_stream(pc);
 				if (o_stream != 0) {
@@ -1491,8 +1769,14 @@ handle_notification(struct dce *dce,
 		break;
 	case SCTP_AUTHENTICATION_EVENT:
 		break;
-	case SCTP_SENDER_DRY_EVENT:
-		dce->snd_dry_event = true;
+	case SCTP_SENDER_DRY_EVENT: {
+		struct le *le;
+
+		LIST_FOREACH(&dce->channell, le)
+			sendq_flush(dce, le->data);
+
+		dce->snd_dry_event = sendq_isempty(dce);
+	}
 		break;
 	case SCTP_NOTIFICATIONS_STOPPED_EVENT:
 		break;
@@ -1574,8 +1858,8 @@ print_status(const struct peer_connection *pc, struct re_printf *pf)
 	}
 	err |= re_hprintf(pf,"        Number of streams (i/o) = (%u/%u)\n",
 	       status.sstat_instrms, status.sstat_outstrms);
-	for (i = 0; i < NUMBER_OF_CHANNELS; i++) {
-		channel = &(pc->channels[i]);
+	for (i = 0; i < pc->channelc; i++) {
+		channel = pc->channelv[i];
 		if (channel->state == DATA_CHANNEL_CLOSED) {
 			continue;
 		}
@@ -1631,30 +1915,28 @@ static int
 receive_cb(struct socket *sock, union sctp_sockstore addr, void *data,
            size_t datalen, struct sctp_rcvinfo rcv, int flags, void *ulp_info)
 {
-	struct dce *dce = ulp_info;
-	int err = 0;
+	uintptr_t token = (uintptr_t)ulp_info;
+	struct rcvbuf *rb = NULL;
+	struct dce *dce;
 
-	if (!dce) {
+	if (!token) {
 		warning("dce: receive_cb: dce == NULL\n");
 		return 1;
 	}
 
-	debug("sock=%p dce=%p dce->pc=%p\n", sock, dce, &dce->pc);
-
-	lock_write_get(g_dce.lock);
-	if (!exist_dce(&g_dce.dcel, dce)) {
-		warning("dce: receive_cb: dce(%p) not active\n", dce);
-		err = ENOSYS;
-	}
-	else {
-		assert(DCE_MAGIC == dce->magic);
-		/* Make sure we have a ref to the dce */
-		mem_ref(dce);
+	dce = dce_slot_get(g_dce.slots, token);
+	if (!dce) {
+		warning("dce: receive_cb: dce(0x%lx) not active\n",
+			(unsigned long)token);
+		return 1;
 	}
-	lock_rel(g_dce.lock);
 
-	if (err)
-		return 1;
+	assert(DCE_MAGIC == dce->magic);
+	/* Make sure we have a ref to the dce */
+	mem_ref(dce);
+	dce_slot_put(g_dce.slots, token);
+
+	debug("sock=%p dce=%p dce->pc=%p\n", sock, dce, &dce->pc);
 	
 	if (data) {
 		lock_peer_connection(&dce->pc);
@@ -1662,18 +1944,27 @@ receive_cb(struct socket *sock, union sctp_sockstore addr, void *data,
 			handle_notification(dce,
 				  (union sctp_notification *)data, datalen);
 		} else {
-			handle_message(dce,
-				       data, datalen,
-				       ntohl(rcv.rcv_ppid), rcv.rcv_sid);
+			/* Received messages reference the usrsctp
+			 * buffer, it is freed with the last of them.
+			 */
+			rb = mem_zalloc(sizeof(*rb), rcvbuf_destructor);
+			if (rb) {
+				rb->data = data;
+				handle_message(dce, rb,
+					       data, datalen,
+					       ntohl(rcv.rcv_ppid),
+					       rcv.rcv_sid);
+				data = NULL;
+			}
 		}
 		unlock_peer_connection(&dce->pc);
 
+		mem_deref(rb);
 		free(data);
 	}
 	else {
-		usrsctp_deregister_address(dce);
-		if (dce)
-			dce->sock = NULL;
+		usrsctp_deregister_address(dce_addr(dce));
+		dce->sock = NULL;
 		usrsctp_close(sock);
 	}
 
@@ -1720,7 +2011,7 @@ int dce_connect(struct dce *dce, bool dtls_role_active)
 	sconn.sconn_len = sizeof(struct sockaddr_conn);
 #endif
 	sconn.sconn_port = htons(port);
-	sconn.sconn_addr = dce;
+	sconn.sconn_addr = dce_addr(dce);
 	
 	sctp_err = usrsctp_connect(dce->sock, (struct sockaddr *)&sconn,
 				   sizeof(sconn));
@@ -1775,17 +2066,22 @@ int dce_open_chan(struct dce *dce, struct dce_channel *ch)
 int
 dce_close_chan(struct dce *dce, struct dce_channel *ch)
 {
+	struct peer_connection *pc;
+
 	if (!dce || !ch)
 		return EINVAL;
 
 	assert(DCE_MAGIC == dce->magic);
-    
-	if (ch->id >= NUMBER_OF_CHANNELS || ch->id < 0)
+
+	pc = &dce->pc;
+
+	lock_peer_connection(pc);
+	if (ch->id < 0 || (uint32_t)ch->id >= pc->channelc) {
+		unlock_peer_connection(pc);
 		return ERANGE;
-    
-	lock_peer_connection(&dce->pc);
-	close_channel(&dce->pc, &dce->pc.channels[ch->id]);
-	unlock_peer_connection(&dce->pc);
+	}
+	close_channel(pc, pc->channelv[ch->id]);
+	unlock_peer_connection(pc);
 
 	return 0;
 }
@@ -1819,32 +2115,106 @@ void dce_recv_pkt(struct dce *dce, const uint8_t *pkt, size_t len)
 		}
 	}
 
-	usrsctp_conninput(dce, pkt, len, 0);
+	usrsctp_conninput(dce_addr(dce), pkt, len, 0);
 }
 
 
 int dce_send(struct dce *dce, struct dce_channel *ch, const void *data, size_t len)
 {
+	struct peer_connection *pc;
+	int ret = 0;
+
 	if (!dce || !ch)
 		return EINVAL;
 
 	assert(DCE_MAGIC == dce->magic);
-    
-	if (ch->id >= NUMBER_OF_CHANNELS || ch->id < 0) {
+
+	pc = &dce->pc;
+
+	lock_peer_connection(pc);
+
+	if (ch->id < 0 || (uint32_t)ch->id >= pc->channelc) {
 		warning("dce: send: invalid channel %d\n", ch->id);
-		return ERANGE;
+		ret = ERANGE;
+		goto out;
 	}
 
-	lock_peer_connection(&dce->pc);
 	dce->snd_dry_event = false;
-	int ret = send_user_message(&dce->pc,
-			  &dce->pc.channels[ch->id],
-			  data, len);
-	unlock_peer_connection(&dce->pc);
+
+	/* Messages already waiting go first */
+	if (dce_sendq_isempty(&ch->sendq)) {
+		ret = send_user_message(pc, pc->channelv[ch->id], data, len);
+		if (ret == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			goto out;
+	}
+
+	ret = dce_sendq_append(&ch->sendq, data, len, DCE_MAX_BUFFERED);
+	if (ret) {
+		warning("dce: send: channel %d: cannot queue %zu bytes,"
+			" %zu buffered (%m)\n", ch->id, len,
+			ch->sendq.buffered, ret);
+		goto out;
+	}
+
+	sendq_flush(dce, ch);
+
+ out:
+	unlock_peer_connection(pc);
 
 	return ret;
 }
 
+
+size_t dce_buffered_amount(struct dce *dce, const struct dce_channel *ch)
+{
+	size_t amount;
+
+	if (!dce || !ch)
+		return 0;
+
+	lock_peer_connection(&dce->pc);
+	amount = ch->sendq.buffered;
+	unlock_peer_connection(&dce->pc);
+
+	return amount;
+}
+
+
+int dce_set_buffered_low(struct dce *dce, struct dce_channel *ch,
+			 size_t lowmark, dce_buffered_low_h *lowh)
+{
+	if (!dce || !ch)
+		return EINVAL;
+
+	lock_peer_connection(&dce->pc);
+	ch->lowmark = lowmark;
+	ch->lowh = lowh;
+	unlock_peer_connection(&dce->pc);
+
+	return 0;
+}
+
+
+int dce_set_max_streams(struct dce *dce, uint16_t n)
+{
+	struct peer_connection *pc;
+	int err = 0;
+
+	if (!dce || !n)
+		return EINVAL;
+
+	pc = &dce->pc;
+
+	lock_peer_connection(pc);
+	if (n < pc->streamc || n < pc->channelc)
+		err = EBUSY;
+	else
+		pc->max_streams = n;
+	unlock_peer_connection(pc);
+
+	return err;
+}
+
 bool dce_snd_dry(struct dce *dce)
 {
 	return dce->snd_dry_event;
@@ -1865,13 +2235,12 @@ debug_printf(const char *format, ...)
 static void dce_destructor(void *arg)
 {
 	struct dce *dce = arg;
+	void *addr = dce_addr(dce);
 
-	lock_write_get(g_dce.lock);
-	list_unlink(&dce->le);
-	lock_rel(g_dce.lock);
+	/* From here on usrsctp can no longer reach this dce */
+	dce_slot_release(g_dce.slots, dce->token);
+	dce->token = 0;
 
-	assert(DCE_MAGIC == dce->magic);
-    
 	info("dce: destructor: %p\n", dce);
 
 	dce->sendh = NULL;
@@ -1884,7 +2253,8 @@ static void dce_destructor(void *arg)
 	}
 #endif
 
-	usrsctp_deregister_address(dce);
+	if (addr)
+		usrsctp_deregister_address(addr);
 	if (dce->sock) {
 		struct socket *sock = dce->sock;
 		dce->sock = NULL;
@@ -1900,19 +2270,20 @@ static void dce_destructor(void *arg)
 static int usrsctp_send_handler(void *addr, void *buf, size_t len,
 				uint8_t tos, uint8_t set_df)
 {
-	struct dce *dce = addr;
+	uintptr_t token = (uintptr_t)addr;
+	struct dce *dce;
 	struct sctp_header hdr;
 	struct mbuf mb;
 	int err;
     
-	if (!dce)
+	if (!token)
 		return EINVAL;
 
-	lock_write_get(g_dce.lock);
-	if (!exist_dce(&g_dce.dcel, dce)) {
-		debug("dce: send: dce(%p) not active\n", dce);
-		err = ENOSYS;
-		goto out;
+	dce = dce_slot_get(g_dce.slots, token);
+	if (!dce) {
+		debug("dce: send: dce(0x%lx) not active\n",
+		      (unsigned long)token);
+		return 1;
 	}
 
 	assert(DCE_MAGIC == dce->magic);
@@ -1940,29 +2311,30 @@ static int usrsctp_send_handler(void *addr, void *buf, size_t len,
 	}
 
  out:
-	lock_rel(g_dce.lock);
+	dce_slot_put(g_dce.slots, token);
 
 	return err ? 1 : 0;
 }
 
 
-static void dce_mqueue_handler(int id, void *data, void *arg)
+static void payload_handle(struct payload *pld)
 {
-	struct payload *pld = data;
 	struct dce_channel *ch;
+	struct dce *dce;
 	bool valid;
-	(void)arg;
+	int id = pld->type;
 
-	info("dce: mqueue_handler:  id=%d <dce=%p>\n", id, pld->dce);
+	debug("dce: payload_handle:  id=%d <dce=%p>\n", id, pld->dce);
 
 	if (PAYLOAD_MAGIC != pld->magic) {
 		warning("dce: invalid payload magic\n");
-		return;
+		goto out;
 	}
 
-	lock_write_get(g_dce.lock);
-	valid = exist_dce(&g_dce.dcel, pld->dce);
-	lock_rel(g_dce.lock);
+	dce = dce_slot_get(g_dce.slots, pld->token);
+	if (dce)
+		dce_slot_put(g_dce.slots, pld->token);
+	valid = dce && dce == pld->dce;
 
 	if (!valid) {
 		warning("dce: mqueue_recv: dce(%p) not valid\n", pld->dce);
@@ -2006,16 +2378,48 @@ static void dce_mqueue_handler(int id, void *data, void *arg)
 		}
 		break;
 
+	case CH_BUFLOW:
+		if (ch->lowh)
+			ch->lowh(ch->id, pld->v.buflow.amount, ch->arg);
+		break;
+
 	default:
 		warning("dce: mqueue: ignored event %d\n", id);
 		break;
 	}
 
  out:
+	/* Also unlinks it from the batch, which is drained by this */
 	mem_deref(pld);
 }
 
 
+/* Delivers all payloads queued since the last wakeup, in order */
+static void dce_mqueue_handler(int id, void *data, void *arg)
+{
+	struct list batch = LIST_INIT;
+	struct le *le;
+	(void)data;
+	(void)arg;
+
+	if (MQ_BATCH != id) {
+		warning("dce: mqueue: ignored event %d\n", id);
+		return;
+	}
+
+	lock_write_get(g_dce.qlock);
+	while ((le = list_head(&g_dce.pendingl))) {
+		list_unlink(le);
+		list_append(&batch, le, le->data);
+	}
+	g_dce.posted = false;
+	lock_rel(g_dce.qlock);
+
+	while ((le = list_head(&batch)))
+		payload_handle(le->data);
+}
+
+
 int dce_init(void)
 {
 	int err;
@@ -2027,9 +2431,11 @@ int dce_init(void)
 
 	memset(&g_dce, 0, sizeof(g_dce));
 
-	list_init(&g_dce.dcel);
+	err = lock_alloc(&g_dce.qlock);
+	if (err)
+		return err;
 
-	err = lock_alloc(&g_dce.lock);
+	err = dce_slots_alloc(&g_dce.slots);
 	if (err)
 		return err;
 
@@ -2059,7 +2465,7 @@ void dce_close(void)
 		usleep(500000);
 	}
 
-	mem_deref(g_dce.lock);
+	g_dce.slots = mem_deref(g_dce.slots);
 
 	g_dce.mqueue = mem_deref(g_dce.mqueue);
 
@@ -2068,6 +2474,8 @@ void dce_close(void)
 			  list_count(&g_dce.pendingl));
 	}
 	list_flush(&g_dce.pendingl);
+	g_dce.posted = false;
+	g_dce.qlock = mem_deref(g_dce.qlock);
 
 	dce_inited = false;	
 }
@@ -2119,10 +2527,16 @@ int dce_alloc(struct dce **dcep,
 #endif
 	usrsctp_sysctl_set_sctp_blackhole(2);
 
-	usrsctp_register_address(dce);
+	err = dce_slot_alloc(g_dce.slots, &dce->token);
+	if (err) {
+		warning("dce: alloc: no free association slot\n");
+		goto out;
+	}
+
+	usrsctp_register_address(dce_addr(dce));
 
 	dce->sock = usrsctp_socket(AF_CONN, SOCK_STREAM, IPPROTO_SCTP,
-				   receive_cb, NULL, 0, dce);
+				   receive_cb, NULL, 0, dce_addr(dce));
 	
 	if (dce->sock == NULL) {
 		warning("dce: alloc: failed to create socket\n");
@@ -2217,7 +2631,7 @@ int dce_alloc(struct dce **dcep,
 	sconn.sconn_len = sizeof(sconn);
 #endif
 	sconn.sconn_port = htons(port);
-	sconn.sconn_addr = dce;
+	sconn.sconn_addr = dce_addr(dce);
 	info("dce: alloc: binding: %p:%d\n", dce, port);
 	sctp_err = usrsctp_bind(dce->sock,
 				(struct sockaddr *)&sconn, sizeof(sconn));
@@ -2239,10 +2653,8 @@ int dce_alloc(struct dce **dcep,
     
 	dce->magic = DCE_MAGIC;
 
-	lock_write_get(g_dce.lock);
-	list_append(&g_dce.dcel, &dce->le, dce);
-	lock_rel(g_dce.lock);
-    
+	dce_slot_publish(g_dce.slots, dce->token, dce);
+
  out:
 	if (err)
 		mem_deref(dce);
@@ -2252,6 +2664,14 @@ int dce_alloc(struct dce **dcep,
 	return err;
 }
 
+static void dce_channel_destructor(void *arg)
+{
+	struct dce_channel *ch = arg;
+
+	dce_sendq_clear(&ch->sendq);
+}
+
+
 int dce_channel_alloc(struct dce_channel **chp,
 		      struct dce *dce,
 		      const char *label,
@@ -2277,7 +2697,7 @@ int dce_channel_alloc(struct dce_channel **chp,
 		return EALREADY;
 	}
 
-	ch = mem_zalloc(sizeof(*ch), NULL);
+	ch = mem_zalloc(sizeof(*ch), dce_channel_destructor);
 	if (!ch)
 		return ENOMEM;
 	
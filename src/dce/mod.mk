@@ -3,6 +3,8 @@
 #
 
 AVS_SRCS += \
+	dce/sendq.c \
+	dce/slot.c \
 	#dce/dce_pc.c
 #dce/dce.c
 
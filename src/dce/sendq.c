@@ -0,0 +1,108 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+
+#include "sendq.h"
+
+
+struct sndmsg {
+	struct le le;
+	struct mbuf *mb;
+};
+
+
+static void sndmsg_destructor(void *arg)
+{
+	struct sndmsg *msg = arg;
+
+	list_unlink(&msg->le);
+	mem_deref(msg->mb);
+}
+
+
+int dce_sendq_append(struct dce_sendq *q, const void *data, size_t len,
+		     size_t max)
+{
+	struct sndmsg *msg;
+
+	if (!q || (!data && len))
+		return EINVAL;
+
+	if (q->buffered + len > max)
+		return ENOBUFS;
+
+	msg = mem_zalloc(sizeof(*msg), sndmsg_destructor);
+	if (!msg)
+		return ENOMEM;
+
+	msg->mb = mbuf_alloc(len);
+	if (!msg->mb) {
+		mem_deref(msg);
+		return ENOMEM;
+	}
+	(void)mbuf_write_mem(msg->mb, data, len);
+	msg->mb->pos = 0;
+
+	list_append(&q->msgl, &msg->le, msg);
+	q->buffered += len;
+
+	return 0;
+}
+
+
+int dce_sendq_send(struct dce_sendq *q, dce_sendq_h *sendh, void *arg)
+{
+	struct le *le;
+	int err = 0;
+
+	if (!q || !sendh)
+		return EINVAL;
+
+	while ((le = list_head(&q->msgl))) {
+		struct sndmsg *msg = le->data;
+		size_t len = mbuf_get_left(msg->mb);
+		int e;
+
+		e = sendh(mbuf_buf(msg->mb), len, arg);
+		if (e == EAGAIN || e == EWOULDBLOCK || e == ENOBUFS)
+			return e;
+
+		/* Any other error will not go away on a retry */
+		if (e) {
+			++q->dropped;
+			q->dropped_err = e;
+			err = e;
+		}
+
+		q->buffered -= len;
+		mem_deref(msg);
+	}
+
+	return err;
+}
+
+
+void dce_sendq_clear(struct dce_sendq *q)
+{
+	if (!q)
+		return;
+
+	list_flush(&q->msgl);
+	q->buffered = 0;
+}
@@ -0,0 +1,60 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DCE_SENDQ_H
+#define DCE_SENDQ_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Messages of one data channel waiting for SCTP buffer space */
+struct dce_sendq {
+	struct list msgl;
+	size_t buffered;     /* bytes in msgl */
+	uint64_t dropped;    /* messages that failed for good */
+	int dropped_err;     /* error of the last one dropped */
+};
+
+/* Returns 0 when the message was taken, EAGAIN or ENOBUFS when the
+ * buffer is full, any other error when the message cannot be sent.
+ */
+typedef int (dce_sendq_h)(const uint8_t *data, size_t len, void *arg);
+
+int  dce_sendq_append(struct dce_sendq *q, const void *data, size_t len,
+		      size_t max);
+
+/* Sends queued messages in order until the buffer is full. A message
+ * refused with EAGAIN, EWOULDBLOCK or ENOBUFS stays at the head of the
+ * queue and that error is returned. A message failing with any other
+ * error is dropped and counted, and sending goes on; the last such
+ * error is returned once the queue is empty, 0 if there was none.
+ */
+int  dce_sendq_send(struct dce_sendq *q, dce_sendq_h *sendh, void *arg);
+void dce_sendq_clear(struct dce_sendq *q);
+
+static inline bool dce_sendq_isempty(const struct dce_sendq *q)
+{
+	return q ? list_isempty(&q->msgl) : true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
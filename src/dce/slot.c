@@ -0,0 +1,187 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sched.h>
+
+#include <re.h>
+
+#include "slot.h"
+
+
+#define DCE_SLOT_MASK (DCE_SLOTS - 1)
+#define DCE_GEN_MASK  0xfffff
+
+
+struct dce_slot {
+	void *obj;
+	uint32_t gen;    /* bumped when the slot is released */
+	uint32_t users;  /* lookups in progress */
+};
+
+struct dce_slots {
+	struct dce_slot slotv[DCE_SLOTS];
+	struct lock *lock;
+	uint16_t freev[DCE_SLOTS]; /* free slot indices, protected by lock */
+	size_t freec;
+};
+
+
+static void slots_destructor(void *arg)
+{
+	struct dce_slots *st = arg;
+
+	mem_deref(st->lock);
+}
+
+
+int dce_slots_alloc(struct dce_slots **stp)
+{
+	struct dce_slots *st;
+	size_t i;
+	int err;
+
+	if (!stp)
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), slots_destructor);
+	if (!st)
+		return ENOMEM;
+
+	err = lock_alloc(&st->lock);
+	if (err)
+		goto out;
+
+	for (i = 0; i < DCE_SLOTS; i++) {
+		st->slotv[i].gen = 1;
+		st->freev[i] = DCE_SLOTS - 1 - i;
+	}
+	st->freec = DCE_SLOTS;
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*stp = st;
+
+	return err;
+}
+
+
+int dce_slot_alloc(struct dce_slots *st, uintptr_t *tokenp)
+{
+	uint16_t ix;
+	int err = 0;
+
+	if (!st || !tokenp)
+		return EINVAL;
+
+	lock_write_get(st->lock);
+
+	if (!st->freec) {
+		err = ENOSPC;
+		goto out;
+	}
+
+	ix = st->freev[--st->freec];
+
+	*tokenp = ((uintptr_t)st->slotv[ix].gen << DCE_SLOT_BITS) | ix;
+
+ out:
+	lock_rel(st->lock);
+
+	return err;
+}
+
+
+void dce_slot_publish(struct dce_slots *st, uintptr_t token, void *obj)
+{
+	struct dce_slot *slot;
+
+	if (!st || !token)
+		return;
+
+	slot = &st->slotv[token & DCE_SLOT_MASK];
+
+	__atomic_store_n(&slot->obj, obj, __ATOMIC_RELEASE);
+}
+
+
+void dce_slot_release(struct dce_slots *st, uintptr_t token)
+{
+	struct dce_slot *slot;
+	uint32_t gen;
+	uint16_t ix;
+
+	if (!st || !token)
+		return;
+
+	ix = token & DCE_SLOT_MASK;
+	slot = &st->slotv[ix];
+
+	/* Invalidate the token, then wait for lookups
+	 * that saw the old generation to finish.
+	 */
+	gen = (slot->gen + 1) & DCE_GEN_MASK;
+	if (!gen)
+		gen = 1;
+	__atomic_store_n(&slot->gen, gen, __ATOMIC_SEQ_CST);
+
+	while (__atomic_load_n(&slot->users, __ATOMIC_SEQ_CST))
+		sched_yield();
+
+	__atomic_store_n(&slot->obj, NULL, __ATOMIC_RELAXED);
+
+	lock_write_get(st->lock);
+	st->freev[st->freec++] = ix;
+	lock_rel(st->lock);
+}
+
+
+void *dce_slot_get(struct dce_slots *st, uintptr_t token)
+{
+	struct dce_slot *slot;
+	void *obj = NULL;
+
+	if (!st || !token)
+		return NULL;
+
+	slot = &st->slotv[token & DCE_SLOT_MASK];
+
+	__atomic_fetch_add(&slot->users, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&slot->gen, __ATOMIC_SEQ_CST)
+	    == (token >> DCE_SLOT_BITS)) {
+		obj = __atomic_load_n(&slot->obj, __ATOMIC_ACQUIRE);
+	}
+	if (!obj)
+		__atomic_fetch_sub(&slot->users, 1, __ATOMIC_RELEASE);
+
+	return obj;
+}
+
+
+void dce_slot_put(struct dce_slots *st, uintptr_t token)
+{
+	struct dce_slot *slot;
+
+	if (!st || !token)
+		return;
+
+	slot = &st->slotv[token & DCE_SLOT_MASK];
+
+	__atomic_fetch_sub(&slot->users, 1, __ATOMIC_RELEASE);
+}
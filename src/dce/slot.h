@@ -0,0 +1,56 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DCE_SLOT_H
+#define DCE_SLOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Associations are addressed by a token instead of an object pointer.
+ * The token indexes a slot in a fixed table and carries the generation
+ * of the slot, so a stale token is detected in O(1) and lookups take
+ * no lock. The table lock is only taken to allocate and free slots.
+ */
+#define DCE_SLOT_BITS 12
+#define DCE_SLOTS     (1 << DCE_SLOT_BITS)
+
+struct dce_slots;
+
+int   dce_slots_alloc(struct dce_slots **stp);
+
+/* Reserves a slot, fails with ENOSPC once all DCE_SLOTS are in use */
+int   dce_slot_alloc(struct dce_slots *st, uintptr_t *tokenp);
+
+/* Makes a fully set up object reachable through its token */
+void  dce_slot_publish(struct dce_slots *st, uintptr_t token, void *obj);
+
+/* Invalidates the token and waits for lookups in progress */
+void  dce_slot_release(struct dce_slots *st, uintptr_t token);
+
+/* A non-NULL object stays valid until the matching dce_slot_put() */
+void *dce_slot_get(struct dce_slots *st, uintptr_t token);
+void  dce_slot_put(struct dce_slots *st, uintptr_t token);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -95,6 +95,10 @@ void ecall_close(struct ecall *ecall, int err, uint32_t msg_time)
 	ecall->icall.qualityh = NULL;
 	tmr_cancel(&ecall->quality.tmr);
 
+	/* Hands the last partial period up while the handler is valid */
+	ecall_qhist_stop(ecall);
+	ecall->icall.quality_sampleh = NULL;
+
 	closeh = ecall->icall.closeh;
 
 	if (err) {
@@ -572,6 +576,7 @@ static void ecall_destructor(void *data)
 	tmr_cancel(&ecall->update_tmr);
 
 	tmr_cancel(&ecall->quality.tmr);
+	tmr_cancel(&ecall->qhist.tmr);
 
 	if (ecall->conf_part) {
 		//ecall->conf_part->data = NULL;
@@ -596,8 +601,6 @@ static void ecall_destructor(void *data)
 	mem_deref(ecall->sdp.offer);
 	mem_deref(ecall->media_laddr);
 
-	list_flush(&ecall->tracel);
-
 	/* last thing to do */
 	ecall->magic = 0;
 }
@@ -834,6 +837,22 @@ static int _icall_dce_send(struct icall *icall, struct mbuf *mb)
 	return ecall_dce_send((struct ecall *)icall, mb);
 }
 
+static int _icall_get_audio_levels(struct icall *icall,
+				   struct speaker_level *levelv,
+				   size_t *levelc)
+{
+	return ecall_get_audio_levels((struct ecall*)icall, levelv, levelc);
+}
+
+
+static int _icall_set_active_speakers(struct icall *icall,
+				      const struct speaker_rank *rankv,
+				      size_t rankc)
+{
+	return ecall_set_active_speakers((struct ecall*)icall, rankv, rankc);
+}
+
+
 static int _icall_set_quality_interval(struct icall *icall,
 				       uint64_t interval)
 {
@@ -927,6 +946,8 @@ int ecall_alloc(struct ecall **ecallp, struct list *ecalls,
 			    NULL, // _icall_sft_msg_recv
 			    _icall_get_members,
 			    _icall_set_quality_interval,
+			    _icall_get_audio_levels,
+			    _icall_set_active_speakers,
 			    _icall_dce_send,
 			    NULL, // icall_set_clients
 			    _icall_debug,
@@ -936,6 +957,7 @@ int ecall_alloc(struct ecall **ecallp, struct list *ecalls,
 	list_append(&g_ecalls, &ecall->ecall_le, ecall);
 
 	ecall->ts_start = tmr_jiffies();
+	ecall_qhist_start(ecall);
 
  out:
 	if (err)
@@ -2520,6 +2542,33 @@ int ecall_add_decoders_for_user(struct ecall *ecall,
 }
 
 
+int ecall_get_audio_levels(struct ecall *ecall,
+			   struct speaker_level *levelv,
+			   size_t *levelc)
+{
+	if (!ecall || !levelv || !levelc)
+		return EINVAL;
+
+	if (!ecall->flow || !ecall->flow->get_audio_levels) {
+		*levelc = 0;
+		return 0;
+	}
+
+	return IFLOW_CALLE(ecall->flow, get_audio_levels, levelv, levelc);
+}
+
+
+int ecall_set_active_speakers(struct ecall *ecall,
+			      const struct speaker_rank *rankv,
+			      size_t rankc)
+{
+	if (!ecall)
+		return EINVAL;
+
+	return IFLOW_CALLE(ecall->flow, set_active_speakers, rankv, rankc);
+}
+
+
 int ecall_remove_decoders_for_user(struct ecall *ecall,
 				   const char *userid,
 				   const char *clientid,
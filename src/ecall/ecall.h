@@ -107,6 +107,41 @@ struct user_data {
 	struct file_status file_rcv;
 };
 
+/* Ecall quality history */
+
+#define ECALL_QHIST_SAMPLE  5000   /* ms between flow stats samples   */
+#define ECALL_QHIST_PERIOD  60     /* seconds per history entry       */
+
+/* Averages one period, the history itself is kept by the owner */
+struct ecall_qhist {
+	struct wcall_quality_sample acc;
+	struct tmr tmr;
+};
+
+/* Ecall trace */
+
+#define ECALL_TRACE_SZ       256    /* most recent signaling messages */
+#define ECALL_TRACE_MSG_MAX  0x40   /* above the highest econn_msg    */
+
+/* Compact binary trace entry, kept in a fixed ring per ecall */
+struct trace_entry {
+	uint32_t ts;                   /* ms since the ecall started       */
+	uint32_t age;
+	uint32_t latency;              /* ms to a response of our request */
+	uint8_t msg_type;
+	uint8_t tp;
+	bool tx;
+	bool resp;
+};
+
+struct ecall_trace {
+	struct trace_entry entv[ECALL_TRACE_SZ];
+	uint32_t head;                 /* entries ever written */
+
+	/* ts + 1 of the last request sent per message type, 0 if none */
+	uint32_t reqv[ECALL_TRACE_MSG_MAX];
+};
+
 struct ecall {
 	struct icall icall;
 
@@ -160,7 +195,7 @@ struct ecall {
 
 	struct conf_part *conf_part;
 
-	struct list tracel;
+	struct ecall_trace trace;
 	uint64_t ts_start;
 
 	bool devpair;
@@ -181,6 +216,8 @@ struct ecall {
 		uint64_t interval;
 	} quality;
 
+	struct ecall_qhist qhist;
+
 	struct zapi_ice_server turnv[MAX_TURN_SERVERS];
 	size_t turnc;
 	bool turn_added;
@@ -204,18 +241,7 @@ void ecall_close(struct ecall *ecall, int err, uint32_t msg_time);
 int ecall_set_media_laddr(struct ecall *ecall, struct sa *laddr);
 
 
-/* Ecall trace */
-
-
-struct trace_entry {
-	struct le le;
-
-	uint64_t ts;
-	bool tx;
-	enum econn_transport tp;
-	enum econn_msg msg_type;
-	bool resp;
-	uint32_t age;
-};
-
 int ecall_show_trace(struct re_printf *pf, const struct ecall *ecall);
+
+void ecall_qhist_start(struct ecall *ecall);
+void ecall_qhist_stop(struct ecall *ecall);
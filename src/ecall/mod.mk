@@ -5,6 +5,7 @@
 
 AVS_SRCS += \
 	ecall/ecall.c \
+	ecall/quality.c \
 	ecall/trace.c
 
 
@@ -0,0 +1,119 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <time.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_msystem.h"
+#include "avs_zapi.h"
+#include "avs_base.h"
+#include "avs_icall.h"
+#include "avs_iflow.h"
+#include "avs_econn.h"
+#include "avs_ecall.h"
+#include "avs_wcall.h"
+#include "ecall.h"
+
+
+/*
+ * Every ECALL_QHIST_SAMPLE ms the flow stats are added to an
+ * accumulator, which is averaged into one sample per period and handed
+ * to the quality_sampleh of the icall. The owner keeps the history, so
+ * it survives the ecall.
+ */
+
+
+static void qhist_push(struct ecall *ecall)
+{
+	struct wcall_quality_sample *acc = &ecall->qhist.acc;
+	float n = (float)acc->nsamples;
+
+	acc->rtt /= n;
+	acc->dloss /= n;
+	acc->jitter /= n;
+	acc->send_kbps /= n;
+	acc->recv_kbps /= n;
+	acc->audio_level /= n;
+	acc->video_fps /= n;
+
+	ICALL_CALL_CB(ecall->icall, quality_sampleh,
+		      &ecall->icall, ecall->userid_peer, acc,
+		      ecall->icall.arg);
+
+	memset(acc, 0, sizeof(*acc));
+}
+
+
+static void qhist_timeout(void *arg)
+{
+	struct ecall *ecall = arg;
+	struct ecall_qhist *qh = &ecall->qhist;
+	struct wcall_quality_sample *acc = &qh->acc;
+	struct iflow_stats stats;
+	uint64_t now;
+	int err;
+
+	tmr_start(&qh->tmr, ECALL_QHIST_SAMPLE, qhist_timeout, ecall);
+
+	if (!ecall->flow)
+		return;
+
+	memset(&stats, 0, sizeof(stats));
+	err = IFLOW_CALLE(ecall->flow, get_stats, &stats);
+	if (err)
+		return;
+
+	now = (uint64_t)time(NULL);
+	if (acc->nsamples == 0)
+		acc->ts = now;
+
+	acc->rtt += stats.rtt;
+	acc->dloss += stats.dloss;
+	acc->jitter += stats.jitter;
+	acc->send_kbps += stats.send_kbps;
+	acc->recv_kbps += stats.recv_kbps;
+	acc->audio_level += stats.audio_level;
+	acc->video_fps += stats.video_fps;
+	++acc->nsamples;
+
+	if (now >= acc->ts + ECALL_QHIST_PERIOD)
+		qhist_push(ecall);
+}
+
+
+void ecall_qhist_start(struct ecall *ecall)
+{
+	if (!ecall)
+		return;
+
+	tmr_start(&ecall->qhist.tmr, ECALL_QHIST_SAMPLE,
+		  qhist_timeout, ecall);
+}
+
+
+void ecall_qhist_stop(struct ecall *ecall)
+{
+	if (!ecall)
+		return;
+
+	tmr_cancel(&ecall->qhist.tmr);
+
+	if (ecall->qhist.acc.nsamples)
+		qhist_push(ecall);
+}
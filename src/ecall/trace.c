@@ -26,16 +26,59 @@
 #include "avs_econn.h"
 #include "avs_econn_fmt.h"
 #include "avs_ecall.h"
+#include "avs_wcall.h"
 #include "avs_jzon.h"
 #include "avs_ztime.h"
 #include "ecall.h"
 
 
-static void entry_destructor(void *arg)
+/*
+ * Every message goes into a fixed ring of compact entries per ecall,
+ * the oldest entries are overwritten. A response to one of our
+ * requests is matched by message type and its latency is added to
+ * process wide histograms, updated atomically since calls may live
+ * on different threads.
+ */
+
+static const uint32_t latency_boundv[ECALL_LATENCY_BUCKETS - 1] = {
+	10, 25, 50, 100, 250, 500, 1000, 2500, 5000
+};
+
+static struct {
+	uint32_t countv[ECALL_TRACE_MSG_MAX];
+	uint64_t sumv[ECALL_TRACE_MSG_MAX];
+	uint32_t maxv[ECALL_TRACE_MSG_MAX];
+	uint32_t bucketv[ECALL_TRACE_MSG_MAX][ECALL_LATENCY_BUCKETS];
+} latency;
+
+
+static void latency_add(enum econn_msg msg_type, uint32_t ms)
 {
-	struct trace_entry *entry = arg;
+	uint32_t max;
+	size_t b;
 
-	list_unlink(&entry->le);
+	for (b = 0; b < ARRAY_SIZE(latency_boundv); ++b) {
+		if (ms < latency_boundv[b])
+			break;
+	}
+
+	__atomic_fetch_add(&latency.countv[msg_type], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&latency.sumv[msg_type], ms, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&latency.bucketv[msg_type][b], 1,
+			   __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&latency.maxv[msg_type], __ATOMIC_RELAXED);
+	while (ms > max &&
+	       !__atomic_compare_exchange_n(&latency.maxv[msg_type], &max, ms,
+					    true, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+
+static uint32_t trace_first(const struct ecall_trace *trace)
+{
+	return trace->head > ECALL_TRACE_SZ ? trace->head - ECALL_TRACE_SZ : 0;
 }
 
 
@@ -43,23 +86,36 @@ void ecall_trace(struct ecall *ecall, const struct econn_message *msg,
 		 bool tx, enum econn_transport tp,
 		 const char *fmt, ...)
 {
+	struct ecall_trace *trace;
 	struct trace_entry *entry;
 	va_list ap;
 
 	if (!ecall)
 		return;
 
-	/* save the ECONN message in the trace queue */
-	entry = mem_zalloc(sizeof(*entry), entry_destructor);
-	if (entry) {
-		entry->ts = tmr_jiffies() - ecall->ts_start;
-		entry->tx = tx;
-		entry->tp = tp;
-		entry->msg_type = msg->msg_type;
-		entry->resp = msg->resp;
-		entry->age = msg->age;
-
-		list_append(&ecall->tracel, &entry->le, entry);
+	trace = &ecall->trace;
+
+	/* save the ECONN message in the trace ring */
+	entry = &trace->entv[trace->head++ % ECALL_TRACE_SZ];
+	entry->ts = (uint32_t)(tmr_jiffies() - ecall->ts_start);
+	entry->tx = tx;
+	entry->tp = tp;
+	entry->msg_type = msg->msg_type;
+	entry->resp = msg->resp;
+	entry->age = msg->age;
+	entry->latency = 0;
+
+	if (msg->msg_type < ECALL_TRACE_MSG_MAX) {
+		uint32_t *req = &trace->reqv[msg->msg_type];
+
+		if (tx && !msg->resp) {
+			*req = entry->ts + 1;
+		}
+		else if (!tx && msg->resp && *req) {
+			entry->latency = entry->ts + 1 - *req;
+			latency_add(msg->msg_type, entry->latency);
+			*req = 0;
+		}
 	}
 
 	if (!ecall->conf.trace)
@@ -83,17 +139,22 @@ void ecall_trace(struct ecall *ecall, const struct econn_message *msg,
 
 int ecall_show_trace(struct re_printf *pf, const struct ecall *ecall)
 {
-	struct le *le;
+	const struct ecall_trace *trace;
+	uint32_t i;
 	int err;
 
 	if (!ecall)
 		return 0;
 
-	err = re_hprintf(pf, "Ecall message trace (%u messages):\n",
-			 list_count(&ecall->tracel));
+	trace = &ecall->trace;
+
+	err = re_hprintf(pf, "Ecall message trace (%u messages, %u dropped):\n",
+			 trace->head - trace_first(trace), trace_first(trace));
 
-	for (le = list_head(&ecall->tracel); le; le = le->next) {
-		struct trace_entry *ent = le->data;
+	for (i = trace_first(trace); i < trace->head; ++i) {
+		const struct trace_entry *ent;
+
+		ent = &trace->entv[i % ECALL_TRACE_SZ];
 
 		err = re_hprintf(pf, "* %.3fs  %s via %7s  %10s %-8s"
 				 ,
@@ -109,6 +170,10 @@ int ecall_show_trace(struct re_printf *pf, const struct ecall *ecall)
 			err |= re_hprintf(pf, "    age=%usec", ent->age);
 		}
 
+		if (ent->latency) {
+			err |= re_hprintf(pf, "    latency=%ums", ent->latency);
+		}
+
 		err |= re_hprintf(pf, "\n");
 
 		if (err)
@@ -117,3 +182,156 @@ int ecall_show_trace(struct re_printf *pf, const struct ecall *ecall)
 
 	return err;
 }
+
+
+int ecall_trace_json(char **strp, const struct ecall *ecall)
+{
+	const struct ecall_trace *trace;
+	struct json_object *jobj = NULL;
+	struct json_object *jents = NULL;
+	uint32_t i;
+	int err = 0;
+
+	if (!strp || !ecall)
+		return EINVAL;
+
+	trace = &ecall->trace;
+
+	jobj = jzon_alloc_object();
+	jents = jzon_alloc_array();
+	if (!jobj || !jents) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	jzon_add_int(jobj, "messages", trace->head - trace_first(trace));
+	jzon_add_int(jobj, "dropped", trace_first(trace));
+
+	for (i = trace_first(trace); i < trace->head; ++i) {
+		const struct trace_entry *ent;
+		struct json_object *jent;
+
+		ent = &trace->entv[i % ECALL_TRACE_SZ];
+
+		jent = jzon_alloc_object();
+		if (!jent) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		jzon_add_int(jent, "ts", ent->ts);
+		jzon_add_str(jent, "dir", ent->tx ? "send" : "recv");
+		jzon_add_str(jent, "transp", econn_transp_name(ent->tp));
+		jzon_add_str(jent, "type", econn_msg_name(ent->msg_type));
+		jzon_add_bool(jent, "resp", ent->resp);
+		if (!ent->tx && ent->tp == ECONN_TRANSP_BACKEND)
+			jzon_add_int(jent, "age", ent->age);
+		if (ent->latency)
+			jzon_add_int(jent, "latency", ent->latency);
+
+		json_object_array_add(jents, jent);
+	}
+
+	json_object_object_add(jobj, "timeline", jents);
+	jents = NULL;
+
+	err = jzon_encode(strp, jobj);
+
+ out:
+	mem_deref(jents);
+	mem_deref(jobj);
+
+	return err;
+}
+
+
+uint32_t ecall_latency_bound(size_t bucket)
+{
+	if (bucket < ARRAY_SIZE(latency_boundv))
+		return latency_boundv[bucket];
+
+	return UINT32_MAX;
+}
+
+
+int ecall_latency_get(struct ecall_latency *latv, size_t *latc)
+{
+	size_t n = 0;
+	int t, b;
+
+	if (!latv || !latc)
+		return EINVAL;
+
+	for (t = 0; t < ECALL_TRACE_MSG_MAX && n < *latc; ++t) {
+		struct ecall_latency *lat = &latv[n];
+		uint64_t sum;
+
+		lat->count = __atomic_load_n(&latency.countv[t],
+					     __ATOMIC_RELAXED);
+		if (!lat->count)
+			continue;
+
+		sum = __atomic_load_n(&latency.sumv[t], __ATOMIC_RELAXED);
+
+		lat->msg_type = (enum econn_msg)t;
+		lat->avg_ms = (uint32_t)(sum / lat->count);
+		lat->max_ms = __atomic_load_n(&latency.maxv[t],
+					      __ATOMIC_RELAXED);
+		for (b = 0; b < ECALL_LATENCY_BUCKETS; ++b) {
+			lat->bucketv[b] = __atomic_load_n(
+				&latency.bucketv[t][b], __ATOMIC_RELAXED);
+		}
+		++n;
+	}
+
+	*latc = n;
+
+	return 0;
+}
+
+
+void ecall_latency_reset(void)
+{
+	int t, b;
+
+	for (t = 0; t < ECALL_TRACE_MSG_MAX; ++t) {
+		__atomic_store_n(&latency.countv[t], 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&latency.sumv[t], 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&latency.maxv[t], 0, __ATOMIC_RELAXED);
+		for (b = 0; b < ECALL_LATENCY_BUCKETS; ++b) {
+			__atomic_store_n(&latency.bucketv[t][b], 0,
+					 __ATOMIC_RELAXED);
+		}
+	}
+}
+
+
+int ecall_latency_debug(struct re_printf *pf, void *arg)
+{
+	struct ecall_latency latv[ECALL_TRACE_MSG_MAX];
+	size_t latc = ARRAY_SIZE(latv);
+	size_t i, b;
+	int err;
+
+	(void)arg;
+
+	ecall_latency_get(latv, &latc);
+
+	err = re_hprintf(pf, "Ecall request latency (%zu message types):\n",
+			 latc);
+
+	for (i = 0; i < latc && !err; ++i) {
+		const struct ecall_latency *lat = &latv[i];
+
+		err = re_hprintf(pf, "* %10s  n=%u avg=%ums max=%ums  |",
+				 econn_msg_name(lat->msg_type),
+				 lat->count, lat->avg_ms, lat->max_ms);
+
+		for (b = 0; b < ECALL_LATENCY_BUCKETS; ++b)
+			err |= re_hprintf(pf, " %u", lat->bucketv[b]);
+
+		err |= re_hprintf(pf, "\n");
+	}
+
+	return err;
+}
@@ -574,6 +574,8 @@ int egcall_alloc(struct egcall **egcallp,
 			    NULL, // egcall_sft_msg_recv,
 			    egcall_get_members,
 			    egcall_set_quality_interval,
+			    egcall_get_audio_levels,
+			    egcall_set_active_speakers,
 			    NULL,
 			    NULL,
 			    egcall_debug,
@@ -984,6 +986,18 @@ static void ecall_quality_handler(struct icall *icall,
 }
 
 
+static void ecall_quality_sample_handler(struct icall *icall,
+					 const char *userid,
+					 const struct wcall_quality_sample *sample,
+					 void *arg)
+{
+	struct egcall *egcall = arg;
+
+	ICALL_CALL_CB(egcall->icall, quality_sampleh,
+		&egcall->icall, userid, sample, egcall->icall.arg);
+}
+
+
 static int add_ecall(struct ecall **ecallp, struct egcall *egcall,
 		     const char *userid_peer, const char *clientid_peer)
 {
@@ -1030,6 +1044,7 @@ static int add_ecall(struct ecall **ecallp, struct egcall *egcall,
 			    ecall_vstate_handler,
 			    ecall_audiocbr_handler,
 			    ecall_quality_handler,
+			    ecall_quality_sample_handler,
 			    NULL,
 			    egcall);
 
@@ -1555,6 +1570,57 @@ int egcall_set_video_send_state(struct icall *icall, enum icall_vstate state)
 	return err;
 }
 
+/* Levels of all peers, each ecall adds the streams of its flow */
+int egcall_get_audio_levels(struct icall *icall,
+			    struct speaker_level *levelv,
+			    size_t *levelc)
+{
+	struct egcall *egcall = (struct egcall*)icall;
+	size_t n = 0;
+	struct le *le;
+
+	if (!egcall || !levelv || !levelc)
+		return EINVAL;
+
+	LIST_FOREACH(&egcall->ecalll, le) {
+		struct ecall *ecall = le->data;
+		size_t c = *levelc - n;
+		int err;
+
+		if (c == 0)
+			break;
+
+		err = ecall_get_audio_levels(ecall, &levelv[n], &c);
+		if (!err)
+			n += c;
+	}
+
+	*levelc = n;
+
+	return 0;
+}
+
+
+int egcall_set_active_speakers(struct icall *icall,
+			       const struct speaker_rank *rankv,
+			       size_t rankc)
+{
+	struct egcall *egcall = (struct egcall*)icall;
+	struct le *le;
+
+	if (!egcall)
+		return EINVAL;
+
+	LIST_FOREACH(&egcall->ecalll, le) {
+		struct ecall *ecall = le->data;
+
+		ecall_set_active_speakers(ecall, rankv, rankc);
+	}
+
+	return 0;
+}
+
+
 int egcall_set_quality_interval(struct icall *icall, uint64_t interval)
 {
 	struct egcall *egcall = (struct egcall*)icall;
@@ -33,6 +33,8 @@ void icall_set_functions(struct icall *icall,
 			 icall_sft_msg_recv		*sft_msg_recv,
 			 icall_get_members		*get_members,
 			 icall_set_quality_interval	*set_quality_interval,
+			 icall_get_audio_levels		*get_audio_levels,
+			 icall_set_active_speakers	*set_active_speakers,
 			 icall_dce_send                 *dce_send,
 			 icall_set_clients		*set_clients,
 			 icall_debug			*debug,
@@ -55,6 +57,8 @@ void icall_set_functions(struct icall *icall,
 	icall->sft_msg_recv		= sft_msg_recv;
 	icall->get_members		= get_members;
 	icall->set_quality_interval	= set_quality_interval;
+	icall->get_audio_levels		= get_audio_levels;
+	icall->set_active_speakers	= set_active_speakers;
 	icall->dce_send                 = dce_send;
 	icall->set_clients		= set_clients;
 	icall->debug			= debug;
@@ -78,6 +82,7 @@ void icall_set_callbacks(struct icall *icall,
 			 icall_vstate_changed_h	*vstate_changedh,
 			 icall_acbr_changed_h	*acbr_changedh,
 			 icall_quality_h	*qualityh,
+			 icall_quality_sample_h	*quality_sampleh,
 			 icall_req_clients_h	*req_clientsh,
 			 void			*arg)
 {
@@ -100,6 +105,7 @@ void icall_set_callbacks(struct icall *icall,
 	icall->vstate_changedh	= vstate_changedh;
 	icall->acbr_changedh	= acbr_changedh;
 	icall->qualityh		= qualityh;
+	icall->quality_sampleh	= quality_sampleh;
 	icall->req_clientsh	= req_clientsh;
 	icall->arg		= arg;
 }
@@ -36,6 +36,8 @@ void iflow_set_functions(struct iflow *iflow,
 			 iflow_gather_all_turn		*gather_all_turn,
 			 iflow_add_decoders_for_user	*add_decoders_for_user,
 			 iflow_remove_decoders_for_user	*remove_decoders_for_user,
+			 iflow_get_audio_levels		*get_audio_levels,
+			 iflow_set_active_speakers	*set_active_speakers,
 			 iflow_set_e2ee_key		*set_e2ee_key,
 			 iflow_dce_send			*dce_send,
 			 iflow_stop_media		*stop_media,
@@ -63,6 +65,8 @@ void iflow_set_functions(struct iflow *iflow,
 	iflow->gather_all_turn		= gather_all_turn;
 	iflow->add_decoders_for_user	= add_decoders_for_user;
 	iflow->remove_decoders_for_user	= remove_decoders_for_user;
+	iflow->get_audio_levels		= get_audio_levels;
+	iflow->set_active_speakers	= set_active_speakers;
 	iflow->set_e2ee_key		= set_e2ee_key;
 	iflow->dce_send			= dce_send;
 	iflow->stop_media		= stop_media;
@@ -142,12 +146,16 @@ struct {
 	iflow_destroyf	*destroy;
 	iflow_set_mutef	*set_mute;
 	iflow_get_mutef	*get_mute;
+	iflow_set_video_budgetf *set_video_budget;
+	iflow_set_video_visiblef *set_video_visible;
 } statics = {
 #ifdef __EMSCRIPTEN__
 	jsflow_alloc,
 #else
 	peerflow_alloc,
 #endif
+	NULL,
+	NULL,
 	NULL,
 	NULL,
 	NULL
@@ -162,6 +170,8 @@ void iflow_destroy(void)
 	statics.destroy = NULL;
 	statics.set_mute = NULL;
 	statics.get_mute = NULL;
+	statics.set_video_budget = NULL;
+	statics.set_video_visible = NULL;
 }
 
 
@@ -182,14 +192,36 @@ bool iflow_get_mute(void)
 }
 
 
+void iflow_set_video_budget(uint64_t max_pps)
+{
+	if (statics.set_video_budget) {
+		statics.set_video_budget(max_pps);
+	}
+}
+
+
+void iflow_set_video_visible(const char *userid,
+			     const char *clientid,
+			     bool visible)
+{
+	if (statics.set_video_visible) {
+		statics.set_video_visible(userid, clientid, visible);
+	}
+}
+
+
 void iflow_register_statics(iflow_destroyf *destroy,
 			    iflow_set_mutef *set_mute,
-			    iflow_get_mutef *get_mute)
+			    iflow_get_mutef *get_mute,
+			    iflow_set_video_budgetf *set_video_budget,
+			    iflow_set_video_visiblef *set_video_visible)
 {
 	iflow_destroy();
 	statics.destroy = destroy;
 	statics.set_mute = set_mute;
 	statics.get_mute = get_mute;
+	statics.set_video_budget = set_video_budget;
+	statics.set_video_visible = set_video_visible;
 }
 
 
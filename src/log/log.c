@@ -19,6 +19,12 @@
 #include <re.h>
 #include "avs_log.h"
 #include <string.h>
+#include <stdlib.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#endif
 
 
 static struct {
@@ -32,21 +38,234 @@ static struct {
 };
 
 
+#ifdef HAVE_PTHREAD
+
+/*
+ * Async mode
+ *
+ * Each logging thread owns a single producer/single consumer queue of
+ * preallocated slots, messages are formatted straight into a slot
+ * and the thread returns. One writer thread drains all queues, masks
+ * the messages and passes them to stderr and the registered handlers.
+ * A full queue drops the message, a message longer than a slot is
+ * truncated. Queues are claimed per thread and recycled when the
+ * thread exits, they are never freed.
+ */
+
+#define LOG_ASYNC_SLOTS    256
+#define LOG_ASYNC_MSG_SZ   1024
+#define LOG_ASYNC_WAIT_MS  20
+
+struct log_slot {
+	enum log_level level;
+	char msg[LOG_ASYNC_MSG_SZ];
+};
+
+struct log_queue {
+	struct log_slot slotv[LOG_ASYNC_SLOTS];
+	uint32_t head;                 /* written by the owner thread */
+	uint32_t tail;                 /* written by the writer       */
+	int in_use;
+	struct log_queue *next;
+};
+
+/*
+ * Handlers
+ *
+ * The handlers are called from an immutable copy of lg.logl, rebuilt
+ * whenever a handler is registered or unregistered. Emitters take a
+ * reference to the current copy and call the handlers without holding
+ * any lock, so handlers may log and logging threads do not serialise.
+ */
+struct log_hent {
+	log_h *h;
+	void *arg;
+};
+
+struct log_hlist {
+	uint32_t refs;                 /* atomic */
+	size_t n;
+	struct log_hent v[];
+};
+
+static struct {
+	int enabled;
+	int run;
+	int idle;
+	pthread_t thread;
+	pthread_once_t once;
+	pthread_key_t key;
+	pthread_key_t emit_key;        /* hlist being emitted */
+	pthread_mutex_t mutex;         /* writer wakeup       */
+	pthread_mutex_t hmutex;        /* lg.logl, hlist      */
+	struct log_hlist *hlist;
+	pthread_cond_t cond;
+	struct log_queue *queuel;
+
+	uint64_t queued;
+	uint64_t written;
+	uint64_t dropped;
+	uint64_t truncated;
+} la = {
+	.once   = PTHREAD_ONCE_INIT,
+	.mutex  = PTHREAD_MUTEX_INITIALIZER,
+	.hmutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond   = PTHREAD_COND_INITIALIZER,
+};
+
+#endif
+
+
+#ifdef HAVE_PTHREAD
+
+static void queue_release(void *arg);
+
+
+static void key_init(void)
+{
+	pthread_key_create(&la.key, queue_release);
+	pthread_key_create(&la.emit_key, NULL);
+}
+
+
+static struct log_hlist *hlist_get(void)
+{
+	struct log_hlist *hl;
+
+	pthread_mutex_lock(&la.hmutex);
+	hl = la.hlist;
+	if (hl)
+		__atomic_add_fetch(&hl->refs, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&la.hmutex);
+
+	return hl;
+}
+
+
+static void hlist_put(struct log_hlist *hl)
+{
+	if (!hl)
+		return;
+
+	if (__atomic_sub_fetch(&hl->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(hl);
+}
+
+
+/* Called with la.hmutex held, returns the previous copy */
+static struct log_hlist *hlist_rebuild(void)
+{
+	struct log_hlist *hl, *old = la.hlist;
+	struct le *le;
+	size_t n;
+
+	n = list_count(&lg.logl);
+	hl = n ? malloc(sizeof(*hl) + n * sizeof(hl->v[0])) : NULL;
+	if (hl) {
+		hl->refs = 1;
+		hl->n = 0;
+		LIST_FOREACH(&lg.logl, le) {
+			struct log *log = le->data;
+
+			hl->v[hl->n].h = log->h;
+			hl->v[hl->n].arg = log->arg;
+			++hl->n;
+		}
+	}
+
+	/* Out of memory drops all handlers rather than keep a stale one,
+	 * the next register rebuilds the copy.
+	 */
+	la.hlist = hl;
+
+	return old;
+}
+
+
+static void emit_handlers(enum log_level level, const char *msg)
+{
+	struct log_hlist *hl;
+	size_t i;
+
+	pthread_once(&la.once, key_init);
+
+	/* A line logged by a handler only goes to stderr */
+	if (pthread_getspecific(la.emit_key))
+		return;
+
+	hl = hlist_get();
+	if (!hl)
+		return;
+
+	pthread_setspecific(la.emit_key, hl);
+	for (i = 0; i < hl->n; ++i) {
+		if (hl->v[i].h)
+			hl->v[i].h(level, msg, hl->v[i].arg);
+	}
+	pthread_setspecific(la.emit_key, NULL);
+
+	hlist_put(hl);
+}
+
+#endif
+
+
 void log_register_handler(struct log *log)
 {
+#ifdef HAVE_PTHREAD
+	struct log_hlist *old;
+#endif
+
 	if (!log)
 		return;
 
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&la.hmutex);
+	list_append(&lg.logl, &log->le, log);
+	old = hlist_rebuild();
+	pthread_mutex_unlock(&la.hmutex);
+
+	hlist_put(old);
+#else
 	list_append(&lg.logl, &log->le, log);
+#endif
 }
 
 
+/*
+ * Returns once no other thread is calling the handler any more, so the
+ * caller may free its argument. From within a handler only the calls on
+ * other threads are waited for.
+ */
 void log_unregister_handler(struct log *log)
 {
+#ifdef HAVE_PTHREAD
+	struct log_hlist *old;
+	uint32_t own;
+#endif
+
 	if (!log)
 		return;
 
+#ifdef HAVE_PTHREAD
+	pthread_once(&la.once, key_init);
+
+	pthread_mutex_lock(&la.hmutex);
 	list_unlink(&log->le);
+	old = hlist_rebuild();
+	pthread_mutex_unlock(&la.hmutex);
+
+	if (!old)
+		return;
+
+	own = pthread_getspecific(la.emit_key) == old ? 1 : 0;
+	while (__atomic_load_n(&old->refs, __ATOMIC_ACQUIRE) > 1 + own)
+		usleep(1000);
+
+	hlist_put(old);
+#else
+	list_unlink(&log->le);
+#endif
 }
 
 
@@ -77,17 +296,11 @@ void vloglv(enum log_level level, const char *fmt, va_list ap)
 }
 
 
-void vlog(enum log_level level, const char *fmt, va_list ap)
+static void log_emit(enum log_level level, const char *msg)
 {
+#ifndef HAVE_PTHREAD
 	struct le *le;
-	char *msg;
-	int err;
-
-	err = re_vsdprintf(&msg, fmt, ap);
-	if (err)
-		return;
-
-	log_mask_ipaddr(msg);
+#endif
 
 	if (lg.stder) {
 
@@ -103,6 +316,9 @@ void vlog(enum log_level level, const char *fmt, va_list ap)
 			(void)re_fprintf(stderr, "\x1b[;m");
 	}
 
+#ifdef HAVE_PTHREAD
+	emit_handlers(level, msg);
+#else
 	le = lg.logl.head;
 
 	while (le) {
@@ -113,6 +329,269 @@ void vlog(enum log_level level, const char *fmt, va_list ap)
 		if (log->h)
 			log->h(level, msg, log->arg);
 	}
+#endif
+}
+
+
+#ifdef HAVE_PTHREAD
+
+static void queue_release(void *arg)
+{
+	struct log_queue *q = arg;
+
+	__atomic_store_n(&q->in_use, 0, __ATOMIC_RELEASE);
+}
+
+
+static struct log_queue *queue_get(void)
+{
+	struct log_queue *q;
+
+	q = pthread_getspecific(la.key);
+	if (q)
+		return q;
+
+	/* Reuse the queue of a thread that has exited */
+	q = __atomic_load_n(&la.queuel, __ATOMIC_ACQUIRE);
+	for (; q; q = q->next) {
+		int free_q = 0;
+
+		if (__atomic_compare_exchange_n(&q->in_use, &free_q, 1, false,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			break;
+	}
+
+	if (!q) {
+		q = calloc(1, sizeof(*q));
+		if (!q)
+			return NULL;
+
+		q->in_use = 1;
+		q->next = __atomic_load_n(&la.queuel, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&la.queuel, &q->next, q,
+						    true, __ATOMIC_RELEASE,
+						    __ATOMIC_RELAXED))
+			;
+	}
+
+	pthread_setspecific(la.key, q);
+
+	return q;
+}
+
+
+static bool async_log(enum log_level level, const char *fmt, va_list ap)
+{
+	struct log_queue *q;
+	struct log_slot *slot;
+	uint32_t head, tail;
+
+	q = queue_get();
+	if (!q)
+		return false;
+
+	head = q->head;
+	tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+	if (head - tail >= LOG_ASYNC_SLOTS) {
+		__atomic_fetch_add(&la.dropped, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	slot = &q->slotv[head % LOG_ASYNC_SLOTS];
+	slot->level = level;
+	if (re_vsnprintf(slot->msg, sizeof(slot->msg), fmt, ap) < 0) {
+		size_t n = strlen(slot->msg);
+
+		if (n)
+			slot->msg[n - 1] = '\n';
+		__atomic_fetch_add(&la.truncated, 1, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&la.queued, 1, __ATOMIC_RELAXED);
+
+	if (__atomic_load_n(&la.idle, __ATOMIC_RELAXED))
+		pthread_cond_signal(&la.cond);
+
+	return true;
+}
+
+
+static size_t async_drain(void)
+{
+	struct log_queue *q;
+	size_t n = 0;
+
+	q = __atomic_load_n(&la.queuel, __ATOMIC_ACQUIRE);
+	for (; q; q = q->next) {
+		uint32_t tail = q->tail;
+		uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+		if (tail == head)
+			continue;
+
+		for (; tail != head; ++tail, ++n) {
+			struct log_slot *slot;
+
+			slot = &q->slotv[tail % LOG_ASYNC_SLOTS];
+
+			log_mask_ipaddr(slot->msg);
+			log_emit(slot->level, slot->msg);
+		}
+
+		__atomic_store_n(&q->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	__atomic_fetch_add(&la.written, n, __ATOMIC_RELAXED);
+
+	return n;
+}
+
+
+static void *writer_thread(void *arg)
+{
+	(void)arg;
+
+	while (__atomic_load_n(&la.run, __ATOMIC_ACQUIRE)) {
+
+		struct timespec ts;
+		struct timeval now;
+
+		if (async_drain())
+			continue;
+
+		gettimeofday(&now, NULL);
+		ts.tv_sec = now.tv_sec;
+		ts.tv_nsec = (now.tv_usec + LOG_ASYNC_WAIT_MS * 1000) * 1000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec += 1;
+			ts.tv_nsec -= 1000000000;
+		}
+
+		pthread_mutex_lock(&la.mutex);
+		__atomic_store_n(&la.idle, 1, __ATOMIC_RELAXED);
+		pthread_cond_timedwait(&la.cond, &la.mutex, &ts);
+		__atomic_store_n(&la.idle, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&la.mutex);
+	}
+
+	async_drain();
+
+	return NULL;
+}
+
+
+int log_enable_async(bool enable)
+{
+	int err;
+
+	pthread_once(&la.once, key_init);
+
+	if (enable == !!__atomic_load_n(&la.run, __ATOMIC_ACQUIRE))
+		return 0;
+
+	if (enable) {
+		__atomic_store_n(&la.run, 1, __ATOMIC_RELEASE);
+		err = pthread_create(&la.thread, NULL, writer_thread, NULL);
+		if (err) {
+			__atomic_store_n(&la.run, 0, __ATOMIC_RELEASE);
+			return err;
+		}
+
+		__atomic_store_n(&la.enabled, 1, __ATOMIC_RELEASE);
+	}
+	else {
+		__atomic_store_n(&la.enabled, 0, __ATOMIC_RELEASE);
+		__atomic_store_n(&la.run, 0, __ATOMIC_RELEASE);
+		pthread_cond_signal(&la.cond);
+		pthread_join(la.thread, NULL);
+
+		/* Messages queued while the writer was stopping */
+		async_drain();
+	}
+
+	return 0;
+}
+
+
+static bool async_pending(void)
+{
+	struct log_queue *q;
+
+	q = __atomic_load_n(&la.queuel, __ATOMIC_ACQUIRE);
+	for (; q; q = q->next) {
+		if (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) !=
+		    __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+			return true;
+	}
+
+	return false;
+}
+
+
+void log_async_flush(void)
+{
+	while (__atomic_load_n(&la.run, __ATOMIC_ACQUIRE) &&
+	       async_pending()) {
+
+		pthread_cond_signal(&la.cond);
+		usleep(1000);
+	}
+}
+
+
+void log_async_stats(struct log_async_stats *stats)
+{
+	if (!stats)
+		return;
+
+	stats->queued    = __atomic_load_n(&la.queued, __ATOMIC_RELAXED);
+	stats->written   = __atomic_load_n(&la.written, __ATOMIC_RELAXED);
+	stats->dropped   = __atomic_load_n(&la.dropped, __ATOMIC_RELAXED);
+	stats->truncated = __atomic_load_n(&la.truncated, __ATOMIC_RELAXED);
+}
+
+#else
+
+int log_enable_async(bool enable)
+{
+	return enable ? ENOSYS : 0;
+}
+
+
+void log_async_flush(void)
+{
+}
+
+
+void log_async_stats(struct log_async_stats *stats)
+{
+	if (stats)
+		memset(stats, 0, sizeof(*stats));
+}
+
+#endif
+
+
+void vlog(enum log_level level, const char *fmt, va_list ap)
+{
+	char *msg;
+	int err;
+
+#ifdef HAVE_PTHREAD
+	if (__atomic_load_n(&la.enabled, __ATOMIC_ACQUIRE) &&
+	    async_log(level, fmt, ap))
+		return;
+#endif
+
+	err = re_vsdprintf(&msg, fmt, ap);
+	if (err)
+		return;
+
+	log_mask_ipaddr(msg);
+
+	log_emit(level, msg);
 
 	mem_deref(msg);
 }
@@ -207,63 +686,104 @@ const char *anon_client(char *outid, const char *inid)
 #define MASK_CHAR 'x'
 
 
-void log_mask_ipaddr(const char *msg)
+/*
+ * Masks the last two fields of IPv4 addresses (d.d.d.d) and the last
+ * five fields of full IPv6 addresses (h:h:h:h:h:h:h:h), IPv4 first.
+ *
+ * A match can only start at the beginning of a digit (hex) run, and
+ * a match attempt that fails at the start of a run fails anywhere
+ * inside it, so each pass tries every run start once and moves on.
+ */
+
+static inline bool is_dec(char c)
 {
-	struct pl a, b, c, d, e, f, g, h;
-	const char *p = msg;
-	const char *pend = msg + str_len(msg);
-	size_t i;
+	return c >= '0' && c <= '9';
+}
 
-	while (p < pend) {
 
-		const size_t len = pend - p;
+static inline bool is_hex(char c)
+{
+	return is_dec(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
 
-		if (0 == re_regex(p, len,
-				  "[0-9]+.[0-9]+.[0-9]+.[0-9]+",
-				  &a, &b, &c, &d)) {
 
-			for (i=0; i<c.l; i++)
-				*(char *)&c.p[i] = MASK_CHAR;
+static void mask_span(char *p, size_t n)
+{
+	memset(p, MASK_CHAR, n);
+}
 
-			for (i=0; i<d.l; i++)
-				*(char *)&d.p[i] = MASK_CHAR;
 
-			p = d.p + d.l;
-		}
-		else {
-			break;
+/* Matches n runs separated by sep at p, fills in the run starts/ends */
+static bool match_runs(const char *p, const char *pend, bool hex,
+		       char sep, int n, const char **startv,
+		       const char **endv)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+
+		startv[i] = p;
+		while (p < pend && (hex ? is_hex(*p) : is_dec(*p)))
+			++p;
+		endv[i] = p;
+
+		if (endv[i] == startv[i])
+			return false;
+
+		if (i < n - 1) {
+			if (p >= pend || *p != sep)
+				return false;
+			++p;
 		}
 	}
 
-	p = msg;
-	while (p < pend) {
+	return true;
+}
 
-		const size_t len = pend - p;
 
-		if (0 == re_regex(p, len,
-				  "[0-9a-fA-F]+:[0-9a-fA-F]+:[0-9a-fA-F]+:[0-9a-fA-F]+:"
-				  "[0-9a-fA-F]+:[0-9a-fA-F]+:[0-9a-fA-F]+:[0-9a-fA-F]+",
-				  &a, &b, &c, &d, &e, &f, &g, &h)) {
+static void mask_pass(char *msg, char *pend, bool hex, char sep,
+		      int nruns, int nkeep)
+{
+	const char *startv[8], *endv[8];
+	char *p = msg;
+	int i;
 
-			for (i=0; i<d.l; i++)
-				*(char *)&d.p[i] = MASK_CHAR;
+	/* no separator, no address */
+	if (!memchr(msg, sep, pend - msg))
+		return;
 
-			for (i=0; i<e.l; i++)
-				*(char *)&e.p[i] = MASK_CHAR;
+	while (p < pend) {
 
-			for (i=0; i<f.l; i++)
-				*(char *)&f.p[i] = MASK_CHAR;
+		if (!(hex ? is_hex(*p) : is_dec(*p))) {
+			++p;
+			continue;
+		}
 
-			for (i=0; i<g.l; i++)
-				*(char *)&g.p[i] = MASK_CHAR;
+		if (match_runs(p, pend, hex, sep, nruns, startv, endv)) {
 
-			for (i=0; i<h.l; i++)
-				*(char *)&h.p[i] = MASK_CHAR;
+			for (i = nkeep; i < nruns; i++)
+				mask_span((char *)startv[i],
+					  endv[i] - startv[i]);
 
-			p = h.p + h.l;
+			p = (char *)endv[nruns - 1];
 		}
 		else {
-			break;
+			/* skip to the end of this run */
+			while (p < pend && (hex ? is_hex(*p) : is_dec(*p)))
+				++p;
 		}
 	}
 }
+
+
+void log_mask_ipaddr(const char *msg)
+{
+	char *p = (char *)msg;
+	char *pend = p + str_len(msg);
+
+	if (!msg)
+		return;
+
+	mask_pass(p, pend, false, '.', 4, 2);
+	mask_pass(p, pend, true, ':', 8, 3);
+}
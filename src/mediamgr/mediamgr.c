@@ -20,6 +20,7 @@
 #include "avs.h"
 #include "avs_mediamgr.h"
 #include "avs_lockedqueue.h"
+#include "avs_semaphore.h"
 #include "avs_audio_io.h"
 #include <pthread.h>
 #include "mediamgr.h"
@@ -92,6 +93,7 @@ struct mm_message {
 	union {
 		struct {
 			char media_name[128];
+			uint64_t req_ts;
 		} media_elem;
 		struct {
 			enum mediamgr_state state;
@@ -135,6 +137,7 @@ struct mm {
 	enum mediamgr_state hold_state;
 	enum mm_sys_state sys_state;
 	volatile bool started;
+	struct avs_sem *ready;	/* posted when the thread has started */
 	bool audio_started;
 	bool should_reset;
 	bool alloc_pending;
@@ -413,8 +416,8 @@ static bool stop_play(char *key, void *val, void *arg)
 }
 #endif
 
-static void play_sound(struct mm *mm, const char *mname, bool sync,
-		       bool delayed)
+static void play_sound_at(struct mm *mm, const char *mname, bool sync,
+			  bool delayed, uint64_t req_ts)
 {
 	struct sound *snd;
 	
@@ -426,6 +429,9 @@ static void play_sound(struct mm *mm, const char *mname, bool sync,
 
 	info("mediamgr: play_sound: %s\n", mname);
 
+	/* The platform may report the start from another thread */
+	__atomic_store_n(&snd->req_ts, req_ts, __ATOMIC_RELEASE);
+
 	if (mediamgr_can_play_sound(mm, mm->sounds, snd)) {
 #if 0
 		if (snd->priority > 0) {
@@ -438,6 +444,29 @@ static void play_sound(struct mm *mm, const char *mname, bool sync,
 	}
 }
 
+
+static void play_sound(struct mm *mm, const char *mname, bool sync,
+		       bool delayed)
+{
+	play_sound_at(mm, mname, sync, delayed, tmr_jiffies());
+}
+
+
+void mediamgr_sound_started(struct sound *snd)
+{
+	uint64_t req_ts;
+
+	if (!snd)
+		return;
+
+	/* Only the first start after a request is measured */
+	req_ts = __atomic_exchange_n(&snd->req_ts, 0, __ATOMIC_ACQ_REL);
+	if (!req_ts)
+		return;
+
+	sound_played(snd, req_ts);
+}
+
 static int mediamgr_post_media_cmd(struct mm *mm,
 				   mm_marshal_id cmd,
 				   const char* media_name)
@@ -466,6 +495,7 @@ static int mediamgr_post_media_cmd(struct mm *mm,
 		str_ncpy(elem->media_elem.media_name,
 			 media_name,
 			 sizeof(elem->media_elem.media_name));
+		elem->media_elem.req_ts = tmr_jiffies();
 	}
 
 	return mqueue_push(mm->mq, cmd, elem);
@@ -556,9 +586,12 @@ static void mm_destructor(void *arg)
 	mem_deref(mm->sounds);
 	mem_deref(mm->mq);
 	mem_deref(mm->aio);
+	mem_deref(mm->ready);
     
 	mm_platform_free(mm);
 
+	sound_stats_close();
+
 	g_mm = NULL;
 
 	list_flush(&g_postponed_medial);
@@ -584,6 +617,7 @@ struct mm *mediamgr_get(struct mediamgr *mediamgr)
 static int mm_alloc(struct mm **mmp)
 {
 	struct mm *mm;
+	uint64_t t0;
 	int err = 0;
 
 	mm = mem_zalloc(sizeof(*mm), mm_destructor);
@@ -596,6 +630,16 @@ static int mm_alloc(struct mm **mmp)
 
 	mm->started = false;
 
+	err = avs_sem_alloc(&mm->ready, 0);
+	if (err)
+		goto out;
+
+	err = sound_stats_init();
+	if (err)
+		goto out;
+
+	t0 = tmr_jiffies();
+
 #ifdef MM_USE_THREAD	
 	err = pthread_create(&mm->thread, NULL, mediamgr_thread, mm);
 	if (err != 0) {
@@ -604,11 +648,14 @@ static int mm_alloc(struct mm **mmp)
 #else
 	mediamgr_thread(mm);
 #endif
-	for ( int cnt = 0; cnt < 10000; cnt++) {
-		if (mm->started) {
-			break;
-		}
-		usleep(1000);  /* 1ms so allow to wait 10 secs */
+	avs_sem_wait(mm->ready);
+
+	if (mm->started) {
+		info("mediamgr: startup: thread ready in %llu ms\n",
+		     tmr_jiffies() - t0);
+	}
+	else {
+		warning("mediamgr: startup: thread failed to start\n");
 	}
 
 	mm->router.cur_route = MEDIAMGR_AUPLAY_UNKNOWN;
@@ -1174,6 +1221,18 @@ void mediamgr_unregister_media(struct mediamgr *mediamgr,
 }
 
 
+int mediamgr_get_play_stats(struct mediamgr *mediamgr,
+			    struct mediamgr_play_stats *stats)
+{
+	if (!mediamgr || !stats)
+		return EINVAL;
+
+	sound_play_stats(stats);
+
+	return 0;
+}
+
+
 void mediamgr_set_sound_mode(struct mediamgr *mediamgr,
 			     enum mediamgr_sound_mode mode)
 {
@@ -1694,7 +1753,8 @@ static void mqueue_handler(int id, void *data, void *arg)
 		break;
 
 	case MM_MARSHAL_PLAY_MEDIA:
-		play_sound(mm, msg->media_elem.media_name, false, false);
+		play_sound_at(mm, msg->media_elem.media_name, false, false,
+			      msg->media_elem.req_ts);
 		break;
 		
 	case MM_MARSHAL_PAUSE_MEDIA: {
@@ -1877,6 +1937,8 @@ static void *mediamgr_thread(void *arg)
 	}
 	
 	mm->started = true;
+	avs_sem_post(mm->ready);
+
 	if (g_postponed_medial.head)
 		register_postponed_media(mm);
 	
@@ -1898,6 +1960,10 @@ static void *mediamgr_thread(void *arg)
 #endif
 
 out:
+	/* Do not leave mm_alloc waiting if we failed to start */
+	if (!mm->started)
+		avs_sem_post(mm->ready);
+
 	return NULL;
 }
 
@@ -36,6 +36,8 @@ struct sound {
 	bool sync; /* played synchronosuly */
 	void *arg;
 
+	uint64_t req_ts;  /* play requested, for the latency metric */
+
 	struct le le; /* member of sounds list */
 };
 
@@ -43,6 +45,14 @@ int sound_alloc(struct sound **sndp,
 		const char *path, const char *fmt,
 		bool loop, bool mixing, bool incall, int intensity, bool is_call_media);
 
+int  sound_stats_init(void);
+void sound_stats_close(void);
+void sound_played(const struct sound *snd, uint64_t req_ts);
+void sound_play_stats(struct mediamgr_play_stats *stats);
+
+/* Called by the platform when snd starts playing */
+void mediamgr_sound_started(struct sound *snd);
+
 const char *mediamgr_route_name(enum mediamgr_auplay route);
 
 void mediamgr_enable_speaker_mm(struct mm *mm, bool enable);
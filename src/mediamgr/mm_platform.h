@@ -35,6 +35,9 @@ struct mm_platform_start_rec {
 int mm_platform_init(struct mm *mm, struct dict *sounds);
 int mm_platform_free(struct mm *mm);
 	
+/* Platforms that know when playback actually starts report it with
+ * mediamgr_sound_started(), from any thread.
+ */
 void mm_platform_play_sound(struct sound *snd, bool sync, bool delayed);
 void mm_platform_pause_sound(struct sound *snd);
 void mm_platform_resume_sound(struct sound *snd);
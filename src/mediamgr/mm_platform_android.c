@@ -56,6 +56,7 @@ static struct {
 	jmethodID mpSetShouldLoop;
 	jmethodID mpSetVolumen;
 	jmethodID mpGetIsPlaying;
+	jmethodID mpSetNativeSound;
 } java = {
     .initialized = false,
     .err = 0,
@@ -76,7 +77,8 @@ static struct {
     .mpStop = NULL,
     .mpSetShouldLoop  = NULL,
     .mpSetVolumen = NULL,
-    .mpGetIsPlaying = NULL
+    .mpGetIsPlaying = NULL,
+    .mpSetNativeSound = NULL
 };
 
 struct jni_env {
@@ -225,6 +227,16 @@ static JNINativeMethod methods[] = {
     {"nativeBTDeviceConnected", "(ZJ)V", (void*)nativeBTDeviceConnected },
 };
 
+static void nativeSoundStarted(JNIEnv* env, jobject obj, jlong nativeSound) {
+    struct sound *snd = (struct sound *)nativeSound;
+
+    mediamgr_sound_started(snd);
+}
+
+static JNINativeMethod mpMethods[] = {
+    {"nativeSoundStarted", "(J)V", (void*)nativeSoundStarted },
+};
+
 int mm_android_jni_init(JNIEnv *env, jobject jobj, jobject ctx)
 {
     jint res;
@@ -309,6 +321,15 @@ int mm_android_jni_init(JNIEnv *env, jobject jobj, jobject ctx)
         error("mm: Could not get getIsPlaying method ID \n");
     }
     java.mpGetIsPlaying = jmObject;
+
+    if ((jmObject= (*env)->GetMethodID(env, jcObject, "setNativeSound", "(J)V")) == NULL){
+        error("mm: Could not get setNativeSound method ID \n");
+    }
+    java.mpSetNativeSound = jmObject;
+
+    if ((*env)->RegisterNatives(env, jcObject, mpMethods, sizeof(mpMethods) / sizeof(mpMethods[0])) < 0) {
+        error("mm: RegisterNatives for MediaPlayer failed !! \n");
+    }
     
     /* Get the router class */
     if ((jcObject= (*env)->FindClass(env, "com/waz/media/manager/router/AudioRouter")) == NULL){
@@ -447,6 +468,13 @@ int mm_platform_free(struct mm *mm)
     return 0;
 }
 
+static void snd_destructor(void *arg)
+{
+    struct sound *snd = arg;
+
+    mem_deref(snd->name);
+}
+
 void mm_platform_registerMedia(struct dict *sounds,
                                const char *name,
                                void *mediaObj,
@@ -457,10 +485,11 @@ void mm_platform_registerMedia(struct dict *sounds,
                                bool is_call_media)
 {
     struct sound *snd;
+    struct jni_env jni_env;
 
     info("mm_platform_android: registerMedia name=%s\n", name);
         
-    snd = mem_zalloc(sizeof(struct sound), NULL);
+    snd = mem_zalloc(sizeof(struct sound), snd_destructor);
 
     str_dup(&snd->name, name);
     snd->arg = mediaObj;
@@ -473,6 +502,15 @@ void mm_platform_registerMedia(struct dict *sounds,
     dict_add(sounds, name, (void*)snd);
     /* snd is now owned by dictionary */
     mem_deref(snd);
+
+    /* The player reports its starts with nativeSoundStarted */
+    if (jni_attach(&jni_env)) {
+        error("mm: %s jni_attach failed\n", __FUNCTION__);
+        return;
+    }
+    callVoidMethodHelper(jni_env.env, (jobject)snd->arg,
+                         java.mpSetNativeSound, (jlong)snd);
+    jni_detach(&jni_env);
 }
 
 void mm_platform_unregisterMedia(struct dict *sounds, const char *name)
@@ -491,6 +529,9 @@ void mm_platform_unregisterMedia(struct dict *sounds, const char *name)
         return;
     }
 
+    /* Returns once a running nativeSoundStarted is done with snd */
+    callVoidMethodHelper(jni_env.env, (jobject)snd->arg,
+                         java.mpSetNativeSound, (jlong)0);
     (*jni_env.env)->DeleteGlobalRef(jni_env.env, (jobject)snd->arg);
     
     dict_remove(sounds, name);
@@ -44,7 +44,8 @@ int mm_platform_free(struct mm *mm)
 
 void mm_platform_play_sound(struct sound *snd, bool sync, bool delayed)
 {
-	(void)snd;
+	/* Nothing to render, the sound starts right away */
+	mediamgr_sound_started(snd);
 }
 
 void mm_platform_pause_sound(struct sound *snd)
@@ -143,6 +143,9 @@ static void set_active(bool active)
 
 - (void)didStartPlayingMedia:(id<AVSMedia>)media
 {
+	if ([media respondsToSelector:@selector(sound)])
+		mediamgr_sound_started((struct sound*)[media sound]);
+
 #if !TARGET_IPHONE_SIMULATOR
 	NSString *cname = NSStringFromClass([media class]);
 
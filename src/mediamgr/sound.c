@@ -20,6 +20,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <re/re.h>
 
@@ -28,6 +31,16 @@
 #include "mediamgr.h"
 
 
+/* Time from a play request to the start of a sound, see sound_played */
+static struct {
+	struct lock *lock;
+	struct mediamgr_play_stats stats;
+	uint64_t total_ms;
+} play = {
+	.lock = NULL,
+};
+
+
 static void destructor(void *arg)
 {
 	struct sound *snd = arg;
@@ -61,3 +74,60 @@ int sound_alloc(struct sound **sndp,
 
 	return err;
 }
+
+
+int sound_stats_init(void)
+{
+	if (play.lock)
+		return 0;
+
+	return lock_alloc(&play.lock);
+}
+
+
+void sound_stats_close(void)
+{
+	memset(&play.stats, 0, sizeof(play.stats));
+	play.total_ms = 0;
+	play.lock = mem_deref(play.lock);
+}
+
+
+/* Records the time from a play request to the start of a sound */
+void sound_played(const struct sound *snd, uint64_t req_ts)
+{
+	uint64_t ms;
+
+	if (!snd || !req_ts || !play.lock)
+		return;
+
+	ms = tmr_jiffies() - req_ts;
+
+	lock_write_get(play.lock);
+	++play.stats.nplays;
+	play.total_ms += ms;
+	play.stats.last_ms = (uint32_t)ms;
+	play.stats.avg_ms = (uint32_t)(play.total_ms / play.stats.nplays);
+	if (ms > play.stats.max_ms)
+		play.stats.max_ms = (uint32_t)ms;
+	lock_rel(play.lock);
+
+	info("mediamgr: sound: %s: started %llu ms after request\n",
+	     snd->name ? snd->name : snd->path, ms);
+}
+
+
+void sound_play_stats(struct mediamgr_play_stats *stats)
+{
+	if (!stats)
+		return;
+
+	if (!play.lock) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	lock_read_get(play.lock);
+	*stats = play.stats;
+	lock_rel(play.lock);
+}
@@ -17,6 +17,7 @@
 */
 
 #include <string.h>
+#include <stdlib.h>
 #include <sys/time.h>
 
 #include <re.h>
@@ -27,9 +28,30 @@
 #include "netprobe.h"
 
 
+#define LEGACY_PKT_SIZE         160
+#define UDP_OVERHEAD             28   /* IPv4 + UDP headers */
+#define DRAIN_MS                500
+#define JITTER_GAP_MS            10   /* not queued behind its predecessor */
+#define CHIRP_QUEUE_US         5000   /* delay build-up that means congestion */
+#define CHIRP_EXCURSION_US     1000   /* smallest build-up told from jitter */
+
+#define DEFAULT_TRAIN_COUNT      10
+#define DEFAULT_TRAIN_LEN        10
+#define DEFAULT_TRAIN_INTERVAL  100
+#define DEFAULT_PKT_SIZE       1000
+#define DEFAULT_CHIRP_MIN_KBPS   64
+#define DEFAULT_CHIRP_MAX_KBPS 4000
+
+#define BITRATE_MIN_KBPS         40
+#define BITRATE_MAX_KBPS       2000
+#define BITRATE_DEFAULT_KBPS    300
+#define CBR_MIN_KBPS            100
+
+
 struct result {
 	bool ok;
 	uint32_t rtt_us;
+	uint64_t ts_rx;
 };
 
 
@@ -43,12 +65,20 @@ struct netprobe {
 	uint32_t secret;
 	uint32_t seq_ctr;
 	uint32_t pkt_interval;
+	uint32_t drain_ms;
+
+	struct netprobe_config cfg;
+	bool probe;
 
 	struct tmr tmr_tx;
 
 	netprobe_h *h;
 	void *arg;
 
+	struct mbuf *mb;      /* send buffer, only the header is rewritten */
+	uint32_t *gapv;       /* wait after sending each packet [ms]       */
+	uint32_t *tmpv;       /* scratch for percentiles and medians       */
+
 	struct result *resultv;
 	size_t resultc;
 };
@@ -103,6 +133,7 @@ static void receive_packet(struct netprobe *np,
 
 	result->ok = true;
 	result->rtt_us = rtt;
+	result->ts_rx = ts_now;
 }
 
 
@@ -116,25 +147,235 @@ static void udp_recv(const struct sa *src, struct mbuf *mb, void *arg)
 
 static int send_one(struct netprobe *np, uint32_t seq)
 {
-	struct mbuf *mb;
+	struct mbuf *mb = np->mb;
 	uint64_t ts_now;
 	int err;
 
-	mb = mbuf_alloc(1024);
-
 	ts_now = tmr_microseconds();
 
-	err = packet_encode(mb, ts_now, np->secret, seq, 160);
+	mb->pos = 0;
+	err = packet_encode_header(mb, ts_now, np->secret, seq,
+				   np->cfg.pkt_size);
 	if (err)
-		goto out;
+		return err;
 
 	mb->pos = 0;
-	err = udp_send(np->us_tx, &np->relay_addr, mb);
+	return udp_send(np->us_tx, &np->relay_addr, mb);
+}
 
- out:
-	mem_deref(mb);
 
-	return err;
+static uint32_t wire_bits(const struct netprobe *np)
+{
+	return (PACKET_HDR_SIZE + np->cfg.pkt_size + UDP_OVERHEAD) * 8;
+}
+
+
+static int u32_cmp(const void *a, const void *b)
+{
+	const uint32_t x = *(const uint32_t *)a;
+	const uint32_t y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+/* Delay distribution of the packets that did not queue behind another */
+static void calc_jitter(struct netprobe *np, struct netprobe_result *result)
+{
+	const size_t len = np->cfg.train_len;
+	uint32_t dmin = ~0u;
+	size_t i, n = 0;
+
+	for (i = 0; i < np->resultc; i++) {
+
+		const struct result *res = &np->resultv[i];
+
+		if (!res->ok)
+			continue;
+		if (i % len && np->gapv[i-1] < JITTER_GAP_MS)
+			continue;
+
+		np->tmpv[n++] = res->rtt_us;
+		if (res->rtt_us < dmin)
+			dmin = res->rtt_us;
+	}
+
+	if (!n)
+		return;
+
+	for (i = 0; i < n; i++)
+		np->tmpv[i] -= dmin;
+
+	qsort(np->tmpv, n, sizeof(*np->tmpv), u32_cmp);
+
+	result->jitter_p50 = np->tmpv[(n - 1) * 50 / 100];
+	result->jitter_p90 = np->tmpv[(n - 1) * 90 / 100];
+	result->jitter_p99 = np->tmpv[(n - 1) * 99 / 100];
+	result->jitter_max = np->tmpv[n - 1];
+}
+
+
+static void calc_loss_bursts(const struct netprobe *np,
+			     struct netprobe_result *result)
+{
+	size_t i, run = 0, lost = 0;
+
+	for (i = 0; i <= np->resultc; i++) {
+
+		if (i < np->resultc && !np->resultv[i].ok) {
+			++run;
+			continue;
+		}
+		if (!run)
+			continue;
+
+		++result->n_loss_bursts;
+		lost += run;
+		if (run > result->loss_burst_max)
+			result->loss_burst_max = run;
+		run = 0;
+	}
+
+	if (result->n_loss_bursts)
+		result->loss_burst_avg = (float)lost / result->n_loss_bursts;
+}
+
+
+/* Received bits over the spread of arrival times */
+static uint32_t train_bw(const struct netprobe *np, size_t first)
+{
+	uint64_t rx_first = 0, rx_last = 0;
+	size_t i, n = 0;
+
+	for (i = first; i < first + np->cfg.train_len; i++) {
+
+		const struct result *res = &np->resultv[i];
+
+		if (!res->ok)
+			continue;
+
+		if (!n || res->ts_rx < rx_first)
+			rx_first = res->ts_rx;
+		if (res->ts_rx > rx_last)
+			rx_last = res->ts_rx;
+		++n;
+	}
+
+	if (n < 2 || rx_last <= rx_first)
+		return 0;
+
+	/* bits per micro-second to kbps */
+	return (uint32_t)((uint64_t)(n - 1) * wire_bits(np) * 1000
+			  / (rx_last - rx_first));
+}
+
+
+/* Send rate at which the delay starts to build up for good */
+static uint32_t chirp_bw(const struct netprobe *np, size_t first)
+{
+	const size_t len = np->cfg.train_len;
+	uint32_t dmin = ~0u;
+	size_t j, k, n = 0;
+
+	for (j = 0; j < len; j++) {
+
+		const struct result *res = &np->resultv[first + j];
+
+		if (res->ok) {
+			if (res->rtt_us < dmin)
+				dmin = res->rtt_us;
+			++n;
+		}
+	}
+
+	if (n < 2)
+		return 0;
+
+	/* Lost packets count as congested */
+	k = len;
+	for (j = len; j-- > 1; ) {
+
+		const struct result *res = &np->resultv[first + j];
+
+		if (res->ok && res->rtt_us - dmin < CHIRP_QUEUE_US)
+			break;
+		k = j;
+	}
+
+	/* Never congested, the highest rate probed is a lower bound */
+	if (k == len) {
+		k = len - 1;
+	}
+	else {
+		/* Back to where the excursion started */
+		while (k > 1) {
+			const struct result *cur = &np->resultv[first + k];
+			const struct result *prev = &np->resultv[first + k-1];
+
+			if (!cur->ok || !prev->ok || prev->rtt_us >= cur->rtt_us)
+				break;
+			if (prev->rtt_us - dmin < CHIRP_EXCURSION_US)
+				break;
+			--k;
+		}
+	}
+
+	return wire_bits(np) / np->gapv[first + k - 1];
+}
+
+
+static void calc_bw(struct netprobe *np, struct netprobe_result *result)
+{
+	size_t t, n = 0;
+	uint32_t bw;
+
+	for (t = 0; t < np->cfg.train_count; t++) {
+
+		const size_t first = t * np->cfg.train_len;
+
+		if (np->cfg.pattern == NETPROBE_PATTERN_CHIRP)
+			bw = chirp_bw(np, first);
+		else
+			bw = train_bw(np, first);
+
+		if (bw)
+			np->tmpv[n++] = bw;
+	}
+
+	if (!n)
+		return;
+
+	qsort(np->tmpv, n, sizeof(*np->tmpv), u32_cmp);
+
+	result->bw_kbps = np->tmpv[n / 2];
+}
+
+
+static void recommend(struct netprobe_result *result)
+{
+	size_t loss_pct = 100;
+	uint32_t bitrate;
+
+	if (result->n_pkt_sent) {
+		loss_pct = 100 * (result->n_pkt_sent - result->n_pkt_recv)
+			/ result->n_pkt_sent;
+	}
+
+	if (result->bw_kbps)
+		bitrate = result->bw_kbps / 4 * 3;
+	else
+		bitrate = BITRATE_DEFAULT_KBPS;
+
+	if (loss_pct >= 10)
+		bitrate /= 2;
+
+	result->bitrate_kbps = MIN(MAX(bitrate, BITRATE_MIN_KBPS),
+				   BITRATE_MAX_KBPS);
+
+	/* CBR gives up adapting to the network, only use it on good links */
+	result->audio_cbr = result->bitrate_kbps >= CBR_MIN_KBPS
+		&& loss_pct < 5
+		&& result->loss_burst_max <= 2;
 }
 
 
@@ -162,6 +403,20 @@ static void tmr_completed_handler(void *arg)
 	if (result.n_pkt_recv)
 		result.rtt_avg = (uint32_t)(rtt_acc / result.n_pkt_recv);
 
+	calc_jitter(np, &result);
+	calc_loss_bursts(np, &result);
+	if (np->probe)
+		calc_bw(np, &result);
+	recommend(&result);
+
+	if (np->probe) {
+		info("netprobe: %zu/%zu packets, bw %u kbps, jitter"
+		     " p50/p90/p99 %u/%u/%u us, %zu loss bursts (max %zu)\n",
+		     result.n_pkt_recv, result.n_pkt_sent, result.bw_kbps,
+		     result.jitter_p50, result.jitter_p90, result.jitter_p99,
+		     result.n_loss_bursts, result.loss_burst_max);
+	}
+
 	np->h(0, &result, np->arg);
 }
 
@@ -169,15 +424,24 @@ static void tmr_completed_handler(void *arg)
 static void tmr_handler(void *arg)
 {
 	struct netprobe *np = arg;
+	uint32_t gap = 0;
 
-	if (np->seq_ctr < np->resultc) {
+	/* A zero gap sends the next packet back-to-back */
+	while (np->seq_ctr < np->resultc) {
 
-		tmr_start(&np->tmr_tx, np->pkt_interval, tmr_handler, np);
-		send_one(np, np->seq_ctr++);
-	}
-	else {
-		tmr_start(&np->tmr_tx, 50, tmr_completed_handler, np);
+		const uint32_t seq = np->seq_ctr++;
+
+		send_one(np, seq);
+
+		gap = np->gapv[seq];
+		if (gap)
+			break;
 	}
+
+	if (np->seq_ctr < np->resultc)
+		tmr_start(&np->tmr_tx, gap, tmr_handler, np);
+	else
+		tmr_start(&np->tmr_tx, np->drain_ms, tmr_completed_handler, np);
 }
 
 
@@ -245,32 +509,62 @@ static void destructor(void *arg)
 	mem_deref(np->turnc);
 	mem_deref(np->us_tx);
 	mem_deref(np->us_rx);
+	mem_deref(np->mb);
+	mem_deref(np->gapv);
+	mem_deref(np->tmpv);
 	mem_deref(np->resultv);
 }
 
 
-/*
- * @param pkt_interval_ms  Packet interval in [milliseconds]
- */
-int netprobe_alloc(struct netprobe **npb, const struct sa *turn_srv,
-		   int proto, bool secure,
-		   const char *turn_username, const char *turn_password,
-		   size_t pkt_count, uint32_t pkt_interval_ms,
-		   netprobe_h *h, void *arg)
+static void setup_gaps(struct netprobe *np)
+{
+	const struct netprobe_config *cfg = &np->cfg;
+	const uint32_t bits = wire_bits(np);
+	size_t t, i;
+
+	for (t = 0; t < cfg->train_count; t++) {
+		for (i = 0; i < cfg->train_len; i++) {
+
+			uint32_t *gap = &np->gapv[t * cfg->train_len + i];
+			uint32_t rate;
+
+			if (i == cfg->train_len - 1) {
+				*gap = cfg->train_interval_ms;
+			}
+			else if (cfg->pattern == NETPROBE_PATTERN_CHIRP) {
+				rate = cfg->chirp_min_kbps
+					+ (cfg->chirp_max_kbps
+					   - cfg->chirp_min_kbps)
+					* i / MAX(cfg->train_len - 2, 1);
+
+				/* kbps is bits per ms */
+				*gap = MAX((bits + rate / 2) / rate, 1);
+			}
+			else {
+				*gap = 0;
+			}
+		}
+	}
+}
+
+
+static int alloc(struct netprobe **npb, const struct sa *turn_srv,
+		 int proto, bool secure,
+		 const char *turn_username, const char *turn_password,
+		 const struct netprobe_config *cfg, bool probe,
+		 netprobe_h *h, void *arg)
 {
 	struct netprobe *np;
 	struct sa laddr;
 	int err;
 
-	if (!npb || !turn_srv || !pkt_count || !pkt_interval_ms)
-		return EINVAL;
-
 	np = mem_zalloc(sizeof(*np), destructor);
 	if (!np)
 		return ENOMEM;
 
 	np->secret = rand_u32();
-	np->pkt_interval = pkt_interval_ms;
+	np->cfg = *cfg;
+	np->probe = probe;
 
 	/* XXX: bind to a specific network interface */
 	sa_init(&laddr, AF_INET);
@@ -296,8 +590,21 @@ int netprobe_alloc(struct netprobe **npb, const struct sa *turn_srv,
 	if (err)
 		goto out;
 
-	np->resultv = mem_zalloc(sizeof(struct result) * pkt_count, NULL);
-	np->resultc = pkt_count;
+	np->resultc = cfg->train_count * cfg->train_len;
+	np->resultv = mem_zalloc(sizeof(struct result) * np->resultc, NULL);
+	np->gapv = mem_zalloc(sizeof(uint32_t) * np->resultc, NULL);
+	np->tmpv = mem_zalloc(sizeof(uint32_t) * np->resultc, NULL);
+	np->mb = mbuf_alloc(PACKET_HDR_SIZE + cfg->pkt_size);
+	if (!np->resultv || !np->gapv || !np->tmpv || !np->mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = packet_encode(np->mb, 0, np->secret, 0, cfg->pkt_size);
+	if (err)
+		goto out;
+
+	setup_gaps(np);
 
 	np->h = h;
 	np->arg = arg;
@@ -310,3 +617,83 @@ int netprobe_alloc(struct netprobe **npb, const struct sa *turn_srv,
 
 	return err;
 }
+
+
+/*
+ * @param pkt_interval_ms  Packet interval in [milliseconds]
+ */
+int netprobe_alloc(struct netprobe **npb, const struct sa *turn_srv,
+		   int proto, bool secure,
+		   const char *turn_username, const char *turn_password,
+		   size_t pkt_count, uint32_t pkt_interval_ms,
+		   netprobe_h *h, void *arg)
+{
+	struct netprobe_config cfg;
+	int err;
+
+	if (!npb || !turn_srv || !pkt_count || !pkt_interval_ms)
+		return EINVAL;
+
+	/* One packet per train, equally spaced */
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.pattern = NETPROBE_PATTERN_TRAIN;
+	cfg.train_count = pkt_count;
+	cfg.train_len = 1;
+	cfg.train_interval_ms = pkt_interval_ms;
+	cfg.pkt_size = LEGACY_PKT_SIZE;
+
+	err = alloc(npb, turn_srv, proto, secure,
+		    turn_username, turn_password,
+		    &cfg, false, h, arg);
+	if (err)
+		return err;
+
+	(*npb)->pkt_interval = pkt_interval_ms;
+	(*npb)->drain_ms = pkt_interval_ms + 50;
+
+	return 0;
+}
+
+
+int netprobe_alloc_probe(struct netprobe **npb, const struct sa *turn_srv,
+			 int proto, bool secure,
+			 const char *turn_username, const char *turn_password,
+			 const struct netprobe_config *cfg,
+			 netprobe_h *h, void *arg)
+{
+	struct netprobe_config c;
+	int err;
+
+	if (!npb || !turn_srv || !cfg)
+		return EINVAL;
+
+	c = *cfg;
+	if (!c.train_count)
+		c.train_count = DEFAULT_TRAIN_COUNT;
+	if (!c.train_len)
+		c.train_len = DEFAULT_TRAIN_LEN;
+	if (!c.train_interval_ms)
+		c.train_interval_ms = DEFAULT_TRAIN_INTERVAL;
+	if (!c.pkt_size)
+		c.pkt_size = DEFAULT_PKT_SIZE;
+	if (!c.chirp_min_kbps)
+		c.chirp_min_kbps = DEFAULT_CHIRP_MIN_KBPS;
+	if (!c.chirp_max_kbps)
+		c.chirp_max_kbps = DEFAULT_CHIRP_MAX_KBPS;
+
+	if (c.train_len < 2 || c.chirp_max_kbps < c.chirp_min_kbps)
+		return EINVAL;
+	if (c.pattern == NETPROBE_PATTERN_CHIRP && c.train_len < 3)
+		return EINVAL;
+
+	err = alloc(npb, turn_srv, proto, secure,
+		    turn_username, turn_password,
+		    &c, true, h, arg);
+	if (err)
+		return err;
+
+	(*npb)->pkt_interval = 0;
+	(*npb)->drain_ms = DRAIN_MS;
+
+	return 0;
+}
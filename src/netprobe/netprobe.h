@@ -29,8 +29,13 @@ struct packet {
 };
 
 
+#define PACKET_HDR_SIZE 20
+
+
 int packet_encode(struct mbuf *mb, uint64_t ts, uint32_t secret,
 		  uint32_t seq, uint32_t len);
+int packet_encode_header(struct mbuf *mb, uint64_t ts, uint32_t secret,
+			 uint32_t seq, uint32_t len);
 int packet_decode(struct packet *pkt, struct mbuf *mb);
 
 
@@ -22,8 +22,9 @@
 #include "netprobe.h"
 
 
-int packet_encode(struct mbuf *mb, uint64_t ts, uint32_t secret,
-		  uint32_t seq, uint32_t len)
+/* Writes the header only, the payload of a reused buffer is left as is */
+int packet_encode_header(struct mbuf *mb, uint64_t ts, uint32_t secret,
+			 uint32_t seq, uint32_t len)
 {
 	int err = 0;
 
@@ -31,6 +32,17 @@ int packet_encode(struct mbuf *mb, uint64_t ts, uint32_t secret,
 	err |= mbuf_write_u32(mb, htonl(secret));
 	err |= mbuf_write_u32(mb, htonl(seq));
 	err |= mbuf_write_u32(mb, htonl(len));
+
+	return err;
+}
+
+
+int packet_encode(struct mbuf *mb, uint64_t ts, uint32_t secret,
+		  uint32_t seq, uint32_t len)
+{
+	int err;
+
+	err = packet_encode_header(mb, ts, secret, seq, len);
 	err |= mbuf_fill(mb, 0x42, len);
 
 	return err;
@@ -282,7 +282,9 @@ static int jsflow_init(void)
 {
 	iflow_register_statics(jsflow_destroy,
 			       jsflow_set_mute,
-			       jsflow_get_mute);
+			       jsflow_get_mute,
+			       NULL,
+			       NULL);
 	g_jf.initialized = true;
 	
 	return 0;
@@ -415,6 +417,8 @@ int jsflow_alloc(struct iflow		**flowp,
 			 jsflow_gather_all_turn,
 			 jsflow_add_decoders_for_user,
 			 NULL, //peerflow_remove_decoders_for_user,
+			 NULL, //jsflow_get_audio_levels,
+			 NULL, //jsflow_set_active_speakers,
 			 NULL, //peerflow_set_e2ee_key,
 			 jsflow_dce_send,
 			 jsflow_stop_media,
@@ -868,7 +872,6 @@ void pc_local_sdp_handler(int self, int err,
 			  const char *type, const char *sdp)
 {
 	struct jsflow *flow = self2pc(self);
-	struct sdp_session *sess = NULL;
 	const char *modsdp = NULL;
 
 	if (!flow) {
@@ -885,12 +888,12 @@ void pc_local_sdp_handler(int self, int err,
 #if MODIFY_SDP
 	/* Modify SDP here */
 	if (streq(type, "offer")) {
-		sdp_dup(&sess, sdp, true);
-		modsdp = sdp_modify_offer(sess, flow->conv_type, flow->audio.local_cbr);
+		sdp_rewrite((char **)&modsdp, sdp, true,
+			    flow->conv_type, flow->audio.local_cbr);
 	}
 	else if (streq(type, "answer")) {
-		sdp_dup(&sess, sdp, false);		
-		modsdp = sdp_modify_answer(sess, flow->conv_type, flow->audio.local_cbr);
+		sdp_rewrite((char **)&modsdp, sdp, false,
+			    flow->conv_type, flow->audio.local_cbr);
 	}
 	else {
 		str_dup((char **)&modsdp, sdp);
@@ -901,7 +904,6 @@ void pc_local_sdp_handler(int self, int err,
 	
 	pc_SetLocalDescription(flow->handle, type, modsdp);
 
-	mem_deref(sess);
 	mem_deref((void *)modsdp);
 }
 
@@ -13,6 +13,7 @@ AVS_SRCS += \
 	peerflow/frame_decryptor.cpp \
 	peerflow/frame_encryptor.cpp \
 	peerflow/peerflow.cpp \
+	peerflow/video_budget.c \
 	peerflow/video_renderer.cpp \
 	peerflow/sdp.c
 endif
@@ -17,6 +17,7 @@
 */
 
 #include <stdio.h>
+#include <algorithm>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,6 +32,7 @@ extern "C" {
 #endif
 
 #include "rtc_base/scoped_ref_ptr.h"
+#include "rtc_base/timeutils.h"
 #include "api/peerconnectioninterface.h"
 #include "api/call/callfactoryinterface.h"
 #include "api/audio_codecs/builtin_audio_decoder_factory.h"
@@ -64,6 +66,10 @@ extern "C" {
 #define TMR_STATS_INTERVAL 1000
 #define DISCONNECT_TIMEOUT 2000
 
+#define MAX_VIDEO_DECODERS 4   /* conference members decoded at once */
+#define VIDEO_DECODER_HOLD 3000 /* ms a member keeps its video decoder */
+#define AUDIO_LEVEL_MAX_AGE 500 /* ms, older RTP sources are silent */
+
 #define DOUBLE_ENCRYPTION 0
 
 #define GROUP_PTIME 40
@@ -140,12 +146,19 @@ struct peerflow {
 
 		bool local_cbr;
 		bool remote_cbr;
+
+		/* Refreshed on the stats tick, not on every level poll */
+		std::vector<rtc::scoped_refptr<webrtc::RtpReceiverInterface>>
+			*rxv;
 	} audio;
 
 	struct {
 		rtc::scoped_refptr<webrtc::VideoTrackInterface>	track;
 		struct list renderl;
 		bool negotiated;
+
+		std::vector<uint32_t> *rankv;  /* speaker SSRCs, best first */
+		bool held;  /* a ranked member waits for a decoder */
 	} video;
 
 	struct {
@@ -221,8 +234,12 @@ struct conf_member {
 	char *label;
 	char *userid;
 	char *clientid;
+	char *cname;
+	char *msid;
 	uint32_t ssrca;
 	uint32_t ssrcv;
+	bool video_active;  /* ssrcv is in the remote description */
+	uint64_t ts_active; /* video_active last set */
 
 	struct peerflow *pf;
 
@@ -239,6 +256,8 @@ static void cm_destructor(void *arg)
 	mem_deref(cm->label);
 	mem_deref(cm->userid);
 	mem_deref(cm->clientid);
+	mem_deref(cm->cname);
+	mem_deref(cm->msid);
 }
 
 
@@ -296,6 +315,24 @@ static struct conf_member *conf_member_find_by_userclient(
 }
 
 
+static struct conf_member *conf_member_find_by_ssrca(
+		  struct peerflow *pf,
+		  uint32_t ssrca)
+{
+	struct conf_member *cm;	
+	bool found = false;
+	struct le *le;
+
+	for(le = pf->cml.head; !found && le; le = le->next) {
+		cm = (struct conf_member *)le->data;
+
+		found = cm->ssrca == ssrca;
+	}
+
+	return found ? cm : NULL;
+}
+
+
 static struct conf_member *conf_member_find_by_label(
 		  struct peerflow *pf,
 		  const char *label)
@@ -729,6 +766,19 @@ static bool peerflow_get_mute(void)
 		return false;
 }
 
+/* Applied to all flows on their next stats tick */
+void peerflow_set_video_budget(uint64_t max_pps)
+{
+	wire::video_budget_set_max(max_pps);
+}
+
+void peerflow_set_video_visible(const char *userid,
+				const char *clientid,
+				bool visible)
+{
+	wire::video_budget_set_visible(userid, clientid, visible);
+}
+
 int peerflow_init(void)
 {
 	int err;
@@ -750,6 +800,10 @@ int peerflow_init(void)
 	if (err)
 		goto out;
 
+	err = wire::video_budget_init();
+	if (err)
+		goto out;
+
 	//rtc::LogMessage::LogToDebug(rtc::LS_INFO);
 
 	peerflow_start_log();
@@ -785,7 +839,9 @@ int peerflow_init(void)
 
 	iflow_register_statics(peerflow_destroy,
 			       peerflow_set_mute,
-			       peerflow_get_mute);
+			       peerflow_get_mute,
+			       peerflow_set_video_budget,
+			       peerflow_set_video_visible);
 	g_pf.initialized = true;
 
  out:
@@ -808,6 +864,8 @@ void peerflow_destroy(void)
 
 	g_pf.lock = (struct lock *)mem_deref(g_pf.lock);
 
+	wire::video_budget_close();
+
 	g_pf.initialized = false;
 
 	rtc::LogMessage::RemoveLogToStream(g_pf.logsink);
@@ -1297,6 +1355,7 @@ public:
 			render->track = vtrack;
 			list_append(&pf_->video.renderl, &render->le, render);
 			vtrack->AddOrUpdateSink(sink, vsw);
+			wire::video_budget_add(sink, vtrack);
 		}
 		else if (streq(kind,
 			       webrtc::MediaStreamTrackInterface::kAudioKind))
@@ -1353,6 +1412,11 @@ public:
 			render = (struct render_le *)le->data;
 			
 			if (render->track == track) {
+				/* Waits for a budget update still
+				 * applying wants to the sink.
+				 */
+				wire::video_budget_remove(
+					(wire::VideoRendererSink *)render->sink);
 				list_unlink(&render->le);
 				break;
 			}
@@ -1524,9 +1588,8 @@ public:
 	virtual void OnSuccess(webrtc::SessionDescriptionInterface *isdp) {
 		
 		webrtc::SdpType type;
-		struct sdp_session *sess = NULL;
 		std::string sdp_str;
-		const char *sdp = NULL;
+		char *sdp = NULL;
 		webrtc::SessionDescriptionInterface *imod_sdp = nullptr;
 		int err;
 
@@ -1542,13 +1605,14 @@ public:
 		
 		switch(type) {
 		case webrtc::SdpType::kOffer:
-			err = sdp_dup(&sess, sdp_str.c_str(), true);
+			err = sdp_rewrite(&sdp, sdp_str.c_str(), true,
+					  pf_->conv_type, pf_->audio.local_cbr);
 			if (err) {
-				warning("pf(%p): sdp_dup failed: %m\n", err);
+				warning("pf(%p): sdp_rewrite failed: %m\n",
+					pf_, err);
 				return;
 			}
 			
-			sdp = sdp_modify_offer(sess, pf_->conv_type, pf_->audio.local_cbr);
 			imod_sdp = sdp_interface(sdp, webrtc::SdpType::kOffer);
 			pf_->peerConn->SetLocalDescription(
 					pf_->offerObserver,
@@ -1556,13 +1620,14 @@ public:
 			break;
 
 		case webrtc::SdpType::kAnswer:
-			err = sdp_dup(&sess, sdp_str.c_str(), false);
+			err = sdp_rewrite(&sdp, sdp_str.c_str(), false,
+					  pf_->conv_type, pf_->audio.local_cbr);
 			if (err) {
-				warning("pf(%p): sdp_dup failed: %m\n", err);
+				warning("pf(%p): sdp_rewrite failed: %m\n",
+					pf_, err);
 				return;
 			}
 			
-			sdp = sdp_modify_answer(sess, pf_->conv_type, pf_->audio.local_cbr);
 			imod_sdp = sdp_interface(sdp, webrtc::SdpType::kAnswer);
 			pf_->peerConn->SetLocalDescription(
 					pf_->answerObserver,
@@ -1573,8 +1638,7 @@ public:
 			break;
 		}
 
-		mem_deref((void *)sess);
-		mem_deref((void *)sdp);
+		mem_deref(sdp);
 	}
 
 	virtual void OnFailure(webrtc::RTCError err) {
@@ -1718,6 +1782,8 @@ static void pf_destructor(void *arg)
 	delete pf->answerOptions;
 	delete pf->config;
 	delete pf->observer;
+	delete pf->audio.rxv;
+	delete pf->video.rankv;
 
 	pf->peerConn = NULL;
 	pf->sdpObserver = NULL;
@@ -1735,15 +1801,44 @@ static void pf_destructor(void *arg)
 	list_flush(&pf->cml);
 
 	list_flush(&pf->video.renderl);
+	wire::video_budget_remove_flow(pf);
 }
 
+static void update_audio_receivers(struct peerflow *pf)
+{
+	std::vector<rtc::scoped_refptr<webrtc::RtpReceiverInterface>> rxs;
+
+	pf->audio.rxv->clear();
+
+	rxs = pf->peerConn->GetReceivers();
+	for (const auto& rx : rxs) {
+		if (rx->media_type() == cricket::MEDIA_TYPE_AUDIO)
+			pf->audio.rxv->push_back(rx);
+	}
+}
+
+static int follow_speakers(struct peerflow *pf, uint64_t now);
+
 static void timer_stats(void *arg)
 {
 	struct peerflow *pf = (struct peerflow *)arg;
 
-	if (pf && pf->peerConn) {
+	if (!pf)
+		return;
+
+	if (pf->peerConn) {
 		pf->peerConn->GetStats(pf->netStatsCb);
+		update_audio_receivers(pf);
 	}
+
+	wire::video_budget_update();
+
+	/* Members the budget paused or resumed lose or get their decoder,
+	 * a speaker waiting for one gets it once the hold is over.
+	 */
+	if (wire::video_budget_changed(pf) || pf->video.held)
+		follow_speakers(pf, tmr_jiffies());
+
 	tmr_start(&pf->tmr_stats, TMR_STATS_INTERVAL, timer_stats, pf);
 }
 
@@ -1785,6 +1880,8 @@ int peerflow_alloc(struct iflow		**flowp,
 			 peerflow_gather_all_turn,
 			 peerflow_add_decoders_for_user,
 			 NULL, //peerflow_remove_decoders_for_user,
+			 peerflow_get_audio_levels,
+			 peerflow_set_active_speakers,
 			 NULL, //peerflow_set_e2ee_key,
 			 peerflow_dce_send,
 			 peerflow_stop_media,
@@ -1799,6 +1896,9 @@ int peerflow_alloc(struct iflow		**flowp,
 	
 	pf->config = new webrtc::PeerConnectionInterface::RTCConfiguration();
 	pf->observer = new AvsPeerConnectionObserver(pf);
+	pf->audio.rxv = new std::vector<
+		rtc::scoped_refptr<webrtc::RtpReceiverInterface>>();
+	pf->video.rankv = new std::vector<uint32_t>();
 #if 0
 	pf->dc.ch = pf->pf->CreateDataChannel("calling-3.0", nullptr);
 	if (!pf->dc.ch) {
@@ -2163,6 +2263,105 @@ int peerflow_set_remote_userclientid(struct iflow *iflow,
 	return err;
 }
 
+struct ssrc_keep {
+	struct peerflow *pf;
+	std::vector<std::string> linev;
+};
+
+
+/* Collects the ssrc lines that do not belong to a conference member */
+static bool ssrc_keep_handler(const char *name, const char *value, void *arg)
+{
+	struct ssrc_keep *keep = (struct ssrc_keep *)arg;
+	uint32_t ssrc = (uint32_t)strtoul(value, NULL, 10);
+	struct le *le;
+
+	(void)name;
+
+	LIST_FOREACH(&keep->pf->cml, le) {
+		const struct conf_member *cm =
+			(const struct conf_member *)le->data;
+
+		if (cm->ssrcv && cm->ssrcv == ssrc)
+			return false;
+	}
+
+	keep->linev.push_back(value);
+
+	return false;
+}
+
+
+/* Puts the video SSRCs of the active members in the remote description */
+static int update_video_decoders(struct peerflow *pf)
+{
+	struct sdp_media *sdpm;
+	webrtc::SessionDescriptionInterface *isdp;
+	struct ssrc_keep keep;
+	const char *sdp;
+	struct le *le;
+	int err = 0;
+
+	sdpm = find_media(pf->rsess, "video");
+	if (!sdpm)
+		return ENOSYS;
+
+	keep.pf = pf;
+	sdp_media_lattr_apply(sdpm, "ssrc", ssrc_keep_handler, &keep);
+	sdp_media_del_lattr(sdpm, "ssrc");
+
+	for (const std::string& line : keep.linev) {
+		err |= sdp_media_set_lattr(sdpm, false, "ssrc", "%s",
+					   line.c_str());
+	}
+
+	LIST_FOREACH(&pf->cml, le) {
+		struct conf_member *cm = (struct conf_member *)le->data;
+
+		if (!cm->video_active || !cm->ssrcv)
+			continue;
+
+		err |= sdp_media_set_lattr(sdpm, false,
+					   "ssrc", "%u cname:%s",
+					   cm->ssrcv, cm->cname);
+		err |= sdp_media_set_lattr(sdpm, false, "ssrc", "%u msid:%s %s",
+					   cm->ssrcv, cm->msid, cm->label);
+		err |= sdp_media_set_lattr(sdpm, false, "ssrc", "%u mslabel:%s",
+					   cm->ssrcv, cm->msid);
+		err |= sdp_media_set_lattr(sdpm, false, "ssrc", "%u label:%s",
+					   cm->ssrcv, cm->label);
+	}
+	if (err)
+		return err;
+
+	sdp = sdp_modify_offer(pf->rsess, pf->conv_type, pf->audio.local_cbr);
+	isdp = sdp_interface(sdp, webrtc::SdpType::kOffer);
+
+	pf->peerConn->SetRemoteDescription(
+		std::unique_ptr<webrtc::SessionDescriptionInterface>(isdp),
+		pf->sdpRemoteObserver);
+
+	return 0;
+}
+
+
+static size_t video_decoder_count(const struct peerflow *pf)
+{
+	struct le *le;
+	size_t n = 0;
+
+	LIST_FOREACH(&pf->cml, le) {
+		const struct conf_member *cm =
+			(const struct conf_member *)le->data;
+
+		if (cm->video_active)
+			++n;
+	}
+
+	return n;
+}
+
+
 int peerflow_add_decoders_for_user(struct iflow *iflow,
 				   const char *userid,
 				   const char *clientid,
@@ -2170,13 +2369,10 @@ int peerflow_add_decoders_for_user(struct iflow *iflow,
 				   uint32_t ssrcv)
 {
 	struct peerflow *pf = (struct peerflow*)iflow;
-	struct sdp_media *sdpm = NULL;
 	char cname[16];             /* common for audio+video */
 	char msid[36];
-	char *label;
+	char *label = NULL;
 	struct conf_member *memb;
-	webrtc::SessionDescriptionInterface *isdp;
-	const char *sdp;
 	int err = 0;
 
 	if (!pf)
@@ -2198,31 +2394,204 @@ int peerflow_add_decoders_for_user(struct iflow *iflow,
 	if (err)
 		goto out;
 
-	sdpm = find_media(pf->rsess, "video");
-	if (!sdpm)
-		return ENOSYS;
+	err  = str_dup(&memb->cname, cname);
+	err |= str_dup(&memb->msid, msid);
+	if (err)
+		goto out;
 
-	err = sdp_media_set_lattr(sdpm, false,
-				  "ssrc", "%u cname:%s",
-				  ssrcv, cname);
-	err |= sdp_media_set_lattr(sdpm, false, "ssrc", "%u msid:%s %s",
-				   ssrcv, msid, label);
-	err |= sdp_media_set_lattr(sdpm, false, "ssrc", "%u mslabel:%s",
-				   ssrcv, msid);
-	err |= sdp_media_set_lattr(sdpm, false, "ssrc", "%u label:%s",	   
-				   ssrcv, label);
-	
+	/* Beyond the limit, video follows the active speakers */
+	memb->video_active = video_decoder_count(pf) < MAX_VIDEO_DECODERS
+		&& !wire::video_budget_paused(pf, userid, clientid);
+	memb->ts_active = tmr_jiffies();
+
+	err = update_video_decoders(pf);
+
+ out:
 	mem_deref(label);
 
-	sdp = sdp_modify_offer(pf->rsess, pf->conv_type, pf->audio.local_cbr);
-	isdp = sdp_interface(sdp, webrtc::SdpType::kOffer);
+	return err;
+}
 
-	pf->peerConn->SetRemoteDescription(
-		std::unique_ptr<webrtc::SessionDescriptionInterface>(isdp),
-		pf->sdpRemoteObserver);
+
+int peerflow_get_audio_levels(struct iflow *iflow,
+			      struct speaker_level *levelv,
+			      size_t *levelc)
+{
+	struct peerflow *pf = (struct peerflow*)iflow;
+	int64_t now = rtc::TimeMillis();
+	size_t n = 0;
+
+	if (!pf || !levelv || !levelc)
+		return EINVAL;
+	if (!pf->peerConn)
+		return ENOENT;
+
+	/* RFC 6464 levels from the header extension of the last packet */
+	for (const auto& rx : *pf->audio.rxv) {
+		for (const webrtc::RtpSource& src : rx->GetSources()) {
+			struct speaker_level *lvl;
+			const struct conf_member *cm;
+
+			if (src.source_type() != webrtc::RtpSourceType::SSRC
+			    || !src.audio_level().has_value())
+				continue;
+			if (now - src.timestamp_ms() > AUDIO_LEVEL_MAX_AGE)
+				continue;
+			if (n >= *levelc)
+				goto out;
+
+			lvl = &levelv[n++];
+			lvl->ssrc = src.source_id();
+			lvl->dbov = *src.audio_level();
+
+			cm = conf_member_find_by_ssrca(pf, lvl->ssrc);
+			if (cm) {
+				lvl->userid = cm->userid;
+				lvl->clientid = cm->clientid;
+			}
+			else {
+				lvl->userid = pf->userid_remote;
+				lvl->clientid = pf->clientid_remote;
+			}
+		}
+	}
 
  out:
-	return err;
+	*levelc = n;
+
+	return 0;
+}
+
+
+static bool member_chosen(const std::vector<struct conf_member *>& v,
+			  const struct conf_member *cm)
+{
+	return std::find(v.begin(), v.end(), cm) != v.end();
+}
+
+
+static bool member_paused(const struct peerflow *pf,
+			  const struct conf_member *cm)
+{
+	return wire::video_budget_paused(pf, cm->userid, cm->clientid);
+}
+
+
+/*
+ * Keeps video decoders for the best ranked conference members, filling
+ * any slots left with members that have not spoken yet, those already
+ * decoded first. A member keeps its decoder for at least
+ * VIDEO_DECODER_HOLD ms, so that speakers trading places do not make
+ * the decoders churn. A speaker held out is retried on the stats tick.
+ * Members the video budget paused are not decoded at all.
+ */
+static int follow_speakers(struct peerflow *pf, uint64_t now)
+{
+	std::vector<struct conf_member *> chosen;
+	std::vector<struct conf_member *> keep;
+	bool changed = false;
+	struct le *le;
+	int pass;
+
+	pf->video.held = false;
+
+	if (list_count(&pf->cml) == 0)
+		return 0;
+
+	for (uint32_t ssrc : *pf->video.rankv) {
+		struct conf_member *cm;
+
+		if (chosen.size() >= MAX_VIDEO_DECODERS)
+			break;
+
+		cm = conf_member_find_by_ssrca(pf, ssrc);
+		if (!cm || !cm->ssrcv || member_chosen(chosen, cm)
+		    || member_paused(pf, cm))
+			continue;
+
+		chosen.push_back(cm);
+	}
+
+	for (pass = 0; pass < 2; ++pass) {
+		LIST_FOREACH(&pf->cml, le) {
+			struct conf_member *cm = (struct conf_member *)le->data;
+
+			if (chosen.size() >= MAX_VIDEO_DECODERS)
+				break;
+			if (!cm->ssrcv || cm->video_active != (pass == 0))
+				continue;
+			if (member_chosen(chosen, cm) || member_paused(pf, cm))
+				continue;
+
+			chosen.push_back(cm);
+		}
+	}
+
+	LIST_FOREACH(&pf->cml, le) {
+		struct conf_member *cm = (struct conf_member *)le->data;
+
+		if (!cm->video_active)
+			continue;
+
+		if (member_chosen(chosen, cm))
+			keep.push_back(cm);
+		else if (now < cm->ts_active + VIDEO_DECODER_HOLD
+			 && !member_paused(pf, cm))
+			keep.push_back(cm);
+	}
+
+	for (struct conf_member *cm : chosen) {
+		if (member_chosen(keep, cm))
+			continue;
+
+		if (keep.size() >= MAX_VIDEO_DECODERS) {
+			pf->video.held = true;
+			break;
+		}
+
+		keep.push_back(cm);
+	}
+
+	LIST_FOREACH(&pf->cml, le) {
+		struct conf_member *cm = (struct conf_member *)le->data;
+		bool active = member_chosen(keep, cm);
+
+		if (active != cm->video_active) {
+			cm->video_active = active;
+			if (active)
+				cm->ts_active = now;
+			changed = true;
+		}
+	}
+
+	if (!changed)
+		return 0;
+
+	info("pf(%p): video decoders follow speakers: %zu active%s\n",
+	     pf, keep.size(), pf->video.held ? ", speakers held" : "");
+
+	return update_video_decoders(pf);
+}
+
+
+int peerflow_set_active_speakers(struct iflow *iflow,
+				 const struct speaker_rank *rankv,
+				 size_t rankc)
+{
+	struct peerflow *pf = (struct peerflow*)iflow;
+	size_t i;
+
+	if (!pf)
+		return EINVAL;
+
+	wire::video_budget_set_speakers(pf, rankv, rankc);
+	wire::video_budget_update();
+
+	pf->video.rankv->clear();
+	for (i = 0; i < rankc; ++i)
+		pf->video.rankv->push_back(rankv[i].ssrc);
+
+	return follow_speakers(pf, tmr_jiffies());
 }
 
 
@@ -2412,14 +2781,43 @@ void peerflow_stop_media(struct iflow *iflow)
 	IFLOW_CALL_CB(pf->iflow, stoppedh, pf->iflow.arg);
 }
 
-void peerflow_set_stats(struct peerflow* pf, float downloss, float rtt)
+void peerflow_set_stats(struct peerflow* pf,
+			const struct peerflow_stats *stats)
 {
-	if (!pf) {
+	struct iflow_stats is;
+
+	if (!pf || !stats) {
 		return;
 	}
 
-	pf->stats.dloss = downloss;
-	pf->stats.rtt = rtt;
+	memset(&is, 0, sizeof(is));
+	is.dloss = stats->dloss;
+	is.rtt = stats->rtt;
+
+	for (size_t i = 0; i < stats->streamc; i++) {
+		const struct peerflow_stream_stats *ss = &stats->streamv[i];
+
+		if (!ss->inbound) {
+			is.send_kbps += ss->bitrate_kbps;
+			continue;
+		}
+
+		is.recv_kbps += ss->bitrate_kbps;
+		is.jitter = std::max(is.jitter, ss->jitter_ms);
+		if (ss->video)
+			is.video_fps = std::max(is.video_fps, ss->frame_rate);
+		else
+			is.audio_level = std::max(is.audio_level,
+						  ss->audio_level);
+	}
+
+	is.video_budget = stats->video_budget;
+	is.video_used = stats->video_used;
+	is.video_allocc = stats->allocc;
+	memcpy(is.video_allocv, stats->allocv,
+	       stats->allocc * sizeof(*stats->allocv));
+
+	pf->stats = is;
 }
 
 int peerflow_get_stats(struct iflow *flow,
@@ -2434,9 +2832,36 @@ int peerflow_get_stats(struct iflow *flow,
 	return 0;
 }
 
+int peerflow_get_stats_snapshot(struct iflow *flow,
+				struct peerflow_stats *stats)
+{
+	struct peerflow *pf = (struct peerflow*)flow;
+	if (!pf || !stats) {
+		return EINVAL;
+	}
+	if (!pf->netStatsCb) {
+		return ENOENT;
+	}
+
+	return pf->netStatsCb->snapshot(stats);
+}
+
+int peerflow_get_stats_json(struct iflow *flow, char **json)
+{
+	struct peerflow *pf = (struct peerflow*)flow;
+	if (!pf || !json) {
+		return EINVAL;
+	}
+	if (!pf->netStatsCb) {
+		return ENOENT;
+	}
+
+	return pf->netStatsCb->currentStats(json);
+}
+
 int peerflow_debug(struct re_printf *pf, const struct iflow *flow)
 {
-	return 0;
+	return wire::video_budget_debug(pf, (const struct peerflow *)flow);
 }
 
 
@@ -16,15 +16,62 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef PEERFLOW_H
+#define PEERFLOW_H
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 struct iflow;
 
+#define PEERFLOW_STATS_MAX_STREAMS 16
+
+/* One RTP stream of the last stats report. Rates are over the
+ * interval since the previous report.
+ */
+struct peerflow_stream_stats {
+	uint32_t ssrc;
+	bool video;
+	bool inbound;
+
+	uint64_t packets;        /* received or sent */
+	int32_t packets_lost;    /* inbound only */
+	uint64_t bytes;
+	uint32_t frames;         /* decoded or encoded, video only */
+	uint64_t samples;        /* total samples received, audio only */
+	uint64_t concealed;      /* concealed samples, audio only */
+
+	float jitter_ms;
+	float audio_level;       /* inbound audio only, 0..1 */
+	float bitrate_kbps;
+	float frame_rate;
+	float conceal_ratio;     /* concealed / received samples */
+};
+
+struct peerflow_stats {
+	int64_t ts_us;           /* report timestamp */
+	float dloss;
+	float rtt;
+
+	size_t streamc;
+	struct peerflow_stream_stats streamv[PEERFLOW_STATS_MAX_STREAMS];
+
+	/* Remote video budget, shared by all flows */
+	uint64_t video_budget;   /* rendered pixels/s, 0 is unlimited */
+	uint64_t video_used;     /* pixels/s granted over all flows */
+	size_t allocc;           /* streams of this flow */
+	struct iflow_video_alloc allocv[IFLOW_STATS_MAX_VIDEO];
+};
+
 int pc_platform_init(void);
 void peerflow_destroy(void);
 
+void peerflow_set_video_budget(uint64_t max_pps);
+void peerflow_set_video_visible(const char *userid,
+				const char *clientid,
+				bool visible);
+
 int peerflow_set_video_state(struct iflow *iflow,
 			     enum icall_vstate vstate);
 
@@ -64,6 +111,13 @@ int peerflow_add_decoders_for_user(struct iflow *iflow,
 				   uint32_t ssrca,
 				   uint32_t ssrcv);
 
+int peerflow_get_audio_levels(struct iflow *iflow,
+			      struct speaker_level *levelv,
+			      size_t *levelc);
+int peerflow_set_active_speakers(struct iflow *iflow,
+				 const struct speaker_rank *rankv,
+				 size_t rankc);
+
 void peerflow_stop_media(struct iflow *iflow);
 void peerflow_close(struct iflow *iflow);
 
@@ -77,9 +131,14 @@ int peerflow_debug(struct re_printf *pf, const struct iflow *flow);
 
 int peerflow_get_stats(struct iflow *flow,
 		       struct iflow_stats *stats);
-void peerflow_set_stats(struct peerflow* flow, float downloss, float rtt);
+void peerflow_set_stats(struct peerflow* flow,
+			const struct peerflow_stats *stats);
+int peerflow_get_stats_snapshot(struct iflow *flow,
+				struct peerflow_stats *stats);
+int peerflow_get_stats_json(struct iflow *flow, char **json);
 
 #ifdef __cplusplus
 }
 #endif
 
+#endif
@@ -318,61 +318,352 @@ const char *sdp_modify_answer(struct sdp_session *sess,
 	return sdp_sess2str(sess);
 }
 
-void sdp_check_remote_acbr(const char *sdp,
-			   bool offer,
-			   peerflow_acbr_h *acbrh,
-			   void *arg)
+/*
+ * Single pass rewriter
+ *
+ * Applies the edits of sdp_dup() followed by sdp_modify_offer() or
+ * sdp_modify_answer() directly on the line spans of a local SDP,
+ * without decoding it into a session. Formats other than opus and
+ * VP8 are dropped together with their rtpmap/fmtp/rtcp-fb lines,
+ * everything else is copied verbatim.
+ */
+
+#define REWRITE_MAX_PT 32
+
+enum rw_media {
+	RW_MEDIA_NONE = 0,
+	RW_MEDIA_AUDIO,
+	RW_MEDIA_VIDEO,
+	RW_MEDIA_OTHER,
+};
+
+struct rw_sect {
+	enum rw_media media;
+	int ptv[REWRITE_MAX_PT];    /* kept payload types         */
+	bool fmtpv[REWRITE_MAX_PT]; /* kept payload type has fmtp */
+	size_t ptc;
+	bool has_c;
+};
+
+
+static bool next_line(struct pl *line, const char **pp, const char *end)
 {
-	struct sdp_session *rsess = NULL;
-	struct sa laddr;
-	struct mbuf mbsdp;
-	const struct list *medial;
-	struct le *le;
-	int err = 0;
+	const char *p = *pp;
+	const char *eol;
 
-	mbsdp.buf = (uint8_t *)sdp;
-	mbsdp.pos = 0;
-	mbsdp.end = str_len(sdp);
-	mbsdp.size = mbsdp.end;
+	if (p >= end)
+		return false;
 
-	sa_init(&laddr, AF_INET);
-	sa_set_str(&laddr, "127.0.0.1", 9);
-	err = sdp_session_alloc(&rsess, &laddr);
-	if (err) {
-		warning("sdp_dup: failed to alloc sdp_session: %m\n", err);
-		goto out;
+	eol = memchr(p, '\n', end - p);
+	line->p = p;
+	line->l = (eol ? eol : end) - p;
+	if (line->l && line->p[line->l - 1] == '\r')
+		--line->l;
+
+	*pp = eol ? eol + 1 : end;
+
+	return true;
+}
+
+
+static bool line_prefix(const struct pl *line, const char *pfx)
+{
+	size_t n = strlen(pfx);
+
+	return line->l >= n && 0 == memcmp(line->p, pfx, n);
+}
+
+
+static bool line_contains(const struct pl *line, const char *str)
+{
+	size_t n = strlen(str);
+	size_t i;
+
+	for (i = 0; i + n <= line->l; ++i) {
+		if (0 == memcmp(line->p + i, str, n))
+			return true;
 	}
 
-	err = sdp_decode(rsess, &mbsdp, true);
-	if (err) {
-		warning("sdp_decode: failed to parse sdp: %m\n", err);
-		goto out;
+	return false;
+}
+
+
+/* Payload type of an "a=<attr>:<pt> ..." line, -1 if none */
+static int line_pt(const struct pl *line, const char *attr)
+{
+	size_t n = strlen(attr);
+	size_t i;
+	int pt = 0;
+
+	if (!line_prefix(line, attr))
+		return -1;
+
+	for (i = n; i < line->l && line->p[i] != ' '; ++i) {
+		if (line->p[i] < '0' || line->p[i] > '9')
+			return -1;
+		pt = pt * 10 + (line->p[i] - '0');
 	}
-	medial = sdp_session_medial(rsess, false);
-	LIST_FOREACH(medial, le) {
-		struct sdp_media *sdpm = (struct sdp_media *)le->data;
 
-		if (streq(sdp_media_name(sdpm), "audio")) {
-			const struct list *fmtl;
-			struct le *fle;
+	return i > n ? pt : -1;
+}
 
-			fmtl = sdp_media_format_lst(sdpm, false);
-			LIST_FOREACH(fmtl, fle) {
-				struct sdp_format *fmt = (struct sdp_format *)fle;
 
-				if (fmt && fmt->params && 0 == re_regex(fmt->params, strlen(fmt->params), "cbr=1")) {
+static int sect_find(const struct rw_sect *sect, int pt)
+{
+	size_t i;
 
-					if (acbrh) {
-						acbrh(true, offer, arg);
-					}
+	for (i = 0; i < sect->ptc; ++i) {
+		if (sect->ptv[i] == pt)
+			return (int)i;
+	}
 
-					info("sdp: remote side asking for CBR\n");
-				}
+	return -1;
+}
+
+
+static bool keep_format(enum rw_media media, const struct pl *enc)
+{
+	struct pl name = *enc;
+	const char *slash;
+
+	slash = pl_strchr(&name, '/');
+	if (slash)
+		name.l = slash - name.p;
+
+	if (media == RW_MEDIA_AUDIO)
+		return 0 == pl_strcmp(&name, "opus");
+	else if (media == RW_MEDIA_VIDEO)
+		return 0 == pl_strcasecmp(&name, "vp8");
+
+	return true;
+}
+
+
+/* Collects the kept payload types of the section that starts at p */
+static void sect_scan(struct rw_sect *sect, const struct pl *mline,
+		      const char *p, const char *end)
+{
+	struct pl line;
+
+	memset(sect, 0, sizeof(*sect));
+
+	if (line_prefix(mline, "m=audio "))
+		sect->media = RW_MEDIA_AUDIO;
+	else if (line_prefix(mline, "m=video "))
+		sect->media = RW_MEDIA_VIDEO;
+	else
+		sect->media = RW_MEDIA_OTHER;
+
+	while (next_line(&line, &p, end)) {
+		int pt;
+		int ix;
+
+		if (line_prefix(&line, "m="))
+			break;
+		else if (line_prefix(&line, "c="))
+			sect->has_c = true;
+		else if ((pt = line_pt(&line, "a=rtpmap:")) >= 0) {
+			struct pl enc;
+			const char *sp = pl_strchr(&line, ' ');
+
+			if (!sp || sect->ptc >= REWRITE_MAX_PT)
+				continue;
+
+			enc.p = sp + 1;
+			enc.l = line.l - (enc.p - line.p);
+			if (keep_format(sect->media, &enc))
+				sect->ptv[sect->ptc++] = pt;
+		}
+		else if ((pt = line_pt(&line, "a=fmtp:")) >= 0) {
+			ix = sect_find(sect, pt);
+			if (ix >= 0)
+				sect->fmtpv[ix] = true;
+		}
+	}
+}
+
+
+static uint32_t sect_bandwidth(const struct rw_sect *sect, bool group)
+{
+	if (sect->media == RW_MEDIA_AUDIO)
+		return 50;
+	else
+		return group ? 300 : 800;
+}
+
+
+/* m=<media> <port> <proto> <fmt> ... with only the kept formats */
+static int write_mline(struct mbuf *mb, const struct rw_sect *sect,
+		       const struct pl *mline)
+{
+	const char *p = mline->p;
+	const char *end = mline->p + mline->l;
+	int nsp = 0;
+	int err;
+
+	while (p < end && nsp < 3) {
+		if (*p++ == ' ')
+			++nsp;
+	}
+
+	if (sect->media == RW_MEDIA_OTHER || sect->ptc == 0 || nsp < 3)
+		return mbuf_printf(mb, "%r\r\n", mline);
+
+	err = mbuf_write_mem(mb, (const uint8_t *)mline->p,
+			     p - 1 - mline->p);
+
+	while (!err && p < end) {
+		struct pl fmt;
+
+		fmt.p = p;
+		while (p < end && *p != ' ')
+			++p;
+		fmt.l = p - fmt.p;
+
+		if (fmt.l && sect_find(sect, pl_u32(&fmt)) >= 0)
+			err = mbuf_printf(mb, " %r", &fmt);
+
+		if (p < end)
+			++p;
+	}
+
+	err |= mbuf_write_str(mb, "\r\n");
+
+	return err;
+}
+
+
+int sdp_rewrite(char **sdpp, const char *sdp, bool offer,
+		enum icall_conv_type conv_type, bool audio_cbr)
+{
+	const bool group = conv_type != ICALL_CONV_TYPE_ONEONONE;
+	const char *p = sdp;
+	const char *end;
+	struct rw_sect sect;
+	struct mbuf *mb;
+	struct pl line;
+	char suffix[32];
+	int err = 0;
+
+	if (!sdpp || !sdp)
+		return EINVAL;
+
+	/* Appended to the fmtp params of the audio formats */
+	re_snprintf(suffix, sizeof(suffix), "%s%s",
+		    !offer && group ? ";usedtx=1" : "",
+		    audio_cbr ? ";cbr=1" : "");
+
+	end = sdp + str_len(sdp);
+	mb = mbuf_alloc(end - sdp + 128);
+	if (!mb)
+		return ENOMEM;
+
+	memset(&sect, 0, sizeof(sect));
+
+	while (!err && next_line(&line, &p, end)) {
+		bool av = sect.media == RW_MEDIA_AUDIO
+			|| sect.media == RW_MEDIA_VIDEO;
+		int pt;
+		int ix;
+
+		if (line_prefix(&line, "m=")) {
+			if (sect.media == RW_MEDIA_AUDIO && group)
+				err = mbuf_write_str(mb, "a=ptime:40\r\n");
+
+			sect_scan(&sect, &line, p, end);
+			err |= write_mline(mb, &sect, &line);
+			if (!sect.has_c && sect.media != RW_MEDIA_OTHER) {
+				err |= mbuf_printf(mb, "b=AS:%u\r\n",
+					   sect_bandwidth(&sect, group));
 			}
+			continue;
+		}
+
+		if (!av || line.l == 0) {
+			if (line.l)
+				err = mbuf_printf(mb, "%r\r\n", &line);
+			continue;
+		}
+
+		if (line_prefix(&line, "b="))
+			continue;
+		else if (line_prefix(&line, "c=")) {
+			err = mbuf_printf(mb, "%r\r\nb=AS:%u\r\n", &line,
+					  sect_bandwidth(&sect, group));
+		}
+		else if (sect.media == RW_MEDIA_AUDIO && group &&
+			 line_prefix(&line, "a=ptime:")) {
+			continue;
+		}
+		else if ((pt = line_pt(&line, "a=rtpmap:")) >= 0) {
+			ix = sect_find(&sect, pt);
+			if (ix < 0)
+				continue;
+
+			err = mbuf_printf(mb, "%r\r\n", &line);
+			if (sect.media == RW_MEDIA_AUDIO && suffix[0] &&
+			    !sect.fmtpv[ix]) {
+				err |= mbuf_printf(mb, "a=fmtp:%d %s\r\n",
+						   pt, suffix + 1);
+			}
+		}
+		else if ((pt = line_pt(&line, "a=fmtp:")) >= 0) {
+			if (sect_find(&sect, pt) < 0)
+				continue;
+
+			err = mbuf_printf(mb, "%r%s\r\n", &line,
+				sect.media == RW_MEDIA_AUDIO ? suffix : "");
+		}
+		else if ((pt = line_pt(&line, "a=rtcp-fb:")) >= 0) {
+			if (sect_find(&sect, pt) < 0)
+				continue;
+
+			err = mbuf_printf(mb, "%r\r\n", &line);
+		}
+		else {
+			err = mbuf_printf(mb, "%r\r\n", &line);
+		}
+	}
+
+	if (!err && sect.media == RW_MEDIA_AUDIO && group)
+		err = mbuf_write_str(mb, "a=ptime:40\r\n");
+
+	if (!err) {
+		mb->pos = 0;
+		err = mbuf_strdup(mb, sdpp, mb->end);
+	}
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/* Calls acbrh for every audio fmtp line that asks for CBR */
+void sdp_check_remote_acbr(const char *sdp,
+			   bool offer,
+			   peerflow_acbr_h *acbrh,
+			   void *arg)
+{
+	const char *p = sdp;
+	const char *end = sdp + str_len(sdp);
+	bool audio = false;
+	struct pl line;
+
+	while (next_line(&line, &p, end)) {
+
+		if (line_prefix(&line, "m=")) {
+			audio = line_prefix(&line, "m=audio ");
+		}
+		else if (audio && line_prefix(&line, "a=fmtp:") &&
+			 line_contains(&line, "cbr=1")) {
+
+			if (acbrh)
+				acbrh(true, offer, arg);
+
+			info("sdp: remote side asking for CBR\n");
 		}
 	}
- out:
-	mem_deref(rsess);
 }
 
 int sdp_strip_video(char **sdp, const char *osdp)
@@ -33,6 +33,15 @@ const char *sdp_modify_answer(struct sdp_session *sess,
 			      enum icall_conv_type conv_type,
 			      bool audio_cbr);
 
+/* Single pass equivalent of sdp_dup() followed by sdp_modify_offer()
+ * or sdp_modify_answer(), for local SDPs. *sdpp is a mem string.
+ */
+int sdp_rewrite(char **sdpp,
+		const char *sdp,
+		bool offer,
+		enum icall_conv_type conv_type,
+		bool audio_cbr);
+
 void sdp_check_remote_acbr(const char *sdp,
 			   bool offer,
 			   peerflow_acbr_h *acbrh,
@@ -25,6 +25,7 @@
 
 #include "re.h"
 #include "peerflow.h"
+#include "video_renderer.h"
 
 namespace wire {
 
@@ -57,17 +58,17 @@ public:
 		pf_(pf),
 		total_(0),
 		lost_(0),
-		current_stats_(NULL),		
 		active_(true)
 	{
 		lock_alloc(&lock_);
+		memset(&snap_, 0, sizeof(snap_));
 	}
 
 	virtual ~NetStatsCallback()
 	{
 		setActive(false);
+		report_ = NULL;
 		mem_deref(lock_);
-		mem_deref(current_stats_);		
 	}
 
 	void setActive(bool active)
@@ -77,36 +78,54 @@ public:
 		lock_rel(lock_);
 	}
 
+	/* Fills the typed snapshot straight from the report in one pass,
+	 * the report itself is kept for currentStats.
+	 */
 	void OnStatsDelivered(
 		const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report)
 	{
-		std::string sstat = report->ToJson();
-		const char *stats = sstat.c_str();
-		char *tmp = NULL;
-		int err;
-
-		lock_write_get(lock_);	       		
-		err = str_dup(&tmp, stats);
-		info("mediaflow(%p): OnStatsDelivered err=%d len=%d\n", pf_, err, (int)str_len(tmp));
-		mem_deref(current_stats_);
-		current_stats_ = tmp;
-		lock_rel(lock_);
-		
-		std::vector<const webrtc::RTCInboundRTPStreamStats*> streamStats =
-			report->GetStatsOfType<webrtc::RTCInboundRTPStreamStats>();
-		std::vector<const webrtc::RTCInboundRTPStreamStats*>::iterator it;
+		struct peerflow_stats snap;
 		uint32_t packetsLost = 0, packetsTotal = 0;
+		float rtt = 0.0f;
+		double dt;
+
+		memset(&snap, 0, sizeof(snap));
+		snap.ts_us = report->timestamp_us();
+
+		lock_write_get(lock_);
+		dt = (double)(snap.ts_us - snap_.ts_us) / 1000000.0;
+		if (snap_.ts_us == 0 || dt <= 0.0)
+			dt = 0.0;
 
-		for (it = streamStats.begin(); it != streamStats.end(); it++) {
-			const webrtc::RTCInboundRTPStreamStats* s = *it;
+		for (const webrtc::RTCStats& st : *report) {
+			const char *type = st.type();
 
-			
-			if (s->packets_received.is_defined()) {
-				packetsTotal += *s->packets_received;
+			if (type == webrtc::RTCInboundRTPStreamStats::kType) {
+				const webrtc::RTCInboundRTPStreamStats& s =
+					st.cast_to<webrtc::RTCInboundRTPStreamStats>();
+
+				if (s.packets_received.is_defined())
+					packetsTotal += *s.packets_received;
+				if (s.packets_lost.is_defined()) {
+					packetsTotal += *s.packets_lost;
+					packetsLost += *s.packets_lost;
+				}
+				addInbound(&snap, *report, s, dt);
+			}
+			else if (type == webrtc::RTCOutboundRTPStreamStats::kType) {
+				addOutbound(&snap,
+					    st.cast_to<webrtc::RTCOutboundRTPStreamStats>(),
+					    dt);
 			}
-			if (s->packets_lost.is_defined()) {
-				packetsTotal += *s->packets_lost;
-				packetsLost += *s->packets_lost;
+			else if (type == webrtc::RTCIceCandidatePairStats::kType) {
+				const webrtc::RTCIceCandidatePairStats& s =
+					st.cast_to<webrtc::RTCIceCandidatePairStats>();
+
+				if (s.state.is_defined()
+				    && *s.state == webrtc::RTCStatsIceCandidatePairState::kSucceeded
+				    && s.current_round_trip_time.is_defined()) {
+					rtt = *s.current_round_trip_time * 1000.0f;
+				}
 			}
 		}
 
@@ -125,52 +144,228 @@ public:
 			downloss = (100.0f * packetsLost) / packetsTotal;
 		}
 
-		std::vector<const webrtc::RTCIceCandidatePairStats*> iceStats =
-			report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>();
-		std::vector<const webrtc::RTCIceCandidatePairStats*>::iterator iceIt;
-
-		float rtt = 0.0f;
+		snap.dloss = downloss;
+		snap.rtt = rtt;
+		video_budget_stats(pf_, &snap);
+		snap_ = snap;
+		report_ = report;
 
-		for (iceIt = iceStats.begin(); iceIt != iceStats.end(); iceIt++) {
-			const webrtc::RTCIceCandidatePairStats* s = *iceIt;
-			std::string state = *s->state;
-			if (state == "succeeded") {
-				rtt = *s->current_round_trip_time * 1000.0f;
-			}
-		}
-
-		info("stats callback: pl: %.02f rtt: %.02f\n", downloss, rtt);
-		lock_write_get(lock_);
+		info("stats callback: pl: %.02f rtt: %.02f streams: %zu\n",
+		     downloss, rtt, snap.streamc);
 		if (active_) {
-			peerflow_set_stats(pf_, downloss, rtt);
+			peerflow_set_stats(pf_, &snap);
 		}
 		lock_rel(lock_);
 	}
 
-	int currentStats(char **stats)
+	int snapshot(struct peerflow_stats *stats)
 	{
-		int err;
-		
-		lock_write_get(lock_);
+		int err = 0;
+
+		if (!stats)
+			return EINVAL;
 
-		if (current_stats_)
-			err = str_dup(stats, current_stats_);
+		lock_write_get(lock_);
+		if (snap_.ts_us)
+			*stats = snap_;
 		else
 			err = ENOENT;
-
 		lock_rel(lock_);
-		
+
 		return err;
 	}
 
-	
+	/* JSON of the last report, only built when asked for. The video
+	 * budget is added to it as a "video-budget" object.
+	 */
+	int currentStats(char **stats)
+	{
+		rtc::scoped_refptr<const webrtc::RTCStatsReport> report;
+		struct peerflow_stats snap;
+		std::string json;
+
+		lock_write_get(lock_);
+		report = report_;
+		snap = snap_;
+		lock_rel(lock_);
+
+		if (!report)
+			return ENOENT;
+
+		json = report->ToJson();
+		if (json.empty() || json[json.size() - 1] != ']')
+			return str_dup(stats, json.c_str());
+
+		json.erase(json.size() - 1);
+		if (json.size() > 1)
+			json += ",";
+		budgetJson(json, &snap);
+		json += "]";
+
+		return str_dup(stats, json.c_str());
+	}
 
 private:
+	static void budgetJson(std::string &json,
+			       const struct peerflow_stats *snap)
+	{
+		char buf[512];
+
+		re_snprintf(buf, sizeof(buf),
+			    "{\"type\":\"video-budget\",\"id\":\"VB\","
+			    "\"timestamp\":%lld,\"budget\":%llu,\"used\":%llu,"
+			    "\"streams\":[",
+			    (long long)snap->ts_us, snap->video_budget,
+			    snap->video_used);
+		json += buf;
+
+		for (size_t i = 0; i < snap->allocc; i++) {
+			const struct iflow_video_alloc *va = &snap->allocv[i];
+
+			re_snprintf(buf, sizeof(buf),
+				    "%s{\"userid\":\"%s\",\"clientid\":\"%s\","
+				    "\"visible\":%s,\"speaking\":%s,"
+				    "\"paused\":%s,\"pixels\":%u,"
+				    "\"fps\":%.1f,\"maxFps\":%d,"
+				    "\"allocPps\":%llu}",
+				    i ? "," : "", va->userid, va->clientid,
+				    va->visible ? "true" : "false",
+				    va->speaking ? "true" : "false",
+				    va->paused ? "true" : "false",
+				    va->pixels, va->fps, va->max_fps,
+				    va->alloc_pps);
+			json += buf;
+		}
+
+		json += "]}";
+	}
+
+	const struct peerflow_stream_stats *prevStream(uint32_t ssrc,
+						      bool inbound) const
+	{
+		for (size_t i = 0; i < snap_.streamc; i++) {
+			const struct peerflow_stream_stats *ps = &snap_.streamv[i];
+
+			if (ps->ssrc == ssrc && ps->inbound == inbound)
+				return ps;
+		}
+
+		return NULL;
+	}
+
+	static struct peerflow_stream_stats *newStream(struct peerflow_stats *snap)
+	{
+		struct peerflow_stream_stats *ss;
+
+		if (snap->streamc >= PEERFLOW_STATS_MAX_STREAMS)
+			return NULL;
+
+		ss = &snap->streamv[snap->streamc++];
+		memset(ss, 0, sizeof(*ss));
+
+		return ss;
+	}
+
+	/* Rates need the counters of the previous report */
+	void setRates(struct peerflow_stream_stats *ss, double dt) const
+	{
+		const struct peerflow_stream_stats *ps;
+
+		ps = prevStream(ss->ssrc, ss->inbound);
+		if (!ps || dt <= 0.0)
+			return;
+
+		if (ss->bytes >= ps->bytes)
+			ss->bitrate_kbps = (float)((ss->bytes - ps->bytes) * 8
+						   / (dt * 1000.0));
+		if (ss->frames >= ps->frames)
+			ss->frame_rate = (float)((ss->frames - ps->frames) / dt);
+		if (ss->samples > ps->samples && ss->concealed >= ps->concealed)
+			ss->conceal_ratio = (float)(ss->concealed - ps->concealed)
+				/ (float)(ss->samples - ps->samples);
+	}
+
+	void addInbound(struct peerflow_stats *snap,
+			const webrtc::RTCStatsReport& report,
+			const webrtc::RTCInboundRTPStreamStats& s,
+			double dt)
+	{
+		struct peerflow_stream_stats *ss;
+
+		if (!s.ssrc.is_defined())
+			return;
+
+		ss = newStream(snap);
+		if (!ss)
+			return;
+
+		ss->ssrc = *s.ssrc;
+		ss->inbound = true;
+		ss->video = s.media_type.is_defined()
+			&& *s.media_type == "video";
+		if (s.packets_received.is_defined())
+			ss->packets = *s.packets_received;
+		if (s.packets_lost.is_defined())
+			ss->packets_lost = *s.packets_lost;
+		if (s.bytes_received.is_defined())
+			ss->bytes = *s.bytes_received;
+		if (s.frames_decoded.is_defined())
+			ss->frames = *s.frames_decoded;
+		if (s.jitter.is_defined())
+			ss->jitter_ms = (float)(*s.jitter * 1000.0);
+
+		/* Concealment is only reported on the receiving track */
+		if (!ss->video && s.track_id.is_defined()) {
+			const webrtc::RTCStats *ts = report.Get(*s.track_id);
+
+			if (ts && ts->type() == webrtc::RTCMediaStreamTrackStats::kType) {
+				const webrtc::RTCMediaStreamTrackStats& t =
+					ts->cast_to<webrtc::RTCMediaStreamTrackStats>();
+
+				if (t.total_samples_received.is_defined())
+					ss->samples = *t.total_samples_received;
+				if (t.concealed_samples.is_defined())
+					ss->concealed = *t.concealed_samples;
+				if (t.audio_level.is_defined())
+					ss->audio_level = (float)*t.audio_level;
+			}
+		}
+
+		setRates(ss, dt);
+	}
+
+	void addOutbound(struct peerflow_stats *snap,
+			 const webrtc::RTCOutboundRTPStreamStats& s,
+			 double dt)
+	{
+		struct peerflow_stream_stats *ss;
+
+		if (!s.ssrc.is_defined())
+			return;
+
+		ss = newStream(snap);
+		if (!ss)
+			return;
+
+		ss->ssrc = *s.ssrc;
+		ss->video = s.media_type.is_defined()
+			&& *s.media_type == "video";
+		if (s.packets_sent.is_defined())
+			ss->packets = *s.packets_sent;
+		if (s.bytes_sent.is_defined())
+			ss->bytes = *s.bytes_sent;
+		if (s.frames_encoded.is_defined())
+			ss->frames = *s.frames_encoded;
+
+		setRates(ss, dt);
+	}
+
 	struct peerflow* pf_;
 	uint32_t total_, lost_;
 	bool active_;
 	struct lock *lock_;
-	char *current_stats_;	
+	struct peerflow_stats snap_;
+	rtc::scoped_refptr<const webrtc::RTCStatsReport> report_;
 };
 
 }
@@ -0,0 +1,152 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Remote video budget
+ *
+ * The budget is shared in two passes over the visible streams, speakers
+ * first, then by speaker rank, then by arrival. The first pass gives
+ * each stream VIDEO_BUDGET_MIN_FPS at its current size, pausing those
+ * that no longer fit, so that as many participants as possible stay on
+ * screen. The second pass tops the streams up to their received rate in
+ * the same order. A stream left below its rate is capped in frame rate
+ * and asks for a frame size that would reach VIDEO_BUDGET_TARGET_FPS.
+ */
+
+#include <stdlib.h>
+#include <re.h>
+#include <avs.h>
+
+#include "video_budget.h"
+
+
+static uint64_t stream_pixels(const struct video_budget_stream *s)
+{
+	return s->pixels ? s->pixels : VIDEO_BUDGET_DEFAULT_PIXELS;
+}
+
+
+static uint64_t stream_demand(const struct video_budget_stream *s)
+{
+	float fps = s->fps >= 1.0f ? s->fps : VIDEO_BUDGET_DEFAULT_FPS;
+
+	return (uint64_t)(stream_pixels(s) * fps);
+}
+
+
+static int prio_cmp(const void *a, const void *b)
+{
+	const struct video_budget_stream *sa =
+		*(const struct video_budget_stream * const *)a;
+	const struct video_budget_stream *sb =
+		*(const struct video_budget_stream * const *)b;
+
+	if (sa->speaking != sb->speaking)
+		return sa->speaking ? -1 : 1;
+
+	if (sa->rank != sb->rank) {
+		if (sa->rank < 0)
+			return 1;
+		if (sb->rank < 0)
+			return -1;
+		return sa->rank < sb->rank ? -1 : 1;
+	}
+
+	if (sa->order != sb->order)
+		return sa->order < sb->order ? -1 : 1;
+
+	return 0;
+}
+
+
+void video_budget_allocate(struct video_budget_stream *streamv,
+			   size_t streamc,
+			   uint64_t max_pps)
+{
+	struct video_budget_stream **prio;
+	uint64_t left = max_pps;
+	size_t i, n = 0;
+
+	if (!streamv || !streamc)
+		return;
+
+	prio = mem_zalloc(streamc * sizeof(*prio), NULL);
+
+	for (i = 0; i < streamc; ++i) {
+		struct video_budget_stream *s = &streamv[i];
+
+		s->paused = !s->visible;
+		s->alloc_pps = 0;
+		s->max_pixels = s->paused ? VIDEO_BUDGET_MIN_PIXELS : 0;
+		s->max_fps = 0;
+
+		if (s->paused)
+			continue;
+
+		if (!max_pps || !prio)
+			s->alloc_pps = stream_demand(s);
+		else
+			prio[n++] = s;
+	}
+
+	if (!n)
+		goto out;
+
+	qsort(prio, n, sizeof(*prio), prio_cmp);
+
+	for (i = 0; i < n; ++i) {
+		struct video_budget_stream *s = prio[i];
+		uint64_t need = stream_pixels(s) * VIDEO_BUDGET_MIN_FPS;
+
+		need = min(need, stream_demand(s));
+		if (need > left) {
+			s->paused = true;
+			s->max_pixels = VIDEO_BUDGET_MIN_PIXELS;
+			continue;
+		}
+
+		s->alloc_pps = need;
+		left -= need;
+	}
+
+	for (i = 0; i < n; ++i) {
+		struct video_budget_stream *s = prio[i];
+		uint64_t demand = stream_demand(s);
+		uint64_t pixels = stream_pixels(s);
+		uint64_t extra;
+
+		if (s->paused)
+			continue;
+
+		extra = min(demand - s->alloc_pps, left);
+		s->alloc_pps += extra;
+		left -= extra;
+
+		if (s->alloc_pps >= demand)
+			continue;
+
+		s->max_fps = (int)(s->alloc_pps / pixels);
+		s->max_pixels = (uint32_t)min(s->alloc_pps
+					      / VIDEO_BUDGET_TARGET_FPS,
+					      pixels);
+		if (s->max_pixels < VIDEO_BUDGET_MIN_PIXELS)
+			s->max_pixels = VIDEO_BUDGET_MIN_PIXELS;
+	}
+
+ out:
+	mem_deref(prio);
+}
@@ -0,0 +1,60 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VIDEO_BUDGET_H
+#define VIDEO_BUDGET_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VIDEO_BUDGET_MIN_FPS        5          /* paused below this     */
+#define VIDEO_BUDGET_TARGET_FPS     15         /* aim of lower layers   */
+#define VIDEO_BUDGET_MIN_PIXELS     (320*180)  /* asked for when paused */
+#define VIDEO_BUDGET_DEFAULT_PIXELS (640*360)  /* before the first frame */
+#define VIDEO_BUDGET_DEFAULT_FPS    15
+
+/* One remote video stream competing for the video budget */
+struct video_budget_stream {
+	/* Filled in by the caller */
+	bool visible;        /* shown by the app */
+	bool speaking;
+	int rank;            /* speaker rank, -1 when not ranked */
+	uint32_t order;      /* arrival order, breaks ties */
+	uint32_t pixels;     /* decoded frame size, 0 if unknown */
+	float fps;           /* received frame rate, 0 if unknown */
+
+	/* Filled in by video_budget_allocate() */
+	bool paused;
+	uint64_t alloc_pps;  /* pixels per second granted */
+	uint32_t max_pixels; /* largest frame to ask for, 0 for any */
+	int max_fps;         /* frame rate cap, 0 for none */
+};
+
+/* Shares max_pps rendered pixels per second over the streams, 0 is
+ * unlimited. Hidden streams are always paused.
+ */
+void video_budget_allocate(struct video_budget_stream *streamv,
+			   size_t streamc,
+			   uint64_t max_pps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
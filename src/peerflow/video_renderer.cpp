@@ -16,6 +16,10 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "video_renderer.h"
 
 namespace wire {
@@ -27,7 +31,12 @@ VideoRendererSink::VideoRendererSink(struct peerflow *pf,
 	last_width_(0),
 	last_height_(0),
 	fps_count_(0),
-	frame_count_(0)
+	frame_count_(0),
+	paused_(false),
+	max_fps_(0),
+	ts_render_next_(0),
+	budget_count_(0),
+	drop_count_(0)
 {
 	char uid_anon[ANON_ID_LEN];
 	char cid_anon[ANON_CLIENT_LEN];
@@ -35,6 +44,7 @@ VideoRendererSink::VideoRendererSink(struct peerflow *pf,
 	str_dup(&userid_remote_, userid_remote);
 	str_dup(&clientid_remote_, clientid_remote);
 	ts_fps_ = tmr_jiffies();
+	ts_budget_ = ts_fps_;
 
 	info("VideoRenderSink(%p): constructor user: %s.%s\n",
 		this, anon_id(uid_anon, userid_remote_),
@@ -46,9 +56,13 @@ VideoRendererSink::~VideoRendererSink()
 	char uid_anon[ANON_ID_LEN];
 	char cid_anon[ANON_CLIENT_LEN];
 
-	info("VideoRenderSink(%p): destructor user: %s.%s frames: %u\n",
+	video_budget_remove(this);
+
+	info("VideoRenderSink(%p): destructor user: %s.%s frames: %u "
+	     "dropped: %u\n",
 		this, anon_id(uid_anon, userid_remote_),
-		anon_client(cid_anon, clientid_remote_), frame_count_);
+		anon_client(cid_anon, clientid_remote_), frame_count_,
+		drop_count_);
 	mem_deref(userid_remote_);
 	mem_deref(clientid_remote_);
 }
@@ -77,12 +91,26 @@ void VideoRendererSink::OnFrame(const webrtc::VideoFrame& frame)
 		ts_fps_ = now;
 	}
 
+	budget_count_++;
+	msec = now - ts_budget_;
+	if (msec >= BUDGET_MEASURE_DELAY) {
+		video_budget_measure(this, (uint32_t)(fw * fh),
+				     (float)budget_count_ * 1000.0f / msec);
+		budget_count_ = 0;
+		ts_budget_ = now;
+	}
+
 	if (fw != last_width_ || fh != last_height_) {
 		iflow_video_sizeh(fw, fh, userid_remote_);
 		last_width_ = fw;
 		last_height_ = fh;
 	}
 
+	if (!BudgetAllows(now)) {
+		drop_count_++;
+		return;
+	}
+
 	struct avs_vidframe avsframe;
 	rtc::scoped_refptr<webrtc::I420BufferInterface> i420;
 
@@ -125,5 +153,536 @@ void VideoRendererSink::OnFrame(const webrtc::VideoFrame& frame)
 		
 }
 
+void VideoRendererSink::SetBudget(bool paused, int max_fps)
+{
+	__atomic_store_n(&max_fps_, max_fps, __ATOMIC_RELAXED);
+	__atomic_store_n(&paused_, paused, __ATOMIC_RELAXED);
+}
+
+/* Only called on the decoding thread, ts_render_next_ is not shared */
+bool VideoRendererSink::BudgetAllows(uint64_t now)
+{
+	int max_fps = __atomic_load_n(&max_fps_, __ATOMIC_RELAXED);
+	uint64_t interval;
+
+	if (__atomic_load_n(&paused_, __ATOMIC_RELAXED))
+		return false;
+	if (max_fps <= 0)
+		return true;
+
+	/* A quarter interval early is still on time, otherwise jitter
+	 * would push the rate well below max_fps.
+	 */
+	interval = 1000 / max_fps;
+	if (now + interval / 4 < ts_render_next_)
+		return false;
+
+	ts_render_next_ = std::max(ts_render_next_ + interval, now);
+
+	return true;
+}
+
+
+/*
+ * Entries belong to a member of a flow rather than to a sink. A stream
+ * paused by the budget loses its decoder where the flow can release it,
+ * and with it the sink, the entry is kept parked until the budget
+ * resumes it or the flow goes away.
+ */
+struct budget_entry {
+	const struct peerflow *pf;
+	std::string userid;
+	std::string clientid;
+	VideoRendererSink *sink;  /* NULL while parked */
+	rtc::scoped_refptr<webrtc::VideoTrackInterface> track;
+	struct video_budget_stream bs;
+	bool applied;
+	bool changed;  /* paused changed, see video_budget_changed() */
+};
+
+struct budget_apply {
+	VideoRendererSink *sink;
+	rtc::scoped_refptr<webrtc::VideoTrackInterface> track;
+	rtc::VideoSinkWants wants;
+};
+
+static struct {
+	struct lock *lock;
+	struct lock *apply_lock;  /* sinks are not removed while held */
+	std::vector<struct budget_entry> entryv;
+	std::vector<std::string> hiddenv;  /* userid.clientid */
+	uint64_t max_pps;
+	uint32_t order;
+} g_budget;
+
+
+static std::string budget_key(const char *userid, const char *clientid)
+{
+	std::string key(userid ? userid : "");
+
+	key += ".";
+	key += clientid ? clientid : "";
+
+	return key;
+}
+
+static bool budget_hidden(const std::string &key)
+{
+	return std::find(g_budget.hiddenv.begin(), g_budget.hiddenv.end(),
+			 key) != g_budget.hiddenv.end();
+}
+
+static bool budget_match(const struct budget_entry *e,
+			 const char *userid, const char *clientid)
+{
+	return e->userid == (userid ? userid : "")
+		&& e->clientid == (clientid ? clientid : "");
+}
+
+static struct budget_entry *budget_find_sink(const VideoRendererSink *sink)
+{
+	size_t i;
+
+	for (i = 0; i < g_budget.entryv.size(); ++i) {
+		if (g_budget.entryv[i].sink == sink)
+			return &g_budget.entryv[i];
+	}
+
+	return NULL;
+}
+
+static rtc::VideoSinkWants budget_wants(const struct video_budget_stream *bs)
+{
+	rtc::VideoSinkWants wants;
+
+	if (bs->max_pixels)
+		wants.max_pixel_count = (int)bs->max_pixels;
+
+	if (bs->paused)
+		wants.max_framerate_fps = 0;
+	else if (bs->max_fps)
+		wants.max_framerate_fps = bs->max_fps;
+
+	return wants;
+}
+
+int video_budget_init(void)
+{
+	int err;
+
+	if (g_budget.lock)
+		return 0;
+
+	err = lock_alloc(&g_budget.apply_lock);
+	if (err)
+		return err;
+
+	err = lock_alloc(&g_budget.lock);
+	if (err)
+		g_budget.apply_lock = (struct lock *)
+			mem_deref(g_budget.apply_lock);
+
+	return err;
+}
+
+void video_budget_close(void)
+{
+	if (!g_budget.lock)
+		return;
+
+	lock_write_get(g_budget.lock);
+	g_budget.entryv.clear();
+	g_budget.hiddenv.clear();
+	lock_rel(g_budget.lock);
+
+	g_budget.lock = (struct lock *)mem_deref(g_budget.lock);
+	g_budget.apply_lock = (struct lock *)mem_deref(g_budget.apply_lock);
+}
+
+void video_budget_add(VideoRendererSink *sink,
+		      webrtc::VideoTrackInterface *track)
+{
+	struct budget_entry e = budget_entry();
+	size_t i;
+
+	if (!g_budget.lock || !sink || !track)
+		return;
+
+	lock_write_get(g_budget.lock);
+
+	/* A parked member is back, its share is applied on the next update */
+	for (i = 0; i < g_budget.entryv.size(); ++i) {
+		struct budget_entry *pe = &g_budget.entryv[i];
+
+		if (!pe->sink && pe->pf == sink->pf()
+		    && budget_match(pe, sink->userid(), sink->clientid())) {
+			pe->sink = sink;
+			pe->track = track;
+			pe->applied = false;
+			goto out;
+		}
+	}
+
+	e.pf = sink->pf();
+	e.userid = sink->userid() ? sink->userid() : "";
+	e.clientid = sink->clientid() ? sink->clientid() : "";
+	e.sink = sink;
+	e.track = track;
+	e.bs.rank = -1;
+	e.bs.visible = !budget_hidden(budget_key(sink->userid(),
+						 sink->clientid()));
+	e.bs.order = g_budget.order++;
+	g_budget.entryv.push_back(e);
+
+ out:
+	lock_rel(g_budget.lock);
+}
+
+/* Waits for an update that may still be applying wants to the sink */
+void video_budget_remove(VideoRendererSink *sink)
+{
+	std::vector<struct budget_entry>::iterator it;
+
+	if (!g_budget.lock || !sink)
+		return;
+
+	lock_write_get(g_budget.apply_lock);
+	lock_write_get(g_budget.lock);
+	for (it = g_budget.entryv.begin(); it != g_budget.entryv.end(); ++it) {
+		if (it->sink != sink)
+			continue;
+
+		if (it->bs.paused) {
+			it->sink = NULL;
+			it->track = NULL;
+			it->applied = false;
+		}
+		else {
+			g_budget.entryv.erase(it);
+		}
+		break;
+	}
+	lock_rel(g_budget.lock);
+	lock_rel(g_budget.apply_lock);
+}
+
+void video_budget_remove_flow(const struct peerflow *pf)
+{
+	std::vector<struct budget_entry>::iterator it;
+
+	if (!g_budget.lock || !pf)
+		return;
+
+	lock_write_get(g_budget.apply_lock);
+	lock_write_get(g_budget.lock);
+	it = g_budget.entryv.begin();
+	while (it != g_budget.entryv.end()) {
+		if (it->pf == pf)
+			it = g_budget.entryv.erase(it);
+		else
+			++it;
+	}
+	lock_rel(g_budget.lock);
+	lock_rel(g_budget.apply_lock);
+}
+
+void video_budget_measure(VideoRendererSink *sink,
+			  uint32_t pixels, float fps)
+{
+	struct budget_entry *e;
+
+	if (!g_budget.lock || !sink)
+		return;
+
+	lock_write_get(g_budget.lock);
+	e = budget_find_sink(sink);
+	if (e) {
+		e->bs.pixels = pixels;
+		e->bs.fps = fps;
+	}
+	lock_rel(g_budget.lock);
+}
+
+void video_budget_set_max(uint64_t max_pps)
+{
+	if (!g_budget.lock)
+		return;
+
+	info("video_budget: max %llu pixels/s\n", max_pps);
+
+	lock_write_get(g_budget.lock);
+	g_budget.max_pps = max_pps;
+	lock_rel(g_budget.lock);
+}
+
+void video_budget_set_visible(const char *userid,
+			      const char *clientid,
+			      bool visible)
+{
+	std::string key = budget_key(userid, clientid);
+	std::vector<std::string>::iterator it;
+	size_t i;
+
+	if (!g_budget.lock)
+		return;
+
+	lock_write_get(g_budget.lock);
+
+	it = std::find(g_budget.hiddenv.begin(), g_budget.hiddenv.end(), key);
+	if (visible && it != g_budget.hiddenv.end())
+		g_budget.hiddenv.erase(it);
+	else if (!visible && it == g_budget.hiddenv.end())
+		g_budget.hiddenv.push_back(key);
+
+	for (i = 0; i < g_budget.entryv.size(); ++i) {
+		struct budget_entry *e = &g_budget.entryv[i];
+
+		if (budget_match(e, userid, clientid))
+			e->bs.visible = visible;
+	}
+
+	lock_rel(g_budget.lock);
+}
+
+void video_budget_set_speakers(const struct peerflow *pf,
+			       const struct speaker_rank *rankv,
+			       size_t rankc)
+{
+	size_t i, j;
+
+	if (!g_budget.lock)
+		return;
+
+	lock_write_get(g_budget.lock);
+	for (i = 0; i < g_budget.entryv.size(); ++i) {
+		struct budget_entry *e = &g_budget.entryv[i];
+
+		if (e->pf != pf)
+			continue;
+
+		e->bs.rank = -1;
+		e->bs.speaking = false;
+
+		for (j = 0; j < rankc; ++j) {
+			if (budget_match(e, rankv[j].userid,
+					 rankv[j].clientid)) {
+				e->bs.rank = (int)j;
+				e->bs.speaking = rankv[j].speaking;
+				break;
+			}
+		}
+	}
+	lock_rel(g_budget.lock);
+}
+
+bool video_budget_paused(const struct peerflow *pf,
+			 const char *userid,
+			 const char *clientid)
+{
+	bool paused = false;
+	size_t i;
+
+	if (!g_budget.lock)
+		return false;
+
+	lock_read_get(g_budget.lock);
+	for (i = 0; i < g_budget.entryv.size(); ++i) {
+		const struct budget_entry *e = &g_budget.entryv[i];
+
+		if (e->pf == pf && budget_match(e, userid, clientid)) {
+			paused = e->bs.paused;
+			break;
+		}
+	}
+	lock_rel(g_budget.lock);
+
+	return paused;
 }
 
+bool video_budget_changed(const struct peerflow *pf)
+{
+	bool changed = false;
+	size_t i;
+
+	if (!g_budget.lock)
+		return false;
+
+	lock_write_get(g_budget.lock);
+	for (i = 0; i < g_budget.entryv.size(); ++i) {
+		struct budget_entry *e = &g_budget.entryv[i];
+
+		if (e->pf == pf && e->changed) {
+			e->changed = false;
+			changed = true;
+		}
+	}
+	lock_rel(g_budget.lock);
+
+	return changed;
+}
+
+/*
+ * Shares the budget out again and sends new wants to the tracks whose
+ * share changed. Parked entries get theirs when a sink is added again.
+ */
+void video_budget_update(void)
+{
+	std::vector<struct video_budget_stream> streamv;
+	std::vector<struct budget_apply> applyv;
+	char uid_anon[ANON_ID_LEN];
+	char cid_anon[ANON_CLIENT_LEN];
+	size_t i;
+
+	if (!g_budget.lock)
+		return;
+
+	lock_write_get(g_budget.apply_lock);
+	lock_write_get(g_budget.lock);
+
+	for (i = 0; i < g_budget.entryv.size(); ++i)
+		streamv.push_back(g_budget.entryv[i].bs);
+
+	video_budget_allocate(streamv.data(), streamv.size(),
+			      g_budget.max_pps);
+
+	for (i = 0; i < streamv.size(); ++i) {
+		struct budget_entry *e = &g_budget.entryv[i];
+		const struct video_budget_stream *bs = &streamv[i];
+		struct budget_apply a;
+		bool moved;
+
+		moved = bs->paused != e->bs.paused
+			|| bs->max_fps != e->bs.max_fps
+			|| bs->max_pixels != e->bs.max_pixels;
+		if (bs->paused != e->bs.paused)
+			e->changed = true;
+
+		e->bs = *bs;
+		if (!e->sink || (e->applied && !moved))
+			continue;
+
+		e->applied = true;
+		e->sink->SetBudget(bs->paused, bs->max_fps);
+
+		a.sink = e->sink;
+		a.track = e->track;
+		a.wants = budget_wants(bs);
+		applyv.push_back(a);
+
+		info("video_budget: user: %s.%s %s fps: %d pixels: %u "
+		     "alloc: %llu/%llu\n",
+		     anon_id(uid_anon, e->userid.c_str()),
+		     anon_client(cid_anon, e->clientid.c_str()),
+		     bs->paused ? "paused" : "rendering",
+		     bs->max_fps, bs->max_pixels,
+		     bs->alloc_pps, g_budget.max_pps);
+	}
+
+	lock_rel(g_budget.lock);
+
+	/* The track proxies block on the worker thread, so the wants are
+	 * applied outside the lock, but under apply_lock: a sink cannot
+	 * be removed, and then deleted, until they are.
+	 */
+	for (i = 0; i < applyv.size(); ++i)
+		applyv[i].track->AddOrUpdateSink(applyv[i].sink,
+						 applyv[i].wants);
+
+	lock_rel(g_budget.apply_lock);
+}
+
+void video_budget_stats(const struct peerflow *pf,
+			struct peerflow_stats *stats)
+{
+	size_t i;
+
+	if (!g_budget.lock || !stats)
+		return;
+
+	stats->video_used = 0;
+	stats->allocc = 0;
+
+	lock_read_get(g_budget.lock);
+
+	stats->video_budget = g_budget.max_pps;
+
+	for (i = 0; i < g_budget.entryv.size(); ++i) {
+		const struct budget_entry *e = &g_budget.entryv[i];
+		struct iflow_video_alloc *va;
+
+		stats->video_used += e->bs.alloc_pps;
+
+		if (e->pf != pf || stats->allocc >= IFLOW_STATS_MAX_VIDEO)
+			continue;
+
+		va = &stats->allocv[stats->allocc++];
+		memset(va, 0, sizeof(*va));
+		str_ncpy(va->userid, e->userid.c_str(), sizeof(va->userid));
+		str_ncpy(va->clientid, e->clientid.c_str(),
+			 sizeof(va->clientid));
+		va->visible = e->bs.visible;
+		va->speaking = e->bs.speaking;
+		va->paused = e->bs.paused;
+		va->pixels = e->bs.pixels;
+		va->fps = e->bs.fps;
+		va->max_fps = e->bs.max_fps;
+		va->alloc_pps = e->bs.alloc_pps;
+	}
+
+	lock_rel(g_budget.lock);
+}
+
+int video_budget_debug(struct re_printf *pf, const struct peerflow *flow)
+{
+	char uid_anon[ANON_ID_LEN];
+	char cid_anon[ANON_CLIENT_LEN];
+	uint64_t used = 0;
+	size_t i;
+	int err = 0;
+
+	if (!g_budget.lock)
+		return 0;
+
+	lock_read_get(g_budget.lock);
+
+	for (i = 0; i < g_budget.entryv.size(); ++i)
+		used += g_budget.entryv[i].bs.alloc_pps;
+
+	if (g_budget.max_pps) {
+		err |= re_hprintf(pf, "video budget: %llu/%llu pixels/s"
+				  " over %zu streams\n",
+				  used, g_budget.max_pps,
+				  g_budget.entryv.size());
+	}
+	else {
+		err |= re_hprintf(pf, "video budget: unlimited, %llu pixels/s"
+				  " over %zu streams\n",
+				  used, g_budget.entryv.size());
+	}
+
+	for (i = 0; i < g_budget.entryv.size(); ++i) {
+		const struct budget_entry *e = &g_budget.entryv[i];
+		const struct video_budget_stream *bs = &e->bs;
+
+		if (e->pf != flow)
+			continue;
+
+		err |= re_hprintf(pf, "\t%s.%s %s%s rank: %d"
+				  " %u px @ %.1f fps -> %s fps: %d"
+				  " alloc: %llu\n",
+				  anon_id(uid_anon, e->userid.c_str()),
+				  anon_client(cid_anon, e->clientid.c_str()),
+				  bs->visible ? "visible" : "hidden",
+				  bs->speaking ? " speaking" : "",
+				  bs->rank, bs->pixels, bs->fps,
+				  !bs->paused ? "rendering"
+				  : e->sink ? "paused" : "parked",
+				  bs->max_fps, bs->alloc_pps);
+	}
+
+	lock_rel(g_budget.lock);
+
+	return err;
+}
+
+}
@@ -27,7 +27,11 @@
 #include "rtc_base/scoped_ref_ptr.h"
 #include "api/peerconnectioninterface.h"
 
+#include "peerflow.h"
+#include "video_budget.h"
+
 #define STATS_DELAY 10000
+#define BUDGET_MEASURE_DELAY 1000
 
 extern "C" {
 
@@ -60,7 +64,16 @@ public:
 	
 	void OnFrame(const webrtc::VideoFrame& frame);
 
+	const struct peerflow *pf() const { return pf_; }
+	const char *userid() const { return userid_remote_; }
+	const char *clientid() const { return clientid_remote_; }
+
+	/* Frames are dropped while paused or above max_fps */
+	void SetBudget(bool paused, int max_fps);
+
 private:
+	bool BudgetAllows(uint64_t now);
+
 	char *userid_remote_;
 	char *clientid_remote_;
 	struct peerflow *pf_;
@@ -69,8 +82,50 @@ private:
 	uint64_t ts_fps_;
 	uint32_t fps_count_;
 	uint32_t frame_count_;
+
+	bool paused_;
+	int max_fps_;
+	uint64_t ts_render_next_;
+	uint64_t ts_budget_;
+	uint32_t budget_count_;
+	uint32_t drop_count_;
 };
 
+/*
+ * Budget of rendered pixels shared by the remote video of all peerflows.
+ * Sinks are added when their track arrives, the budget is shared out
+ * again on video_budget_update() and the result applied with
+ * VideoSinkWants. A flow asks video_budget_changed() and
+ * video_budget_paused() which members to release the decoders of.
+ */
+int  video_budget_init(void);
+void video_budget_close(void);
+
+void video_budget_add(VideoRendererSink *sink,
+		      webrtc::VideoTrackInterface *track);
+void video_budget_remove(VideoRendererSink *sink);
+void video_budget_remove_flow(const struct peerflow *pf);
+void video_budget_measure(VideoRendererSink *sink,
+			  uint32_t pixels, float fps);
+
+void video_budget_set_max(uint64_t max_pps);
+void video_budget_set_visible(const char *userid,
+			      const char *clientid,
+			      bool visible);
+void video_budget_set_speakers(const struct peerflow *pf,
+			       const struct speaker_rank *rankv,
+			       size_t rankc);
+
+bool video_budget_paused(const struct peerflow *pf,
+			 const char *userid,
+			 const char *clientid);
+bool video_budget_changed(const struct peerflow *pf);
+
+void video_budget_update(void);
+void video_budget_stats(const struct peerflow *pf,
+			struct peerflow_stats *stats);
+int  video_budget_debug(struct re_printf *pf, const struct peerflow *flow);
+
 }
 
 #endif
@@ -71,48 +71,66 @@ typedef struct
 	uint32_t offset;
 } RtpDumpPacketHeader;
 
+#define RTPDUMP_BUF_SZ    (256 * 1024)
+#define RTPDUMP_FLUSH_MS  500
+
 RtpDump::RtpDump()
 {
 	pthread_mutex_init(&_mutex,NULL);
+	pthread_cond_init(&_cond,NULL);
+	_running = false;
 	_file = NULL;
 	_startTime = 0;
+	_optHeadersOnly = false;
+	_optMaxFileBytes = 0;
+	_headersOnly = false;
+	_maxFileBytes = 0;
+	_fileName = NULL;
+	_fileIndex = 0;
+	_fileBytes = 0;
+	_buf[0] = NULL;
+	_buf[1] = NULL;
+	_len[0] = _len[1] = 0;
+	_count[0] = _count[1] = 0;
+	_active = 0;
+	_pending = false;
+	memset(&_stats, 0, sizeof(_stats));
 }
 
 RtpDump::~RtpDump()
 {
+	Stop();
+	pthread_cond_destroy(&_cond);
 	pthread_mutex_destroy(&_mutex);
-	if(_file){
-		fclose(_file);
-	}
+	free(_buf[0]);
+	free(_buf[1]);
 }
 
-int32_t RtpDump::Start(const char* fileNameUTF8)
+void RtpDump::SetOptions(bool headersOnly, size_t maxFileBytes)
 {
-	if (fileNameUTF8 == NULL){
-		return -1;
-	}
-
 	pthread_mutex_lock(&_mutex);
-	if(_file){
-		fclose(_file);
-	}
-	_file = fopen(fileNameUTF8, "wb");
-	if (!_file) {
+	_optHeadersOnly = headersOnly;
+	_optMaxFileBytes = maxFileBytes;
+	pthread_mutex_unlock(&_mutex);
+}
+
+FILE* RtpDump::OpenFile(const char* fileName)
+{
+	FILE* file;
+
+	file = fopen(fileName, "wb");
+	if (!file) {
 		error("rtpdump: Failed to open file.\n");
-		pthread_mutex_unlock(&_mutex);
-		return -1;
+		return NULL;
 	}
 
-	// Store start of RTP dump (to be used for offset calculation later).
-	_startTime = GetTimeInMS();
-
 	// All rtp dump files start with #!rtpplay.
 	char magic[14+1] = "";
 	snprintf(magic, sizeof(magic), "#!rtpplay%s \n", RTPFILE_VERSION);
-	if (fwrite(magic, sizeof(magic)-1, 1, _file) != 1){
+	if (fwrite(magic, sizeof(magic)-1, 1, file) != 1){
 		error("rtpdump: Error writing to file. \n");
-		pthread_mutex_unlock(&_mutex);
-		return -1;
+		fclose(file);
+		return NULL;
 	}
 
 	// The header according to the rtpdump documentation is sizeof(RD_hdr_t)
@@ -124,11 +142,68 @@ int32_t RtpDump::Start(const char* fileNameUTF8)
 	// of padding should be added to the header.
 	char dummyHdr[16];
 	memset(dummyHdr, 0, sizeof(dummyHdr));
-	if (fwrite(dummyHdr, sizeof(dummyHdr), 1, _file) != 1){
+	if (fwrite(dummyHdr, sizeof(dummyHdr), 1, file) != 1){
 		error("rtpdump: Error writing to file. \n");
+		fclose(file);
+		return NULL;
+	}
+
+	_fileBytes = sizeof(magic) - 1 + sizeof(dummyHdr);
+
+	return file;
+}
+
+int32_t RtpDump::Start(const char* fileNameUTF8)
+{
+	if (fileNameUTF8 == NULL){
+		return -1;
+	}
+
+	Stop();
+
+	pthread_mutex_lock(&_mutex);
+
+	if (!_buf[0])
+		_buf[0] = (uint8_t *)malloc(RTPDUMP_BUF_SZ);
+	if (!_buf[1])
+		_buf[1] = (uint8_t *)malloc(RTPDUMP_BUF_SZ);
+	if (!_buf[0] || !_buf[1]) {
+		error("rtpdump: Failed to allocate buffers.\n");
 		pthread_mutex_unlock(&_mutex);
 		return -1;
 	}
+
+	memset(&_stats, 0, sizeof(_stats));
+	_headersOnly = _optHeadersOnly;
+	_maxFileBytes = _optMaxFileBytes;
+	_fileIndex = 0;
+	_file = OpenFile(fileNameUTF8);
+	if (!_file) {
+		pthread_mutex_unlock(&_mutex);
+		return -1;
+	}
+
+	_fileName = strdup(fileNameUTF8);
+	_stats.files = 1;
+
+	// Store start of RTP dump (to be used for offset calculation later).
+	_startTime = GetTimeInMS();
+
+	_len[0] = _len[1] = 0;
+	_count[0] = _count[1] = 0;
+	_active = 0;
+	_pending = false;
+	_running = true;
+
+	if (pthread_create(&_thread, NULL, WriterThread, this) != 0) {
+		error("rtpdump: Failed to start writer thread.\n");
+		_running = false;
+		fclose(_file);
+		_file = NULL;
+		pthread_mutex_unlock(&_mutex);
+		return -1;
+	}
+
 	pthread_mutex_unlock(&_mutex);
 	return 0;
 }
@@ -136,47 +211,93 @@ int32_t RtpDump::Start(const char* fileNameUTF8)
 int32_t RtpDump::Stop()
 {
 	pthread_mutex_lock(&_mutex);
+	if (!_running) {
+		pthread_mutex_unlock(&_mutex);
+		return 0;
+	}
+	_running = false;
+	pthread_cond_signal(&_cond);
+	pthread_mutex_unlock(&_mutex);
+
+	// The writer flushes both buffers before it exits
+	pthread_join(_thread, NULL);
+
 	if(_file){
 		fclose(_file);
 		_file = NULL;
 	}
-	pthread_mutex_unlock(&_mutex);
+	free(_fileName);
+	_fileName = NULL;
+
+	if (_stats.dropped) {
+		warning("rtpdump: dropped %llu of %llu packets\n",
+			(unsigned long long)_stats.dropped,
+			(unsigned long long)(_stats.packets + _stats.dropped));
+	}
+
 	return 0;
 }
 
 bool RtpDump::IsActive() const
 {
-	bool file_opened = false;
-	if(_file){
-		file_opened = true;
-	}
-	return file_opened;
+	return _running;
 }
 
-int32_t RtpDump::DumpPacket(const uint8_t* packet, size_t packetLength)
+void RtpDump::GetStats(RtpDumpStats* stats)
 {
+	if (!stats)
+		return;
+
 	pthread_mutex_lock(&_mutex);
-	if (!IsActive()){
-		pthread_mutex_unlock(&_mutex);
-		return 0;
+	*stats = _stats;
+	pthread_mutex_unlock(&_mutex);
+}
+
+size_t RtpDump::RtpHeaderLength(const uint8_t* packet,
+				size_t packetLength) const
+{
+	size_t len;
+
+	if (packetLength < 12)
+		return packetLength;
+
+	len = 12 + 4 * (packet[0] & 0x0f);
+	if ((packet[0] & 0x10) && len + 4 <= packetLength) {
+		len += 4 + 4 * ((packet[len + 2] << 8) | packet[len + 3]);
 	}
 
+	return len < packetLength ? len : packetLength;
+}
+
+int32_t RtpDump::DumpPacket(const uint8_t* packet, size_t packetLength)
+{
 	if (packet == NULL){
-		pthread_mutex_unlock(&_mutex);
 		return -1;
 	}
 
 	RtpDumpPacketHeader hdr;
 	size_t total_size = packetLength + sizeof hdr;
 	if (packetLength < 1 || total_size > std::numeric_limits<uint16_t>::max()){
-		pthread_mutex_unlock(&_mutex);
 		return -1;
 	}
 
+	pthread_mutex_lock(&_mutex);
+	if (!IsActive()){
+		pthread_mutex_unlock(&_mutex);
+		return 0;
+	}
+
 	// If the packet doesn't contain a valid RTCP header the packet will be
 	// considered RTP (without further verification).
 	bool isRTCP = RTCP(packet);
 
+	// Only the RTP header is recorded, plen keeps the original length.
+	size_t dumpLength = packetLength;
+	if (_headersOnly && !isRTCP){
+		dumpLength = RtpHeaderLength(packet, packetLength);
+	}
+	size_t recordLength = dumpLength + sizeof hdr;
+
 	// Offset is relative to when recording was started.
 	uint32_t offset = GetTimeInMS();
 	if (offset < _startTime){
@@ -187,26 +308,127 @@ int32_t RtpDump::DumpPacket(const uint8_t* packet, size_t packetLength)
 	}
 	hdr.offset = RtpDumpHtonl(offset);
 
-	hdr.length = RtpDumpHtons((uint16_t)(total_size));
+	hdr.length = RtpDumpHtons((uint16_t)(recordLength));
 	if (isRTCP){
 		hdr.plen = 0;
 	} else{
 		hdr.plen = RtpDumpHtons((uint16_t)packetLength);
 	}
 
-	if (fwrite(&hdr, 1, sizeof(hdr), _file) == -1){
+	if (_len[_active] + recordLength > RTPDUMP_BUF_SZ){
+		if (_pending){
+			// Writer has not finished the other buffer yet
+			_stats.dropped++;
+			pthread_mutex_unlock(&_mutex);
+			return 0;
+		}
+		_pending = true;
+		_active ^= 1;
+		pthread_cond_signal(&_cond);
+	}
+
+	uint8_t* p = _buf[_active] + _len[_active];
+	memcpy(p, &hdr, sizeof(hdr));
+	memcpy(p + sizeof(hdr), packet, dumpLength);
+	_len[_active] += recordLength;
+	_count[_active]++;
+
+	_stats.packets++;
+	_stats.bytes += recordLength;
+
+	pthread_mutex_unlock(&_mutex);
+	return 0;
+}
+
+// Called on the writer thread without the mutex, the buffer is not
+// touched by DumpPacket while it is pending. Returns the number of
+// packets that could not be written.
+uint32_t RtpDump::WriteBuffer(int ix)
+{
+	if (_len[ix] == 0)
+		return 0;
+
+	if (_file && _fileName && _maxFileBytes
+	    && _fileBytes + _len[ix] > _maxFileBytes){
+		char name[1024];
+
+		fclose(_file);
+		_fileIndex++;
+		snprintf(name, sizeof(name), "%s.%u", _fileName, _fileIndex);
+		_file = OpenFile(name);
+	}
+
+	if (!_file)
+		return _count[ix];
+
+	if (fwrite(_buf[ix], 1, _len[ix], _file) != _len[ix]){
 		error("rtpdump: Error writing to file.\n");
-		pthread_mutex_unlock(&_mutex);
-		return -1;
+		return _count[ix];
 	}
-	if (fwrite(packet, sizeof(uint8_t), packetLength, _file) == -1){
-		error("rtpdump: Error writing to file. \n");
-		pthread_mutex_unlock(&_mutex);
-		return -1;
+	_fileBytes += _len[ix];
+
+	return 0;
+}
+
+void* RtpDump::WriterThread(void* arg)
+{
+	RtpDump* dump = (RtpDump*)arg;
+
+	dump->WriterLoop();
+
+	return NULL;
+}
+
+void RtpDump::WriterLoop()
+{
+	pthread_mutex_lock(&_mutex);
+
+	for (;;) {
+		if (!_pending && _running){
+			struct timespec ts;
+			struct timeval now;
+
+			gettimeofday(&now, NULL);
+			ts.tv_sec = now.tv_sec + RTPDUMP_FLUSH_MS / 1000;
+			ts.tv_nsec = (now.tv_usec +
+				      (RTPDUMP_FLUSH_MS % 1000) * 1000) * 1000;
+			if (ts.tv_nsec >= 1000000000){
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&_cond, &_mutex, &ts);
+		}
+
+		// Write partly filled buffers periodically and when stopping
+		if (!_pending && _len[_active] > 0){
+			_pending = true;
+			_active ^= 1;
+		}
+
+		if (_pending){
+			int ix = _active ^ 1;
+			uint32_t lost;
+
+			pthread_mutex_unlock(&_mutex);
+			lost = WriteBuffer(ix);
+			pthread_mutex_lock(&_mutex);
+
+			_stats.dropped += lost;
+			_stats.files = _fileIndex + 1;
+			_len[ix] = 0;
+			_count[ix] = 0;
+			_pending = false;
+			continue;
+		}
+
+		if (!_running)
+			break;
 	}
 
+	if (_file)
+		fflush(_file);
+
 	pthread_mutex_unlock(&_mutex);
-	return 0;
 }
 
 bool RtpDump::RTCP(const uint8_t* packet) const
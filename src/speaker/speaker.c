@@ -0,0 +1,399 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/* libavs
+ *
+ * Active speaker detection
+ *
+ * Each stream's RFC 6464 level is smoothed with a fast attack and a slow
+ * release, so a word onset is picked up at once while short pauses do
+ * not drop the speaker. Speaking starts above SPEAKER_ON_DBOV and ends
+ * SPEAKER_HOLD ms after falling below SPEAKER_OFF_DBOV. The ranking puts
+ * current speakers first, loudest first, followed by the rest in order
+ * of who spoke most recently, which is what video should follow.
+ */
+
+#include <stdlib.h>
+#include <re.h>
+#include <avs.h>
+
+
+#define SPEAKER_ATTACK       0.6f   /* weight of a louder sample       */
+#define SPEAKER_RELEASE      0.15f  /* weight of a quieter sample      */
+#define SPEAKER_ON_DBOV      50     /* -dBov, starts speaking above    */
+#define SPEAKER_OFF_DBOV     60     /* -dBov, may stop speaking below  */
+#define SPEAKER_HOLD         600    /* ms kept speaking after that     */
+#define SPEAKER_STALE        500    /* ms without samples is silence   */
+#define SPEAKER_TIMEOUT      5000   /* ms without samples drops it     */
+#define SPEAKER_LEVEL_DELTA  0.05f  /* level change worth reporting    */
+
+
+struct speaker {
+	struct le le;
+	char *userid;
+	char *clientid;
+	uint32_t ssrc;
+
+	float level;
+	bool speaking;
+	uint64_t ts_sample;
+	uint64_t ts_loud;    /* last sample above the off threshold */
+	uint64_t ts_spoke;   /* last tick while speaking */
+};
+
+struct speaker_engine {
+	struct list speakerl;
+	uint64_t interval;
+	uint64_t ts_emit;
+
+	struct speaker_rank *rankv;  /* as last reported */
+	size_t rankc;
+
+	speaker_rank_h *rankh;
+	void *arg;
+};
+
+
+static void speaker_destructor(void *arg)
+{
+	struct speaker *spk = arg;
+
+	list_unlink(&spk->le);
+	mem_deref(spk->userid);
+	mem_deref(spk->clientid);
+}
+
+
+static void ranking_flush(struct speaker_engine *se)
+{
+	size_t i;
+
+	for (i = 0; i < se->rankc; ++i) {
+		mem_deref(se->rankv[i].userid);
+		mem_deref(se->rankv[i].clientid);
+	}
+
+	se->rankv = mem_deref(se->rankv);
+	se->rankc = 0;
+}
+
+
+static void engine_destructor(void *arg)
+{
+	struct speaker_engine *se = arg;
+
+	list_flush(&se->speakerl);
+	ranking_flush(se);
+}
+
+
+float speaker_dbov2level(uint8_t dbov)
+{
+	if (dbov > 127)
+		dbov = 127;
+
+	return (float)(127 - dbov) / 127.0f;
+}
+
+
+int speaker_engine_alloc(struct speaker_engine **sep, uint64_t interval,
+			 speaker_rank_h *rankh, void *arg)
+{
+	struct speaker_engine *se;
+
+	if (!sep)
+		return EINVAL;
+
+	se = mem_zalloc(sizeof(*se), engine_destructor);
+	if (!se)
+		return ENOMEM;
+
+	list_init(&se->speakerl);
+	se->interval = interval;
+	se->rankh = rankh;
+	se->arg = arg;
+
+	*sep = se;
+
+	return 0;
+}
+
+
+static bool id_eq(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return streq(a, b);
+}
+
+
+static struct speaker *speaker_find(const struct speaker_engine *se,
+				    const struct speaker_level *lvl)
+{
+	struct le *le;
+
+	LIST_FOREACH(&se->speakerl, le) {
+		struct speaker *spk = le->data;
+
+		if (spk->ssrc == lvl->ssrc
+		    && id_eq(spk->userid, lvl->userid)
+		    && id_eq(spk->clientid, lvl->clientid))
+			return spk;
+	}
+
+	return NULL;
+}
+
+
+static void speaker_sample(struct speaker *spk, float level, uint64_t now)
+{
+	float w = level > spk->level ? SPEAKER_ATTACK : SPEAKER_RELEASE;
+
+	spk->level += w * (level - spk->level);
+
+	if (spk->level >= speaker_dbov2level(SPEAKER_ON_DBOV)) {
+		spk->speaking = true;
+		spk->ts_loud = now;
+	}
+	else if (spk->level >= speaker_dbov2level(SPEAKER_OFF_DBOV)) {
+		if (spk->speaking)
+			spk->ts_loud = now;
+	}
+	else if (spk->speaking && now - spk->ts_loud > SPEAKER_HOLD) {
+		spk->speaking = false;
+	}
+}
+
+
+int speaker_engine_level(struct speaker_engine *se,
+			 const struct speaker_level *lvl, uint64_t now)
+{
+	struct speaker *spk;
+	int err = 0;
+
+	if (!se || !lvl)
+		return EINVAL;
+
+	spk = speaker_find(se, lvl);
+	if (!spk) {
+		spk = mem_zalloc(sizeof(*spk), speaker_destructor);
+		if (!spk)
+			return ENOMEM;
+
+		spk->ssrc = lvl->ssrc;
+		if (lvl->userid)
+			err |= str_dup(&spk->userid, lvl->userid);
+		if (lvl->clientid)
+			err |= str_dup(&spk->clientid, lvl->clientid);
+		if (err) {
+			mem_deref(spk);
+			return err;
+		}
+
+		list_append(&se->speakerl, &spk->le, spk);
+	}
+
+	spk->ts_sample = now;
+	speaker_sample(spk, speaker_dbov2level(lvl->dbov), now);
+
+	return 0;
+}
+
+
+static int rank_cmp(const void *a, const void *b)
+{
+	const struct speaker *s1 = *(const struct speaker * const *)a;
+	const struct speaker *s2 = *(const struct speaker * const *)b;
+
+	if (s1->speaking != s2->speaking)
+		return s1->speaking ? -1 : 1;
+
+	if (!s1->speaking && s1->ts_spoke != s2->ts_spoke)
+		return s1->ts_spoke > s2->ts_spoke ? -1 : 1;
+
+	if (s1->level != s2->level)
+		return s1->level > s2->level ? -1 : 1;
+
+	if (s1->ssrc != s2->ssrc)
+		return s1->ssrc < s2->ssrc ? -1 : 1;
+
+	return 0;
+}
+
+
+static bool ranking_changed(const struct speaker_engine *se,
+			    struct speaker * const *spkv, size_t n)
+{
+	size_t i;
+
+	if (n != se->rankc)
+		return true;
+
+	for (i = 0; i < n; ++i) {
+		const struct speaker_rank *r = &se->rankv[i];
+		const struct speaker *spk = spkv[i];
+		float d = spk->level - r->level;
+
+		if (r->ssrc != spk->ssrc
+		    || r->speaking != spk->speaking
+		    || !id_eq(r->userid, spk->userid)
+		    || !id_eq(r->clientid, spk->clientid))
+			return true;
+
+		if (d >= SPEAKER_LEVEL_DELTA || d <= -SPEAKER_LEVEL_DELTA)
+			return true;
+	}
+
+	return false;
+}
+
+
+static int ranking_set(struct speaker_engine *se,
+		       struct speaker * const *spkv, size_t n)
+{
+	struct speaker_rank *rankv = NULL;
+	size_t i;
+	int err = 0;
+
+	if (n) {
+		rankv = mem_zalloc(n * sizeof(*rankv), NULL);
+		if (!rankv)
+			return ENOMEM;
+	}
+
+	ranking_flush(se);
+	se->rankv = rankv;
+	se->rankc = n;
+
+	for (i = 0; i < n; ++i) {
+		const struct speaker *spk = spkv[i];
+		struct speaker_rank *r = &rankv[i];
+
+		if (spk->userid)
+			err |= str_dup(&r->userid, spk->userid);
+		if (spk->clientid)
+			err |= str_dup(&r->clientid, spk->clientid);
+		r->ssrc = spk->ssrc;
+		r->level = spk->level;
+		r->speaking = spk->speaking;
+	}
+
+	return err;
+}
+
+
+void speaker_engine_tick(struct speaker_engine *se, uint64_t now)
+{
+	struct speaker **spkv = NULL;
+	struct le *le;
+	size_t n = 0;
+	int err;
+
+	if (!se)
+		return;
+
+	le = se->speakerl.head;
+	while (le) {
+		struct speaker *spk = le->data;
+
+		le = le->next;
+
+		if (now - spk->ts_sample > SPEAKER_TIMEOUT) {
+			mem_deref(spk);
+			continue;
+		}
+		if (now - spk->ts_sample > SPEAKER_STALE)
+			speaker_sample(spk, 0.0f, now);
+		if (spk->speaking)
+			spk->ts_spoke = now;
+	}
+
+	n = list_count(&se->speakerl);
+	if (n) {
+		spkv = mem_zalloc(n * sizeof(*spkv), NULL);
+		if (!spkv)
+			return;
+
+		n = 0;
+		LIST_FOREACH(&se->speakerl, le)
+			spkv[n++] = le->data;
+
+		qsort(spkv, n, sizeof(*spkv), rank_cmp);
+	}
+
+	if (!ranking_changed(se, spkv, n))
+		goto out;
+
+	/* A change is held back until the interval has passed */
+	if (se->ts_emit && now - se->ts_emit < se->interval)
+		goto out;
+
+	err = ranking_set(se, spkv, n);
+	if (err) {
+		warning("speaker: ranking of %zu streams failed (%m)\n",
+			n, err);
+		goto out;
+	}
+
+	se->ts_emit = now;
+
+	if (se->rankh)
+		se->rankh(se->rankv, se->rankc, se->arg);
+
+ out:
+	mem_deref(spkv);
+}
+
+
+const struct speaker_rank *speaker_engine_ranking(
+	const struct speaker_engine *se, size_t *rankc)
+{
+	if (!se) {
+		if (rankc)
+			*rankc = 0;
+		return NULL;
+	}
+
+	if (rankc)
+		*rankc = se->rankc;
+
+	return se->rankv;
+}
+
+
+int speaker_engine_debug(struct re_printf *pf,
+			 const struct speaker_engine *se)
+{
+	size_t i;
+	int err = 0;
+
+	if (!se)
+		return 0;
+
+	err = re_hprintf(pf, "speakers: %zu streams\n",
+			 list_count(&se->speakerl));
+	for (i = 0; i < se->rankc; ++i) {
+		const struct speaker_rank *r = &se->rankv[i];
+
+		err |= re_hprintf(pf, "\t%zu: ssrc=%u level=%.2f%s\n",
+				  i, r->ssrc, r->level,
+				  r->speaking ? " speaking" : "");
+	}
+
+	return err;
+}
@@ -5,4 +5,6 @@
 
 AVS_SRCS += \
 	wcall/wcall.c \
-	wcall/marshal.c
+	wcall/marshal.c \
+	wcall/parts.c \
+	wcall/shard.c
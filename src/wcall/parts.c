@@ -0,0 +1,125 @@
+/*
+ * Wire
+ * Copyright (C) 2019 Wire Swiss GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <re.h>
+
+#include <avs.h>
+#include "avs_wcall.h"
+#include "parts.h"
+
+
+static bool id_eq(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return streq(a, b);
+}
+
+
+static void part_set(struct wcall_participant *part,
+		     const struct wcall_member *memb)
+{
+	part->userid = memb->userid;
+	part->clientid = memb->clientid;
+	part->audio_estab = memb->audio_estab;
+	part->video_recv = memb->video_recv;
+}
+
+
+int wcall_parts_diff(struct wcall_participant **partvp, size_t *partcp,
+		     uint32_t *changesp,
+		     const struct wcall_members *members,
+		     const struct wcall_members *prev)
+{
+	size_t prevc = prev ? prev->membc : 0;
+	struct wcall_participant *partv;
+	size_t partc = 0, i, j;
+	uint32_t changes = 0;
+	bool *seen = NULL;
+	int err = 0;
+
+	if (!partvp || !partcp || !changesp || !members)
+		return EINVAL;
+
+	partv = mem_zalloc((members->membc + prevc + 1) * sizeof(*partv),
+			   NULL);
+	if (prevc)
+		seen = mem_zalloc(prevc * sizeof(*seen), NULL);
+	if (!partv || (prevc && !seen)) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < members->membc; ++i) {
+		const struct wcall_member *memb = &members->membv[i];
+		const struct wcall_member *old = NULL;
+		struct wcall_participant *part = &partv[partc++];
+
+		for (j = 0; j < prevc && !old; ++j) {
+			const struct wcall_member *pm = &prev->membv[j];
+
+			if (!seen[j] && id_eq(memb->userid, pm->userid)
+			    && id_eq(memb->clientid, pm->clientid)) {
+				old = pm;
+				seen[j] = true;
+			}
+		}
+
+		part_set(part, memb);
+
+		if (!old) {
+			part->changes = WCALL_PARTICIPANT_ADDED;
+		}
+		else {
+			if (old->audio_estab != memb->audio_estab)
+				part->changes |= WCALL_PARTICIPANT_AUDIO;
+			if (old->video_recv != memb->video_recv)
+				part->changes |= WCALL_PARTICIPANT_VIDEO;
+		}
+
+		changes |= part->changes;
+	}
+
+	for (j = 0; j < prevc; ++j) {
+		struct wcall_participant *part;
+
+		if (seen[j])
+			continue;
+
+		part = &partv[partc++];
+		part_set(part, &prev->membv[j]);
+		part->changes = WCALL_PARTICIPANT_REMOVED;
+
+		changes |= part->changes;
+	}
+
+ out:
+	mem_deref(seen);
+
+	if (err) {
+		mem_deref(partv);
+	}
+	else {
+		*partvp = partv;
+		*partcp = partc;
+		*changesp = changes;
+	}
+
+	return err;
+}
@@ -0,0 +1,40 @@
+/*
+ * Wire
+ * Copyright (C) 2019 Wire Swiss GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WCALL_PARTS_H
+#define WCALL_PARTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Diffs members against prev, which may be NULL, into a flat array of
+ * participants with their WCALL_PARTICIPANT_ masks. Removed participants
+ * come last. The strings point into members and prev, so the array is
+ * only valid while both are. The OR of all masks goes to changesp.
+ */
+int wcall_parts_diff(struct wcall_participant **partvp, size_t *partcp,
+		     uint32_t *changesp,
+		     const struct wcall_members *members,
+		     const struct wcall_members *prev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * Wire
+ * Copyright (C) 2016 Wire Swiss GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Shards are event loop threads that calling instances can be spread
+ * over. Each shard runs its own re_main with its own mqueue and timers.
+ * An instance is created on its shard, so its marshal mqueue and all
+ * ecall/egcall timers belong to that loop, and marshalled API calls
+ * land there without any further routing.
+ */
+
+#include <pthread.h>
+
+#include <re.h>
+
+#include <avs.h>
+#include "avs_semaphore.h"
+#include "avs_wcall.h"
+#include "wcall.h"
+
+
+enum shard_event {
+	SHARD_EV_JOB,
+	SHARD_EV_STOP,
+};
+
+struct wcall_shard {
+	pthread_t tid;
+	bool running;
+	int ix;
+
+	struct mqueue *mq;
+	struct lock *lock;	/* one job in flight */
+	struct avs_sem *sem;
+	int err;
+
+	size_t ninst;
+};
+
+struct shard_job {
+	shard_job_h *jobh;
+	void *arg;
+};
+
+static struct {
+	struct wcall_shard *shardv;
+	size_t shardc;
+	struct lock *lock;	/* protects ninst */
+} shards = {
+	.shardv = NULL,
+	.shardc = 0,
+	.lock = NULL,
+};
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct wcall_shard *sh = arg;
+	struct shard_job *job = data;
+
+	switch (id) {
+
+	case SHARD_EV_JOB:
+		job->jobh(job->arg);
+		avs_sem_post(sh->sem);
+		break;
+
+	case SHARD_EV_STOP:
+		re_cancel();
+		break;
+
+	default:
+		warning("wcall: shard(%d): unknown event: %d\n", sh->ix, id);
+		break;
+	}
+}
+
+
+static void *shard_thread(void *arg)
+{
+	struct wcall_shard *sh = arg;
+	int err;
+
+	err = re_thread_init();
+	if (err) {
+		warning("wcall: shard(%d): re_thread_init failed (%m)\n",
+			sh->ix, err);
+		goto out;
+	}
+
+	err = mqueue_alloc(&sh->mq, mqueue_handler, sh);
+	if (err) {
+		warning("wcall: shard(%d): cannot allocate mqueue (%m)\n",
+			sh->ix, err);
+		re_thread_close();
+		goto out;
+	}
+
+	info("wcall: shard(%d): loop started\n", sh->ix);
+
+	sh->err = 0;
+	avs_sem_post(sh->sem);
+
+	re_main(NULL);
+
+	info("wcall: shard(%d): loop exiting\n", sh->ix);
+
+	sh->mq = mem_deref(sh->mq);
+	re_thread_close();
+
+	return NULL;
+
+ out:
+	sh->err = err;
+	avs_sem_post(sh->sem);
+
+	return NULL;
+}
+
+
+int wcall_shards_start(size_t n)
+{
+	size_t i;
+	int err = 0;
+
+	if (!n)
+		return EINVAL;
+	if (shards.shardc)
+		return EALREADY;
+
+	shards.shardv = mem_zalloc(n * sizeof(*shards.shardv), NULL);
+	if (!shards.shardv)
+		return ENOMEM;
+
+	shards.shardc = n;
+
+	err = lock_alloc(&shards.lock);
+	if (err)
+		goto out;
+
+	for (i = 0; i < n; ++i) {
+		struct wcall_shard *sh = &shards.shardv[i];
+
+		sh->ix = (int)i;
+
+		err = lock_alloc(&sh->lock);
+		if (err)
+			goto out;
+
+		err = avs_sem_alloc(&sh->sem, 0);
+		if (err)
+			goto out;
+
+		err = pthread_create(&sh->tid, NULL, shard_thread, sh);
+		if (err)
+			goto out;
+
+		/* Wait until the loop owns its mqueue */
+		avs_sem_wait(sh->sem);
+		if (sh->err) {
+			err = sh->err;
+			pthread_join(sh->tid, NULL);
+			goto out;
+		}
+
+		sh->running = true;
+	}
+
+	info("wcall: started %zu shards\n", n);
+
+ out:
+	if (err) {
+		warning("wcall: starting %zu shards failed (%m)\n", n, err);
+		wcall_shards_stop();
+	}
+
+	return err;
+}
+
+
+void wcall_shards_stop(void)
+{
+	size_t i;
+
+	if (!shards.shardv)
+		return;
+
+	for (i = 0; i < shards.shardc; ++i) {
+		struct wcall_shard *sh = &shards.shardv[i];
+
+		if (sh->running) {
+			mqueue_push(sh->mq, SHARD_EV_STOP, NULL);
+			pthread_join(sh->tid, NULL);
+			sh->running = false;
+		}
+
+		sh->sem = mem_deref(sh->sem);
+		sh->lock = mem_deref(sh->lock);
+	}
+
+	info("wcall: stopped %zu shards\n", shards.shardc);
+
+	shards.shardv = mem_deref(shards.shardv);
+	shards.shardc = 0;
+	shards.lock = mem_deref(shards.lock);
+}
+
+
+size_t wcall_shards_count(void)
+{
+	return shards.shardc;
+}
+
+
+/* Picks the least loaded shard for a new instance */
+int wcall_shard_assign(void)
+{
+	size_t i, best = 0;
+
+	if (!shards.shardc)
+		return -1;
+
+	lock_write_get(shards.lock);
+	for (i = 1; i < shards.shardc; ++i) {
+		if (shards.shardv[i].ninst < shards.shardv[best].ninst)
+			best = i;
+	}
+	++shards.shardv[best].ninst;
+	lock_rel(shards.lock);
+
+	return (int)best;
+}
+
+
+void wcall_shard_release(int ix)
+{
+	if (ix < 0 || (size_t)ix >= shards.shardc)
+		return;
+
+	lock_write_get(shards.lock);
+	if (shards.shardv[ix].ninst)
+		--shards.shardv[ix].ninst;
+	lock_rel(shards.lock);
+}
+
+
+/* Index of the shard whose loop runs on the calling thread, or -1 */
+static int shard_current(void)
+{
+	size_t i;
+
+	for (i = 0; i < shards.shardc; ++i) {
+		struct wcall_shard *sh = &shards.shardv[i];
+
+		if (sh->running && pthread_equal(pthread_self(), sh->tid))
+			return (int)i;
+	}
+
+	return -1;
+}
+
+
+/*
+ * Runs jobh on the loop of shard ix and waits for it to complete.
+ * Called from the shard itself the job runs in place. Called from
+ * another shard it fails with EDEADLK: two shards waiting on each
+ * other would never return, so shards only hand work to each other
+ * asynchronously.
+ */
+int wcall_shard_call(int ix, shard_job_h *jobh, void *arg)
+{
+	struct wcall_shard *sh;
+	struct shard_job job;
+	int self;
+	int err;
+
+	if (!jobh)
+		return EINVAL;
+	if (ix < 0 || (size_t)ix >= shards.shardc)
+		return ENOENT;
+
+	sh = &shards.shardv[ix];
+	if (!sh->running)
+		return ENOENT;
+
+	self = shard_current();
+	if (self == ix) {
+		jobh(arg);
+		return 0;
+	}
+	else if (self >= 0) {
+		warning("wcall: shard(%d): synchronous call into shard %d "
+			"refused\n", self, ix);
+		return EDEADLK;
+	}
+
+	job.jobh = jobh;
+	job.arg = arg;
+
+	lock_write_get(sh->lock);
+	err = mqueue_push(sh->mq, SHARD_EV_JOB, &job);
+	if (!err)
+		avs_sem_wait(sh->sem);
+	lock_rel(sh->lock);
+
+	return err;
+}
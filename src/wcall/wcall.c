@@ -21,11 +21,13 @@
 
 #include <re/re.h>
 #include <avs.h>
+#include <avs_semaphore.h>
 
 #include <avs_wcall.h>
 #include <avs_peerflow.h>
 
 #include "wcall.h"
+#include "parts.h"
 
 #ifdef __APPLE__
 #       include <TargetConditionals.h>
@@ -37,6 +39,11 @@
 
 #define AUDIO_CBR_STATE_UNSET (-1)
 
+#define SPEAKER_POLL_INTERVAL    200  /* ms between audio level polls  */
+#define SPEAKER_UPDATE_INTERVAL  500  /* ms between speaker updates    */
+#define SPEAKER_SLOW_HANDLER      20  /* ms, speakerh calls logged     */
+#define SPEAKER_MAX_LEVELS        64  /* audio streams polled per call */
+
 #define APITAG "WAPI "
 
 
@@ -50,6 +57,7 @@ static struct {
 	int run_err;
 	pthread_t tid;
 	uint32_t wuser_index;
+	uint64_t init_ts;
 	struct {
 		wcall_mute_h *h;
 		void *arg;
@@ -91,8 +99,8 @@ struct calling_instance {
 	struct list wcalls;
 	struct list ctxl;
 
-	pthread_t tid;
-	bool thread_run;
+	struct lock *snap_lock;	/* protects the snap pointer only */
+	struct wcall_snap *snap;
 
 	wcall_ready_h *readyh;
 	wcall_send_h *sendh;
@@ -120,12 +128,21 @@ struct calling_instance {
 			wcall_participant_changed_h *chgh;
 			void *arg;
 		} json;
+		struct {
+			wcall_participants_h *partsh;
+			void *arg;
+		} parts;
 	} group;
 
 	struct {
 		wcall_mute_h *h;
 		void *arg;
 	} mute;
+
+	struct {
+		wcall_active_speaker_h *h;
+		void *arg;
+	} speakers;
 	
 	void *arg;
 
@@ -146,6 +163,8 @@ struct calling_instance {
 	struct sa *media_laddr;
 
 	uint32_t wuser;
+	int shard; /* -1 when running on the main loop */
+	uint64_t create_ts;
 };
 
 struct wcall {
@@ -165,13 +184,67 @@ struct wcall {
 		int cbr_state;
 	} audio;
 
+	struct {
+		struct speaker_engine *engine;
+		struct tmr tmr;
+	} speakers;
+
 	int state; /* wcall state */
 	bool disable_audio;
+	struct wcall_members *parts; /* as last reported to partsh */
+	struct list qhistl; /* struct wcall_qhist, one per peer */
 	
 	struct le le;
 };
 
 
+#define WCALL_QHIST_SZ 120 /* two hours of one minute periods */
+
+/*
+ * Quality history of one peer. It is kept on the wcall rather than the
+ * ecall so that it outlives the ecall, and is only touched on the AVS
+ * thread; other threads read the copy in the snapshot.
+ */
+struct wcall_qhist {
+	char *userid;
+	struct wcall_quality_sample samplev[WCALL_QHIST_SZ];
+	uint32_t head; /* samples ever added */
+	struct call_qhist *pub; /* published copy, NULL once stale */
+
+	struct le le;
+};
+
+
+/*
+ * Read-mostly view of the calls of an instance, for threads other than
+ * the AVS thread. A snapshot is immutable once published: the AVS thread
+ * builds a new one whenever a call is added, removed, changes state,
+ * its members change or a quality sample arrives, and swaps it in.
+ * Readers take a reference and iterate it without holding inst->lock;
+ * the last one out frees it.
+ */
+struct call_qhist {
+	uint32_t refs;	/* atomic, shared by the snapshots until a new sample */
+	char *userid;
+	struct wcall_quality_sample *samplev;	/* oldest first */
+	size_t samplec;
+};
+
+struct call_snap {
+	char *convid;
+	int state;
+	struct wcall_members *members;	/* NULL if not available */
+	struct call_qhist **qhistv;
+	size_t qhistc;
+};
+
+struct wcall_snap {
+	uint32_t refs;	/* atomic, mem_ref is not thread-safe */
+	struct call_snap *callv;
+	size_t callc;
+};
+
+
 struct wcall_ctx {
 	struct calling_instance *inst;
 	struct wcall *wcall;
@@ -182,8 +255,15 @@ struct wcall_ctx {
 
 static void wcall_end_internal(struct wcall *wcall);
 static bool wcall_has_calls(struct calling_instance *inst);
+static void destroy_handler(void *arg);
 
 
+/*
+ * No reference is taken, the instance stays valid until wcall_destroy()
+ * of the same wuser. Teardown only ever runs on the instance's own loop
+ * (its shard, or the main loop), never from another shard, and the app
+ * must not call into a wuser concurrently with or after destroying it.
+ */
 struct calling_instance *wuser2inst(WUSER_HANDLE wuser)
 {
 	bool found = false;
@@ -193,7 +273,7 @@ struct calling_instance *wuser2inst(WUSER_HANDLE wuser)
 	if ((wuser & WU_MAGIC) != WU_MAGIC)
 		return NULL;
 	
-	lock_write_get(calling.lock);
+	lock_read_get(calling.lock);
 	for (le = calling.instances.head; le && !found; le = le->next) {
 		inst = le->data;
 		
@@ -210,9 +290,12 @@ static WUSER_HANDLE inst2wuser(struct calling_instance *inst)
 	WUSER_HANDLE wuser = WUSER_INVALID_HANDLE;
 
 	if (inst) {
+		/* Instances may be created from several threads */
+		lock_write_get(calling.lock);
 		wuser = WU_MAGIC + calling.wuser_index;
 		calling.wuser_index++;
 		calling.wuser_index &= 0xFFFF; /* wrap */
+		lock_rel(calling.lock);
 
 		inst->wuser = wuser;
 	}
@@ -225,7 +308,7 @@ static bool instance_valid(struct calling_instance *inst)
 	bool found = false;
 	struct le *le;
 
-	lock_write_get(calling.lock);
+	lock_read_get(calling.lock);
 	for (le = calling.instances.head; le && !found; le = le->next)
 		found = le->data == inst;
 	lock_rel(calling.lock);
@@ -248,7 +331,7 @@ static bool wcall_valid(const struct wcall *wcall)
 		return false;
 	}
 	
-	lock_write_get(inst->lock);
+	lock_read_get(inst->lock);
 	for (le = inst->wcalls.head; le && !found; le = le->next)
 		found = wcall == le->data;
 	lock_rel(inst->lock);
@@ -336,58 +419,317 @@ static const char *wcall_vstate_name(int vstate)
 	}
 }
 
-static void set_state(struct wcall *wcall, int st)
+static void call_qhist_destructor(void *arg)
 {
-	bool trigger = wcall->state != st;
-	struct calling_instance *inst = wcall->inst;
-	
-	info("wcall(%p): set_state: %s->%s\n",
-	     wcall, wcall_state_name(wcall->state), wcall_state_name(st));
-	
-	wcall->state = st;
+	struct call_qhist *ch = arg;
 
-	if (trigger && inst && inst->stateh) {
-		inst->stateh(wcall->convid, wcall->state, inst->arg);
+	mem_deref(ch->userid);
+	mem_deref(ch->samplev);
+}
+
+
+static void qhist_put(struct call_qhist *ch)
+{
+	if (!ch)
+		return;
+
+	if (__atomic_sub_fetch(&ch->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		mem_deref(ch);
+}
+
+
+static void snap_destructor(void *arg)
+{
+	struct wcall_snap *snap = arg;
+	size_t i;
+
+	for (i = 0; i < snap->callc; ++i) {
+		struct call_snap *cs = &snap->callv[i];
+		size_t j;
+
+		mem_deref(cs->convid);
+		mem_deref(cs->members);
+
+		for (j = 0; j < cs->qhistc; ++j)
+			qhist_put(cs->qhistv[j]);
+		mem_deref(cs->qhistv);
 	}
+
+	mem_deref(snap->callv);
 }
 
 
-#if 0
-static void *cfg_wait_thread(void *arg)
+/* Takes a reference to the current snapshot, or returns NULL */
+static struct wcall_snap *snap_get(struct calling_instance *inst)
 {
-	struct calling_instance *inst = arg;
+	struct wcall_snap *snap;
 
-	(void)arg;
+	if (!inst || !inst->snap_lock)
+		return NULL;
+
+	lock_read_get(inst->snap_lock);
+	snap = inst->snap;
+	if (snap)
+		__atomic_add_fetch(&snap->refs, 1, __ATOMIC_RELAXED);
+	lock_rel(inst->snap_lock);
+
+	return snap;
+}
+
+
+static void snap_put(struct wcall_snap *snap)
+{
+	if (!snap)
+		return;
+
+	if (__atomic_sub_fetch(&snap->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		mem_deref(snap);
+}
+
+
+static void snap_swap(struct calling_instance *inst, struct wcall_snap *snap)
+{
+	struct wcall_snap *old;
+
+	if (!inst->snap_lock)
+		return;
+
+	lock_write_get(inst->snap_lock);
+	old = inst->snap;
+	inst->snap = snap;
+	lock_rel(inst->snap_lock);
+
+	snap_put(old);
+}
+
+
+/* Builds the published copy of a history, oldest sample first */
+static struct call_qhist *qhist_publish(const struct wcall_qhist *qh)
+{
+	struct call_qhist *ch;
+	uint32_t first;
+	size_t i, n;
+	int err;
+
+	ch = mem_zalloc(sizeof(*ch), call_qhist_destructor);
+	if (!ch)
+		return NULL;
+
+	ch->refs = 1;
+
+	err = str_dup(&ch->userid, qh->userid);
+	if (err)
+		goto out;
+
+	n = min(qh->head, WCALL_QHIST_SZ);
+	ch->samplev = mem_alloc(n * sizeof(*ch->samplev), NULL);
+	if (!ch->samplev) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	first = qh->head - (uint32_t)n;
+	for (i = 0; i < n; ++i)
+		ch->samplev[i] = qh->samplev[(first + i) % WCALL_QHIST_SZ];
+
+	ch->samplec = n;
+
+ out:
+	if (err)
+		ch = mem_deref(ch);
+
+	return ch;
+}
+
+
+/*
+ * The snapshot shares the published copy of each history; only the
+ * histories that got a sample since the last publish are copied.
+ */
+static int snap_qhist(struct call_snap *cs, struct wcall *wcall)
+{
+	struct le *le;
+	size_t n;
+
+	n = list_count(&wcall->qhistl);
+	if (!n)
+		return 0;
+
+	cs->qhistv = mem_zalloc(n * sizeof(*cs->qhistv), NULL);
+	if (!cs->qhistv)
+		return ENOMEM;
+
+	LIST_FOREACH(&wcall->qhistl, le) {
+		struct wcall_qhist *qh = le->data;
+
+		if (!qh->pub) {
+			qh->pub = qhist_publish(qh);
+			if (!qh->pub)
+				return ENOMEM;
+		}
+
+		__atomic_add_fetch(&qh->pub->refs, 1, __ATOMIC_RELAXED);
+		cs->qhistv[cs->qhistc++] = qh->pub;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Publishes a new snapshot of inst->wcalls. Only the AVS thread modifies
+ * the list, and this runs on it, so the list is walked without
+ * inst->lock; some callers already hold it.
+ */
+static void snap_publish(struct calling_instance *inst)
+{
+	struct wcall_snap *snap;
+	struct le *le;
+	size_t n, i = 0;
+
+	if (!inst || !inst->snap_lock)
+		return;
 
-	debug("wcall(%p): starting config wait\n", inst);	
-	while (inst->call_config == NULL && inst->thread_run) {
-		sys_msleep(500);
+	snap = mem_zalloc(sizeof(*snap), snap_destructor);
+	if (!snap)
+		goto nomem;
+
+	snap->refs = 1;
+
+	n = list_count(&inst->wcalls);
+	if (n) {
+		snap->callv = mem_zalloc(n * sizeof(*snap->callv), NULL);
+		if (!snap->callv)
+			goto nomem;
 	}
-	if (inst->call_config)
-		debug("wcall(%p): config ready!\n", inst);
 
-	inst->thread_run = false;
+	LIST_FOREACH(&inst->wcalls, le) {
+		struct wcall *wcall = le->data;
+		struct call_snap *cs = &snap->callv[i++];
+		int err;
+
+		err = str_dup(&cs->convid, wcall->convid);
+		if (err)
+			goto nomem;
+
+		cs->state = wcall->state;
+
+		if (wcall->icall) {
+			err = ICALL_CALLE(wcall->icall, get_members,
+					  &cs->members);
+			if (err)
+				cs->members = NULL;
+		}
+
+		snap->callc = i;
+
+		err = snap_qhist(cs, wcall);
+		if (err)
+			goto nomem;
+	}
+
+	snap_swap(inst, snap);
+	return;
+
+ nomem:
+	/* Readers keep seeing the previous snapshot */
+	warning("wcall(%p): snap_publish: out of memory\n", inst);
+	mem_deref(snap);
+}
+
+
+static const struct call_snap *snap_find(const struct wcall_snap *snap,
+					 const char *convid)
+{
+	size_t i;
+
+	if (!snap || !convid)
+		return NULL;
+
+	for (i = 0; i < snap->callc; ++i) {
+		if (streq(convid, snap->callv[i].convid))
+			return &snap->callv[i];
+	}
 
 	return NULL;
 }
 
 
-static int async_cfg_wait(struct calling_instance *inst)
+static void members_destructor(void *arg)
 {
-	int err;
+	struct wcall_members *mm = arg;
+	size_t i;
 
-	info("wcall: creating async config polling thread\n");
-	
-	inst->thread_run = true;
-	err = pthread_create(&inst->tid, NULL, cfg_wait_thread, inst);
-	if (err) {
-		inst->thread_run = false;
-		return err;
+	for (i = 0; i < mm->membc; ++i) {
+		mem_deref(mm->membv[i].userid);
+		mem_deref(mm->membv[i].clientid);
 	}
 
-	return err;
+	mem_deref(mm->membv);
 }
-#endif
+
+
+/* The caller owns the copy, snapshots are shared */
+static struct wcall_members *members_copy(const struct wcall_members *src)
+{
+	struct wcall_members *mm;
+	size_t i;
+	int err = 0;
+
+	mm = mem_zalloc(sizeof(*mm), members_destructor);
+	if (!mm)
+		return NULL;
+
+	if (src->membc) {
+		mm->membv = mem_zalloc(src->membc * sizeof(*mm->membv), NULL);
+		if (!mm->membv) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+	mm->membc = src->membc;
+
+	for (i = 0; i < src->membc; ++i) {
+		const struct wcall_member *sm = &src->membv[i];
+		struct wcall_member *dm = &mm->membv[i];
+
+		if (sm->userid)
+			err |= str_dup(&dm->userid, sm->userid);
+		if (sm->clientid)
+			err |= str_dup(&dm->clientid, sm->clientid);
+		if (err)
+			goto out;
+
+		dm->audio_estab = sm->audio_estab;
+		dm->video_recv = sm->video_recv;
+	}
+
+ out:
+	if (err)
+		mm = mem_deref(mm);
+
+	return mm;
+}
+
+
+static void set_state(struct wcall *wcall, int st)
+{
+	bool trigger = wcall->state != st;
+	struct calling_instance *inst = wcall->inst;
+	
+	info("wcall(%p): set_state: %s->%s\n",
+	     wcall, wcall_state_name(wcall->state), wcall_state_name(st));
+	
+	wcall->state = st;
+
+	if (trigger)
+		snap_publish(inst);
+
+	if (trigger && inst && inst->stateh) {
+		inst->stateh(wcall->convid, wcall->state, inst->arg);
+	}
+}
+
 
 struct wcall *wcall_lookup(struct calling_instance *inst, const char *convid)
 {
@@ -398,7 +740,7 @@ struct wcall *wcall_lookup(struct calling_instance *inst, const char *convid)
 	if (!inst || !convid)
 		return NULL;
 	
-	lock_write_get(inst->lock);
+	lock_read_get(inst->lock);
 	for (le = inst->wcalls.head;
 	     le != NULL && !found;
 	     le = le->next) { 
@@ -599,6 +941,10 @@ static void icall_media_estab_handler(struct icall *icall,
 	
 	set_state(wcall, WCALL_STATE_MEDIA_ESTAB);
 
+	/* An update keeps the state, but may change the members */
+	if (update)
+		snap_publish(inst);
+
 	if (inst->mestabh) {
 		inst->mestabh(wcall->convid, icall, userid, inst->arg);
 	}
@@ -650,21 +996,17 @@ static void icall_media_stopped_handler(struct icall *icall, void *arg)
 }
 
 
-static int members_json(struct wcall *wcall, char **mjson)
+static int members_json(const char *convid,
+			const struct wcall_members *members, char **mjson)
 {
-	struct wcall_members *members = NULL;
 	struct json_object *tmembs = NULL;
 	struct json_object *jmembs = NULL;	
 	size_t i;
 	int err = 0;
 	
-	err = ICALL_CALLE(wcall->icall, get_members, &members);
-	if (err)
-		return EBADF;
-
 	info("wcall: members_json: %d members\n", members->membc);
 	tmembs = jzon_alloc_object();
-	jzon_add_str(tmembs, "convid", "%s", wcall->convid);
+	jzon_add_str(tmembs, "convid", "%s", convid);
 	
 	jmembs = json_object_new_array();
 	if (!mjson) {
@@ -692,7 +1034,6 @@ static int members_json(struct wcall *wcall, char **mjson)
 	jzon_encode(mjson, tmembs);
 
  out:
-	mem_deref(members);
 	mem_deref(tmembs);
 
 	return err;
@@ -700,12 +1041,13 @@ static int members_json(struct wcall *wcall, char **mjson)
 
 
 static void call_group_change_json(struct calling_instance *inst,
-				   struct wcall *wcall)
+				   struct wcall *wcall,
+				   const struct wcall_members *members)
 {
 	char *mjson = NULL;
 	int err;
 	
-	err = members_json(wcall, &mjson);
+	err = members_json(wcall->convid, members, &mjson);
 	if (err) {
 		warning("wcall(%p): members_json failed: %m\n",
 			wcall, err);
@@ -725,6 +1067,72 @@ static void call_group_change_json(struct calling_instance *inst,
 }
 
 
+/*
+ * Reports the members to partsh as a flat array, or nothing if no
+ * participant has changed since the last call.
+ */
+static void call_group_change_parts(struct calling_instance *inst,
+				    struct wcall *wcall,
+				    struct wcall_members *members)
+{
+	struct wcall_participant *partv = NULL;
+	size_t partc = 0;
+	uint32_t changes = 0;
+	int err;
+
+	err = wcall_parts_diff(&partv, &partc, &changes,
+			       members, wcall->parts);
+	if (err) {
+		warning("wcall(%p): group_change_parts: diff failed (%m)\n",
+			wcall, err);
+		return;
+	}
+
+	if (changes && inst->group.parts.partsh) {
+		uint64_t now = tmr_jiffies();
+
+		info(APITAG "wcall(%p): partsh: %zu participants "
+		     "changes=0x%x\n", wcall, partc, changes);
+		inst->group.parts.partsh(wcall->convid, partv, partc,
+					 inst->group.parts.arg);
+		info(APITAG "wcall(%p): partsh took %llu ms\n",
+		     wcall, tmr_jiffies() - now);
+	}
+
+	/* The old members back the removed entries, swap after the call */
+	mem_deref(wcall->parts);
+	wcall->parts = mem_ref(members);
+
+	mem_deref(partv);
+}
+
+
+/* Reports a change of the members to the JSON and the array consumers */
+static void call_group_change(struct calling_instance *inst,
+			      struct wcall *wcall)
+{
+	struct wcall_members *members = NULL;
+	int err;
+
+	if (!inst->group.json.chgh && !inst->group.parts.partsh)
+		return;
+
+	err = ICALL_CALLE(wcall->icall, get_members, &members);
+	if (err || !members) {
+		warning("wcall(%p): group_change: get_members failed: %m\n",
+			wcall, err);
+		return;
+	}
+
+	if (inst->group.json.chgh)
+		call_group_change_json(inst, wcall, members);
+	if (inst->group.parts.partsh)
+		call_group_change_parts(inst, wcall, members);
+
+	mem_deref(members);
+}
+
+
 static void icall_audio_estab_handler(struct icall *icall, const char *userid,
 				      const char *clientid, bool update,
 				      void *arg)
@@ -748,6 +1156,9 @@ static void icall_audio_estab_handler(struct icall *icall, const char *userid,
 
 	// TODO: check this, it should not be necessary
 	msystem_stop_silencing();
+
+	/* The member is now audio_estab */
+	snap_publish(inst);
 	
 	info(APITAG "wcall(%p): estabh(%p) peer_userid=%s\n",
 	     wcall, inst->estabh, anon_id(peer_userid_anon, userid));
@@ -760,8 +1171,8 @@ static void icall_audio_estab_handler(struct icall *icall, const char *userid,
 		     wcall, tmr_jiffies() - now);
 	}
 	if (wcall->conv_type == WCALL_CONV_TYPE_ONEONONE) {
-		if (!update && inst->group.json.chgh)
-			call_group_change_json(inst, wcall);
+		if (!update)
+			call_group_change(inst, wcall);
 	}
 }
 
@@ -856,6 +1267,9 @@ static void icall_vstate_handler(struct icall *icall, const char *userid,
 		wstate = WCALL_VIDEO_STATE_STOPPED;
 		break;
 	}
+	/* The member's video_recv follows the state */
+	snap_publish(inst);
+
 	info(APITAG "wcall(%p): vstateh(%p) icall=%p conv=%s user=%s state=%d\n",
 	     wcall, inst->vstateh, icall, anon_id(convid_anon, wcall->convid),
 	     anon_id(userid_anon, userid), wstate);
@@ -1059,6 +1473,8 @@ static void egcall_group_changed_handler(struct icall *icall, void *arg)
 		return;
 	}
 
+	snap_publish(inst);
+
 	if (inst->group.chgh) {
 		uint64_t now = tmr_jiffies();
 		info(APITAG "wcall(%p): group_changedh\n", wcall);
@@ -1067,9 +1483,7 @@ static void egcall_group_changed_handler(struct icall *icall, void *arg)
 		     wcall, tmr_jiffies() - now);
 	}
 	
-	if (inst->group.json.chgh) {
-		call_group_change_json(inst, wcall);
-	}
+	call_group_change(inst, wcall);
 }
 
 static void egcall_metrics_handler(struct icall *icall,
@@ -1229,6 +1643,83 @@ out:
 }
 #endif
 
+/*
+ * Ranks the audio streams of the call, the ranking picks the video
+ * decoders of the flows and is reported to the app.
+ */
+static void speaker_rank_handler(const struct speaker_rank *rankv,
+				 size_t rankc, void *arg)
+{
+	struct wcall *wcall = arg;
+	struct calling_instance *inst = wcall->inst;
+	struct wcall_active_speaker *speakerv;
+	uint64_t now, took;
+	size_t i;
+
+	ICALL_CALLE(wcall->icall, set_active_speakers, rankv, rankc);
+
+	if (!inst->speakers.h)
+		return;
+
+	speakerv = mem_zalloc((rankc + 1) * sizeof(*speakerv), NULL);
+	if (!speakerv)
+		return;
+
+	for (i = 0; i < rankc; ++i) {
+		speakerv[i].userid = rankv[i].userid;
+		speakerv[i].clientid = rankv[i].clientid;
+		speakerv[i].audio_level = (int)(rankv[i].level * 100.0f);
+		speakerv[i].speaking = rankv[i].speaking ? 1 : 0;
+	}
+
+	/* Called twice a second, so only slow calls are logged */
+	now = tmr_jiffies();
+	debug(APITAG "wcall(%p): speakerh: %zu participants\n", wcall, rankc);
+	inst->speakers.h(wcall->convid, speakerv, rankc, inst->speakers.arg);
+	took = tmr_jiffies() - now;
+	if (took >= SPEAKER_SLOW_HANDLER) {
+		info(APITAG "wcall(%p): speakerh: %zu participants "
+		     "took %llu ms\n", wcall, rankc, took);
+	}
+
+	mem_deref(speakerv);
+}
+
+
+static void speaker_poll_handler(void *arg)
+{
+	struct wcall *wcall = arg;
+	struct calling_instance *inst = wcall->inst;
+	struct speaker_level levelv[SPEAKER_MAX_LEVELS];
+	size_t levelc = SPEAKER_MAX_LEVELS;
+	uint64_t now = tmr_jiffies();
+	size_t i;
+	int err;
+
+	tmr_start(&wcall->speakers.tmr, SPEAKER_POLL_INTERVAL,
+		  speaker_poll_handler, wcall);
+
+	if (wcall->state != WCALL_STATE_MEDIA_ESTAB)
+		return;
+
+	/* A 1:1 call has no decoders to pick */
+	if (wcall->conv_type == WCALL_CONV_TYPE_ONEONONE && !inst->speakers.h)
+		return;
+
+	if (!wcall->icall || !wcall->icall->get_audio_levels)
+		return;
+
+	err = wcall->icall->get_audio_levels(wcall->icall, levelv, &levelc);
+	if (err)
+		return;
+
+	for (i = 0; i < levelc; ++i)
+		speaker_engine_level(wcall->speakers.engine, &levelv[i], now);
+
+	speaker_engine_tick(wcall->speakers.engine, now);
+}
+
+
 static void destructor(void *arg)
 {
 	struct wcall *wcall = arg;
@@ -1243,6 +1734,11 @@ static void destructor(void *arg)
 	has_calls = inst->wcalls.head != NULL;
 	lock_rel(inst->lock);
 
+	snap_publish(inst);
+
+	tmr_cancel(&wcall->speakers.tmr);
+	mem_deref(wcall->speakers.engine);
+
 	if (!has_calls) {
 		if (inst->mm) {
 			mediamgr_set_call_state(inst->mm,
@@ -1255,6 +1751,8 @@ static void destructor(void *arg)
 
 	mem_deref(wcall->icall);
 	mem_deref(wcall->convid);
+	mem_deref(wcall->parts);
+	list_flush(&wcall->qhistl);
 
 	info("wcall(%p): dtor -- done\n", wcall);
 }
@@ -1299,6 +1797,63 @@ static void icall_quality_handler(struct icall *icall,
 }
 
 
+static void qhist_destructor(void *arg)
+{
+	struct wcall_qhist *qh = arg;
+
+	list_unlink(&qh->le);
+	mem_deref(qh->userid);
+	qhist_put(qh->pub);
+}
+
+
+static void icall_quality_sample_handler(struct icall *icall,
+					 const char *userid,
+					 const struct wcall_quality_sample *sample,
+					 void *arg)
+{
+	struct wcall *wcall = arg;
+	struct wcall_qhist *qh = NULL;
+	struct le *le;
+	int err;
+
+	if (!wcall_valid(wcall)) {
+		warning("wcall(%p): icall_quality_sample_handler wcall "
+			"not valid\n", wcall);
+		return;
+	}
+
+	LIST_FOREACH(&wcall->qhistl, le) {
+		struct wcall_qhist *h = le->data;
+
+		if (0 == str_casecmp(h->userid, userid ? userid : "")) {
+			qh = h;
+			break;
+		}
+	}
+
+	if (!qh) {
+		qh = mem_zalloc(sizeof(*qh), qhist_destructor);
+		if (!qh)
+			return;
+
+		err = str_dup(&qh->userid, userid ? userid : "");
+		if (err) {
+			mem_deref(qh);
+			return;
+		}
+
+		list_append(&wcall->qhistl, &qh->le, qh);
+	}
+
+	qh->samplev[qh->head++ % WCALL_QHIST_SZ] = *sample;
+	qhist_put(qh->pub);
+	qh->pub = NULL;
+
+	snap_publish(wcall->inst);
+}
+
+
 static  void icall_req_clients_handler(struct icall *icall, void *arg)
 {
 	struct wcall *wcall = arg;
@@ -1397,6 +1952,7 @@ int wcall_add(struct calling_instance *inst,
 				    icall_vstate_handler,
 				    icall_audiocbr_handler,
 				    icall_quality_handler,
+				    icall_quality_sample_handler,
 				    icall_req_clients_handler,
 				    wcall);		
 		}
@@ -1433,6 +1989,7 @@ int wcall_add(struct calling_instance *inst,
 				    icall_vstate_handler,
 				    icall_audiocbr_handler,
 				    icall_quality_handler,
+				    icall_quality_sample_handler,
 				    icall_req_clients_handler,
 				    wcall);
 		}
@@ -1470,6 +2027,7 @@ int wcall_add(struct calling_instance *inst,
 				    icall_vstate_handler,
 				    icall_audiocbr_handler,
 				    icall_quality_handler,
+				    icall_quality_sample_handler,
 				    icall_req_clients_handler,
 				    wcall);
 		}
@@ -1503,6 +2061,17 @@ int wcall_add(struct calling_instance *inst,
 	wcall->video.recv_state = WCALL_VIDEO_STATE_STOPPED;
 	wcall->audio.cbr_state = AUDIO_CBR_STATE_UNSET;
 
+	/* Without it the call works, just without speaker updates */
+	if (speaker_engine_alloc(&wcall->speakers.engine,
+				 SPEAKER_UPDATE_INTERVAL,
+				 speaker_rank_handler, wcall)) {
+		warning("wcall(%p): no speaker engine\n", wcall);
+	}
+	else {
+		tmr_start(&wcall->speakers.tmr, SPEAKER_POLL_INTERVAL,
+			  speaker_poll_handler, wcall);
+	}
+
 	list_append(&inst->wcalls, &wcall->le, wcall);
 
  out:
@@ -1510,8 +2079,10 @@ int wcall_add(struct calling_instance *inst,
 
 	if (err)
 		mem_deref(wcall);
-	else
+	else {
+		snap_publish(inst);
 		*wcallp = wcall;
+	}
 
 	return err;
 }
@@ -1691,6 +2262,7 @@ int wcall_init(int env)
 
 	calling.initialized = true;
 	calling.env = env;
+	calling.init_ts = tmr_jiffies();
 
 	msystem_set_env(env);
 
@@ -1707,9 +2279,30 @@ int wcall_init(int env)
 	dns_init(NULL);
 #endif
 
-	return err;
+	info("wcall: startup: init took %llu ms\n",
+	     tmr_jiffies() - calling.init_ts);
+
+	return err;
+}
+
+static struct calling_instance *first_sharded_instance(void)
+{
+	struct calling_instance *inst = NULL;
+	struct le *le;
+
+	lock_read_get(calling.lock);
+	for (le = calling.instances.head; le && !inst; le = le->next) {
+		struct calling_instance *i = le->data;
+
+		if (i->shard >= 0)
+			inst = i;
+	}
+	lock_rel(calling.lock);
+
+	return inst;
 }
 
+
 AVS_EXPORT
 void wcall_close(void)
 {
@@ -1720,6 +2313,22 @@ void wcall_close(void)
 	if (!calling.initialized)
 		return;	
 
+	if (wcall_shards_count() > 0) {
+		struct calling_instance *inst;
+
+		/* Sharded instances own timers on their shard's loop,
+		 * so they are torn down there before the loops stop.
+		 */
+		while ((inst = first_sharded_instance()) != NULL) {
+			inst->shuth = NULL;
+			if (wcall_shard_call(inst->shard,
+					     destroy_handler, inst))
+				inst->shard = -1;
+		}
+
+		wcall_shards_stop();
+	}
+
 	lock_write_get(calling.lock);
 	LIST_FOREACH(&calling.logl, le) {
 		struct log_entry *loge = le->data;
@@ -1739,6 +2348,36 @@ void wcall_close(void)
 }
 
 
+AVS_EXPORT
+int wcall_set_shards(int n)
+{
+	if (!calling.initialized)
+		return EINVAL;
+	if (n <= 0)
+		return EINVAL;
+
+	if (wcall_shards_count() > 0)
+		return EALREADY;
+
+	info(APITAG "wcall: set_shards: %d\n", n);
+
+	return wcall_shards_start((size_t)n);
+}
+
+
+AVS_EXPORT
+int wcall_get_shard(WUSER_HANDLE wuser)
+{
+	struct calling_instance *inst;
+
+	inst = wuser2inst(wuser);
+	if (!inst)
+		return -1;
+
+	return inst->shard;
+}
+
+
 static int config_req_handler(void *arg)
 {
 	struct calling_instance *inst = arg;
@@ -1770,6 +2409,14 @@ static void config_update_handler(struct call_config *cfg, void *arg)
 	debug("wcall(%p): call_config: %d ice servers\n",
 	      inst, cfg->iceserverc);
 	
+	if (first) {
+		uint64_t now = tmr_jiffies();
+
+		info("wcall(%p): startup: ready %llu ms after create, "
+		     "%llu ms after init\n",
+		     inst, now - inst->create_ts, now - calling.init_ts);
+	}
+
 	if (first && inst->readyh) {
 		int ver = WCALL_VERSION_3;
 
@@ -1856,25 +2503,23 @@ static void ide_handler(void *arg)
 
 static void instance_destroy(struct calling_instance *inst)
 {
-	if (inst->thread_run) {
-		inst->thread_run = false;
-
-		debug("wcall: joining thread..\n");
+	uintptr_t vuser = inst->wuser;
 
-		pthread_join(inst->tid, NULL);
-		pthread_detach(inst->tid);
-		inst->tid = 0;
-	}
+	/* calling.instances is guarded by calling.lock, not inst->lock;
+	 * unlink first so that lookups stop finding the instance.
+	 */
+	lock_write_get(calling.lock);
+	list_unlink(&inst->le);
+	lock_rel(calling.lock);
 
-	uintptr_t vuser = inst->wuser;
 	msystem_unregister_listener((void*)vuser);
 	tmr_cancel(&inst->tmr_roam);
 
 	list_flush(&inst->wcalls);	
 	list_flush(&inst->ctxl);
+	snap_swap(inst, NULL);
 
 	lock_write_get(inst->lock);
-	list_unlink(&inst->le);
 	list_flush(&inst->ecalls);
 
 	inst->userid = mem_deref(inst->userid);
@@ -1897,8 +2542,12 @@ static void instance_destroy(struct calling_instance *inst)
 	lock_rel(inst->lock);
 
 	inst->lock = mem_deref(inst->lock);
+	inst->snap_lock = mem_deref(inst->snap_lock);
 	inst->netprobe = mem_deref(inst->netprobe);
 
+	wcall_shard_release(inst->shard);
+	inst->shard = -1;
+
 	{
 		struct inst_dtor_entry *ide;
 		ide = mem_zalloc(sizeof(*ide), ide_destructor);
@@ -1958,44 +2607,45 @@ static void msys_mute_handler(bool muted, void *arg)
 }
 
 
-AVS_EXPORT
-WUSER_HANDLE wcall_create_ex(const char *userid,
-			     const char *clientid,
-			     int use_mediamgr,
-			     const char *msys_name,
-			     wcall_ready_h *readyh,
-			     wcall_send_h *sendh,
-			     wcall_sft_req_h *sfth,
-			     wcall_incoming_h *incomingh,
-			     wcall_missed_h *missedh,
-			     wcall_answered_h *answerh,
-			     wcall_estab_h *estabh,
-			     wcall_close_h *closeh,
-			     wcall_metrics_h *metricsh,
-			     wcall_config_req_h *cfg_reqh,
-			     wcall_audio_cbr_change_h *acbrh,
-			     wcall_video_state_change_h *vstateh,
-			     void *arg)
+/* Arguments of wcall_create_ex, for running it on a shard */
+struct create_job {
+	const char *userid;
+	const char *clientid;
+	int use_mediamgr;
+	const char *msys_name;
+	wcall_ready_h *readyh;
+	wcall_send_h *sendh;
+	wcall_sft_req_h *sfth;
+	wcall_incoming_h *incomingh;
+	wcall_missed_h *missedh;
+	wcall_answered_h *answerh;
+	wcall_estab_h *estabh;
+	wcall_close_h *closeh;
+	wcall_metrics_h *metricsh;
+	wcall_config_req_h *cfg_reqh;
+	wcall_audio_cbr_change_h *acbrh;
+	wcall_video_state_change_h *vstateh;
+	void *arg;
+
+	int shard;
+	WUSER_HANDLE wuser;
+};
+
+
+static WUSER_HANDLE instance_create(const struct create_job *job)
 {
 	WUSER_HANDLE wuser = WUSER_INVALID_HANDLE;			
-	char userid_anon[ANON_ID_LEN];
-	char clientid_anon[ANON_CLIENT_LEN];
 	struct calling_instance *inst = NULL;
 	int err;
 
-	if (!str_isset(userid) || !str_isset(clientid))
-		return WUSER_INVALID_HANDLE;
-
-	info(APITAG "wcall: create userid=%s clientid=%s\n",
-	     anon_id(userid_anon, userid),
-	     anon_client(clientid_anon, clientid));
-
 	inst = mem_zalloc(sizeof(*inst), instance_destructor);
 	if (inst == NULL) {
 		err = ENOMEM;
 		goto out;
 	}
 
+	inst->shard = job->shard;
+	inst->create_ts = tmr_jiffies();
 	wuser = inst2wuser(inst);
 
 	err = wcall_marshal_alloc(&inst->marshal);
@@ -2004,7 +2654,7 @@ WUSER_HANDLE wcall_create_ex(const char *userid,
 		goto out;
 	}
 
-	if (use_mediamgr != 0) {
+	if (job->use_mediamgr != 0) {
 		err = mediamgr_alloc(&inst->mm, mm_mcat_changed, inst);
 		if (err) {
 			warning("wcall: init: cannot allocate mediamgr "
@@ -2018,27 +2668,27 @@ WUSER_HANDLE wcall_create_ex(const char *userid,
 						 inst);
 	}
 
-	err = str_dup(&inst->userid, userid);
+	err = str_dup(&inst->userid, job->userid);
 	if (err)
 		goto out;
 	
-	err = str_dup(&inst->clientid, clientid);
+	err = str_dup(&inst->clientid, job->clientid);
 	if (err)
 		goto out;
 
-	inst->readyh = readyh;
-	inst->sendh = sendh;
-	inst->sfth = sfth;
-	inst->incomingh = incomingh;
-	inst->missedh = missedh;
-	inst->answerh = answerh;
-	inst->estabh = estabh;
-	inst->closeh = closeh;
-	inst->metricsh = metricsh;
-	inst->cfg_reqh = cfg_reqh;
-	inst->vstateh = vstateh;
-	inst->acbrh = acbrh;
-	inst->arg = arg;
+	inst->readyh = job->readyh;
+	inst->sendh = job->sendh;
+	inst->sfth = job->sfth;
+	inst->incomingh = job->incomingh;
+	inst->missedh = job->missedh;
+	inst->answerh = job->answerh;
+	inst->estabh = job->estabh;
+	inst->closeh = job->closeh;
+	inst->metricsh = job->metricsh;
+	inst->cfg_reqh = job->cfg_reqh;
+	inst->vstateh = job->vstateh;
+	inst->acbrh = job->acbrh;
+	inst->arg = job->arg;
 
 	inst->conf.econf.timeout_setup = 60000;
 	inst->conf.econf.timeout_term  =  5000;
@@ -2048,8 +2698,12 @@ WUSER_HANDLE wcall_create_ex(const char *userid,
 	if (err)
 		goto out;
 
+	err = lock_alloc(&inst->snap_lock);
+	if (err)
+		goto out;
+
 	uintptr_t vuser = inst->wuser;
-	err = msystem_get(&inst->msys, msys_name, NULL,
+	err = msystem_get(&inst->msys, job->msys_name, NULL,
 			  msys_activate_handler, msys_mute_handler, (void*)vuser);
 	if (err) {
 		warning("wcall(%p): create, cannot init msystem: %m\n",
@@ -2086,23 +2740,107 @@ WUSER_HANDLE wcall_create_ex(const char *userid,
 	lock_write_get(calling.lock);
 	list_append(&calling.instances, &inst->le, inst);
 	lock_rel(calling.lock);
-	
-	//err = async_cfg_wait(inst);
 
 out:
 	if (err) {
+		/* wcall_create_ex releases the shard slot */
+		if (inst)
+			inst->shard = -1;
 		wcall_i_destroy(inst);
 		inst = NULL;
 		wuser = WUSER_INVALID_HANDLE;
 	}
 
 	
-	info(APITAG "wcall: create return inst=%p hnd=0x%08X\n",
-	     inst, wuser);
+	info(APITAG "wcall: create return inst=%p hnd=0x%08X shard=%d\n",
+	     inst, wuser, job->shard);
+	if (inst) {
+		info("wcall(%p): startup: create took %llu ms\n",
+		     inst, tmr_jiffies() - inst->create_ts);
+	}
 	
 	return wuser;
 }
 
+
+static void create_handler(void *arg)
+{
+	struct create_job *job = arg;
+
+	job->wuser = instance_create(job);
+}
+
+
+AVS_EXPORT
+WUSER_HANDLE wcall_create_ex(const char *userid,
+			     const char *clientid,
+			     int use_mediamgr,
+			     const char *msys_name,
+			     wcall_ready_h *readyh,
+			     wcall_send_h *sendh,
+			     wcall_sft_req_h *sfth,
+			     wcall_incoming_h *incomingh,
+			     wcall_missed_h *missedh,
+			     wcall_answered_h *answerh,
+			     wcall_estab_h *estabh,
+			     wcall_close_h *closeh,
+			     wcall_metrics_h *metricsh,
+			     wcall_config_req_h *cfg_reqh,
+			     wcall_audio_cbr_change_h *acbrh,
+			     wcall_video_state_change_h *vstateh,
+			     void *arg)
+{
+	char userid_anon[ANON_ID_LEN];
+	char clientid_anon[ANON_CLIENT_LEN];
+	struct create_job job;
+	int err;
+
+	if (!str_isset(userid) || !str_isset(clientid))
+		return WUSER_INVALID_HANDLE;
+
+	info(APITAG "wcall: create userid=%s clientid=%s\n",
+	     anon_id(userid_anon, userid),
+	     anon_client(clientid_anon, clientid));
+
+	job.userid = userid;
+	job.clientid = clientid;
+	job.use_mediamgr = use_mediamgr;
+	job.msys_name = msys_name;
+	job.readyh = readyh;
+	job.sendh = sendh;
+	job.sfth = sfth;
+	job.incomingh = incomingh;
+	job.missedh = missedh;
+	job.answerh = answerh;
+	job.estabh = estabh;
+	job.closeh = closeh;
+	job.metricsh = metricsh;
+	job.cfg_reqh = cfg_reqh;
+	job.acbrh = acbrh;
+	job.vstateh = vstateh;
+	job.arg = arg;
+	job.wuser = WUSER_INVALID_HANDLE;
+
+	job.shard = wcall_shard_assign();
+	if (job.shard < 0) {
+		create_handler(&job);
+		return job.wuser;
+	}
+
+	/* Create the instance on its shard, so that its mqueue
+	 * and timers belong to the shard's loop.
+	 */
+	err = wcall_shard_call(job.shard, create_handler, &job);
+	if (err) {
+		warning("wcall: create: shard %d failed (%m)\n",
+			job.shard, err);
+	}
+	if (job.wuser == WUSER_INVALID_HANDLE)
+		wcall_shard_release(job.shard);
+
+	return job.wuser;
+}
+
 AVS_EXPORT
 void wcall_set_shutdown_handler(WUSER_HANDLE wuser,
 				wcall_shutdown_h *shuth, void *arg)
@@ -2133,6 +2871,12 @@ void wcall_i_destroy(struct calling_instance *inst)
 }
 
 
+static void destroy_handler(void *arg)
+{
+	wcall_i_destroy(arg);
+}
+
+
 AVS_EXPORT
 void wcall_destroy(WUSER_HANDLE wuser)	
 {
@@ -2147,6 +2891,12 @@ void wcall_destroy(WUSER_HANDLE wuser)
 
 	if (inst->shuth)
 		wcall_marshal_destroy(inst);
+	else if (inst->shard >= 0) {
+		/* From another shard it is queued to the instance's loop */
+		if (EDEADLK == wcall_shard_call(inst->shard,
+						 destroy_handler, inst))
+			wcall_marshal_destroy(inst);
+	}
 	else
 		wcall_i_destroy(inst);
 }
@@ -2777,6 +3527,8 @@ int wcall_debug(struct re_printf *pf, const void *id)
 		return 0;
 	}
 
+	/* Shared with the AVS thread and other readers */
+	lock_read_get(inst->lock);
 	err = re_hprintf(pf, "# calls=%d\n", list_count(&inst->wcalls));
 	LIST_FOREACH(&inst->wcalls, le) {
 		struct wcall *wcall = le->data;
@@ -2788,7 +3540,13 @@ int wcall_debug(struct re_printf *pf, const void *id)
 			err |= re_hprintf(pf, "\t%H\n", wcall->icall->debug,
 					  wcall->icall);
 		}
+		if (wcall->speakers.engine) {
+			err |= re_hprintf(pf, "\t%H", speaker_engine_debug,
+					  wcall->speakers.engine);
+		}
 	}
+	lock_rel(inst->lock);
+	err |= ecall_latency_debug(pf, NULL);
 	
 	return err;
 }
@@ -2837,7 +3595,9 @@ AVS_EXPORT
 int wcall_get_state(WUSER_HANDLE wuser, const char *convid)
 {
 	struct calling_instance *inst;
-	struct wcall *wcall;
+	struct wcall_snap *snap;
+	const struct call_snap *cs;
+	int state;
 
 	inst = wuser2inst(wuser);
 	if (!inst) {
@@ -2846,9 +3606,12 @@ int wcall_get_state(WUSER_HANDLE wuser, const char *convid)
 		return EINVAL;
 	}
 	
-	wcall = wcall_lookup(inst, convid);
+	snap = snap_get(inst);
+	cs = snap_find(snap, convid);
+	state = cs ? cs->state : WCALL_STATE_UNKNOWN;
+	snap_put(snap);
 
-	return wcall ? wcall->state : WCALL_STATE_UNKNOWN;
+	return state;
 }
 
 
@@ -2857,8 +3620,8 @@ void wcall_iterate_state(WUSER_HANDLE wuser,
 			 wcall_state_change_h *stateh, void *arg)	
 {
 	struct calling_instance *inst;
-	struct wcall *wcall;
-	struct le *le;
+	struct wcall_snap *snap;
+	size_t i;
 
 	inst = wuser2inst(wuser);
 	if (!inst) {
@@ -2867,14 +3630,19 @@ void wcall_iterate_state(WUSER_HANDLE wuser,
 		return;
 	}
 
-	lock_write_get(inst->lock);
-	LIST_FOREACH(&inst->wcalls, le) {
-		wcall = le->data;
+	/* No lock is held while calling stateh */
+	snap = snap_get(inst);
+	if (!snap)
+		return;
+
+	for (i = 0; i < snap->callc; ++i) {
+		const struct call_snap *cs = &snap->callv[i];
 
-		if (wcall->state != WCALL_STATE_NONE)
-			stateh(wcall->convid, wcall->state, arg);
+		if (cs->state != WCALL_STATE_NONE)
+			stateh(cs->convid, cs->state, arg);
 	}
-	lock_rel(inst->lock);
+
+	snap_put(snap);
 }
 
 
@@ -2932,13 +3700,59 @@ void wcall_set_participant_changed_handler(WUSER_HANDLE wuser,
 	inst->group.json.arg = arg;
 }
 
+AVS_EXPORT
+void wcall_set_active_speaker_handler(WUSER_HANDLE wuser,
+				      wcall_active_speaker_h *speakerh,
+				      void *arg)
+{
+	struct calling_instance *inst;
+
+	inst = wuser2inst(wuser);
+	if (!inst) {
+		warning("wcall: set_active_speaker_handler: "
+			"invalid wuser=0x%08X\n",
+			wuser);
+		return;
+	}
+
+	info(APITAG "wcall: set_active_speaker_handler %p inst=%p\n",
+	     speakerh, inst);
+
+	inst->speakers.h = speakerh;
+	inst->speakers.arg = arg;
+}
+
+
+AVS_EXPORT
+void wcall_set_participants_handler(WUSER_HANDLE wuser,
+				    wcall_participants_h *partsh,
+				    void *arg)
+{
+	struct calling_instance *inst;
+
+	inst = wuser2inst(wuser);
+	if (!inst) {
+		warning("wcall: set_participants_handler: "
+			"invalid wuser=0x%08X\n",
+			wuser);
+		return;
+	}
+
+	info(APITAG "wcall: set_participants_handler %p inst=%p\n",
+	     partsh, inst);
+
+	inst->group.parts.partsh = partsh;
+	inst->group.parts.arg = arg;
+}
+
 
 AVS_EXPORT
 struct wcall_members *wcall_get_members(WUSER_HANDLE wuser, const char *convid)
 {
 	struct calling_instance *inst;
-	struct wcall_members *members;
-	struct wcall *wcall;
+	struct wcall_members *members = NULL;
+	const struct call_snap *cs;
+	struct wcall_snap *snap;
 
 	inst = wuser2inst(wuser);
 	if (!inst) {
@@ -2947,18 +3761,13 @@ struct wcall_members *wcall_get_members(WUSER_HANDLE wuser, const char *convid)
 		return NULL;
 	}
 
-	wcall = wcall_lookup(inst, convid);
-
-	if (!wcall || !wcall->icall)
-		return NULL;
-	else {
-		int err;
-		
-		err = ICALL_CALLE(wcall->icall, get_members,
-			&members);
+	snap = snap_get(inst);
+	cs = snap_find(snap, convid);
+	if (cs && cs->members)
+		members = members_copy(cs->members);
+	snap_put(snap);
 
-		return err ? NULL : members;
-	}
+	return members;
 }
 
 AVS_EXPORT
@@ -2967,6 +3776,60 @@ void wcall_free_members(struct wcall_members *members)
 	mem_deref(members);
 }
 
+AVS_EXPORT
+int wcall_get_quality_history(WUSER_HANDLE wuser,
+			      const char *convid,
+			      const char *userid,
+			      struct wcall_quality_sample *samplev,
+			      size_t *samplec)
+{
+	struct calling_instance *inst;
+	struct wcall_snap *snap;
+	const struct call_snap *cs;
+	const struct call_qhist *ch = NULL;
+	size_t i, n;
+	int err = 0;
+
+	if (!samplev || !samplec)
+		return EINVAL;
+
+	inst = wuser2inst(wuser);
+	if (!inst) {
+		warning("wcall: get_quality_history: invalid wuser=0x%08X\n",
+			wuser);
+		return EINVAL;
+	}
+
+	/* Served from the snapshot, the history lives on the AVS thread */
+	snap = snap_get(inst);
+	cs = snap_find(snap, convid);
+	for (i = 0; cs && i < cs->qhistc; ++i) {
+		if (!userid
+		    || 0 == str_casecmp(userid, cs->qhistv[i]->userid)) {
+			ch = cs->qhistv[i];
+			break;
+		}
+	}
+
+	if (!cs) {
+		err = ENOENT;
+	}
+	else if (!ch) {
+		*samplec = 0;
+	}
+	else {
+		/* The most recent ones, oldest first */
+		n = min(ch->samplec, *samplec);
+		memcpy(samplev, &ch->samplev[ch->samplec - n],
+		       n * sizeof(*samplev));
+		*samplec = n;
+	}
+
+	snap_put(snap);
+
+	return err;
+}
+
 AVS_EXPORT
 void wcall_enable_privacy(WUSER_HANDLE wuser, int enabled)
 {
@@ -3221,14 +4084,31 @@ void wcall_set_video_handlers(wcall_render_frame_h *render_frame_h,
 }
 
 
+AVS_EXPORT
+void wcall_set_video_budget(uint64_t max_pps)
+{
+	info(APITAG "wcall: set_video_budget: %llu pixels/s\n", max_pps);
+
+	iflow_set_video_budget(max_pps);
+}
+
+
+AVS_EXPORT
+void wcall_set_video_visible(const char *userid,
+			     const char *clientid,
+			     int visible)
+{
+	iflow_set_video_visible(userid, clientid, visible != 0);
+}
+
+
 AVS_EXPORT
 int wcall_i_dce_send(struct wcall *wcall, struct mbuf *mb)
 {
 	return ICALL_CALLE(wcall->icall, dce_send, mb);
 }
 
-AVS_EXPORT
-void wcall_thread_main(int *err, int *initialized)
+static void thread_main(int *err, int *initialized, struct avs_sem *ready)
 {
 	int e;
 
@@ -3238,12 +4118,18 @@ void wcall_thread_main(int *err, int *initialized)
 	e = wcall_init(WCALL_ENV_DEFAULT);
 	if (e) {
 		error("wcall_main: failed to init wcall\n");
+		*err = e;
+		if (ready)
+			avs_sem_post(ready);
 		goto out;
 	}
 
 	*initialized = e == 0;
 	*err = e;
 
+	if (ready)
+		avs_sem_post(ready);
+
 	re_main(NULL);
 
 out:
@@ -3255,6 +4141,13 @@ out:
 }
 
 
+AVS_EXPORT
+void wcall_thread_main(int *err, int *initialized)
+{
+	thread_main(err, initialized, NULL);
+}
+
+
 AVS_EXPORT
 void wcall_set_req_clients_handler(WUSER_HANDLE wuser,
 				   wcall_req_clients_h *reqch)
@@ -3337,23 +4230,37 @@ int wcall_set_proxy(const char *host, int port)
 	return msystem_set_proxy(host, port);
 }
 
-/*
+
 static void *avs_thread(void *arg)
 {
-	wcall_thread_main(&calling.run_err, &calling.run_init);
+	struct avs_sem *ready = arg;
+
+	thread_main(&calling.run_err, &calling.run_init, ready);
 	return NULL;
 }
 
 AVS_EXPORT
 int wcall_run(void)
 {
+	struct avs_sem *ready = NULL;
+	int err;
+
 	calling.run_init = calling.run_err = 0;
 
-	pthread_create(&calling.tid, NULL, avs_thread, NULL);
-	while(!calling.run_init && calling.run_err == 0)
-		usleep(100000);
+	err = avs_sem_alloc(&ready, 0);
+	if (err)
+		return err;
+
+	err = pthread_create(&calling.tid, NULL, avs_thread, ready);
+	if (err) {
+		mem_deref(ready);
+		return err;
+	}
+
+	/* Posted by the thread once wcall_init has returned */
+	avs_sem_wait(ready);
+	mem_deref(ready);
 
 	return calling.run_err;
 }
-*/
 
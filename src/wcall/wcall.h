@@ -76,3 +76,13 @@ void wcall_i_destroy(struct calling_instance *inst);
 void wcall_i_set_mute(int muted);
 void wcall_marshal_destroy(struct calling_instance *inst);
 
+/* Shards */
+typedef void (shard_job_h)(void *arg);
+
+int    wcall_shards_start(size_t n);
+void   wcall_shards_stop(void);
+size_t wcall_shards_count(void);
+int    wcall_shard_assign(void);
+void   wcall_shard_release(int ix);
+int    wcall_shard_call(int ix, shard_job_h *jobh, void *arg);
+
@@ -29,6 +29,8 @@
 
 int acm_test ( int argc, char *argv[] );
 
+int rtpdump_replay(int argc, char *argv[]);
+
 int apm_test(int argc, char *argv[], const char *path);
 
 int resampler_test(int argc, char *argv[], const char *path);
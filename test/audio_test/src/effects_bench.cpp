@@ -0,0 +1,190 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <memory.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <math.h>
+
+#include <re.h>
+#include "avs_audio_effect.h"
+
+#include <sys/time.h>
+
+/*
+ * Benchmarks the vectorized effect kernels against the scalar
+ * reference: real-time factor of both paths and SNR of the vectorized
+ * output relative to the reference, for each effect and sample rate.
+ */
+
+#define BENCH_DURATION_S 20
+#define BENCH_MIN_SNR_DB 40.0
+
+struct bench_effect {
+    const char *name;
+    enum audio_effect type;
+};
+
+static const struct bench_effect effects[] = {
+    {"reverb_1",     AUDIO_EFFECT_REVERB_MIN},
+    {"reverb_2",     AUDIO_EFFECT_REVERB_MID},
+    {"reverb_3",     AUDIO_EFFECT_REVERB_MAX},
+    {"chorus_1",     AUDIO_EFFECT_CHORUS_MIN},
+    {"chorus_2",     AUDIO_EFFECT_CHORUS_MED},
+    {"chorus_3",     AUDIO_EFFECT_CHORUS_MAX},
+    {"auto_tune_1",  AUDIO_EFFECT_AUTO_TUNE_MIN},
+    {"harmonizer_1", AUDIO_EFFECT_HARMONIZER_MIN},
+};
+
+static const int rates[] = {16000, 32000, 48000};
+
+static double now_ms(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (double)now.tv_sec*1000.0 + (double)now.tv_usec/1000.0;
+}
+
+/* Voiced test signal: harmonics with vibrato, amplitude modulation and noise */
+static void make_signal(std::vector<int16_t> &sig, int fs_hz)
+{
+    double phase = 0.0;
+
+    srand(1);
+    for(size_t i = 0; i < sig.size(); i++){
+        double t = (double)i / fs_hz;
+        double f0 = 140.0 + 20.0*sin(2*M_PI*0.5*t);
+        double env = 0.5 + 0.5*sin(2*M_PI*2.0*t);
+        double y = 0.0;
+
+        phase += 2*M_PI*f0/fs_hz;
+        for(int h = 1; h <= 8; h++){
+            y += sin(h*phase) / h;
+        }
+        y = 6000.0*env*y + 200.0*((double)rand()/RAND_MAX - 0.5);
+        sig[i] = (int16_t)y;
+    }
+}
+
+static int run_effect(enum audio_effect type, int fs_hz, bool simd,
+                      const std::vector<int16_t> &in,
+                      std::vector<int16_t> &out, double *ms)
+{
+    struct aueffect *aue;
+    size_t L = fs_hz/100;
+    size_t L_out;
+    double t0;
+    int err;
+
+    aueffect_set_simd(simd);
+
+    err = aueffect_alloc(&aue, type, fs_hz);
+    if (err)
+        return err;
+
+    out.assign(in.size(), 0);
+
+    t0 = now_ms();
+    for(size_t i = 0; i + L <= in.size(); i += L){
+        aueffect_process(aue, &in[i], &out[i], L, &L_out);
+    }
+    *ms = now_ms() - t0;
+
+    mem_deref(aue);
+
+    return 0;
+}
+
+static double snr_db(const std::vector<int16_t> &ref,
+                     const std::vector<int16_t> &test)
+{
+    double sig = 0.0, noise = 0.0;
+
+    for(size_t i = 0; i < ref.size(); i++){
+        double d = (double)ref[i] - (double)test[i];
+
+        sig += (double)ref[i] * ref[i];
+        noise += d*d;
+    }
+    if (noise == 0.0)
+        return INFINITY;
+
+    return 10.0*log10(sig/noise);
+}
+
+#if TARGET_OS_IPHONE
+int effects_bench(int argc, char *argv[], const char *path)
+#else
+int main(int argc, char *argv[])
+#endif
+{
+    double duration_s = BENCH_DURATION_S;
+    int failed = 0;
+
+    for(int args = 1; args < argc; args++){
+        if (strcmp(argv[args], "-dur")==0 && args + 1 < argc){
+            args++;
+            duration_s = atof(argv[args]);
+        }
+    }
+
+    printf("\n------------------------------------------ \n");
+    printf("Audio effect kernels: scalar vs vectorized \n");
+    printf("------------------------------------------ \n\n");
+    printf("%-14s %6s %12s %12s %8s %9s\n",
+           "effect", "fs", "rtf_scalar", "rtf_simd", "speedup", "snr_db");
+
+    for(size_t r = 0; r < sizeof(rates)/sizeof(rates[0]); r++){
+        int fs_hz = rates[r];
+        std::vector<int16_t> in((size_t)(duration_s * fs_hz));
+        std::vector<int16_t> ref, test;
+        double audio_ms = duration_s * 1000.0;
+
+        make_signal(in, fs_hz);
+
+        for(size_t e = 0; e < sizeof(effects)/sizeof(effects[0]); e++){
+            double ms_ref, ms_simd, snr;
+
+            if (run_effect(effects[e].type, fs_hz, false, in, ref, &ms_ref) ||
+                run_effect(effects[e].type, fs_hz, true, in, test, &ms_simd)) {
+                printf("%-14s %6d failed\n", effects[e].name, fs_hz);
+                failed++;
+                continue;
+            }
+
+            snr = snr_db(ref, test);
+            printf("%-14s %6d %12.5f %12.5f %7.2fx %9.1f%s\n",
+                   effects[e].name, fs_hz,
+                   ms_ref/audio_ms, ms_simd/audio_ms,
+                   ms_simd > 0.0 ? ms_ref/ms_simd : 0.0,
+                   snr, snr < BENCH_MIN_SNR_DB ? " FAIL" : "");
+            if (snr < BENCH_MIN_SNR_DB)
+                failed++;
+        }
+    }
+
+    aueffect_set_simd(true);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,237 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <memory.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <math.h>
+
+#include <re.h>
+#include "avs_audio_effect.h"
+
+#include <sys/time.h>
+
+/*
+ * Compares an effect chain, which estimates pitch once per frame, with
+ * running the same effects one after the other, each doing its own
+ * pitch analysis. The SNR shows how far the shared analysis moves the
+ * output of the later stages.
+ */
+
+#define BENCH_DURATION_S 20
+#define BENCH_MAX_STAGES 4
+
+struct bench_chain {
+    const char *name;
+    enum audio_effect effectv[BENCH_MAX_STAGES];
+    size_t effectc;
+};
+
+static const struct bench_chain chains[] = {
+    {"auto_tune+harmonizer",
+     {AUDIO_EFFECT_AUTO_TUNE_MED, AUDIO_EFFECT_HARMONIZER_MIN}, 2},
+    {"shift+cycler+reverb",
+     {AUDIO_EFFECT_PITCH_UP_SHIFT_MED, AUDIO_EFFECT_PITCH_UP_DOWN_MED,
+      AUDIO_EFFECT_REVERB_MID}, 3},
+    {"vocoder+chorus",
+     {AUDIO_EFFECT_VOCODER_MIN, AUDIO_EFFECT_CHORUS_MIN}, 2},
+    {"harmonizer+pace",
+     {AUDIO_EFFECT_HARMONIZER_MED, AUDIO_EFFECT_PACE_DOWN_SHIFT_MIN}, 2},
+};
+
+static const int rates[] = {16000, 48000};
+
+static double now_ms(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (double)now.tv_sec*1000.0 + (double)now.tv_usec/1000.0;
+}
+
+/* Voiced test signal: harmonics with vibrato, amplitude modulation and noise */
+static void make_signal(std::vector<int16_t> &sig, int fs_hz)
+{
+    double phase = 0.0;
+
+    srand(1);
+    for(size_t i = 0; i < sig.size(); i++){
+        double t = (double)i / fs_hz;
+        double f0 = 140.0 + 20.0*sin(2*M_PI*0.5*t);
+        double env = 0.5 + 0.5*sin(2*M_PI*2.0*t);
+        double y = 0.0;
+
+        phase += 2*M_PI*f0/fs_hz;
+        for(int h = 1; h <= 8; h++){
+            y += sin(h*phase) / h;
+        }
+        y = 6000.0*env*y + 200.0*((double)rand()/RAND_MAX - 0.5);
+        sig[i] = (int16_t)y;
+    }
+}
+
+static int run_separate(const struct bench_chain *bc, int fs_hz,
+                        const std::vector<int16_t> &in,
+                        std::vector<int16_t> &res, double *ms)
+{
+    struct aueffect *auev[BENCH_MAX_STAGES];
+    size_t L = fs_hz/100;
+    size_t n_out = 0;
+    int16_t buf[2][48*10*2];
+    double t0;
+    int err = 0;
+
+    memset(auev, 0, sizeof(auev));
+    for(size_t s = 0; s < bc->effectc; s++){
+        err = aueffect_alloc(&auev[s], bc->effectv[s], fs_hz);
+        if (err)
+            goto out;
+    }
+
+    res.assign(in.size() * 2, 0);
+
+    t0 = now_ms();
+    for(size_t i = 0; i + L <= in.size(); i += L){
+        const int16_t *src = &in[i];
+        size_t n = L;
+
+        for(size_t s = 0; s < bc->effectc; s++){
+            int16_t *dst = s + 1 == bc->effectc ? &res[n_out] : buf[s & 1];
+            size_t n_st;
+
+            aueffect_process(auev[s], src, dst, n, &n_st);
+            src = dst;
+            n = n_st;
+        }
+        n_out += n;
+    }
+    *ms = now_ms() - t0;
+    res.resize(n_out);
+
+ out:
+    for(size_t s = 0; s < bc->effectc; s++){
+        mem_deref(auev[s]);
+    }
+
+    return err;
+}
+
+static int run_chained(const struct bench_chain *bc, int fs_hz,
+                       const std::vector<int16_t> &in,
+                       std::vector<int16_t> &out, double *ms)
+{
+    struct aueffect_chain *chain;
+    size_t L = fs_hz/100;
+    size_t n_out = 0;
+    double t0;
+    int err;
+
+    err = aueffect_chain_alloc(&chain, bc->effectv, bc->effectc, fs_hz);
+    if (err)
+        return err;
+
+    out.assign(in.size() * 2, 0);
+
+    t0 = now_ms();
+    for(size_t i = 0; i + L <= in.size(); i += L){
+        size_t n;
+
+        aueffect_chain_process(chain, &in[i], &out[n_out], L, &n);
+        n_out += n;
+    }
+    *ms = now_ms() - t0;
+    out.resize(n_out);
+
+    mem_deref(chain);
+
+    return 0;
+}
+
+static double snr_db(const std::vector<int16_t> &ref,
+                     const std::vector<int16_t> &test)
+{
+    double sig = 0.0, noise = 0.0;
+    size_t n = ref.size() < test.size() ? ref.size() : test.size();
+
+    for(size_t i = 0; i < n; i++){
+        double d = (double)ref[i] - (double)test[i];
+
+        sig += (double)ref[i] * ref[i];
+        noise += d*d;
+    }
+    if (noise == 0.0)
+        return INFINITY;
+
+    return 10.0*log10(sig/noise);
+}
+
+#if TARGET_OS_IPHONE
+int effects_chain_bench(int argc, char *argv[], const char *path)
+#else
+int main(int argc, char *argv[])
+#endif
+{
+    double duration_s = BENCH_DURATION_S;
+    int failed = 0;
+
+    for(int args = 1; args < argc; args++){
+        if (strcmp(argv[args], "-dur")==0 && args + 1 < argc){
+            args++;
+            duration_s = atof(argv[args]);
+        }
+    }
+
+    printf("\n------------------------------------------ \n");
+    printf("Audio effect chains: separate vs shared pitch \n");
+    printf("------------------------------------------ \n\n");
+    printf("%-22s %6s %12s %12s %8s %9s\n",
+           "chain", "fs", "rtf_separate", "rtf_chained", "speedup", "snr_db");
+
+    for(size_t r = 0; r < sizeof(rates)/sizeof(rates[0]); r++){
+        int fs_hz = rates[r];
+        std::vector<int16_t> in((size_t)(duration_s * fs_hz));
+        std::vector<int16_t> ref, test;
+        double audio_ms = duration_s * 1000.0;
+
+        make_signal(in, fs_hz);
+
+        for(size_t c = 0; c < sizeof(chains)/sizeof(chains[0]); c++){
+            double ms_sep, ms_chain;
+
+            if (run_separate(&chains[c], fs_hz, in, ref, &ms_sep) ||
+                run_chained(&chains[c], fs_hz, in, test, &ms_chain)) {
+                printf("%-22s %6d failed\n", chains[c].name, fs_hz);
+                failed++;
+                continue;
+            }
+
+            printf("%-22s %6d %12.5f %12.5f %7.2fx %9.1f\n",
+                   chains[c].name, fs_hz,
+                   ms_sep/audio_ms, ms_chain/audio_ms,
+                   ms_chain > 0.0 ? ms_sep/ms_chain : 0.0,
+                   snr_db(ref, test));
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,491 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Replays a #!rtpplay file written by src/rtpdump through the ACM receive
+ * path (NetEq + decoder), optionally behind a simulated network, and
+ * reports decode CPU, concealment and jitter buffer delay.
+ *
+ * rtpdump_replay -rtp call.rtp [-out out.pcm] [-fs 48000] [-codec opus]
+ *                [-pt 111] [-ssrc N] [-speed 0|1|..] [-nw_type wifi]
+ *                [-lr 5] [-mbl 2] [-file_path dir]
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+#include <sys/time.h>
+
+#include "webrtc/modules/audio_coding/include/audio_coding_module.h"
+
+#include "NwSimulator.h"
+
+#if TARGET_OS_IPHONE
+#include "AudioTest.h"
+#endif
+
+#define RTP_HEADER_IN_BYTES  12
+#define RTPDUMP_HDR_BYTES    16  /* RD_hdr_t as written by src/rtpdump  */
+#define RTPDUMP_REC_BYTES    8   /* length, plen and offset per record  */
+#define STATS_INTERVAL_MS    1000
+#define DRAIN_MS             1000
+
+/**********************************/
+/* rtpdump file reading           */
+/**********************************/
+
+struct replay_packet {
+  uint8_t  buf[MAX_BYTES_PER_PACKET];
+  int      len;
+  uint32_t offset_ms;
+};
+
+struct replay_counters {
+  int records;
+  int rtcp;
+  int truncated;
+  int oversized;
+  int filtered;
+  int fed;
+};
+
+static int ReadDumpHeader(FILE *file)
+{
+  char line[64];
+  uint8_t hdr[RTPDUMP_HDR_BYTES];
+
+  if(fgets(line, sizeof(line), file) == NULL){
+    return -1;
+  }
+  if(strncmp(line, "#!rtpplay", 9) != 0){
+    printf("Not an rtpdump file, magic is %s \n", line);
+    return -1;
+  }
+  if(fread(hdr, sizeof(hdr), 1, file) != 1){
+    return -1;
+  }
+  return 0;
+}
+
+/* returns 1 when a packet was read, 0 at end of file */
+static int ReadDumpRecord(FILE *file, struct replay_packet *pkt,
+                          struct replay_counters *cnt)
+{
+  uint8_t rec[RTPDUMP_REC_BYTES];
+  int length, plen;
+
+  while(fread(rec, sizeof(rec), 1, file) == 1){
+    length = (rec[0] << 8) | rec[1];
+    plen   = (rec[2] << 8) | rec[3];
+    pkt->offset_ms = ((uint32_t)rec[4] << 24) | ((uint32_t)rec[5] << 16) |
+                     ((uint32_t)rec[6] << 8) | (uint32_t)rec[7];
+    length -= RTPDUMP_REC_BYTES;
+    if(length < 0){
+      return 0;
+    }
+    cnt->records++;
+
+    if(plen == 0){
+      /* RTCP */
+      cnt->rtcp++;
+      fseek(file, length, SEEK_CUR);
+      continue;
+    }
+    if(length < plen){
+      /* Recorded with headers only, no payload to decode */
+      cnt->truncated++;
+      fseek(file, length, SEEK_CUR);
+      continue;
+    }
+    if(length > MAX_BYTES_PER_PACKET){
+      cnt->oversized++;
+      fseek(file, length, SEEK_CUR);
+      continue;
+    }
+    if(fread(pkt->buf, 1, length, file) != (size_t)length){
+      return 0;
+    }
+    pkt->len = length;
+    return 1;
+  }
+  return 0;
+}
+
+/* returns the RTP header length including CSRCs and extension, -1 if bad */
+static int ParseRTPheader(const uint8_t *buf, int len,
+                          webrtc::WebRtcRTPHeader *rtp_info)
+{
+  int hlen, cc, pad = 0;
+
+  if(len < RTP_HEADER_IN_BYTES || (buf[0] >> 6) != 2){
+    return -1;
+  }
+  cc = buf[0] & 0x0f;
+  hlen = RTP_HEADER_IN_BYTES + 4 * cc;
+  if(buf[0] & 0x10){
+    if(len < hlen + 4){
+      return -1;
+    }
+    hlen += 4 + 4 * ((buf[hlen + 2] << 8) | buf[hlen + 3]);
+  }
+  if(buf[0] & 0x20){
+    /* padding, the last byte holds its length */
+    pad = buf[len - 1];
+  }
+  if(hlen + pad > len){
+    return -1;
+  }
+
+  rtp_info->header.markerBit      = (buf[1] & 0x80) != 0;
+  rtp_info->header.payloadType    = buf[1] & 0x7f;
+  rtp_info->header.sequenceNumber = (uint16_t)((buf[2] << 8) | buf[3]);
+  rtp_info->header.timestamp      = ((uint32_t)buf[4] << 24) |
+                                    ((uint32_t)buf[5] << 16) |
+                                    ((uint32_t)buf[6] << 8) | buf[7];
+  rtp_info->header.ssrc           = ((uint32_t)buf[8] << 24) |
+                                    ((uint32_t)buf[9] << 16) |
+                                    ((uint32_t)buf[10] << 8) | buf[11];
+  rtp_info->header.paddingLength  = pad;
+  rtp_info->type.Audio.isCNG = false;
+  rtp_info->type.Audio.channel = 1;
+
+  return hlen;
+}
+
+static void AddTime(struct timeval *tot, const struct timeval *start)
+{
+  struct timeval now, res, tmp;
+
+  gettimeofday(&now, NULL);
+  timersub(&now, start, &res);
+  memcpy(&tmp, tot, sizeof(struct timeval));
+  timeradd(&res, &tmp, tot);
+}
+
+using webrtc::AudioFrame;
+using webrtc::AudioCodingModule;
+
+/**********************************/
+/* Main Testing part              */
+/**********************************/
+#if TARGET_OS_IPHONE
+int rtpdump_replay(int argc, char *argv[])
+#else
+int main(int argc, char *argv[])
+#endif
+{
+  AudioFrame audioframe;
+
+  std::string codec = "opus", rtp_file_name, out_file_name, file_path;
+
+  FILE *rtp_file = NULL, *out_file = NULL;
+
+  int args;
+  int32_t sample_rate_hz = 48000;
+  NW_type nw_type = NW_type_clean;
+  int packet_loss_rate = 0, payload_type = 111;
+  float mean_burst_length = 1.0f, speed = 0.0f;
+  uint32_t ssrc = 0;
+  bool ssrc_set = false;
+  int ret;
+
+  args = 0;
+  while(args < argc){
+    if (strcmp(argv[args], "-rtp")==0){
+      args++;
+      rtp_file_name.insert(0,argv[args]);
+    } else if (strcmp(argv[args], "-out")==0){
+      args++;
+      out_file_name.insert(0,argv[args]);
+    } else if (strcmp(argv[args], "-codec")==0){
+      args++;
+      codec = argv[args];
+    } else if (strcmp(argv[args], "-fs")==0){
+      args++;
+      sample_rate_hz = atol(argv[args]);
+    } else if (strcmp(argv[args], "-pt")==0){
+      args++;
+      payload_type = atol(argv[args]);
+    } else if (strcmp(argv[args], "-ssrc")==0){
+      args++;
+      ssrc = (uint32_t)strtoul(argv[args], NULL, 0);
+      ssrc_set = true;
+    } else if (strcmp(argv[args], "-speed")==0){
+      args++;
+      speed = atof(argv[args]);
+    } else if (strcmp(argv[args], "-nw_type")==0){
+      args++;
+      if(strcmp(argv[args],"wifi") == 0){
+        nw_type = NW_type_wifi;
+      } else if(strcmp(argv[args],"sawtooth") == 0){
+        nw_type = NW_type_sawtooth;
+      } else {
+        nw_type = NW_type_clean;
+      }
+    } else if (strcmp(argv[args], "-lr")==0){
+      args++;
+      packet_loss_rate = atol(argv[args]);
+    } else if (strcmp(argv[args], "-mbl")==0){
+      args++;
+      mean_burst_length = atof(argv[args]);
+    } else if (strcmp(argv[args], "-file_path")==0){
+      args++;
+      file_path.insert(0,argv[args]);
+    }
+    args++;
+  }
+
+  if(file_path.length() && file_path[file_path.length()-1] != '/'){
+    file_path = file_path + "/";
+  }
+  if(rtp_file_name.length() == 0){
+    printf("No rtp file specified ! \n");
+    return -1;
+  }
+  rtp_file_name = file_path + rtp_file_name;
+  if(out_file_name.length()){
+    out_file_name = file_path + out_file_name;
+  }
+
+  rtp_file = fopen(rtp_file_name.c_str(),"rb");
+  if(rtp_file == NULL){
+    printf("Could not open %s for reading \n", rtp_file_name.c_str());
+    return -1;
+  }
+  if(ReadDumpHeader(rtp_file) < 0){
+    printf("Could not read rtpdump header from %s \n", rtp_file_name.c_str());
+    fclose(rtp_file);
+    return -1;
+  }
+  if(out_file_name.length()){
+    out_file = fopen(out_file_name.c_str(),"wb");
+    if(out_file == NULL){
+      printf("Could not open %s for writing \n", out_file_name.c_str());
+      fclose(rtp_file);
+      return -1;
+    }
+  }
+
+  std::unique_ptr<AudioCodingModule> acm(AudioCodingModule::Create(0));
+
+  acm->InitializeReceiver();
+  webrtc::CodecInst my_codec_param;
+  bool codec_found = false;
+  int numberOfCodecs = acm->NumberOfCodecs();
+  for( int i = 0; i < numberOfCodecs; i++ ){
+    ret = acm->Codec( i, &my_codec_param);
+    if(strcmp(my_codec_param.plname,codec.c_str()) == 0){
+      codec_found = true;
+      break;
+    }
+  }
+  if( !codec_found ){
+    printf("Could not find codec %s \n", codec.c_str());
+    fclose(rtp_file);
+    if(out_file){
+      fclose(out_file);
+    }
+    return -1;
+  }
+  /* Decode with the payload type that was negotiated in the call */
+  my_codec_param.pltype = payload_type;
+  ret = acm->RegisterReceiveCodec(my_codec_param);
+  if( ret < 0 ){
+    printf("acm->RegisterReceiveCodec returned %d \n", ret);
+  }
+
+  NwSimulator *nws = new NwSimulator();
+  nws->Init(0, packet_loss_rate, mean_burst_length, nw_type, file_path);
+
+  printf("\n--- Running rtpdump replay:  --- \n");
+  printf("Rtp File                    : %s \n", rtp_file_name.c_str());
+  printf("Output File                 : %s \n", out_file ? out_file_name.c_str() : "none");
+  printf("Codec                       : %s pt %d \n", codec.c_str(), payload_type);
+  printf("Fs                          : %d Hz \n", sample_rate_hz);
+  printf("NW type                     : %s \n", NwSimulator::NWtype2Str(nw_type));
+  printf("Additional packet loss      : %d %% \n", packet_loss_rate);
+  if(speed > 0.0f){
+    printf("Speed                       : %.2fx real time \n", speed);
+  } else {
+    printf("Speed                       : as fast as possible \n");
+  }
+
+  /********************************************/
+  /* Replay                                   */
+  /********************************************/
+  struct replay_packet pkt;
+  struct replay_counters cnt;
+  struct timeval startTime, wallStart, decTime;
+  webrtc::WebRtcRTPHeader rtp_info;
+  webrtc::NetworkStatistics inCallStats;
+  uint8_t RTPpacketBuf[MAX_BYTES_PER_PACKET];
+  int num_frames = 0, num_stats = 0, bytesIn, hlen;
+  int64_t expand_sum = 0, buf_sum = 0;
+  int buf_max = 0, pref_buf = 0;
+  int32_t timeMs = 0, endMs = -1;
+  bool have_packet, eof = false;
+
+  memset(&cnt, 0, sizeof(cnt));
+  memset(&rtp_info, 0, sizeof(rtp_info));
+  timerclear(&decTime);
+  gettimeofday(&wallStart, NULL);
+
+  have_packet = ReadDumpRecord(rtp_file, &pkt, &cnt) > 0;
+  eof = !have_packet;
+  /* Start the clock at the first packet rather than at dump start */
+  if(have_packet){
+    timeMs = (int32_t)pkt.offset_ms;
+  }
+  int32_t firstMs = timeMs;
+
+  while(!eof || timeMs < endMs){
+
+    /* Hand everything sent up to now to the network */
+    while(have_packet && (int32_t)pkt.offset_ms <= timeMs){
+      hlen = ParseRTPheader(pkt.buf, pkt.len, &rtp_info);
+      if(hlen < 0 || rtp_info.header.payloadType != payload_type){
+        cnt.filtered++;
+      } else {
+        if(!ssrc_set){
+          ssrc = rtp_info.header.ssrc;
+          ssrc_set = true;
+        }
+        if(rtp_info.header.ssrc != ssrc){
+          cnt.filtered++;
+        } else {
+          nws->Add_Packet(pkt.buf, pkt.len, timeMs - firstMs);
+          cnt.fed++;
+        }
+      }
+      have_packet = ReadDumpRecord(rtp_file, &pkt, &cnt) > 0;
+      if(!have_packet){
+        eof = true;
+        endMs = timeMs + DRAIN_MS;
+      }
+    }
+
+    /* Get arrived packets from Network Queue */
+    bytesIn = nws->Get_Packet(RTPpacketBuf, timeMs - firstMs);
+    while(bytesIn > 0){
+      hlen = ParseRTPheader(RTPpacketBuf, bytesIn, &rtp_info);
+      if(hlen > 0){
+        gettimeofday(&startTime, NULL);
+        ret = acm->IncomingPacket(RTPpacketBuf + hlen,
+                                  bytesIn - hlen - rtp_info.header.paddingLength,
+                                  rtp_info);
+        AddTime(&decTime, &startTime);
+        if( ret < 0 ){
+          printf("acm->IncomingPacket returned %d \n", ret);
+        }
+      }
+      bytesIn = nws->Get_Packet(RTPpacketBuf, timeMs - firstMs);
+    }
+
+    /* Play out a frame every 10 ms */
+    if((timeMs - firstMs) % 10 == 0){
+      gettimeofday(&startTime, NULL);
+      ret = acm->PlayoutData10Ms(sample_rate_hz, &audioframe);
+      AddTime(&decTime, &startTime);
+      if( ret < 0 ){
+        printf("acm->PlayoutData10Ms returned %d \n", ret);
+      }
+
+      if(out_file){
+        if(audioframe.num_channels_ == 2){
+          int16_t vec[ 48 * 10 ];
+          for( size_t j = 0; j < audioframe.samples_per_channel_; j++){
+            vec[ j ] = audioframe.data_[ 2*j ];
+          }
+          fwrite(vec, sizeof(int16_t), audioframe.samples_per_channel_, out_file);
+        } else {
+          fwrite(audioframe.data_, sizeof(int16_t),
+                 audioframe.samples_per_channel_ * audioframe.num_channels_, out_file);
+        }
+      }
+      num_frames++;
+
+      /* NetEq rates cover the interval since the previous query */
+      if((num_frames * 10) % STATS_INTERVAL_MS == 0){
+        acm->GetNetworkStatistics(&inCallStats);
+        expand_sum += inCallStats.currentExpandRate;
+        buf_sum += inCallStats.currentBufferSize;
+        if(inCallStats.currentBufferSize > buf_max){
+          buf_max = inCallStats.currentBufferSize;
+        }
+        pref_buf = inCallStats.preferredBufferSize;
+        num_stats++;
+      }
+
+      /* Pace against the wall clock when replaying in (scaled) real time */
+      if(speed > 0.0f){
+        struct timeval now, res;
+        int64_t due_us, wall_us;
+
+        gettimeofday(&now, NULL);
+        timersub(&now, &wallStart, &res);
+        wall_us = (int64_t)res.tv_sec * 1000000 + res.tv_usec;
+        due_us = (int64_t)((float)(num_frames * 10000) / speed);
+        if(due_us > wall_us){
+          usleep((useconds_t)(due_us - wall_us));
+        }
+      }
+    }
+    timeMs++;
+  }
+
+  /********************************************/
+  /* Report                                   */
+  /********************************************/
+  float ms_tot = (float)decTime.tv_sec*1000.0 + (float)decTime.tv_usec/1000.0;
+  int audio_ms = 10 * num_frames;
+
+  printf("Replay finished processed %d frames \n", num_frames);
+  printf("Records                     = %d (%d rtcp, %d headers only, %d oversized) \n",
+         cnt.records, cnt.rtcp, cnt.truncated, cnt.oversized);
+  printf("Packets                     = %d fed, %d filtered, ssrc 0x%08x \n",
+         cnt.fed, cnt.filtered, ssrc);
+  printf("Network lost                = %d of %d packets \n",
+         nws->GetLostPacketCount(), nws->GetPacketCount());
+  printf("Decode CPU                  = %.1f ms for %d ms audio, %.2f %% of real time \n",
+         ms_tot, audio_ms, audio_ms ? 100*ms_tot/(float)audio_ms : 0.0f);
+  if(num_stats > 0){
+    printf("Concealment (expand rate)   = %.2f %% \n",
+           100*(float)expand_sum/(float)num_stats/(float)(1 << 14));
+    printf("Buffer delay                = %.1f ms avg, %d ms max \n",
+           (float)buf_sum/(float)num_stats, buf_max);
+    printf("Preferred buffer delay      = %d ms \n", pref_buf);
+  }
+  acm->GetNetworkStatistics(&inCallStats);
+  printf("NetEQ currentPacketLossRate = %.2f %% \n", 100*(float)inCallStats.currentPacketLossRate/(float)(1 << 14));
+  printf("NetEQ currentDiscardRate    = %.2f %% \n", 100*(float)inCallStats.currentDiscardRate/(float)(1 << 14));
+  printf("NetEQ currentAccelerateRate = %.2f %% \n", 100*(float)inCallStats.currentAccelerateRate/(float)(1 << 14));
+  printf("-------------------\n\n");
+
+  fclose(rtp_file);
+  if(out_file){
+    fclose(out_file);
+  }
+  delete nws;
+
+  return 0;
+}
@@ -19,28 +19,39 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
 
 NwSimulator::NwSimulator()
 {
-    memset(packets_,0, sizeof(packets_));
-    read_idx_ = 0;
-    write_idx_ = 0;
-    packets_in_queue_ = 0;
     xtra_loss_rate_ = 0;
     avg_burst_length_ = 1.0f;
     packet_size_ms_ = 0;
     lost_packets_ = 0;
     num_packets_ = 0;
+    dropped_packets_ = 0;
+    reordered_packets_ = 0;
     start_time_offset_ = -1;
     network_ = NW_type_clean;
     jitter_file_ = NULL;
     log_file_ = NULL;
+    bw_kbps_ = 0;
+    max_queue_ms_ = 0;
+    link_free_us_ = 0;
+    reorder_pct_ = 0;
+    reorder_delay_ms_ = 0;
+    trace_idx_ = 0;
+    trace_left_ = TRACE_MTU_BYTES;
+    trace_base_ms_ = -1;
+    trace_period_ms_ = 0;
 }
 
 NwSimulator::~NwSimulator()
 {
+  if(jitter_file_){
+    fclose(jitter_file_);
+  }
 #ifdef NWQ_DBG
-  fclose(log_file);
+  fclose(log_file_);
 #endif
 }
 
@@ -52,7 +63,9 @@ int NwSimulator::Setup_Jitter_File(
     if(jitter_file_){
         fclose(jitter_file_);
     }
-    if(network_ == NW_type_clean){
+    if(network_ == NW_type_clean || network_ == NW_type_4G ||
+       network_ == NW_type_3G || network_ == NW_type_2G){
+        /* Cellular links are modelled by their bandwidth, see Init */
         jitter_file_ = NULL;
     } else if(network_ == NW_type_wifi){
         std::string tmp = file_path_ + "Jitter_wifi.dat";
@@ -76,17 +89,32 @@ int NwSimulator::Init(
   std::string file_path
 )
 {
-  int i, ret;
+  int ret;
   
-  read_idx_ = 0;
-  write_idx_ = 0;
-  packets_in_queue_ = 0;
+  /* Nothing carries over from a previous run */
+  packets_.clear();
+  lost_packets_ = 0;
+  num_packets_ = 0;
+  dropped_packets_ = 0;
+  reordered_packets_ = 0;
+  start_time_offset_ = -1;
+  bw_kbps_ = 0;
+  max_queue_ms_ = 0;
+  link_free_us_ = 0;
+  reorder_pct_ = 0;
+  reorder_delay_ms_ = 0;
+  trace_.clear();
+  trace_idx_ = 0;
+  trace_left_ = TRACE_MTU_BYTES;
+  trace_base_ms_ = -1;
+  trace_period_ms_ = 0;
+
   xtra_loss_rate_ = xtra_loss_rate;
   xtra_prev_lost_ = false;
   if(avg_burst_length > 1.0f){
     avg_burst_length_ = avg_burst_length;
   }else {
-    avg_burst_length = 1.0f;
+    avg_burst_length_ = 1.0f;
   }
   packet_size_ms_ = packet_size_ms;
   network_ = network;
@@ -98,8 +126,18 @@ int NwSimulator::Init(
       printf("No Jitter file found for chosen nw and packet size");
   }
     
-  for( i = 0; i < NUM_PACKETS; i++ ){
-    packets_[i].data_length = -1;
+  switch(network){
+    case NW_type_4G:
+      SetBandwidth(8000, 200);
+      break;
+    case NW_type_3G:
+      SetBandwidth(1000, 500);
+      break;
+    case NW_type_2G:
+      SetBandwidth(150, 1000);
+      break;
+    default:
+      break;
   }
 #ifdef NWQ_DBG
   if( log_file_ == NULL ) {
@@ -110,13 +148,115 @@ int NwSimulator::Init(
   return(0);
 }
 
+void NwSimulator::SetBandwidth(
+  int bw_kbps,
+  int max_queue_ms
+)
+{
+  bw_kbps_ = bw_kbps;
+  max_queue_ms_ = max_queue_ms;
+  link_free_us_ = 0;
+}
+
+void NwSimulator::SetReordering(
+  int pct,
+  int delay_ms
+)
+{
+  reorder_pct_ = pct;
+  reorder_delay_ms_ = std::max(delay_ms, 1);
+}
+
+int NwSimulator::LoadTrace(
+  std::string trace_file
+)
+{
+  FILE *file;
+  int t;
+
+  file = fopen(trace_file.c_str(),"rt");
+  if(file == NULL){
+    printf("Could not open trace %s \n", trace_file.c_str());
+    return -1;
+  }
+  trace_.clear();
+  while(fscanf(file, "%d", &t) == 1){
+    trace_.push_back(t);
+  }
+  fclose(file);
+
+  if(trace_.empty()){
+    return -1;
+  }
+  trace_idx_ = 0;
+  trace_left_ = TRACE_MTU_BYTES;
+  trace_base_ms_ = -1;
+  trace_period_ms_ = std::max(trace_.back(), 1);
+
+  return 0;
+}
+
+int NwSimulator::Trace_Time()
+{
+  return trace_base_ms_ + trace_[trace_idx_];
+}
+
+void NwSimulator::Trace_Next()
+{
+  trace_left_ = TRACE_MTU_BYTES;
+  if(++trace_idx_ == trace_.size()){
+    trace_idx_ = 0;
+    trace_base_ms_ += trace_period_ms_;
+  }
+}
+
+/* Time the last byte leaves the bottleneck, -1 if the queue overflows */
+int NwSimulator::Link_Delivery_Time(
+  int sndTime_ms,
+  int numBytes
+)
+{
+  if(!trace_.empty()){
+    if(trace_base_ms_ == -1){
+      trace_base_ms_ = sndTime_ms;
+    }
+    /* Opportunities while the link was idle are gone */
+    while(Trace_Time() < sndTime_ms){
+      Trace_Next();
+    }
+    if(max_queue_ms_ > 0 && Trace_Time() - sndTime_ms > max_queue_ms_){
+      return -1;
+    }
+    while(numBytes > trace_left_){
+      numBytes -= trace_left_;
+      Trace_Next();
+    }
+    trace_left_ -= numBytes;
+    return Trace_Time();
+  }
+
+  if(bw_kbps_ > 0){
+    int64_t snd_us = (int64_t)sndTime_ms * 1000;
+    int64_t start_us = std::max(snd_us, link_free_us_);
+
+    if(max_queue_ms_ > 0 && start_us - snd_us > (int64_t)max_queue_ms_ * 1000){
+      return -1;
+    }
+    /* kbps is bits per ms */
+    link_free_us_ = start_us + (int64_t)numBytes * 8 * 1000 / bw_kbps_;
+    return (int)((link_free_us_ + 999) / 1000);
+  }
+
+  return sndTime_ms;
+}
+
 int NwSimulator::Add_Packet( /* returns -1 if Queue is full otherwise 0 */
   unsigned char* packet,     /* (I) RTP packet */
   int            numBytes,   /* (I) length of RTP packet */
   int            sndTime_ms  /* (I) Time when send in ms */
 )
 {
-  int prev_write_idx, src_idx, dst_idx, num_packets_to_move, i, rcvTime_ms;
+  int rcvTime_ms;
   int32_t Jitter, time, jit;
 
   if(start_time_offset_ == -1){
@@ -158,61 +298,54 @@ int NwSimulator::Add_Packet( /* returns -1 if Queue is full otherwise 0 */
       return(0);
   }
     
-  rcvTime_ms = sndTime_ms + Jitter;
-	
 #ifdef NWQ_DBG
-  fprintf(log_file,"Time = %d ms : Add_Packet_to_NW_Queue called rcvTime_ms = %d numBytes = %d \n", sndTime_ms, rcvTime_ms, numBytes);
-  fprintf(log_file,"packets_in_queue = %d write_idx = %d read_idx = %d \n", packets_in_queue_, write_idx_, read_idx_);
+  fprintf(log_file_,"Time = %d ms : Add_Packet_to_NW_Queue called Jitter = %d numBytes = %d \n", sndTime_ms, Jitter, numBytes);
+  fprintf(log_file_,"packets_in_queue = %zu \n", packets_.size());
 #endif
 	
   if( numBytes <= 0 ){
     /* DTX mode or packet loss */
     return(0);
   }
-  if (packets_in_queue_ == NUM_PACKETS) {
-#ifdef NWQ_DBG
-    fprintf(log_file_,"NW Queue full \n");
-#endif
+  if( numBytes > MAX_BYTES_PER_PACKET ){
     return(-1);
   }
-  if(packets_[write_idx_].data_length != -1){
+  if (packets_.size() == NUM_PACKETS) {
 #ifdef NWQ_DBG
-    fprintf(log_file,"NW Queue error \n");
+    fprintf(log_file_,"NW Queue full \n");
 #endif
     return(-1);
   }
     
-  /* Check if packet reordering happened */
-  num_packets_to_move = 0;
-  prev_write_idx = write_idx_;
-  for( i = 0; i < packets_in_queue_; i++ ){
-    prev_write_idx = (prev_write_idx - 1) & (NUM_PACKETS -1);
-    if(packets_[prev_write_idx].rcv_time_ms <= rcvTime_ms){
-      break;
-    }
+  /* Queueing at the bottleneck comes before the path jitter */
+  rcvTime_ms = Link_Delivery_Time(sndTime_ms, numBytes);
+  if( rcvTime_ms < 0 ){
+    dropped_packets_++;
+    return(0);
+  }
+  rcvTime_ms += Jitter;
+    
+  if( reorder_pct_ > 0 && (rand() % 100) < reorder_pct_ ){
+    rcvTime_ms += 1 + rand() % reorder_delay_ms_;
+  }
+    
+  /* Keep the queue in arrival order, later packets may overtake */
+  std::deque<NW_Queue_element>::iterator it = packets_.end();
+  while( it != packets_.begin() && (it - 1)->rcv_time_ms > rcvTime_ms ){
+    --it;
+  }
+  if( it != packets_.end() ){
 #ifdef NWQ_DBG
-    fprintf(log_file,"Packet reordering !! \n");
+    fprintf(log_file_,"Packet reordering !! \n");
 #endif
-    num_packets_to_move++;
-  }
-  /* Move the packets that were overtaken by the newly arrived */
-  src_idx = (write_idx_ -1) & (NUM_PACKETS-1);
-  dst_idx = (src_idx + 1) & (NUM_PACKETS-1);
-  for( i = 0; i < num_packets_to_move; i++){
-      memcpy( &packets_[dst_idx],&packets_[src_idx], sizeof(struct NW_Queue_element));
-      src_idx = (src_idx-1) & (NUM_PACKETS-1);
-      dst_idx = (dst_idx-1) & (NUM_PACKETS-1);
+    reordered_packets_++;
   }
-  /* Copy Packet into Queue */
-  dst_idx = (write_idx_ - num_packets_to_move) & (NUM_PACKETS-1);
-  memcpy( packets_[dst_idx].data, packet, numBytes*sizeof(unsigned char));
-  packets_[dst_idx].data_length = numBytes;
-  packets_[dst_idx].rcv_time_ms = rcvTime_ms;
-  write_idx_ = (write_idx_+1) & (NUM_PACKETS-1);
-  packets_in_queue_++;
+  it = packets_.insert(it, NW_Queue_element());
+  it->data.assign(packet, packet + numBytes);
+  it->rcv_time_ms = rcvTime_ms;
     
 #ifdef NWQ_DBG
-  fprintf(log_file_,"Next arrival = %d ms \n", packets_[read_idx_].rcv_time_ms);
+  fprintf(log_file_,"Next arrival = %d ms \n", packets_.front().rcv_time_ms);
 #endif
   return(0);
 }
@@ -221,41 +354,49 @@ int NwSimulator::Get_Packet( /* (O) returns -1 if no more packets otherwise leng
   unsigned char* packet,   /* (O) Pointer to RTP packet                    */
   int            time_ms   /* (I) Get Packets recieved up untill this time */
 )
+{
+  return Get_Packet(packet, MAX_BYTES_PER_PACKET, time_ms);
+}
+
+int NwSimulator::Get_Packet( /* (O) returns -1 if no more packets otherwise length of packet */
+  unsigned char* packet,   /* (O) Pointer to RTP packet                    */
+  int            maxBytes, /* (I) Size of packet buffer                    */
+  int            time_ms   /* (I) Get Packets recieved up untill this time */
+)
 {
   int numBytes;
 
 #ifdef NWQ_DBG
     fprintf(log_file_,"Time = %d ms : Get_Packet_from_NW_Queue called \n", time_ms);
-    fprintf(log_file_,"packets_in_queue = %d write_idx = %d read_idx = %d \n", packets_in_queue_, write_idx_, read_idx_);
+    fprintf(log_file_,"packets_in_queue = %zu \n", packets_.size());
 #endif
     
-  if( packets_in_queue_ == 0){
+  while( !packets_.empty() && packets_.front().rcv_time_ms <= time_ms ){
+    numBytes = (int)packets_.front().data.size();
+    if(numBytes > maxBytes){
 #ifdef NWQ_DBG
-    fprintf(log_file_,"NW Queue empty !! \n");
+      fprintf(log_file_,"Error packet too large for buffer !! %d \n", numBytes);
 #endif
-    return(-1);
-  }
-  if( packets_[read_idx_].rcv_time_ms <= time_ms ){
-    numBytes = packets_[read_idx_].data_length;
-    if(numBytes < 0 || numBytes > MAX_BYTES_PER_PACKET){
-#ifdef NWQ_DBG
-      fprintf(log_file_,"Error invalid number of Bytes !! %d \n", numBytes);
-#endif
-      return(-1);
+      /* Drop it and move on to the next one rather than block the queue */
+      packets_.pop_front();
+      dropped_packets_++;
+      continue;
     }
 
-    memcpy( packet, packets_[read_idx_].data, numBytes*sizeof(unsigned char));
-    packets_[read_idx_].data_length = -1;
-    packets_[read_idx_].rcv_time_ms = -1;
-    read_idx_ = (read_idx_ + 1) & (NUM_PACKETS -1);
-    packets_in_queue_--;
+    memcpy( packet, &packets_.front().data[0], numBytes*sizeof(unsigned char));
+    packets_.pop_front();
 #ifdef NWQ_DBG
     fprintf(log_file_,"Packet with %d bytes ready !! \n", numBytes);
 #endif
     return(numBytes);
-  } else{
-    return(-1);
   }
+
+#ifdef NWQ_DBG
+  if( packets_.empty() ){
+    fprintf(log_file_,"NW Queue empty !! \n");
+  }
+#endif
+  return(-1);
 }
 
 int NwSimulator::GetLostPacketCount()
@@ -268,6 +409,16 @@ int NwSimulator::GetPacketCount()
 	return(num_packets_);
 }
 
+int NwSimulator::GetDroppedPacketCount()
+{
+    return(dropped_packets_);
+}
+
+int NwSimulator::GetReorderedPacketCount()
+{
+    return(reordered_packets_);
+}
+
 const char *NwSimulator::NWtype2Str(NW_type nw_type)
 {
     switch (nw_type) {
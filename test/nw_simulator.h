@@ -18,9 +18,12 @@
 #include <stdio.h>
 #include <stdio.h>
 #include <string>
+#include <deque>
+#include <vector>
 
-#define MAX_BYTES_PER_PACKET 616 /* 64 kbps @ 60 ms packets + header */
-#define NUM_PACKETS          (1 << 9)
+#define MAX_BYTES_PER_PACKET 1500 /* MTU, video packets are up to this size */
+#define NUM_PACKETS          (1 << 12)
+#define TRACE_MTU_BYTES      1500 /* bytes per delivery opportunity in a trace */
 //#define NWQ_DBG
 
 enum NW_type {
@@ -33,8 +36,7 @@ enum NW_type {
 };
 
 struct NW_Queue_element {
-  unsigned char data[ MAX_BYTES_PER_PACKET ];
-  int data_length;
+  std::vector<unsigned char> data;
   int rcv_time_ms;
 };
 
@@ -52,6 +54,24 @@ public:
          std::string file_path
     );
     
+    /* Serialize packets at bw_kbps, drop those that would queue longer than max_queue_ms */
+    void SetBandwidth(
+         int bw_kbps,
+         int max_queue_ms
+    );
+    
+    /* Hold back pct % of the packets by up to delay_ms */
+    void SetReordering(
+         int pct,
+         int delay_ms
+    );
+    
+    /* Replay a link trace, one line per ms timestamp at which TRACE_MTU_BYTES
+       can be delivered (mahimahi format). The trace is looped. */
+    int LoadTrace(
+         std::string trace_file
+    );
+    
     int Add_Packet( /* returns -1 if Queue is full otherwise 0 */
         unsigned char* packet,     /* (I) RTP packet */
         int            numBytes,   /* (I) length of RTP packet */
@@ -63,28 +83,57 @@ public:
         int            time_ms   /* (I) Get Packets recieved up untill this time */
     );
     
+    /* Packets larger than maxBytes are dropped and counted, and the next
+       packet that is due is returned instead */
+    int Get_Packet( /* (O) returns -1 if no more packets otherwise length of packet */
+        unsigned char* packet,   /* (O) Pointer to RTP packet                    */
+        int            maxBytes, /* (I) Size of packet buffer                    */
+        int            time_ms   /* (I) Get Packets recieved up untill this time */
+    );
+    
     int GetLostPacketCount();
     
     int GetPacketCount();
     
+    int GetDroppedPacketCount();
+    
+    int GetReorderedPacketCount();
+    
     static const char *NWtype2Str(NW_type nw_type);
     
 private:
     int Setup_Jitter_File(bool add_offset);
     
-    struct NW_Queue_element packets_[ NUM_PACKETS ];
-    int read_idx_;
-    int write_idx_;
-    int packets_in_queue_;
+    int Link_Delivery_Time(int sndTime_ms, int numBytes);
+    int Trace_Time();
+    void Trace_Next();
+    
+    std::deque<NW_Queue_element> packets_;
     int xtra_loss_rate_;
     float avg_burst_length_;
     bool xtra_prev_lost_;
     int packet_size_ms_;
     int lost_packets_;
     int num_packets_;
+    int dropped_packets_;
+    int reordered_packets_;
     int start_time_offset_;
     NW_type network_;
     std::string file_path_;
     FILE *jitter_file_;
     FILE *log_file_;
+    
+    /* Bottleneck link */
+    int bw_kbps_;
+    int max_queue_ms_;
+    int64_t link_free_us_;
+    
+    int reorder_pct_;
+    int reorder_delay_ms_;
+    
+    std::vector<int> trace_;
+    size_t trace_idx_;
+    int trace_left_;
+    int trace_base_ms_;
+    int trace_period_ms_;
 };
@@ -19,6 +19,8 @@ TEST_SRCS	+= test_chunk.cpp
 #TEST_SRCS	+= test_confpos.cpp
 TEST_SRCS	+= test_cookie.cpp
 #TEST_SRCS	+= test_dce.cpp
+TEST_SRCS	+= test_dce_sendq.cpp
+TEST_SRCS	+= test_dce_slot.cpp
 TEST_SRCS	+= test_dict.cpp
 #TEST_SRCS	+= test_dtls.cpp
 #TEST_SRCS	+= test_ecall.cpp
@@ -28,27 +30,34 @@ TEST_SRCS	+= test_http.cpp
 TEST_SRCS	+= test_jzon.cpp
 #TEST_SRCS	+= test_kase.cpp
 TEST_SRCS	+= test_libre.cpp
+TEST_SRCS	+= test_log.cpp
 TEST_SRCS	+= test_login.cpp
 #TEST_SRCS	+= test_media.cpp
 #TEST_SRCS	+= test_media_crypto.cpp
 #TEST_SRCS	+= test_media_dual.cpp
 #TEST_SRCS	+= test_mediastats.cpp
 TEST_SRCS	+= test_msystem.cpp
-#TEST_SRCS	+= test_netprobe.cpp
+TEST_SRCS	+= test_netprobe.cpp
 TEST_SRCS	+= test_network.cpp
 TEST_SRCS	+= test_nevent.cpp
+TEST_SRCS	+= test_nw_simulator.cpp
 #TEST_SRCS	+= test_packetqueue.cpp
 #TEST_SRCS	+= test_resampler.cpp
 TEST_SRCS	+= test_rest.cpp
+TEST_SRCS	+= test_sdp.cpp
+TEST_SRCS	+= test_speaker.cpp
 #TEST_SRCS	+= test_srtp.cpp
 TEST_SRCS	+= test_string.cpp
 #TEST_SRCS	+= test_turn.cpp
 TEST_SRCS	+= test_uuid.cpp
 #TEST_SRCS	+= test_vidcodec.cpp
+TEST_SRCS	+= test_video_budget.cpp
 #TEST_SRCS	+= test_vie.cpp
 #TEST_SRCS	+= test_voe.cpp
 #TEST_SRCS	+= test_vp8_impl.cpp
 #TEST_SRCS	+= test_wcall.cpp
+TEST_SRCS	+= test_wcall_parts.cpp
+TEST_SRCS	+= test_wcall_shard.cpp
 TEST_SRCS	+= test_zapi.cpp
 TEST_SRCS	+= test_ztime.cpp
 
@@ -780,3 +780,281 @@ TEST_F(Dce, alloc_after_close)
 	ASSERT_EQ(0, B.co[0].n_received);
 
 }
+
+
+/*
+ * Many associations in parallel: every pair connects, opens a channel
+ * and sends a burst of messages. All SCTP packets pass through
+ * usrsctp_send_handler, so this measures the per-packet routing cost.
+ */
+
+#define BENCH_PAIRS     64
+#define BENCH_MESSAGES  100
+#define BENCH_MSG_SIZE  256
+#define BENCH_TIMEOUT   30000
+
+
+struct bench_peer {
+	Dce *fix;
+	struct dce *dce;
+	struct dce_channel *ch;
+	struct bench_peer *peer;
+	bool active;
+
+	unsigned n_estab;
+	unsigned n_open;
+	unsigned n_recv;
+	unsigned n_sent;
+	uint64_t n_pkts;
+};
+
+struct bench_pkt {
+	struct bench_peer *dst;
+	uint8_t *pkt;
+	size_t len;
+};
+
+struct bench_control {
+	struct bench_peer *peerv;
+	size_t peerc;
+	struct tmr tmr;
+	uint64_t t_start;
+	uint64_t t_done;
+	int step;
+};
+
+
+static void bench_pkt_destructor(void *arg)
+{
+	struct bench_pkt *bp = (struct bench_pkt *)arg;
+
+	mem_deref(bp->pkt);
+}
+
+
+static void bench_mq_handler(int id, void *data, void *arg)
+{
+	struct bench_pkt *bp = (struct bench_pkt *)data;
+
+	(void)id;
+	(void)arg;
+
+	dce_recv_pkt(bp->dst->dce, bp->pkt, bp->len);
+	mem_deref(bp);
+}
+
+
+static struct mqueue *bench_mq;
+
+
+static int bench_send_handler(uint8_t *pkt, size_t len, void *arg)
+{
+	struct bench_peer *p = (struct bench_peer *)arg;
+	struct bench_pkt *bp;
+
+	bp = (struct bench_pkt *)mem_zalloc(sizeof(*bp),
+					    bench_pkt_destructor);
+	if (!bp)
+		return ENOMEM;
+
+	bp->pkt = (uint8_t *)mem_alloc(len, NULL);
+	memcpy(bp->pkt, pkt, len);
+	bp->len = len;
+	bp->dst = p->peer;
+
+	__atomic_fetch_add(&p->n_pkts, 1, __ATOMIC_RELAXED);
+
+	return mqueue_push(bench_mq, 0, bp);
+}
+
+
+static void bench_estab_handler(void *arg)
+{
+	struct bench_peer *p = (struct bench_peer *)arg;
+
+	++p->n_estab;
+}
+
+
+static void bench_open_handler(int sid, const char *label,
+			       const char *protocol, void *arg)
+{
+	struct bench_peer *p = (struct bench_peer *)arg;
+
+	++p->n_open;
+}
+
+
+static void bench_data_handler(int chid, uint8_t *data, size_t len,
+			       void *arg)
+{
+	struct bench_peer *p = (struct bench_peer *)arg;
+
+	++p->n_recv;
+}
+
+
+static bool bench_all(const struct bench_control *bc,
+		      bool (*pred)(const struct bench_peer *p))
+{
+	for (size_t i = 0; i < bc->peerc; i++) {
+		if (!pred(&bc->peerv[i]))
+			return false;
+	}
+
+	return true;
+}
+
+
+static bool bench_is_estab(const struct bench_peer *p)
+{
+	return p->n_estab > 0;
+}
+
+
+static bool bench_is_open(const struct bench_peer *p)
+{
+	return dce_is_chan_open(p->ch);
+}
+
+
+static bool bench_is_received(const struct bench_peer *p)
+{
+	return p->active || p->n_recv >= p->peer->n_sent;
+}
+
+
+static void bench_tmr_handler(void *arg)
+{
+	struct bench_control *bc = (struct bench_control *)arg;
+	static const uint8_t msg[BENCH_MSG_SIZE] = {0};
+
+	switch (bc->step) {
+
+	case 0:
+		if (!bench_all(bc, bench_is_estab))
+			break;
+
+		for (size_t i = 0; i < bc->peerc; i++) {
+			struct bench_peer *p = &bc->peerv[i];
+
+			if (p->active)
+				dce_open_chan(p->dce, p->ch);
+		}
+		++bc->step;
+		break;
+
+	case 1:
+		if (!bench_all(bc, bench_is_open))
+			break;
+
+		bc->t_start = tmr_jiffies();
+
+		for (size_t i = 0; i < bc->peerc; i++) {
+			struct bench_peer *p = &bc->peerv[i];
+
+			if (!p->active)
+				continue;
+
+			for (int n = 0; n < BENCH_MESSAGES; n++) {
+				if (0 == dce_send(p->dce, p->ch,
+						  msg, sizeof(msg)))
+					++p->n_sent;
+			}
+		}
+		++bc->step;
+		break;
+
+	case 2:
+		if (!bench_all(bc, bench_is_received))
+			break;
+
+		bc->t_done = tmr_jiffies();
+		++bc->step;
+		re_cancel();
+		return;
+	}
+
+	tmr_start(&bc->tmr, 1, bench_tmr_handler, bc);
+}
+
+
+TEST_F(Dce, many_associations_throughput)
+{
+	struct bench_peer peerv[2 * BENCH_PAIRS];
+	struct bench_control bc;
+	uint64_t n_pkts = 0;
+	unsigned n_recv = 0, n_sent = 0;
+	int err;
+
+	log_set_min_level(LOG_LEVEL_ERROR);
+
+	memset(peerv, 0, sizeof(peerv));
+	memset(&bc, 0, sizeof(bc));
+	bc.peerv = peerv;
+	bc.peerc = ARRAY_SIZE(peerv);
+
+	err = mqueue_alloc(&bench_mq, bench_mq_handler, NULL);
+	ASSERT_EQ(0, err);
+
+	for (size_t i = 0; i < ARRAY_SIZE(peerv); i++) {
+		struct bench_peer *p = &peerv[i];
+
+		p->fix = this;
+		p->active = (i % 2) == 0;
+		p->peer = p->active ? &peerv[i + 1] : &peerv[i - 1];
+
+		err = dce_alloc(&p->dce, bench_send_handler,
+				bench_estab_handler, p);
+		ASSERT_EQ(0, err);
+
+		err = dce_channel_alloc(&p->ch, p->dce, "bench", "",
+					NULL,
+					bench_open_handler,
+					NULL,
+					bench_data_handler,
+					p);
+		ASSERT_EQ(0, err);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(peerv); i++) {
+		err = dce_connect(peerv[i].dce, peerv[i].active);
+		ASSERT_EQ(0, err);
+	}
+
+	tmr_start(&bc.tmr, 1, bench_tmr_handler, &bc);
+
+	err = re_main_wait(BENCH_TIMEOUT);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(3, bc.step);
+
+	for (size_t i = 0; i < ARRAY_SIZE(peerv); i++) {
+		struct bench_peer *p = &peerv[i];
+
+		n_pkts += p->n_pkts;
+		n_recv += p->n_recv;
+		n_sent += p->n_sent;
+
+		/* Everything queued by dce_send has been handed to SCTP */
+		ASSERT_EQ(0u, dce_buffered_amount(p->dce, p->ch));
+	}
+
+	ASSERT_EQ(n_sent, n_recv);
+	ASSERT_GT(n_recv, 0u);
+
+	printf("dce: %u associations: %u messages, %llu packets"
+	       " in %llu ms (%.0f messages/s)\n",
+	       (unsigned)ARRAY_SIZE(peerv), n_recv,
+	       (unsigned long long)n_pkts,
+	       (unsigned long long)(bc.t_done - bc.t_start),
+	       bc.t_done > bc.t_start
+	       ? 1000.0 * n_recv / (bc.t_done - bc.t_start) : 0.0);
+
+	tmr_cancel(&bc.tmr);
+
+	/* Channels are owned by their dce */
+	for (size_t i = 0; i < ARRAY_SIZE(peerv); i++)
+		mem_deref(peerv[i].dce);
+
+	bench_mq = (struct mqueue *)mem_deref(bench_mq);
+}
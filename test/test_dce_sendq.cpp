@@ -0,0 +1,154 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include "../src/dce/sendq.h"
+#include "gtest/gtest.h"
+
+
+struct sink {
+	unsigned accept;   /* messages to take before failing */
+	int err;           /* returned once accept is used up */
+	unsigned sent;
+	size_t bytes;
+	char last[16];
+};
+
+
+static int send_handler(const uint8_t *data, size_t len, void *arg)
+{
+	struct sink *sk = (struct sink *)arg;
+
+	if (sk->sent >= sk->accept)
+		return sk->err;
+
+	++sk->sent;
+	sk->bytes += len;
+	memset(sk->last, 0, sizeof(sk->last));
+	if (len < sizeof(sk->last))
+		memcpy(sk->last, data, len);
+
+	return 0;
+}
+
+
+class DceSendq : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		memset(&q, 0, sizeof(q));
+		memset(&sk, 0, sizeof(sk));
+
+		ASSERT_EQ(0, dce_sendq_append(&q, "one", 3, 1024));
+		ASSERT_EQ(0, dce_sendq_append(&q, "two", 3, 1024));
+		ASSERT_EQ(0, dce_sendq_append(&q, "three", 5, 1024));
+		ASSERT_EQ(11u, q.buffered);
+	}
+
+	virtual void TearDown() override
+	{
+		dce_sendq_clear(&q);
+	}
+
+protected:
+	struct dce_sendq q;
+	struct sink sk;
+};
+
+
+TEST_F(DceSendq, sends_all_in_order)
+{
+	sk.accept = 3;
+
+	ASSERT_EQ(0, dce_sendq_send(&q, send_handler, &sk));
+	ASSERT_EQ(3u, sk.sent);
+	ASSERT_EQ(11u, sk.bytes);
+	ASSERT_STREQ("three", sk.last);
+	ASSERT_EQ(0u, q.buffered);
+	ASSERT_TRUE(dce_sendq_isempty(&q));
+}
+
+
+TEST_F(DceSendq, full_buffer_keeps_the_rest)
+{
+	sk.accept = 1;
+	sk.err = EAGAIN;
+
+	ASSERT_EQ(EAGAIN, dce_sendq_send(&q, send_handler, &sk));
+	ASSERT_EQ(8u, q.buffered);
+
+	sk.accept = 3;
+	ASSERT_EQ(0, dce_sendq_send(&q, send_handler, &sk));
+	ASSERT_STREQ("three", sk.last);
+	ASSERT_EQ(0u, q.buffered);
+}
+
+
+TEST_F(DceSendq, full_buffer_error_keeps_the_message)
+{
+	sk.accept = 1;
+	sk.err = ENOBUFS;
+
+	ASSERT_EQ(ENOBUFS, dce_sendq_send(&q, send_handler, &sk));
+	ASSERT_EQ(1u, sk.sent);
+	ASSERT_EQ(8u, q.buffered);
+	ASSERT_EQ(0u, q.dropped);
+
+	/* The refused message is the first to go on the retry */
+	sk.accept = 2;
+	ASSERT_EQ(ENOBUFS, dce_sendq_send(&q, send_handler, &sk));
+	ASSERT_STREQ("two", sk.last);
+	ASSERT_EQ(5u, q.buffered);
+}
+
+
+TEST_F(DceSendq, send_error_drops_the_message)
+{
+	sk.accept = 0;
+	sk.err = EMSGSIZE;
+
+	/* Nothing can be sent, every message is dropped */
+	ASSERT_EQ(EMSGSIZE, dce_sendq_send(&q, send_handler, &sk));
+	ASSERT_EQ(0u, sk.sent);
+	ASSERT_EQ(3u, q.dropped);
+	ASSERT_EQ(EMSGSIZE, q.dropped_err);
+	ASSERT_EQ(0u, q.buffered);
+	ASSERT_TRUE(dce_sendq_isempty(&q));
+
+	/* The queue is not wedged */
+	ASSERT_EQ(0, dce_sendq_append(&q, "four", 4, 1024));
+	sk.accept = 1;
+	ASSERT_EQ(0, dce_sendq_send(&q, send_handler, &sk));
+	ASSERT_STREQ("four", sk.last);
+}
+
+
+TEST_F(DceSendq, limit)
+{
+	ASSERT_EQ(ENOBUFS, dce_sendq_append(&q, "four", 4, 14));
+	ASSERT_EQ(11u, q.buffered);
+
+	ASSERT_EQ(0, dce_sendq_append(&q, "four", 3, 14));
+	ASSERT_EQ(14u, q.buffered);
+
+	dce_sendq_clear(&q);
+	ASSERT_EQ(0u, q.buffered);
+	ASSERT_TRUE(dce_sendq_isempty(&q));
+}
@@ -0,0 +1,252 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <re.h>
+#include <avs.h>
+#include "../src/dce/slot.h"
+#include "gtest/gtest.h"
+#include "ztest.h"
+
+
+#define SLOT_BENCH_ASSOCS  128
+#define SLOT_BENCH_THREADS 4
+#define SLOT_BENCH_LOOKUPS 200000
+
+
+class DceSlot : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		st = NULL;
+		ASSERT_EQ(0, dce_slots_alloc(&st));
+	}
+
+	virtual void TearDown() override
+	{
+		mem_deref(st);
+	}
+
+protected:
+	struct dce_slots *st;
+};
+
+
+TEST_F(DceSlot, lookup)
+{
+	uintptr_t token = 0;
+	int obj;
+
+	ASSERT_EQ(0, dce_slot_alloc(st, &token));
+	ASSERT_NE(0u, token);
+
+	/* Not reachable until published */
+	ASSERT_TRUE(dce_slot_get(st, token) == NULL);
+
+	dce_slot_publish(st, token, &obj);
+	ASSERT_EQ(&obj, dce_slot_get(st, token));
+	dce_slot_put(st, token);
+
+	dce_slot_release(st, token);
+	ASSERT_TRUE(dce_slot_get(st, token) == NULL);
+	ASSERT_TRUE(dce_slot_get(st, 0) == NULL);
+}
+
+
+TEST_F(DceSlot, stale_token_after_reuse)
+{
+	uintptr_t old = 0, token = 0;
+	int a, b;
+
+	ASSERT_EQ(0, dce_slot_alloc(st, &old));
+	dce_slot_publish(st, old, &a);
+	dce_slot_release(st, old);
+
+	/* The slot is reused with a new generation */
+	ASSERT_EQ(0, dce_slot_alloc(st, &token));
+	ASSERT_NE(old, token);
+	dce_slot_publish(st, token, &b);
+
+	ASSERT_TRUE(dce_slot_get(st, old) == NULL);
+	ASSERT_EQ(&b, dce_slot_get(st, token));
+	dce_slot_put(st, token);
+
+	dce_slot_release(st, token);
+}
+
+
+TEST_F(DceSlot, full)
+{
+	uintptr_t token;
+
+	for (int i = 0; i < DCE_SLOTS; i++)
+		ASSERT_EQ(0, dce_slot_alloc(st, &token));
+
+	ASSERT_EQ(ENOSPC, dce_slot_alloc(st, &token));
+}
+
+
+struct slot_holder {
+	struct dce_slots *st;
+	uintptr_t token;
+	volatile bool held;
+	volatile bool released;
+};
+
+
+static void *release_thread(void *arg)
+{
+	struct slot_holder *sh = (struct slot_holder *)arg;
+
+	dce_slot_release(sh->st, sh->token);
+	sh->released = true;
+
+	return NULL;
+}
+
+
+TEST_F(DceSlot, release_waits_for_lookups)
+{
+	struct slot_holder sh;
+	pthread_t tid;
+	int obj;
+
+	memset(&sh, 0, sizeof(sh));
+	sh.st = st;
+
+	ASSERT_EQ(0, dce_slot_alloc(st, &sh.token));
+	dce_slot_publish(st, sh.token, &obj);
+	ASSERT_EQ(&obj, dce_slot_get(st, sh.token));
+
+	ASSERT_EQ(0, pthread_create(&tid, NULL, release_thread, &sh));
+	usleep(20000);
+	ASSERT_FALSE(sh.released);
+
+	dce_slot_put(st, sh.token);
+	pthread_join(tid, NULL);
+	ASSERT_TRUE(sh.released);
+}
+
+
+/*
+ * Lookup throughput: SLOT_BENCH_THREADS threads look up random
+ * associations out of SLOT_BENCH_ASSOCS, as the usrsctp send and
+ * receive callbacks do, compared with scanning a locked list.
+ */
+
+struct slot_bench {
+	struct dce_slots *st;
+	uintptr_t tokenv[SLOT_BENCH_ASSOCS];
+	int objv[SLOT_BENCH_ASSOCS];
+
+	struct lock *lock;
+	struct list objl;
+	struct le lev[SLOT_BENCH_ASSOCS];
+
+	bool locked;
+	uint64_t misses;
+};
+
+
+static void *slot_bench_thread(void *arg)
+{
+	struct slot_bench *sb = (struct slot_bench *)arg;
+	unsigned seed = (unsigned)(uintptr_t)pthread_self();
+	uint64_t misses = 0;
+
+	for (int n = 0; n < SLOT_BENCH_LOOKUPS; n++) {
+		int i = rand_r(&seed) % SLOT_BENCH_ASSOCS;
+		bool found = false;
+
+		if (sb->locked) {
+			struct le *le;
+
+			lock_read_get(sb->lock);
+			for (le = sb->objl.head; le && !found; le = le->next)
+				found = le->data == &sb->objv[i];
+			lock_rel(sb->lock);
+		}
+		else if (dce_slot_get(sb->st, sb->tokenv[i])) {
+			found = true;
+			dce_slot_put(sb->st, sb->tokenv[i]);
+		}
+
+		if (!found)
+			++misses;
+	}
+
+	__atomic_fetch_add(&sb->misses, misses, __ATOMIC_RELAXED);
+
+	return NULL;
+}
+
+
+static double slot_bench_run(struct slot_bench *sb, bool locked)
+{
+	pthread_t tidv[SLOT_BENCH_THREADS];
+	uint64_t t0, t;
+
+	sb->locked = locked;
+	sb->misses = 0;
+
+	t0 = now_us();
+	for (int i = 0; i < SLOT_BENCH_THREADS; i++)
+		EXPECT_EQ(0, pthread_create(&tidv[i], NULL,
+					    slot_bench_thread, sb));
+	for (int i = 0; i < SLOT_BENCH_THREADS; i++)
+		pthread_join(tidv[i], NULL);
+	t = now_us() - t0;
+
+	EXPECT_EQ(0u, sb->misses);
+
+	return t ? 1e6 * SLOT_BENCH_THREADS * SLOT_BENCH_LOOKUPS / t : 0.0;
+}
+
+
+TEST_F(DceSlot, lookup_throughput)
+{
+	struct slot_bench *sb;
+	double slots, locked;
+
+	sb = (struct slot_bench *)mem_zalloc(sizeof(*sb), NULL);
+	ASSERT_TRUE(sb != NULL);
+	sb->st = st;
+	ASSERT_EQ(0, lock_alloc(&sb->lock));
+
+	for (int i = 0; i < SLOT_BENCH_ASSOCS; i++) {
+		ASSERT_EQ(0, dce_slot_alloc(st, &sb->tokenv[i]));
+		dce_slot_publish(st, sb->tokenv[i], &sb->objv[i]);
+		list_append(&sb->objl, &sb->lev[i], &sb->objv[i]);
+	}
+
+	locked = slot_bench_run(sb, true);
+	slots = slot_bench_run(sb, false);
+
+	printf("dce: %d threads, %d associations: locked list %.0f,"
+	       " slots %.0f lookups/s (%.1fx)\n",
+	       SLOT_BENCH_THREADS, SLOT_BENCH_ASSOCS, locked, slots,
+	       locked > 0 ? slots / locked : 0.0);
+
+	for (int i = 0; i < SLOT_BENCH_ASSOCS; i++)
+		dce_slot_release(st, sb->tokenv[i]);
+
+	list_clear(&sb->objl);
+	mem_deref(sb->lock);
+	mem_deref(sb);
+}
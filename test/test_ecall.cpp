@@ -971,6 +971,7 @@ public:
 					    NULL, // vstate_handler
 					    NULL, // audiocbr_handler
 					    NULL, // quality_handler
+					    NULL, // quality_sample_handler
 					    NULL, // req_client_handler
 					    cli);
 
@@ -0,0 +1,265 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+#include "ztest.h"
+
+
+#define MASK_BENCH_ITERATIONS 200
+
+
+/* The regex based masking that log_mask_ipaddr replaced */
+static void mask_ipaddr_regex(const char *msg)
+{
+	struct pl a, b, c, d, e, f, g, h;
+	const char *p = msg;
+	const char *pend = msg + str_len(msg);
+	size_t i;
+
+	while (p < pend) {
+
+		const size_t len = pend - p;
+
+		if (0 == re_regex(p, len,
+				  "[0-9]+.[0-9]+.[0-9]+.[0-9]+",
+				  &a, &b, &c, &d)) {
+
+			for (i=0; i<c.l; i++)
+				*(char *)&c.p[i] = 'x';
+
+			for (i=0; i<d.l; i++)
+				*(char *)&d.p[i] = 'x';
+
+			p = d.p + d.l;
+		}
+		else {
+			break;
+		}
+	}
+
+	p = msg;
+	while (p < pend) {
+
+		const size_t len = pend - p;
+
+		if (0 == re_regex(p, len,
+				  "[0-9a-fA-F]+:[0-9a-fA-F]+:[0-9a-fA-F]+:[0-9a-fA-F]+:"
+				  "[0-9a-fA-F]+:[0-9a-fA-F]+:[0-9a-fA-F]+:[0-9a-fA-F]+",
+				  &a, &b, &c, &d, &e, &f, &g, &h)) {
+
+			for (i=0; i<d.l; i++)
+				*(char *)&d.p[i] = 'x';
+			for (i=0; i<e.l; i++)
+				*(char *)&e.p[i] = 'x';
+			for (i=0; i<f.l; i++)
+				*(char *)&f.p[i] = 'x';
+			for (i=0; i<g.l; i++)
+				*(char *)&g.p[i] = 'x';
+			for (i=0; i<h.l; i++)
+				*(char *)&h.p[i] = 'x';
+
+			p = h.p + h.l;
+		}
+		else {
+			break;
+		}
+	}
+}
+
+
+static const char *corpus[] = {
+	"",
+	"no addresses here\n",
+	"ecall(0x7f00): remote candidate 192.168.1.23 port 54321\n",
+	"turn: allocation 10.0.0.1:3478 relayed 52.212.17.3:49152\n",
+	"version 1.2.3.4.5.6.7.8.9\n",
+	"1.2.3\n",
+	"..1..2.3.4.5..\n",
+	"2001:0db8:85a3:0000:0000:8a2e:0370:7334\n",
+	"compressed 2001:db8::8a2e:370:7334 is left alone\n",
+	"mac aa:bb:cc:dd:ee:ff\n",
+	"ts 12:34:56.789 elapsed 0.123.4\n",
+	"a=fingerprint:sha-256 6B:8B:5D:EA:59:04:20:23:29:C8:87:1C:CC:87:"
+	"32:BE:DD:8C:66:A5:8E:50:55:EA:8C:D3:B6:5C:09:5E:D6:BC\n",
+	"a=candidate:842163049 1 udp 1677729535 85.12.174.9 61734 typ srflx "
+	"raddr 192.168.1.23 rport 61734 generation 0\n",
+	"a=candidate:1 1 udp 2122262783 fe80:0000:0000:0000:1c2b:3d4e:5f60:"
+	"7182 50000 typ host\n",
+	"mixed ::ffff:1.2.3.4 and 1:2:3:4:5:6:7:8.9.10.11\n",
+};
+
+
+static void compare(const std::string &line)
+{
+	std::vector<char> ref(line.begin(), line.end());
+	std::vector<char> test(line.begin(), line.end());
+
+	ref.push_back('\0');
+	test.push_back('\0');
+
+	mask_ipaddr_regex(&ref[0]);
+	log_mask_ipaddr(&test[0]);
+
+	ASSERT_STREQ(&ref[0], &test[0]) << "input: " << line;
+}
+
+
+TEST(log, mask_ipaddr)
+{
+	char v4[] = "addr 192.168.1.23 port 5000\n";
+	char v6[] = "addr 2001:0db8:85a3:0000:0000:8a2e:0370:7334\n";
+
+	log_mask_ipaddr(v4);
+	ASSERT_STREQ("addr 192.168.x.xx port 5000\n", v4);
+
+	log_mask_ipaddr(v6);
+	ASSERT_STREQ("addr 2001:0db8:85a3:xxxx:xxxx:xxxx:xxxx:xxxx\n", v6);
+}
+
+
+TEST(log, mask_ipaddr_matches_regex)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(corpus); ++i)
+		compare(corpus[i]);
+
+	compare(load_fixture("./test/data/sdp_offer.sdp"));
+	compare(load_fixture("./test/data/sdp_answer.sdp"));
+}
+
+
+TEST(log, mask_ipaddr_random)
+{
+	static const char alphabet[] = "0123456789aFx.: .:..::";
+	std::string line;
+
+	srand(3);
+	for (int n = 0; n < 20000; ++n) {
+		size_t len = rand() % 80;
+
+		line.clear();
+		for (size_t i = 0; i < len; ++i)
+			line += alphabet[rand() % (sizeof(alphabet) - 1)];
+
+		compare(line);
+	}
+}
+
+
+/* Prints the cost per line of both scrubbers, including SDP dumps */
+TEST(log, mask_ipaddr_benchmark)
+{
+	std::vector<std::string> lines;
+	uint64_t t0, t_old, t_new;
+	size_t bytes = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(corpus); ++i)
+		lines.push_back(corpus[i]);
+	lines.push_back(load_fixture("./test/data/sdp_offer.sdp"));
+	lines.push_back(load_fixture("./test/data/sdp_answer.sdp"));
+
+	for (size_t i = 0; i < lines.size(); ++i)
+		bytes += lines[i].size();
+
+	t0 = now_us();
+	for (int n = 0; n < MASK_BENCH_ITERATIONS; ++n) {
+		for (size_t i = 0; i < lines.size(); ++i) {
+			std::string line = lines[i];
+
+			mask_ipaddr_regex(&line[0]);
+		}
+	}
+	t_old = now_us() - t0;
+
+	t0 = now_us();
+	for (int n = 0; n < MASK_BENCH_ITERATIONS; ++n) {
+		for (size_t i = 0; i < lines.size(); ++i) {
+			std::string line = lines[i];
+
+			log_mask_ipaddr(&line[0]);
+		}
+	}
+	t_new = now_us() - t0;
+
+	printf("log: masking %zu lines (%zu bytes): regex %.2f us,"
+	       " scanner %.2f us per pass (%.1fx)\n",
+	       lines.size(), bytes,
+	       (double)t_old / MASK_BENCH_ITERATIONS,
+	       (double)t_new / MASK_BENCH_ITERATIONS,
+	       t_new ? (double)t_old / t_new : 0.0);
+}
+
+
+static void logging_handler(uint32_t level, const char *msg, void *arg)
+{
+	int *calls = (int *)arg;
+
+	(void)level;
+
+	++*calls;
+	if (strstr(msg, "outer"))
+		warning("test: logged from a handler\n");
+}
+
+
+static void unregistering_handler(uint32_t level, const char *msg, void *arg)
+{
+	(void)level;
+	(void)msg;
+
+	log_unregister_handler((struct log *)arg);
+}
+
+
+TEST(log, handler_may_log_and_unregister)
+{
+	struct log logger, self;
+	enum log_level level = log_get_min_level();
+	int calls = 0;
+
+	memset(&logger, 0, sizeof(logger));
+	memset(&self, 0, sizeof(self));
+
+	logger.h = logging_handler;
+	logger.arg = &calls;
+	self.h = unregistering_handler;
+	self.arg = &self;
+
+	log_set_min_level(LOG_LEVEL_WARN);
+	log_enable_stderr(false);
+	log_register_handler(&logger);
+	log_register_handler(&self);
+
+	/* The handler's own line is not passed back to the handlers */
+	warning("test: outer\n");
+	ASSERT_EQ(1, calls);
+
+	/* self has unregistered itself */
+	warning("test: again\n");
+	ASSERT_EQ(2, calls);
+
+	log_unregister_handler(&logger);
+	warning("test: gone\n");
+	ASSERT_EQ(2, calls);
+
+	log_enable_stderr(true);
+	log_set_min_level(level);
+}
@@ -19,6 +19,7 @@
 #include <avs.h>
 #include <gtest/gtest.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include "complexity_check.h"
 
 struct sync_state{
@@ -133,6 +134,34 @@ protected:
 	struct mediamgr *mm = nullptr;
 };
 
+TEST_F(MediamgrTest, play_stats)
+{
+	struct mediamgr_play_stats stats;
+	int n;
+
+	mediamgr_register_media(mm, "ringing_from_them", 0,
+				false, false, 0, 0, true);
+
+	/* Play requests are handled on the mediamgr thread */
+	for (n = 0; n < 100; n++) {
+		mediamgr_play_media(mm, "ringing_from_them");
+		usleep(20000);
+
+		ASSERT_EQ(0, mediamgr_get_play_stats(mm, &stats));
+		if (stats.nplays >= 3)
+			break;
+	}
+
+	ASSERT_GE(stats.nplays, 3u);
+	ASSERT_GE(stats.max_ms, stats.avg_ms);
+	ASSERT_GE(stats.max_ms, stats.last_ms);
+
+	printf("mediamgr: %u plays, request to start:"
+	       " avg %u ms max %u ms\n",
+	       stats.nplays, stats.avg_ms, stats.max_ms);
+}
+
+
 #if 0
 TEST_F(MediamgrTest, allocate)
 {
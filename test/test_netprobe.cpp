@@ -119,3 +119,53 @@ TEST_F(Netprobe, tls)
 	ASSERT_EQ(NUM_PACKETS, result.n_pkt_sent);
 	ASSERT_EQ(NUM_PACKETS, result.n_pkt_recv);
 }
+
+
+TEST_F(Netprobe, udp_train)
+{
+	struct netprobe_config cfg;
+	int err;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.pattern = NETPROBE_PATTERN_TRAIN;
+	cfg.train_count = 4;
+	cfg.train_len = 8;
+	cfg.train_interval_ms = 10;
+
+	err = netprobe_alloc_probe(&np, &srv.addr, IPPROTO_UDP, false,
+				   "", "", &cfg, netprobe_handler, this);
+	ASSERT_EQ(0, err);
+
+	err = re_main_wait(5000);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(0, np_err);
+	ASSERT_EQ(32, result.n_pkt_sent);
+	ASSERT_EQ(32, result.n_pkt_recv);
+	ASSERT_EQ(0, result.n_loss_bursts);
+	ASSERT_GE(result.bitrate_kbps, 40);
+}
+
+
+TEST_F(Netprobe, udp_chirp)
+{
+	struct netprobe_config cfg;
+	int err;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.pattern = NETPROBE_PATTERN_CHIRP;
+	cfg.train_count = 2;
+	cfg.train_len = 12;
+	cfg.chirp_min_kbps = 1000;
+
+	err = netprobe_alloc_probe(&np, &srv.addr, IPPROTO_UDP, false,
+				   "", "", &cfg, netprobe_handler, this);
+	ASSERT_EQ(0, err);
+
+	err = re_main_wait(5000);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(0, np_err);
+	ASSERT_EQ(24, result.n_pkt_sent);
+	ASSERT_GE(result.bw_kbps, 1000);
+}
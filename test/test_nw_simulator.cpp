@@ -0,0 +1,416 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+#include "nw_simulator.h"
+#include "ztest.h"
+
+
+#define BENCH_DURATION_MS  20000
+#define BENCH_DRAIN_MS      2000
+#define VIDEO_MAX_PKT       1200
+#define PKT_HDR_BYTES         16
+
+
+/*
+ * A link setup and a media session. Every run sends the session through
+ * a fresh NwSimulator configured by the scenario.
+ */
+struct scenario {
+	const char *name;
+	NW_type nw_type;
+	int plr;
+	float mbl;
+	int bw_kbps;
+	int queue_ms;
+	int reorder_pct;
+	int reorder_ms;
+	const char *trace;
+};
+
+struct session {
+	const char *name;
+	bool video;
+	int bitrate_kbps;
+	int frame_ms;
+	int playout_ms;     /* later than this counts as late */
+};
+
+struct bench_result {
+	int sent;
+	int recv;
+	int late;
+	int frames;
+	int frames_ok;
+	int dropped;
+	int reordered;
+	int delay_p50;
+	int delay_p95;
+	double cpu_us;
+};
+
+
+static const struct scenario scenariov[] = {
+	{"clean",    NW_type_clean, 0, 1.0f,    0,   0, 0,  0, NULL},
+	{"wifi",     NW_type_wifi,  0, 1.0f,    0,   0, 0,  0, NULL},
+	{"4g",       NW_type_4G,    0, 1.0f,    0,   0, 0,  0, NULL},
+	{"3g",       NW_type_3G,    0, 1.0f,    0,   0, 0,  0, NULL},
+	{"2g",       NW_type_2G,    0, 1.0f,    0,   0, 0,  0, NULL},
+	{"loss5",    NW_type_clean, 5, 2.0f,    0,   0, 0,  0, NULL},
+	{"reorder",  NW_type_clean, 0, 1.0f,    0,   0, 5, 30, NULL},
+	{"cap500",   NW_type_clean, 0, 1.0f,  500, 300, 0,  0, NULL},
+	{"trace",    NW_type_clean, 0, 1.0f,    0, 500, 0,  0,
+	 "./test/data/link_trace.txt"},
+};
+
+static const struct session sessionv[] = {
+	{"audio", false,  32, 20, 200},
+	{"video", true,  800, 33, 300},
+};
+
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+
+static uint32_t get_u32(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+
+static void setup_simulator(NwSimulator *nws, const struct scenario *sc)
+{
+	nws->Init(0, sc->plr, sc->mbl, sc->nw_type, "./test/data/");
+
+	if (sc->bw_kbps)
+		nws->SetBandwidth(sc->bw_kbps, sc->queue_ms);
+	if (sc->reorder_pct)
+		nws->SetReordering(sc->reorder_pct, sc->reorder_ms);
+	if (sc->trace) {
+		ASSERT_EQ(0, nws->LoadTrace(sc->trace));
+		nws->SetBandwidth(0, sc->queue_ms);
+	}
+}
+
+
+/* Frame sizes follow the bitrate, with a keyframe every 3 seconds */
+static int frame_bytes(const struct session *ss, int frame)
+{
+	int bytes = ss->bitrate_kbps * ss->frame_ms / 8;
+
+	if (!ss->video)
+		return bytes + (rand() % (bytes / 2 + 1)) - bytes / 4;
+
+	if (frame % (3000 / ss->frame_ms) == 0)
+		return bytes * 5;
+
+	return bytes * 3 / 4 + rand() % (bytes / 2 + 1);
+}
+
+
+static void run_session(const struct scenario *sc, const struct session *ss,
+			struct bench_result *res)
+{
+	NwSimulator nws;
+	unsigned char pkt[MAX_BYTES_PER_PACKET];
+	std::vector<int> frame_pkts, frame_done, frame_sent;
+	std::vector<int> delays;
+	int seq = 0, frame = 0;
+	uint64_t t0;
+
+	memset(res, 0, sizeof(*res));
+	memset(pkt, 0, sizeof(pkt));
+	srand(1);
+
+	setup_simulator(&nws, sc);
+
+	for (int t = 0; t < BENCH_DURATION_MS + BENCH_DRAIN_MS; ++t) {
+
+		if (t < BENCH_DURATION_MS && t >= frame * ss->frame_ms) {
+
+			int left = frame_bytes(ss, frame);
+			int npkts = 1;
+
+			if (ss->video)
+				npkts = (left + VIDEO_MAX_PKT - 1) / VIDEO_MAX_PKT;
+
+			frame_pkts.push_back(npkts);
+			frame_done.push_back(0);
+			frame_sent.push_back(t);
+
+			for (int i = 0; i < npkts; ++i) {
+
+				int len = std::min(left / (npkts - i),
+						   VIDEO_MAX_PKT);
+
+				left -= len;
+				len = std::max(len, 0) + PKT_HDR_BYTES;
+
+				put_u32(pkt, seq++);
+				put_u32(pkt + 4, t);
+				put_u32(pkt + 8, frame);
+
+				t0 = now_us();
+				nws.Add_Packet(pkt, len, t);
+				res->cpu_us += now_us() - t0;
+				++res->sent;
+			}
+			++frame;
+		}
+
+		for (;;) {
+			int n, delay, f;
+
+			t0 = now_us();
+			n = nws.Get_Packet(pkt, sizeof(pkt), t);
+			res->cpu_us += now_us() - t0;
+			if (n <= 0)
+				break;
+
+			delay = t - (int)get_u32(pkt + 4);
+			f = get_u32(pkt + 8);
+
+			++res->recv;
+			delays.push_back(delay);
+			if (delay > ss->playout_ms)
+				++res->late;
+			else
+				++frame_done[f];
+		}
+	}
+
+	res->frames = frame;
+	for (int f = 0; f < frame; ++f) {
+		if (frame_done[f] == frame_pkts[f])
+			++res->frames_ok;
+	}
+
+	if (!delays.empty()) {
+		std::sort(delays.begin(), delays.end());
+		res->delay_p50 = delays[(delays.size() - 1) * 50 / 100];
+		res->delay_p95 = delays[(delays.size() - 1) * 95 / 100];
+	}
+
+	res->dropped = nws.GetDroppedPacketCount();
+	res->reordered = nws.GetReorderedPacketCount();
+	if (res->sent)
+		res->cpu_us /= res->sent;
+}
+
+
+/* One JSON object per line, appended to $NWSIM_BENCH_OUT if set */
+static void emit(const struct scenario *sc, const struct session *ss,
+		 const struct bench_result *res)
+{
+	const char *path = getenv("NWSIM_BENCH_OUT");
+	char line[512];
+	FILE *fp;
+
+	re_snprintf(line, sizeof(line),
+		    "{\"scenario\":\"%s\",\"session\":\"%s\","
+		    "\"sent\":%d,\"recv\":%d,\"late\":%d,"
+		    "\"loss_pct\":%.2f,\"late_pct\":%.2f,"
+		    "\"frames_ok_pct\":%.2f,"
+		    "\"delay_p50_ms\":%d,\"delay_p95_ms\":%d,"
+		    "\"dropped\":%d,\"reordered\":%d,"
+		    "\"cpu_us_per_pkt\":%.3f}",
+		    sc->name, ss->name,
+		    res->sent, res->recv, res->late,
+		    res->sent ? 100.0 * (res->sent - res->recv) / res->sent : 0.0,
+		    res->recv ? 100.0 * res->late / res->recv : 0.0,
+		    res->frames ? 100.0 * res->frames_ok / res->frames : 0.0,
+		    res->delay_p50, res->delay_p95,
+		    res->dropped, res->reordered,
+		    res->cpu_us);
+
+	printf("%s\n", line);
+
+	if (!path)
+		return;
+
+	fp = fopen(path, "a");
+	if (!fp)
+		return;
+	fprintf(fp, "%s\n", line);
+	fclose(fp);
+}
+
+
+TEST(nw_simulator, video_sized_packets)
+{
+	NwSimulator nws;
+	unsigned char in[1200], out[MAX_BYTES_PER_PACKET];
+
+	for (size_t i = 0; i < sizeof(in); ++i)
+		in[i] = i & 0xff;
+
+	nws.Init(0, 0, 1.0f, NW_type_clean, "");
+
+	ASSERT_EQ(0, nws.Add_Packet(in, sizeof(in), 0));
+	ASSERT_EQ((int)sizeof(in), nws.Get_Packet(out, 0));
+	ASSERT_EQ(0, memcmp(in, out, sizeof(in)));
+
+	/* A buffer that is too small drops the packet, the next one that
+	 * fits is returned in the same call
+	 */
+	ASSERT_EQ(0, nws.Add_Packet(in, sizeof(in), 1));
+	ASSERT_EQ(0, nws.Add_Packet(in, 400, 1));
+	ASSERT_EQ(400, nws.Get_Packet(out, 500, 1));
+	ASSERT_EQ(1, nws.GetDroppedPacketCount());
+	ASSERT_EQ(-1, nws.Get_Packet(out, 1));
+
+	/* Init starts from scratch */
+	nws.SetBandwidth(100, 10);
+	nws.SetReordering(100, 50);
+	nws.Init(0, 0, 1.0f, NW_type_clean, "");
+	ASSERT_EQ(0, nws.GetDroppedPacketCount());
+	ASSERT_EQ(0, nws.Add_Packet(in, sizeof(in), 2));
+	ASSERT_EQ((int)sizeof(in), nws.Get_Packet(out, 2));
+	ASSERT_EQ(0, nws.GetReorderedPacketCount());
+}
+
+
+TEST(nw_simulator, bandwidth_queueing)
+{
+	NwSimulator nws;
+	unsigned char pkt[1250];
+	std::vector<int> arrivals;
+
+	memset(pkt, 0, sizeof(pkt));
+
+	nws.Init(0, 0, 1.0f, NW_type_clean, "");
+
+	/* 10 kbit per packet at 1 Mbps is 10 ms on the link */
+	nws.SetBandwidth(1000, 50);
+
+	for (int i = 0; i < 10; ++i)
+		ASSERT_EQ(0, nws.Add_Packet(pkt, sizeof(pkt), 0));
+
+	for (int t = 0; t < 200; ++t) {
+		while (nws.Get_Packet(pkt, t) > 0)
+			arrivals.push_back(t);
+	}
+
+	/* Packets that would wait more than 50 ms are dropped */
+	ASSERT_EQ(6, (int)arrivals.size());
+	ASSERT_EQ(4, nws.GetDroppedPacketCount());
+	for (size_t i = 0; i < arrivals.size(); ++i)
+		ASSERT_EQ(10 * (int)(i + 1), arrivals[i]);
+}
+
+
+TEST(nw_simulator, reordering)
+{
+	NwSimulator nws;
+	unsigned char pkt[100];
+	uint32_t prev = 0;
+	int recv = 0, out_of_order = 0;
+
+	memset(pkt, 0, sizeof(pkt));
+	srand(1);
+
+	nws.Init(0, 0, 1.0f, NW_type_clean, "");
+	nws.SetReordering(20, 30);
+
+	for (int t = 0; t < 1000; ++t) {
+		put_u32(pkt, t);
+		ASSERT_EQ(0, nws.Add_Packet(pkt, sizeof(pkt), t));
+	}
+
+	for (int t = 0; t < 1100; ++t) {
+		while (nws.Get_Packet(pkt, t) > 0) {
+			uint32_t seq = get_u32(pkt);
+
+			if (recv && seq < prev)
+				++out_of_order;
+			prev = seq;
+			++recv;
+		}
+	}
+
+	ASSERT_EQ(1000, recv);
+	ASSERT_GT(nws.GetReorderedPacketCount(), 0);
+	ASSERT_GT(out_of_order, 0);
+}
+
+
+TEST(nw_simulator, trace_driven_link)
+{
+	NwSimulator nws;
+	unsigned char pkt[1000];
+	int bytes = 0;
+
+	memset(pkt, 0, sizeof(pkt));
+
+	nws.Init(0, 0, 1.0f, NW_type_clean, "");
+	ASSERT_EQ(0, nws.LoadTrace("./test/data/link_trace.txt"));
+
+	/* Offer 8 Mbps, the first second of the trace carries 4 Mbps */
+	for (int t = 0; t < 1000; ++t)
+		ASSERT_EQ(0, nws.Add_Packet(pkt, sizeof(pkt), t));
+
+	for (int t = 0; t <= 1000; ++t) {
+		int n;
+
+		while ((n = nws.Get_Packet(pkt, t)) > 0)
+			bytes += n;
+	}
+
+	ASSERT_GT(bytes * 8 / 1000, 3800);
+	ASSERT_LT(bytes * 8 / 1000, 4200);
+}
+
+
+/* Runs every session on every link and prints the results as JSON lines */
+TEST(nw_simulator, benchmark)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(scenariov); ++i) {
+		for (size_t j = 0; j < ARRAY_SIZE(sessionv); ++j) {
+
+			const struct scenario *sc = &scenariov[i];
+			const struct session *ss = &sessionv[j];
+			struct bench_result res;
+
+			run_session(sc, ss, &res);
+			emit(sc, ss, &res);
+
+			ASSERT_GT(res.sent, 0);
+			ASSERT_LE(res.recv, res.sent);
+
+			if (sc->nw_type == NW_type_clean && !sc->plr &&
+			    !sc->bw_kbps && !sc->reorder_pct && !sc->trace) {
+				ASSERT_EQ(res.sent, res.recv);
+				ASSERT_EQ(res.frames, res.frames_ok);
+			}
+		}
+	}
+}
@@ -0,0 +1,305 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <re.h>
+#include <avs.h>
+#include "../src/peerflow/sdp.h"
+#include "gtest/gtest.h"
+#include "ztest.h"
+
+
+#define SDP_BENCH_ITERATIONS 2000
+
+
+static struct sdp_session *decode(const char *sdp)
+{
+	struct sdp_session *sess = NULL;
+	struct mbuf mb;
+	struct sa laddr;
+	int err;
+
+	mb.buf = (uint8_t *)sdp;
+	mb.pos = 0;
+	mb.end = mb.size = str_len(sdp);
+
+	sa_set_str(&laddr, "127.0.0.1", 9);
+	err = sdp_session_alloc(&sess, &laddr);
+	if (err)
+		return NULL;
+
+	err = sdp_decode(sess, &mb, true);
+	if (err)
+		return (struct sdp_session *)mem_deref(sess);
+
+	return sess;
+}
+
+
+/* Old path: decode into a session, modify and encode */
+static char *session_modify(const char *sdp, bool offer,
+			    enum icall_conv_type conv_type, bool cbr)
+{
+	struct sdp_session *sess = NULL;
+	const char *res;
+
+	if (sdp_dup(&sess, sdp, offer))
+		return NULL;
+
+	if (offer)
+		res = sdp_modify_offer(sess, conv_type, cbr);
+	else
+		res = sdp_modify_answer(sess, conv_type, cbr);
+
+	mem_deref(sess);
+
+	return (char *)res;
+}
+
+
+static void compare_media(const struct sdp_media *a,
+			  const struct sdp_media *b)
+{
+	const struct list *fa, *fb;
+	struct le *lea, *leb;
+
+	ASSERT_STREQ(sdp_media_name(a), sdp_media_name(b));
+	ASSERT_EQ(sdp_media_rbandwidth(a, SDP_BANDWIDTH_AS),
+		  sdp_media_rbandwidth(b, SDP_BANDWIDTH_AS));
+	ASSERT_EQ(sdp_media_rdir(a), sdp_media_rdir(b));
+
+	if (sdp_media_rattr(a, "ptime"))
+		ASSERT_STREQ(sdp_media_rattr(a, "ptime"),
+			     sdp_media_rattr(b, "ptime"));
+	else
+		ASSERT_TRUE(sdp_media_rattr(b, "ptime") == NULL);
+
+	fa = sdp_media_format_lst(a, false);
+	fb = sdp_media_format_lst(b, false);
+	ASSERT_EQ(list_count(fa), list_count(fb));
+
+	for (lea = fa->head, leb = fb->head; lea && leb;
+	     lea = lea->next, leb = leb->next) {
+		const struct sdp_format *fmta = (struct sdp_format *)lea->data;
+		const struct sdp_format *fmtb = (struct sdp_format *)leb->data;
+
+		ASSERT_STREQ(fmta->id, fmtb->id);
+		ASSERT_STREQ(fmta->name, fmtb->name);
+		if (fmta->params)
+			ASSERT_STREQ(fmta->params, fmtb->params);
+	}
+}
+
+
+/* The rewriter must negotiate the same as the session based path */
+static void compare_paths(const char *fixture, bool offer,
+			  enum icall_conv_type conv_type, bool cbr)
+{
+	std::string sdp = load_fixture(fixture);
+	struct sdp_session *sa = NULL, *sb = NULL;
+	char *old_sdp = NULL, *new_sdp = NULL;
+	struct le *lea, *leb;
+	int err;
+
+	ASSERT_FALSE(sdp.empty());
+
+	old_sdp = session_modify(sdp.c_str(), offer, conv_type, cbr);
+	ASSERT_TRUE(old_sdp != NULL);
+
+	err = sdp_rewrite(&new_sdp, sdp.c_str(), offer, conv_type, cbr);
+	ASSERT_EQ(0, err);
+
+	sa = decode(old_sdp);
+	sb = decode(new_sdp);
+	ASSERT_TRUE(sa != NULL);
+	ASSERT_TRUE(sb != NULL);
+
+	ASSERT_EQ(list_count(sdp_session_medial(sa, false)),
+		  list_count(sdp_session_medial(sb, false)));
+
+	for (lea = sdp_session_medial(sa, false)->head,
+	     leb = sdp_session_medial(sb, false)->head;
+	     lea && leb;
+	     lea = lea->next, leb = leb->next) {
+
+		compare_media((struct sdp_media *)lea->data,
+			      (struct sdp_media *)leb->data);
+	}
+
+	mem_deref(sa);
+	mem_deref(sb);
+	mem_deref(old_sdp);
+	mem_deref(new_sdp);
+}
+
+
+static void acbr_handler(bool enabled, bool offer, void *arg)
+{
+	int *count = (int *)arg;
+
+	(void)offer;
+
+	if (enabled)
+		++*count;
+}
+
+
+TEST(sdp, rewrite_offer_oneonone)
+{
+	std::string sdp = load_fixture("./test/data/sdp_offer.sdp");
+	char *res = NULL;
+	int err;
+
+	ASSERT_FALSE(sdp.empty());
+
+	err = sdp_rewrite(&res, sdp.c_str(), true,
+			  ICALL_CONV_TYPE_ONEONONE, true);
+	ASSERT_EQ(0, err);
+
+	ASSERT_TRUE(strstr(res, "m=audio 9 UDP/TLS/RTP/SAVPF 111\r\n"));
+	ASSERT_TRUE(strstr(res, "m=video 9 UDP/TLS/RTP/SAVPF 96\r\n"));
+	ASSERT_TRUE(strstr(res, "b=AS:50\r\n"));
+	ASSERT_TRUE(strstr(res, "b=AS:800\r\n"));
+	ASSERT_TRUE(strstr(res, "a=fmtp:111 minptime=10;useinbandfec=1;cbr=1\r\n"));
+	ASSERT_TRUE(strstr(res, "a=ssrc-group:FID 2231627014 632943048\r\n"));
+	ASSERT_TRUE(strstr(res, "a=sctp-port:5000\r\n"));
+
+	ASSERT_TRUE(strstr(res, "VP9") == NULL);
+	ASSERT_TRUE(strstr(res, "telephone-event") == NULL);
+	ASSERT_TRUE(strstr(res, "a=rtcp-fb:98") == NULL);
+	ASSERT_TRUE(strstr(res, "a=ptime") == NULL);
+
+	mem_deref(res);
+}
+
+
+TEST(sdp, rewrite_answer_group)
+{
+	std::string sdp = load_fixture("./test/data/sdp_answer.sdp");
+	char *res = NULL;
+	int err;
+
+	ASSERT_FALSE(sdp.empty());
+
+	err = sdp_rewrite(&res, sdp.c_str(), false,
+			  ICALL_CONV_TYPE_GROUP, false);
+	ASSERT_EQ(0, err);
+
+	ASSERT_TRUE(strstr(res, "a=fmtp:111 minptime=10;useinbandfec=1;usedtx=1\r\n"));
+	ASSERT_TRUE(strstr(res, "a=ptime:40\r\n"));
+	ASSERT_TRUE(strstr(res, "a=ptime:20") == NULL);
+	ASSERT_TRUE(strstr(res, "b=AS:32") == NULL);
+	ASSERT_TRUE(strstr(res, "a=recvonly\r\n"));
+
+	mem_deref(res);
+}
+
+
+TEST(sdp, rewrite_matches_session_path)
+{
+	static const char *fixtures[] = {
+		"./test/data/sdp_offer.sdp",
+		"./test/data/sdp_answer.sdp",
+	};
+	static const enum icall_conv_type convv[] = {
+		ICALL_CONV_TYPE_ONEONONE,
+		ICALL_CONV_TYPE_GROUP,
+		ICALL_CONV_TYPE_CONFERENCE,
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(fixtures); ++i) {
+		for (size_t c = 0; c < ARRAY_SIZE(convv); ++c) {
+			for (int cbr = 0; cbr < 2; ++cbr) {
+				compare_paths(fixtures[i], true,
+					      convv[c], cbr);
+				compare_paths(fixtures[i], false,
+					      convv[c], cbr);
+			}
+		}
+	}
+}
+
+
+TEST(sdp, check_remote_acbr)
+{
+	std::string sdp = load_fixture("./test/data/sdp_offer.sdp");
+	char *res = NULL;
+	int count = 0;
+
+	ASSERT_FALSE(sdp.empty());
+
+	sdp_check_remote_acbr(sdp.c_str(), true, acbr_handler, &count);
+	ASSERT_EQ(0, count);
+
+	ASSERT_EQ(0, sdp_rewrite(&res, sdp.c_str(), true,
+				 ICALL_CONV_TYPE_ONEONONE, true));
+	sdp_check_remote_acbr(res, true, acbr_handler, &count);
+	ASSERT_EQ(1, count);
+
+	mem_deref(res);
+}
+
+
+/* Prints the cost of both paths per SDP, as during a group call join */
+TEST(sdp, rewrite_benchmark)
+{
+	static const char *fixtures[] = {
+		"./test/data/sdp_offer.sdp",
+		"./test/data/sdp_answer.sdp",
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(fixtures); ++i) {
+		std::string sdp = load_fixture(fixtures[i]);
+		uint64_t t0, t_old, t_new;
+		int count = 0;
+
+		ASSERT_FALSE(sdp.empty());
+
+		t0 = now_us();
+		for (int n = 0; n < SDP_BENCH_ITERATIONS; ++n) {
+			char *res = session_modify(sdp.c_str(), true,
+						   ICALL_CONV_TYPE_GROUP,
+						   true);
+			ASSERT_TRUE(res != NULL);
+			mem_deref(decode(res));
+			mem_deref(res);
+		}
+		t_old = now_us() - t0;
+
+		t0 = now_us();
+		for (int n = 0; n < SDP_BENCH_ITERATIONS; ++n) {
+			char *res = NULL;
+
+			ASSERT_EQ(0, sdp_rewrite(&res, sdp.c_str(), true,
+						 ICALL_CONV_TYPE_GROUP, true));
+			sdp_check_remote_acbr(res, true,
+					      acbr_handler, &count);
+			mem_deref(res);
+		}
+		t_new = now_us() - t0;
+
+		ASSERT_EQ(SDP_BENCH_ITERATIONS, count);
+
+		printf("sdp: %s (%zu bytes): session %.2f us, rewrite %.2f us"
+		       " per SDP (%.1fx)\n",
+		       fixtures[i], sdp.size(),
+		       (double)t_old / SDP_BENCH_ITERATIONS,
+		       (double)t_new / SDP_BENCH_ITERATIONS,
+		       t_new ? (double)t_old / t_new : 0.0);
+	}
+}
@@ -0,0 +1,185 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+#define TICK 100
+
+
+struct ranking {
+	unsigned calls;
+	size_t rankc;
+	uint32_t first;
+	bool first_speaking;
+};
+
+
+static void rank_handler(const struct speaker_rank *rankv, size_t rankc,
+			 void *arg)
+{
+	struct ranking *rk = (struct ranking *)arg;
+
+	++rk->calls;
+	rk->rankc = rankc;
+	rk->first = rankc ? rankv[0].ssrc : 0;
+	rk->first_speaking = rankc ? rankv[0].speaking : false;
+}
+
+
+static void feed(struct speaker_engine *se, uint32_t ssrc,
+		 const char *userid, uint8_t dbov, uint64_t now)
+{
+	struct speaker_level lvl;
+	int err;
+
+	lvl.userid = userid;
+	lvl.clientid = "c";
+	lvl.ssrc = ssrc;
+	lvl.dbov = dbov;
+
+	err = speaker_engine_level(se, &lvl, now);
+	ASSERT_EQ(0, err);
+}
+
+
+TEST(speaker, dbov2level)
+{
+	ASSERT_EQ(1.0f, speaker_dbov2level(0));
+	ASSERT_EQ(0.0f, speaker_dbov2level(127));
+	ASSERT_EQ(0.0f, speaker_dbov2level(255));
+	ASSERT_TRUE(speaker_dbov2level(30) > speaker_dbov2level(60));
+}
+
+
+TEST(speaker, ranks_loudest_first)
+{
+	struct speaker_engine *se = NULL;
+	const struct speaker_rank *rankv;
+	struct ranking rk;
+	uint64_t now = 1000;
+	size_t rankc;
+	int err;
+
+	memset(&rk, 0, sizeof(rk));
+
+	err = speaker_engine_alloc(&se, 0, rank_handler, &rk);
+	ASSERT_EQ(0, err);
+
+	for (int i = 0; i < 10; ++i, now += TICK) {
+		feed(se, 1, "quiet", 127, now);
+		feed(se, 2, "soft", 40, now);
+		feed(se, 3, "loud", 20, now);
+		speaker_engine_tick(se, now);
+	}
+
+	rankv = speaker_engine_ranking(se, &rankc);
+	ASSERT_EQ(3, rankc);
+	ASSERT_EQ(3, rankv[0].ssrc);
+	ASSERT_STREQ("loud", rankv[0].userid);
+	ASSERT_TRUE(rankv[0].speaking);
+	ASSERT_EQ(2, rankv[1].ssrc);
+	ASSERT_TRUE(rankv[1].speaking);
+	ASSERT_EQ(1, rankv[2].ssrc);
+	ASSERT_FALSE(rankv[2].speaking);
+
+	ASSERT_EQ(3, rk.first);
+	ASSERT_TRUE(rk.calls > 0);
+
+	mem_deref(se);
+}
+
+
+TEST(speaker, updates_are_rate_bounded)
+{
+	struct speaker_engine *se = NULL;
+	struct ranking rk;
+	uint64_t now = 1000;
+	int err;
+
+	memset(&rk, 0, sizeof(rk));
+
+	err = speaker_engine_alloc(&se, 500, rank_handler, &rk);
+	ASSERT_EQ(0, err);
+
+	/* Two speakers taking turns every tick, 3 seconds */
+	for (int i = 0; i < 30; ++i, now += TICK) {
+		feed(se, 1, "a", i & 1 ? 10 : 127, now);
+		feed(se, 2, "b", i & 1 ? 127 : 10, now);
+		speaker_engine_tick(se, now);
+	}
+
+	ASSERT_TRUE(rk.calls > 0);
+	ASSERT_TRUE(rk.calls <= 30 * TICK / 500 + 1);
+
+	mem_deref(se);
+}
+
+
+TEST(speaker, pause_keeps_speaker_then_drops_it)
+{
+	struct speaker_engine *se = NULL;
+	const struct speaker_rank *rankv;
+	struct ranking rk;
+	uint64_t now = 1000;
+	size_t rankc;
+	int err;
+
+	memset(&rk, 0, sizeof(rk));
+
+	err = speaker_engine_alloc(&se, 0, rank_handler, &rk);
+	ASSERT_EQ(0, err);
+
+	for (int i = 0; i < 10; ++i, now += TICK) {
+		feed(se, 1, "a", 20, now);
+		feed(se, 2, "b", 127, now);
+		speaker_engine_tick(se, now);
+	}
+
+	/* A short pause does not end speech */
+	for (int i = 0; i < 2; ++i, now += TICK) {
+		feed(se, 1, "a", 127, now);
+		feed(se, 2, "b", 127, now);
+		speaker_engine_tick(se, now);
+	}
+	ASSERT_EQ(1, rk.first);
+	ASSERT_TRUE(rk.first_speaking);
+
+	/* A long one does, but a stays ahead as the last speaker */
+	for (int i = 0; i < 20; ++i, now += TICK) {
+		feed(se, 1, "a", 127, now);
+		feed(se, 2, "b", 127, now);
+		speaker_engine_tick(se, now);
+	}
+	ASSERT_EQ(1, rk.first);
+	ASSERT_FALSE(rk.first_speaking);
+
+	/* b keeps sending, a went away */
+	for (int i = 0; i < 60; ++i, now += TICK) {
+		feed(se, 2, "b", 127, now);
+		speaker_engine_tick(se, now);
+	}
+
+	rankv = speaker_engine_ranking(se, &rankc);
+	ASSERT_EQ(1, rankc);
+	ASSERT_EQ(2, rankv[0].ssrc);
+
+	mem_deref(se);
+}
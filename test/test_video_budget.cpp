@@ -0,0 +1,142 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include "../src/peerflow/video_budget.h"
+#include "gtest/gtest.h"
+
+
+#define PIXELS_360P (640*360)
+#define NUM_STREAMS 3
+
+
+static void init_streams(struct video_budget_stream *streamv, size_t n)
+{
+	memset(streamv, 0, n * sizeof(*streamv));
+
+	for (size_t i = 0; i < n; ++i) {
+		streamv[i].visible = true;
+		streamv[i].rank = -1;
+		streamv[i].order = (uint32_t)i;
+		streamv[i].pixels = PIXELS_360P;
+		streamv[i].fps = 30.0f;
+	}
+}
+
+
+static uint64_t total_alloc(const struct video_budget_stream *streamv,
+			    size_t n)
+{
+	uint64_t sum = 0;
+
+	for (size_t i = 0; i < n; ++i)
+		sum += streamv[i].alloc_pps;
+
+	return sum;
+}
+
+
+TEST(video_budget, unlimited)
+{
+	struct video_budget_stream streamv[NUM_STREAMS];
+
+	init_streams(streamv, NUM_STREAMS);
+	streamv[2].visible = false;
+
+	video_budget_allocate(streamv, NUM_STREAMS, 0);
+
+	for (size_t i = 0; i < 2; ++i) {
+		ASSERT_FALSE(streamv[i].paused);
+		ASSERT_EQ(0, streamv[i].max_fps);
+		ASSERT_EQ(0u, streamv[i].max_pixels);
+		ASSERT_EQ((uint64_t)PIXELS_360P * 30, streamv[i].alloc_pps);
+	}
+
+	/* Hidden streams are paused even without a budget */
+	ASSERT_TRUE(streamv[2].paused);
+	ASSERT_EQ(0u, streamv[2].alloc_pps);
+}
+
+
+TEST(video_budget, speaker_keeps_full_rate)
+{
+	struct video_budget_stream streamv[NUM_STREAMS];
+	const uint64_t budget = 10000000;
+
+	init_streams(streamv, NUM_STREAMS);
+	streamv[0].rank = 1;
+	streamv[1].rank = 2;
+	streamv[2].rank = 0;
+	streamv[1].speaking = true;
+
+	video_budget_allocate(streamv, NUM_STREAMS, budget);
+
+	ASSERT_LE(total_alloc(streamv, NUM_STREAMS), budget);
+
+	/* The speaker first, then by rank */
+	ASSERT_FALSE(streamv[1].paused);
+	ASSERT_EQ(0, streamv[1].max_fps);
+
+	ASSERT_FALSE(streamv[2].paused);
+	ASSERT_GT(streamv[2].max_fps, VIDEO_BUDGET_MIN_FPS);
+	ASSERT_LT(streamv[2].max_fps, 30);
+
+	ASSERT_FALSE(streamv[0].paused);
+	ASSERT_EQ(VIDEO_BUDGET_MIN_FPS, streamv[0].max_fps);
+
+	/* Capped streams ask for a smaller frame */
+	ASSERT_LT(streamv[0].max_pixels, (uint32_t)PIXELS_360P);
+	ASSERT_GE(streamv[0].max_pixels, (uint32_t)VIDEO_BUDGET_MIN_PIXELS);
+}
+
+
+TEST(video_budget, pauses_lowest_priority)
+{
+	struct video_budget_stream streamv[NUM_STREAMS];
+	const uint64_t budget = 2500000;
+
+	init_streams(streamv, NUM_STREAMS);
+	streamv[2].rank = 0;
+
+	video_budget_allocate(streamv, NUM_STREAMS, budget);
+
+	ASSERT_LE(total_alloc(streamv, NUM_STREAMS), budget);
+
+	/* Ranked first, then by arrival */
+	ASSERT_FALSE(streamv[2].paused);
+	ASSERT_FALSE(streamv[0].paused);
+	ASSERT_TRUE(streamv[1].paused);
+	ASSERT_EQ(0u, streamv[1].alloc_pps);
+	ASSERT_EQ((uint32_t)VIDEO_BUDGET_MIN_PIXELS, streamv[1].max_pixels);
+}
+
+
+TEST(video_budget, unknown_streams_use_defaults)
+{
+	struct video_budget_stream streamv[1];
+
+	init_streams(streamv, 1);
+	streamv[0].pixels = 0;
+	streamv[0].fps = 0.0f;
+
+	video_budget_allocate(streamv, 1, 0);
+
+	ASSERT_EQ((uint64_t)VIDEO_BUDGET_DEFAULT_PIXELS
+		  * VIDEO_BUDGET_DEFAULT_FPS, streamv[0].alloc_pps);
+}
@@ -0,0 +1,171 @@
+/*
+* Wire
+* Copyright (C) 2019 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <avs_wcall.h>
+#include "../src/wcall/parts.h"
+#include "gtest/gtest.h"
+
+
+static void set_member(struct wcall_member *memb,
+		       const char *userid, const char *clientid,
+		       int audio_estab, int video_recv)
+{
+	memb->userid = (char *)userid;
+	memb->clientid = (char *)clientid;
+	memb->audio_estab = audio_estab;
+	memb->video_recv = video_recv;
+}
+
+
+static const struct wcall_participant *
+find_part(const struct wcall_participant *partv, size_t partc,
+	  const char *userid)
+{
+	for (size_t i = 0; i < partc; ++i) {
+		if (0 == str_cmp(partv[i].userid, userid))
+			return &partv[i];
+	}
+
+	return NULL;
+}
+
+
+TEST(wcall_parts, first_call_adds_all)
+{
+	struct wcall_member membv[2];
+	struct wcall_members members = {membv, 2};
+	struct wcall_participant *partv = NULL;
+	size_t partc = 0;
+	uint32_t changes = 0;
+
+	set_member(&membv[0], "alice", "a1", 1, 0);
+	set_member(&membv[1], "bob", "b1", 0, 0);
+
+	ASSERT_EQ(0, wcall_parts_diff(&partv, &partc, &changes,
+				      &members, NULL));
+	ASSERT_EQ(2u, partc);
+	ASSERT_EQ((uint32_t)WCALL_PARTICIPANT_ADDED, changes);
+	ASSERT_STREQ("alice", partv[0].userid);
+	ASSERT_EQ(1, partv[0].audio_estab);
+	ASSERT_EQ((uint32_t)WCALL_PARTICIPANT_ADDED, partv[1].changes);
+
+	mem_deref(partv);
+}
+
+
+TEST(wcall_parts, unchanged)
+{
+	struct wcall_member prevv[2], membv[2];
+	struct wcall_members prev = {prevv, 2};
+	struct wcall_members members = {membv, 2};
+	struct wcall_participant *partv = NULL;
+	size_t partc = 0;
+	uint32_t changes = 1;
+
+	set_member(&prevv[0], "alice", "a1", 1, 1);
+	set_member(&prevv[1], "bob", "b1", 1, 0);
+
+	/* Order does not matter */
+	set_member(&membv[0], "bob", "b1", 1, 0);
+	set_member(&membv[1], "alice", "a1", 1, 1);
+
+	ASSERT_EQ(0, wcall_parts_diff(&partv, &partc, &changes,
+				      &members, &prev));
+	ASSERT_EQ(2u, partc);
+	ASSERT_EQ(0u, changes);
+	ASSERT_EQ(0u, partv[0].changes);
+	ASSERT_EQ(0u, partv[1].changes);
+
+	mem_deref(partv);
+}
+
+
+TEST(wcall_parts, change_masks)
+{
+	struct wcall_member prevv[3], membv[3];
+	struct wcall_members prev = {prevv, 3};
+	struct wcall_members members = {membv, 3};
+	struct wcall_participant *partv = NULL;
+	const struct wcall_participant *part;
+	size_t partc = 0;
+	uint32_t changes = 0;
+
+	set_member(&prevv[0], "alice", "a1", 0, 0);
+	set_member(&prevv[1], "bob", "b1", 1, 0);
+	set_member(&prevv[2], "carol", "c1", 1, 1);
+
+	set_member(&membv[0], "alice", "a1", 1, 1);
+	set_member(&membv[1], "bob", "b1", 1, 1);
+	set_member(&membv[2], "dave", "d1", 0, 0);
+
+	ASSERT_EQ(0, wcall_parts_diff(&partv, &partc, &changes,
+				      &members, &prev));
+	ASSERT_EQ(4u, partc);
+	ASSERT_EQ((uint32_t)(WCALL_PARTICIPANT_ADDED
+			     | WCALL_PARTICIPANT_REMOVED
+			     | WCALL_PARTICIPANT_AUDIO
+			     | WCALL_PARTICIPANT_VIDEO), changes);
+
+	part = find_part(partv, partc, "alice");
+	ASSERT_TRUE(part != NULL);
+	ASSERT_EQ((uint32_t)(WCALL_PARTICIPANT_AUDIO
+			     | WCALL_PARTICIPANT_VIDEO), part->changes);
+
+	part = find_part(partv, partc, "bob");
+	ASSERT_TRUE(part != NULL);
+	ASSERT_EQ((uint32_t)WCALL_PARTICIPANT_VIDEO, part->changes);
+
+	part = find_part(partv, partc, "dave");
+	ASSERT_TRUE(part != NULL);
+	ASSERT_EQ((uint32_t)WCALL_PARTICIPANT_ADDED, part->changes);
+
+	/* Removed participants come last, with their last known state */
+	ASSERT_STREQ("carol", partv[3].userid);
+	ASSERT_EQ((uint32_t)WCALL_PARTICIPANT_REMOVED, partv[3].changes);
+	ASSERT_EQ(1, partv[3].audio_estab);
+	ASSERT_EQ(1, partv[3].video_recv);
+
+	mem_deref(partv);
+}
+
+
+TEST(wcall_parts, clients_of_one_user)
+{
+	struct wcall_member prevv[1], membv[2];
+	struct wcall_members prev = {prevv, 1};
+	struct wcall_members members = {membv, 2};
+	struct wcall_participant *partv = NULL;
+	size_t partc = 0;
+	uint32_t changes = 0;
+
+	set_member(&prevv[0], "alice", "a1", 1, 0);
+
+	set_member(&membv[0], "alice", "a1", 1, 0);
+	set_member(&membv[1], "alice", "a2", 0, 0);
+
+	ASSERT_EQ(0, wcall_parts_diff(&partv, &partc, &changes,
+				      &members, &prev));
+	ASSERT_EQ(2u, partc);
+	ASSERT_EQ(0u, partv[0].changes);
+	ASSERT_STREQ("a2", partv[1].clientid);
+	ASSERT_EQ((uint32_t)WCALL_PARTICIPANT_ADDED, partv[1].changes);
+
+	mem_deref(partv);
+}
@@ -0,0 +1,523 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <re.h>
+#include <avs.h>
+#include <avs_wcall.h>
+#include <gtest/gtest.h>
+#include "ztest.h"
+extern "C" {
+#include "../src/wcall/wcall.h"
+}
+
+
+/*
+ * Shard scaling benchmark: a fixed population of instances receives
+ * SETUP/CANCEL pairs from a remote peer, and the rate of incoming calls
+ * handled to completion is measured for 1..ncpu shards.
+ */
+
+#define SHARD_BENCH_INSTANCES 32
+#define SHARD_BENCH_CALLS     20
+#define SHARD_BENCH_TIMEOUT   60000
+
+
+struct bench {
+	std::atomic<unsigned> n_ready;
+	std::atomic<unsigned> n_incoming;
+	std::atomic<unsigned> n_closed;
+};
+
+struct bench_user {
+	struct bench *bench;
+	WUSER_HANDLE wuser;
+};
+
+
+static void bench_ready_handler(int version, void *arg)
+{
+	struct bench_user *bu = (struct bench_user *)arg;
+
+	(void)version;
+
+	++bu->bench->n_ready;
+}
+
+
+static int bench_send_handler(void *ctx, const char *convid,
+			      const char *userid_self,
+			      const char *clientid_self,
+			      const char *userid_dest,
+			      const char *clientid_dest,
+			      const uint8_t *data, size_t len, int transient,
+			      void *arg)
+{
+	struct bench_user *bu = (struct bench_user *)arg;
+
+	wcall_resp(bu->wuser, 200, "", ctx);
+
+	return 0;
+}
+
+
+static void bench_incoming_handler(const char *convid, uint32_t msg_time,
+				   const char *userid, int video_call,
+				   int should_ring, int conv_type,
+				   void *arg)
+{
+	struct bench_user *bu = (struct bench_user *)arg;
+
+	++bu->bench->n_incoming;
+}
+
+
+static void bench_close_handler(int reason, const char *convid,
+				uint32_t msg_time, const char *userid,
+				void *arg)
+{
+	struct bench_user *bu = (struct bench_user *)arg;
+
+	++bu->bench->n_closed;
+}
+
+
+static int bench_config_req_handler(void *wuser, void *arg)
+{
+	(void)arg;
+
+	wcall_config_update(wuser, 0, "{\"ice_servers\":[],\"ttl\":3600}");
+
+	return 0;
+}
+
+
+static bool bench_wait(std::atomic<unsigned> &n, unsigned target)
+{
+	uint64_t t0 = tmr_jiffies();
+
+	while (n < target) {
+		if (tmr_jiffies() - t0 > SHARD_BENCH_TIMEOUT)
+			return false;
+		usleep(1000);
+	}
+
+	return true;
+}
+
+
+static std::string bench_message(enum econn_msg type)
+{
+	struct econn_message *msg = econn_message_alloc();
+	std::string str;
+	char *json = NULL;
+	int err;
+
+	err = econn_message_init(msg, type, "bench");
+	if (err)
+		goto out;
+
+	if (type == ECONN_SETUP) {
+		std::string sdp = load_fixture("./test/data/sdp_offer.sdp");
+
+		if (sdp.empty())
+			goto out;
+
+		err  = str_dup(&msg->u.setup.sdp_msg, sdp.c_str());
+		err |= econn_props_alloc(&msg->u.setup.props, NULL);
+		err |= econn_props_add(msg->u.setup.props,
+				       "videosend", "false");
+		if (err)
+			goto out;
+	}
+
+	err = econn_message_encode(&json, msg);
+	if (err)
+		goto out;
+
+	str = json;
+
+ out:
+	mem_deref(json);
+	mem_deref(msg);
+
+	return str;
+}
+
+
+/* Returns the calls per second handled with nshards shards */
+static double shard_bench_run(int nshards)
+{
+	struct bench_user userv[SHARD_BENCH_INSTANCES];
+	unsigned per_shard[SHARD_BENCH_INSTANCES] = {0};
+	std::string setup = bench_message(ECONN_SETUP);
+	std::string cancel = bench_message(ECONN_CANCEL);
+	const unsigned total = SHARD_BENCH_INSTANCES * SHARD_BENCH_CALLS;
+	struct bench bench;
+	uint64_t t0, t;
+	unsigned i, c;
+	int err;
+
+	EXPECT_FALSE(setup.empty());
+	EXPECT_FALSE(cancel.empty());
+
+	bench.n_ready = 0;
+	bench.n_incoming = 0;
+	bench.n_closed = 0;
+
+	err = wcall_init(WCALL_ENV_DEFAULT);
+	EXPECT_EQ(0, err);
+
+	err = wcall_set_shards(nshards);
+	EXPECT_EQ(0, err);
+
+	for (i = 0; i < SHARD_BENCH_INSTANCES; i++) {
+		char userid[32];
+		int shard;
+
+		re_snprintf(userid, sizeof(userid), "bench-%u", i);
+
+		userv[i].bench = &bench;
+		userv[i].wuser = wcall_create_ex(userid,
+						 "1",
+						 false,
+						 "voe",
+						 bench_ready_handler,
+						 bench_send_handler,
+						 NULL,
+						 bench_incoming_handler,
+						 NULL,
+						 NULL,
+						 NULL,
+						 bench_close_handler,
+						 NULL,
+						 bench_config_req_handler,
+						 NULL,
+						 NULL,
+						 &userv[i]);
+		EXPECT_NE(WUSER_INVALID_HANDLE, userv[i].wuser);
+
+		shard = wcall_get_shard(userv[i].wuser);
+		EXPECT_TRUE(shard >= 0 && shard < nshards);
+		if (shard >= 0 && shard < nshards)
+			++per_shard[shard];
+	}
+
+	/* Instances are spread evenly */
+	for (i = 0; i < (unsigned)nshards; i++) {
+		EXPECT_EQ((unsigned)(SHARD_BENCH_INSTANCES / nshards),
+			  per_shard[i]);
+	}
+
+	EXPECT_TRUE(bench_wait(bench.n_ready, SHARD_BENCH_INSTANCES));
+
+	t0 = tmr_jiffies();
+
+	for (c = 0; c < SHARD_BENCH_CALLS; c++) {
+		char convid[32];
+		uint32_t now = (uint32_t)time(0);
+
+		re_snprintf(convid, sizeof(convid), "conv-%u", c);
+
+		for (i = 0; i < SHARD_BENCH_INSTANCES; i++) {
+			wcall_recv_msg(userv[i].wuser,
+				       (const uint8_t *)setup.c_str(),
+				       setup.size(), now, now,
+				       convid, "peer", "p1");
+			wcall_recv_msg(userv[i].wuser,
+				       (const uint8_t *)cancel.c_str(),
+				       cancel.size(), now, now,
+				       convid, "peer", "p1");
+		}
+	}
+
+	EXPECT_TRUE(bench_wait(bench.n_closed, total));
+	t = tmr_jiffies() - t0;
+
+	EXPECT_EQ(total, (unsigned)bench.n_incoming);
+
+	for (i = 0; i < SHARD_BENCH_INSTANCES; i++)
+		wcall_destroy(userv[i].wuser);
+
+	wcall_close();
+
+	return t ? 1000.0 * total / t : 0.0;
+}
+
+
+TEST(wcall, shard_scaling)
+{
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	double base = 0;
+	int err;
+
+	err = ztest_set_ulimit(1024);
+	ASSERT_EQ(0, err);
+
+	err = flowmgr_init("audummy");
+	ASSERT_EQ(0, err);
+
+	if (ncpu < 1)
+		ncpu = 1;
+
+	for (int n = 1; n <= ncpu && n <= SHARD_BENCH_INSTANCES; n *= 2) {
+		double cps = shard_bench_run(n);
+
+		if (n == 1)
+			base = cps;
+
+		printf("wcall: %2d shards: %.1f calls/s (%.2fx)\n",
+		       n, cps, base > 0 ? cps / base : 0.0);
+	}
+
+	flowmgr_close();
+}
+
+
+struct shard_cross {
+	int ix;
+	int err;
+	bool ran;
+};
+
+
+static void shard_inner(void *arg)
+{
+	struct shard_cross *sc = (struct shard_cross *)arg;
+
+	sc->ran = true;
+}
+
+
+static void shard_outer(void *arg)
+{
+	struct shard_cross *sc = (struct shard_cross *)arg;
+
+	sc->err = wcall_shard_call(sc->ix, shard_inner, sc);
+}
+
+
+TEST(wcall, shard_call_from_another_shard)
+{
+	struct shard_cross sc;
+	int err;
+
+	err = wcall_shards_start(2);
+	ASSERT_EQ(0, err);
+
+	/* Into its own shard the job runs in place */
+	sc.ix = 0;
+	sc.err = -1;
+	sc.ran = false;
+	EXPECT_EQ(0, wcall_shard_call(0, shard_outer, &sc));
+	EXPECT_EQ(0, sc.err);
+	EXPECT_TRUE(sc.ran);
+
+	/* Into another shard it is refused rather than risk a deadlock */
+	sc.ix = 1;
+	sc.err = -1;
+	sc.ran = false;
+	EXPECT_EQ(0, wcall_shard_call(0, shard_outer, &sc));
+	EXPECT_EQ(EDEADLK, sc.err);
+	EXPECT_FALSE(sc.ran);
+
+	wcall_shards_stop();
+}
+
+
+/*
+ * Snapshot contention: UI threads poll wcall_iterate_state and
+ * wcall_get_state while the AVS thread handles incoming calls. The call
+ * rate of the AVS thread is measured without and with pollers.
+ */
+
+#define SNAP_BENCH_READERS 4
+#define SNAP_BENCH_OPEN    8
+#define SNAP_BENCH_CALLS   200
+
+
+struct snap_reader {
+	pthread_t tid;
+	WUSER_HANDLE wuser;
+	std::atomic<bool> *stop;
+	uint64_t polls;
+	uint64_t states;
+	uint64_t hits;
+};
+
+
+static void snap_state_handler(const char *convid, int state, void *arg)
+{
+	struct snap_reader *rd = (struct snap_reader *)arg;
+
+	(void)convid;
+
+	if (state == WCALL_STATE_INCOMING)
+		++rd->states;
+}
+
+
+static void *snap_reader_thread(void *arg)
+{
+	struct snap_reader *rd = (struct snap_reader *)arg;
+
+	while (!*rd->stop) {
+		wcall_iterate_state(rd->wuser, snap_state_handler, rd);
+
+		if (wcall_get_state(rd->wuser, "open-0")
+		    == WCALL_STATE_INCOMING)
+			++rd->hits;
+
+		++rd->polls;
+	}
+
+	return NULL;
+}
+
+
+static void snap_bench_recv(WUSER_HANDLE wuser, const std::string &msg,
+			    const char *convid)
+{
+	uint32_t now = (uint32_t)time(0);
+
+	wcall_recv_msg(wuser, (const uint8_t *)msg.c_str(), msg.size(),
+		       now, now, convid, "peer", "p1");
+}
+
+
+/* Returns the calls per second handled while nreaders threads poll */
+static double snap_bench_run(int nreaders, double *pollsp)
+{
+	struct snap_reader readerv[SNAP_BENCH_READERS];
+	std::string setup = bench_message(ECONN_SETUP);
+	std::string cancel = bench_message(ECONN_CANCEL);
+	std::atomic<bool> stop(false);
+	struct bench_user user;
+	struct bench bench;
+	uint64_t polls = 0, t0, t;
+	char convid[32];
+	int i, err;
+
+	bench.n_ready = 0;
+	bench.n_incoming = 0;
+	bench.n_closed = 0;
+
+	err = wcall_init(WCALL_ENV_DEFAULT);
+	EXPECT_EQ(0, err);
+
+	err = wcall_set_shards(1);
+	EXPECT_EQ(0, err);
+
+	user.bench = &bench;
+	user.wuser = wcall_create_ex("snap",
+				     "1",
+				     false,
+				     "voe",
+				     bench_ready_handler,
+				     bench_send_handler,
+				     NULL,
+				     bench_incoming_handler,
+				     NULL,
+				     NULL,
+				     NULL,
+				     bench_close_handler,
+				     NULL,
+				     bench_config_req_handler,
+				     NULL,
+				     NULL,
+				     &user);
+	EXPECT_NE(WUSER_INVALID_HANDLE, user.wuser);
+	EXPECT_TRUE(bench_wait(bench.n_ready, 1));
+
+	/* Calls that stay ringing, so the pollers have something to see */
+	for (i = 0; i < SNAP_BENCH_OPEN; i++) {
+		re_snprintf(convid, sizeof(convid), "open-%d", i);
+		snap_bench_recv(user.wuser, setup, convid);
+	}
+	EXPECT_TRUE(bench_wait(bench.n_incoming, SNAP_BENCH_OPEN));
+
+	for (i = 0; i < nreaders; i++) {
+		memset(&readerv[i], 0, sizeof(readerv[i]));
+		readerv[i].wuser = user.wuser;
+		readerv[i].stop = &stop;
+		err = pthread_create(&readerv[i].tid, NULL,
+				     snap_reader_thread, &readerv[i]);
+		EXPECT_EQ(0, err);
+	}
+
+	t0 = tmr_jiffies();
+
+	for (i = 0; i < SNAP_BENCH_CALLS; i++) {
+		re_snprintf(convid, sizeof(convid), "conv-%d", i);
+		snap_bench_recv(user.wuser, setup, convid);
+		snap_bench_recv(user.wuser, cancel, convid);
+	}
+
+	EXPECT_TRUE(bench_wait(bench.n_closed, SNAP_BENCH_CALLS));
+	t = tmr_jiffies() - t0;
+
+	stop = true;
+	for (i = 0; i < nreaders; i++) {
+		pthread_join(readerv[i].tid, NULL);
+
+		/* Every poll sees the open calls */
+		EXPECT_GE(readerv[i].states,
+			  readerv[i].polls * SNAP_BENCH_OPEN);
+		EXPECT_EQ(readerv[i].polls, readerv[i].hits);
+		polls += readerv[i].polls;
+	}
+
+	for (i = 0; i < SNAP_BENCH_OPEN; i++) {
+		re_snprintf(convid, sizeof(convid), "open-%d", i);
+		snap_bench_recv(user.wuser, cancel, convid);
+	}
+	EXPECT_TRUE(bench_wait(bench.n_closed,
+			       SNAP_BENCH_CALLS + SNAP_BENCH_OPEN));
+
+	wcall_destroy(user.wuser);
+	wcall_close();
+
+	if (pollsp)
+		*pollsp = t ? 1000.0 * polls / t : 0.0;
+
+	return t ? 1000.0 * SNAP_BENCH_CALLS / t : 0.0;
+}
+
+
+TEST(wcall, snapshot_contention)
+{
+	double base, cps, polls;
+	int err;
+
+	err = flowmgr_init("audummy");
+	ASSERT_EQ(0, err);
+
+	base = snap_bench_run(0, NULL);
+	cps = snap_bench_run(SNAP_BENCH_READERS, &polls);
+
+	printf("wcall: %.1f calls/s idle, %.1f calls/s with %d pollers"
+	       " (%.2fx), %.0f polls/s\n",
+	       base, cps, SNAP_BENCH_READERS,
+	       base > 0 ? cps / base : 0.0, polls);
+
+	flowmgr_close();
+}
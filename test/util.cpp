@@ -19,6 +19,7 @@
 #define _GNU_SOURCE 1
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <string>
 
 #include <re.h>
 #include <avs.h>
@@ -176,3 +177,33 @@ int ztest_set_ulimit(unsigned num)
 
 	return 0;
 }
+
+
+std::string load_fixture(const char *filename)
+{
+	std::string str;
+	char buf[1024];
+	FILE *fp;
+	size_t n;
+
+	fp = fopen(filename, "rb");
+	if (!fp)
+		return str;
+
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		str.append(buf, n);
+
+	fclose(fp);
+
+	return str;
+}
+
+
+uint64_t now_us(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
@@ -16,9 +16,15 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string>
+
 
 int create_http_resp(struct http_msg **msgp, const char *str);
 int re_main_wait(uint32_t timeout_ms);
 int dns_init(struct dnsc **dnscp);
 int create_dtls_srtp_context(struct tls **dtlsp, enum tls_keytype cert_type);
 int ztest_set_ulimit(unsigned num);
+
+/* Returns the contents of a test/data file, empty if it cannot be read */
+std::string load_fixture(const char *filename);
+uint64_t now_us(void);